@@ -145,6 +145,8 @@ load_static_rules(char *rule_path)
 
     rsched_info.mode = (JMode)header->ruleFileType;
     rsched_info.number_of_functions = header->numFuncs;
+    rsched_info.path = rulepath;
+    rsched_info.file_size = file_size;
 
     //if it is in parallel mode, we need to get the number of actual cores
 #ifdef BIND_THREAD_WITH_CORE
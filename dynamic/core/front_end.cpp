@@ -52,6 +52,14 @@ static void         fill_in_hashtable(hashtable_t *table, uint32_t channel, RRul
 
 static void         check_options(client_id_t id);
 
+/* Prefetch rules and the broadcasts of the argument registers may appear several times at
+ * the same pc, the order in the file matters */
+static inline bool
+is_repeated_rule(RuleOp op)
+{
+    return op == MEM_PREFETCH || op == INSTR_CLONE || op == INSTR_UPDATE || op == VECT_BROADCAST;
+}
+
 static bool search_base_key(base_tree* node, PCAddress addr);
 
 static base_tree* insert_base(base_tree* node, PCAddress base);
@@ -164,10 +172,12 @@ load_static_rules(char *rule_path, uint64_t base)
 
     rsched_info.mode = (JMode)header->ruleFileType;
     rsched_info.number_of_functions = header->numFuncs;
+    rsched_info.path = rulepath;
+    rsched_info.file_size = file_size;
 
     //if it is in parallel mode, we need to get the number of actual cores
 #ifdef BIND_THREAD_WITH_CORE
-    if(rsched_info.mode == JPARALLEL) {
+    if(rsched_info.mode == JPARALLEL || rsched_info.mode == JPARAFETCH || rsched_info.mode == JPARAVECT) {
         rsched_info.number_of_cores = sysconf(_SC_NPROCESSORS_ONLN);
 
         if(rsched_info.number_of_threads>rsched_info.number_of_cores) {
@@ -177,7 +187,7 @@ load_static_rules(char *rule_path, uint64_t base)
     }
 #endif
 
-    if (rsched_info.mode == JPARALLEL) {
+    if (rsched_info.mode == JPARALLEL || rsched_info.mode == JPARAFETCH || rsched_info.mode == JPARAVECT) {
         rule_buffer= (RRule *)(file_buffer + header->ruleInstOffset);
         rsched_info.loop_header = (RSLoopHeader *)((uint64_t)header + header->loopHeaderOffset);
     }
@@ -256,13 +266,14 @@ fill_in_hashtable(hashtable_t *table, uint32_t channel, RRule *instr, uint32_t s
         else {
             prev = NULL;
             exist = 0;
-            if (mode == JPARALLEL) {
+            if (mode == JPARALLEL || mode == JPARAFETCH || mode == JPARAVECT) {
                 while(query!=NULL) {
                     if((curr->pc) < (query->pc)) break;
                     if((curr->pc == query->pc))
                     {
                         if(curr->opcode < query->opcode) break;
-                        else if(curr->opcode == query->opcode) {
+                        else if(curr->opcode == query->opcode &&
+                                !is_repeated_rule(curr->opcode)) {
                             exist = 1;
                             break;
                         }
@@ -512,6 +512,8 @@ split_block_handler(JANUS_CONTEXT)
 {
     instr_t *instr, *temp;
     instr_t *trigger = get_trigger_instruction(bb,rule);
+    /* The fragment already ends before the split point */
+    if (trigger == NULL) return;
 #ifdef JANUS_VERBOSE
     printf("Going to split the instruction\n");
     instr_disassemble(drcontext, trigger,STDOUT);
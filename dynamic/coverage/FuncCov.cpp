@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <set>
+#include <string>
 using namespace std;
 
 static dr_emit_flags_t
@@ -32,7 +33,13 @@ timer_thread_init(void *drcontext) {
 
 static void
 timer_thread_exit(void *drcontext) {
-    FILE *fp = fopen("func_cov.txt","w");
+    /* Written next to the executable as {executable}.fcov, same as the loop coverage */
+    module_data_t *main_module = dr_get_main_module();
+    string name = string(main_module->full_path) + ".fcov";
+    dr_free_module_data(main_module);
+
+    FILE *fp = fopen(name.c_str(),"w");
+    if (fp == NULL) return;
     for (int i=0; i<numFunc; i++) {
         //dr_printf("%d %f\n",i,function_counter[i]/(double)global_counter);
         fprintf(fp,"%d %f %f\n",i,function_counter[i]/(double)global_counter,call_counter[i]/(double)global_counter);
@@ -39,9 +39,11 @@ extern RSchedInfo rsched_info;
 //#define JANUS_ORACLE_ASSIST
 //#define HALT_MAIN_THREAD
 //#define HALT_PARALLEL_THREADS
-/* \brief Use thread shared code cache (AArch64 only) */
+/* \brief Use thread shared code cache */
+#define JANUS_SHARED_CC
+/* \brief Check array overlap before each loop invocation and run the sequential version if it fails */
+#define SAFE_RUNTIME_CHECK
 #ifdef JANUS_AARCH64
-#  define JANUS_SHARED_CC
 #  define     BRK(trigger)     INSERT(bb, trigger, instr_create_0dst_1src(drcontext, OP_brk, OPND_CREATE_INT16(0)));
 #  define PRE_BRK(trigger) PRE_INSERT(bb, trigger, instr_create_0dst_1src(drcontext, OP_brk, OPND_CREATE_INT16(0)));
 #elif JANUS_X86
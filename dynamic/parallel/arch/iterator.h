@@ -7,9 +7,18 @@
 #include "janus_api.h"
 #include "emit.h"
 
+/** \brief Thread id passed to the emitters to generate thread-agnostic code,
+ * which reads the thread id from [TLS, LOCAL_ID_OFFSET] at runtime */
+#define JANUS_RUNTIME_TID       -1
+
 /** \brief Emit induction variable initializations for variables for a given loop */
 void emit_init_loop_variables(EMIT_CONTEXT, int tid);
 
 /** \brief Emit merge procedure for variables for a given loop, only executed by the main thread */
 void emit_merge_loop_variables(EMIT_CONTEXT);
+
+/** \brief Emit the switch of a DOACROSS thread from its finished chunk to its next chunk
+ *
+ * Updates [TLS, LOCAL_CHECK_OFFSET] and all induction variables, s3 is clobbered */
+void emit_doacross_next_chunk(EMIT_CONTEXT);
 #endif
\ No newline at end of file
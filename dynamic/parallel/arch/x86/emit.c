@@ -1,6 +1,25 @@
 #include "emit.h"
 #include "jthread.h"
 #include "control.h"
+#include "vhandler.h"
+
+/** \brief Move a SIMD register to or from its cache line in the shared register bank
+ *
+ * A vectorised loop body reads the broadcast registers in full, so the ymm registers are copied */
+static instr_t *
+create_shared_simd_move(void *drcontext, loop_t *loop, reg_id_t reg, reg_id_t base, int disp, bool store)
+{
+    opnd_t mem;
+    if (loop && loop->header->vectorWordSize && CPU_HAS_AVX(myCPU)) {
+        reg = reg - DR_REG_XMM0 + DR_REG_YMM0;
+        mem = opnd_create_base_disp(base, DR_REG_NULL, 0, disp, OPSZ_32);
+        return store ? INSTR_CREATE_vmovdqu(drcontext, mem, opnd_create_reg(reg))
+                     : INSTR_CREATE_vmovdqu(drcontext, opnd_create_reg(reg), mem);
+    }
+    mem = opnd_create_base_disp(base, DR_REG_NULL, 0, disp, OPSZ_16);
+    return store ? INSTR_CREATE_movdqu(drcontext, mem, opnd_create_reg(reg))
+                 : INSTR_CREATE_movdqu(drcontext, opnd_create_reg(reg), mem);
+}
 
 /** \brief Generate a code snippet that switches the current stack to a specified stack */
 void emit_switch_stack_ptr_aligned(EMIT_CONTEXT)
@@ -141,10 +160,7 @@ emit_spill_to_shared_register_bank(EMIT_CONTEXT, uint64_t regMask)
             cacheline = i + 16;
             if (simd_mask & (1<<i)) {
                 INSERT(bb, trigger,
-                    INSTR_CREATE_movdqu(drcontext,
-                                        opnd_create_base_disp(s0, DR_REG_NULL, 0,
-                                                              cacheline*CACHE_LINE_WIDTH, OPSZ_16),
-                                        opnd_create_reg(reg)));
+                    create_shared_simd_move(drcontext, loop, reg, s0, cacheline*CACHE_LINE_WIDTH, true));
             }
         }
     }
@@ -243,10 +259,7 @@ emit_restore_from_shared_register_bank(EMIT_CONTEXT, uint64_t regMask)
             cacheline = i + 16;
             if (simd_mask & (1<<i)) {
                 INSERT(bb, trigger,
-                    INSTR_CREATE_movdqu(drcontext,
-                                        opnd_create_reg(reg),
-                                        opnd_create_base_disp(s0, DR_REG_NULL, 0,
-                                                              cacheline*CACHE_LINE_WIDTH, OPSZ_16)));
+                    create_shared_simd_move(drcontext, loop, reg, s0, cacheline*CACHE_LINE_WIDTH, false));
             }
         }
     }
@@ -20,6 +20,13 @@ emit_init_induction_variable_block(EMIT_CONTEXT, int tid, JVarProfile *profile);
 static void inline
 emit_init_induction_variable_cyclic(EMIT_CONTEXT, int tid, JVarProfile *profile);
 
+static void inline
+emit_init_induction_variable_doacross(EMIT_CONTEXT, int tid, JVarProfile *profile);
+
+/* Store the boundary in s3 into [TLS, LOCAL_CHECK_OFFSET], clamped to the loop boundary */
+static void inline
+emit_store_doacross_chunk_boundary(EMIT_CONTEXT, int64_t bound, int64_t stride);
+
 static void inline
 emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid);
 
@@ -43,6 +50,16 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid,instr_t
 static void inline
 emit_update_thread_loop_boundary(EMIT_CONTEXT, JVar var, JVar init, JVar stride, JVar check, int tid);
 
+#ifdef JANUS_SHARED_CC
+/* Store the per-thread loop boundary of a loop with constant bounds into [TLS, LOCAL_CHECK_OFFSET] */
+static void inline
+emit_store_constant_thread_loop_boundary(EMIT_CONTEXT, JVar init, JVar stride, JVar check, int tid);
+#endif
+
+/* Whether the loop still executes the iteration equal to its check value (JLE like exits) */
+static bool inline
+loop_exit_includes_check(loop_t *loop);
+
 /** \brief Emit induction variable initializations for variables for a given loop */
 void emit_init_loop_variables(EMIT_CONTEXT, int tid)
 {
@@ -79,6 +96,11 @@ emit_merge_loop_variables(EMIT_CONTEXT)
         emit_restore_from_private_register_bank(emit_context, loop->header->registerToMerge, 0, rsched_info.number_of_threads-1);
         if (loop->header->registerToConditionalMerge)
             emit_conditional_merge_loop_variables(emit_context, 0);
+    } else if (LOOP_CHUNK_SCHEDULED(loop)) {
+        //restore the value from the thread that ran the last chunk
+        emit_restore_from_private_register_bank(emit_context, loop->header->registerToMerge, 0, loop->doacross_last_tid);
+        if (loop->header->registerToConditionalMerge)
+            emit_conditional_merge_loop_variables(emit_context, 0);
     }
 
     PRE_INSERT(bb, trigger, skip);
@@ -101,6 +123,8 @@ emit_init_induction_variable(EMIT_CONTEXT, int tid, JVarProfile *profile)
         emit_init_induction_variable_block(emit_context, tid, profile);
     else if (loop->schedule == PARA_DOALL_CYCLIC_CHUNK)
         emit_init_induction_variable_cyclic(emit_context, tid, profile);
+    else if (LOOP_CHUNK_SCHEDULED(loop))
+        emit_init_induction_variable_doacross(emit_context, tid, profile);
     else{
             DR_ASSERT_MSG(false, "Unknown loop schedule type in emit_init_induction_variable!\n");
     }
@@ -125,12 +149,17 @@ emit_init_induction_variable_block(EMIT_CONTEXT, int tid, JVarProfile *profile)
     if (init.type == JVAR_CONSTANT &&
         stride.type == JVAR_CONSTANT &&
         check.type == JVAR_CONSTANT) {
+#ifdef JANUS_SHARED_CC
+        /* With a shared code cache the cmp instruction is shared by all threads,
+         * so the per-thread boundary is read from [TLS, LOCAL_CHECK_OFFSET] */
+        emit_store_constant_thread_loop_boundary(emit_context, init, stride, check, tid);
+#endif
         //for the main thread, you don't have to do anything
         if (tid == 0) return;
         //then we can simply JIT the value
         int64_t slice = (check.value - init.value) / stride.value;
         /* get slice per thread */
-        slice = (slice+1) / rsched_info.number_of_threads;
+        slice = loop_thread_block(loop, slice+1);
 
         slice_var.type = JVAR_CONSTANT;
         slice_var.value = slice;
@@ -183,7 +212,16 @@ emit_init_induction_variable_block(EMIT_CONTEXT, int tid, JVarProfile *profile)
 
     /* Update the boundary of the current thread */
     //for the last thread, keep the original loop boundary
-    if (tid != rsched_info.number_of_threads - 1)
+    if (tid == JANUS_RUNTIME_TID) {
+        INSERT(bb, trigger,
+            INSTR_CREATE_cmp(drcontext,
+                             OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET),
+                             OPND_CREATE_INT32(rsched_info.number_of_threads - 1)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip_label)));
+        emit_update_thread_loop_boundary(emit_context, var, var, stride, check, tid);
+    }
+    else if (tid != rsched_info.number_of_threads - 1)
         emit_update_thread_loop_boundary(emit_context, var, var, stride, check, tid);
 
     INSERT(bb, trigger, skip_label);
@@ -195,6 +233,155 @@ emit_init_induction_variable_cyclic(EMIT_CONTEXT, int tid, JVarProfile *profile)
     
 }
 
+/* Thread tid starts with chunk tid and waits for the chunks within the dependence distance.
+ * The bounds are constant, see loop_doacross_init() */
+static void inline
+emit_init_induction_variable_doacross(EMIT_CONTEXT, int tid, JVarProfile *profile)
+{
+    JVar init = profile->induction.init;
+    JVar stride = profile->induction.stride;
+    //JAN-41, the static analysis outputs a check value one stride less than the cmp operand
+    int64_t bound = profile->induction.check.value + stride.value;
+    int64_t step = loop->doacross_chunk * stride.value;
+    int64_t lag = loop->doacross_lag;
+    instr_t *wait_label = INSTR_CREATE_label(drcontext);
+    instr_t *ready_label = INSTR_CREATE_label(drcontext);
+    JVar slice_var;
+
+    slice_var.type = JVAR_CONSTANT;
+    slice_var.value = loop->doacross_chunk;
+    slice_var.size = profile->var.size;
+
+    if (tid != JANUS_RUNTIME_TID) {
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_st(drcontext,
+                                OPND_CREATE_MEM64(TLS, LOCAL_CHUNK_OFFSET),
+                                OPND_CREATE_INT32(tid)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_imm(drcontext,
+                                 opnd_create_reg(s3),
+                                 OPND_CREATE_INTPTR(init.value + (tid + 1) * step)));
+        emit_store_doacross_chunk_boundary(emit_context, bound, stride.value);
+        if (tid != 0)
+            emit_add_offset_to_all_induction(emit_context, slice_var, tid);
+        //the first chunks have nothing to wait for
+        if (tid - lag + 1 <= 0) return;
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_imm(drcontext,
+                                 opnd_create_reg(s3),
+                                 OPND_CREATE_INTPTR(tid - lag + 1)));
+    } else {
+        /* chunk = tid, boundary = init + (tid + 1) * step */
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_ld(drcontext,
+                                opnd_create_reg(s3),
+                                OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_st(drcontext,
+                                OPND_CREATE_MEM64(TLS, LOCAL_CHUNK_OFFSET),
+                                opnd_create_reg(s3)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_imul_imm(drcontext,
+                                  opnd_create_reg(s3),
+                                  opnd_create_reg(s3),
+                                  OPND_CREATE_INT32(step)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_add(drcontext,
+                             opnd_create_reg(s3),
+                             OPND_CREATE_INT32(init.value + step)));
+        emit_store_doacross_chunk_boundary(emit_context, bound, stride.value);
+        emit_add_offset_to_all_induction(emit_context, slice_var, tid);
+
+        /* s3 = the number of chunks that must be finished before this chunk starts */
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_ld(drcontext,
+                                opnd_create_reg(s3),
+                                OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET)));
+        if (lag > 1)
+            INSERT(bb, trigger,
+                INSTR_CREATE_sub(drcontext,
+                                 opnd_create_reg(s3),
+                                 OPND_CREATE_INT32(lag - 1)));
+    }
+
+    /* The first wait is short, so the thread only spins */
+    INSERT(bb, trigger, wait_label);
+    INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_rel_addr((void *)&(shared->doacross_done), OPSZ_8),
+                         opnd_create_reg(s3)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_jge, opnd_create_instr(ready_label)));
+    INSERT(bb, trigger, INSTR_CREATE_pause(drcontext));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(wait_label)));
+    INSERT(bb, trigger, ready_label);
+}
+
+static void inline
+emit_store_doacross_chunk_boundary(EMIT_CONTEXT, int64_t bound, int64_t stride)
+{
+    instr_t *keep_label = INSTR_CREATE_label(drcontext);
+    instr_t *end_label = INSTR_CREATE_label(drcontext);
+
+    /* the last chunk ends at the loop boundary */
+    INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(bound)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, (stride > 0) ? OP_jle : OP_jge, opnd_create_instr(keep_label)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                            OPND_CREATE_INT32(bound)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(end_label)));
+    INSERT(bb, trigger, keep_label);
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                            opnd_create_reg(s3)));
+    INSERT(bb, trigger, end_label);
+}
+
+void
+emit_doacross_next_chunk(EMIT_CONTEXT)
+{
+    int i;
+    JVar slice_var;
+    int nthreads = rsched_info.number_of_threads;
+
+    for (i=0; i<loop->var_count; i++) {
+        JVarProfile *profile = loop->variables + i;
+        if (profile->type != INDUCTION_PROFILE ||
+            profile->induction.check.type == JVAR_UNKOWN) continue;
+
+        JVar stride = profile->induction.stride;
+        //JAN-41, the static analysis outputs a check value one stride less than the cmp operand
+        int64_t bound = profile->induction.check.value + stride.value;
+        int64_t step = loop->doacross_chunk * stride.value;
+
+        /* The boundary moves over the chunks of the other threads */
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_ld(drcontext,
+                                opnd_create_reg(s3),
+                                OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_add(drcontext,
+                             opnd_create_reg(s3),
+                             OPND_CREATE_INT32(step * nthreads)));
+        emit_store_doacross_chunk_boundary(emit_context, bound, stride.value);
+
+        /* The variables are at the end of the finished chunk, skip the chunks in between */
+        slice_var.type = JVAR_CONSTANT;
+        slice_var.value = loop->doacross_chunk;
+        slice_var.size = profile->var.size;
+        emit_add_offset_to_all_induction(emit_context, slice_var, nthreads - 1);
+        return;
+    }
+}
+
 /* Move the initial value of induction variable to private copy (STACK only) */
 static void inline
 emit_privatise_stack_induction_variables(EMIT_CONTEXT)
@@ -226,6 +413,9 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
     int i;
     int64_t offset;
     JVar offset_var;
+    /* For thread-agnostic code, the offset of thread 1 is computed and then
+     * multiplied by the thread id loaded from TLS */
+    int factor = (tid == JANUS_RUNTIME_TID) ? 1 : tid;
 
     for (i=0; i<loop->var_count; i++) {
         JVarProfile *profile = loop->variables + i;
@@ -237,7 +427,7 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
             //get operand of the variable
             if (slice.type == JVAR_CONSTANT) {
                 //offset for the given thread
-                offset = slice.value * tid;
+                offset = slice.value * factor;
 
                 /* case 1: if the stride is constant */
                 if (profile->induction.stride.type == JVAR_CONSTANT) {
@@ -305,7 +495,7 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
             } else if (slice.type == JVAR_REGISTER) {
                 /* case 1: if the stride is constant */
                 if (profile->induction.stride.type == JVAR_CONSTANT) {
-                    offset = profile->induction.stride.value * tid;
+                    offset = profile->induction.stride.value * factor;
                     /* offset_reg = slice_reg * offset */
                     INSERT(bb, trigger,
                            INSTR_CREATE_imul_imm(drcontext,
@@ -325,32 +515,32 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
                                INSTR_CREATE_imul_imm(drcontext,
                                                      opnd_create_reg(s3),
                                                      OPND_CREATE_MEM64(TLS, LOCAL_S0_OFFSET),
-                                                     OPND_CREATE_INT32(tid)));
+                                                     OPND_CREATE_INT32(factor)));
                     } else if (stride_reg == s1) {
                         INSERT(bb, trigger,
                                INSTR_CREATE_imul_imm(drcontext,
                                                      opnd_create_reg(s3),
                                                      OPND_CREATE_MEM64(TLS, LOCAL_S1_OFFSET),
-                                                     OPND_CREATE_INT32(tid)));
+                                                     OPND_CREATE_INT32(factor)));
                     } else if (stride_reg == s2) {
                         INSERT(bb, trigger,
                                INSTR_CREATE_imul_imm(drcontext,
                                                      opnd_create_reg(s3),
                                                      OPND_CREATE_MEM64(TLS, LOCAL_S2_OFFSET),
-                                                     OPND_CREATE_INT32(tid)));
+                                                     OPND_CREATE_INT32(factor)));
                     } else if (stride_reg == s3) {
                         INSERT(bb, trigger,
                                INSTR_CREATE_imul_imm(drcontext,
                                                      opnd_create_reg(s3),
                                                      OPND_CREATE_MEM64(TLS, LOCAL_S3_OFFSET),
-                                                     OPND_CREATE_INT32(tid)));
+                                                     OPND_CREATE_INT32(factor)));
                     } else {
                         /* offset = stride * tid */
                         INSERT(bb, trigger,
                                INSTR_CREATE_imul_imm(drcontext,
                                                      opnd_create_reg(s3),
                                                      opnd_create_reg(stride_reg),
-                                                     OPND_CREATE_INT32(tid)));
+                                                     OPND_CREATE_INT32(factor)));
                     }
 
                     /* offset = s2 * slice_reg */
@@ -368,7 +558,7 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
                            INSTR_CREATE_imul_imm(drcontext,
                                                  opnd_create_reg(s3),
                                                  opnd_create_reg(slice.value),
-                                                 OPND_CREATE_INT32(tid)));
+                                                 OPND_CREATE_INT32(factor)));
                     /* offset = offset * stride_stk */
                     INSERT(bb, trigger,
                            INSTR_CREATE_imul(drcontext,
@@ -379,6 +569,23 @@ emit_add_offset_to_all_induction(EMIT_CONTEXT, JVar slice, int tid)
                 }
             }
             //slice variable can't be the stack variable.
+            if (tid == JANUS_RUNTIME_TID) {
+                /* offset = offset * [TLS, LOCAL_ID_OFFSET] */
+                if (offset_var.type == JVAR_CONSTANT) {
+                    INSERT(bb, trigger,
+                           INSTR_CREATE_imul_imm(drcontext,
+                                                 opnd_create_reg(s3),
+                                                 OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET),
+                                                 OPND_CREATE_INT32(offset_var.value)));
+                    offset_var.type = JVAR_REGISTER;
+                    offset_var.value = s3;
+                } else {
+                    INSERT(bb, trigger,
+                           INSTR_CREATE_imul(drcontext,
+                                             opnd_create_reg(s3),
+                                             OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET)));
+                }
+            }
             /* Now the calculated offset is in variable offset_var */
             if (profile->induction.op == UPDATE_ADD) {
                 //add to the current variable
@@ -461,11 +668,7 @@ static void inline emit_prepare_loop_upper_bound_in_rax(EMIT_CONTEXT, JVar bound
                                     //We need bound+stride, because the static analyzer emitted "check" value (for constants) is 
                                     //actually one stride lower than the upper bound we require here
 
-        uint32_t jccOpcode = loop->header->jumpInstructionOpcode;
-        if  ((loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JLE || jccOpcode == X86_INS_JBE || jccOpcode == X86_INS_JGE || jccOpcode == X86_INS_JBE)) || 
-            (!loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JL || jccOpcode == X86_INS_JB || jccOpcode == X86_INS_JG || jccOpcode == X86_INS_JB))){
+        if (loop_exit_includes_check(loop)) {
             //If the loop has a JLE instruction (and we jump back to loop start),
             //the upper bound needs to be further incremented, because we assume it to be 
             //one stride past the last executed induction variable value
@@ -577,6 +780,7 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
 {
     instr_t *low_slice_label = INSTR_CREATE_label(drcontext);
     instr_t *skip_label = INSTR_CREATE_label(drcontext);
+    instr_t *main_label = INSTR_CREATE_label(drcontext);
     /* pick the div_reg to store the quotient */
     reg_id_t div_reg = s2;
     //corner case flag
@@ -616,6 +820,22 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
      * if stride is constant, then we can generate a quick division 
      * if stride is non-constant, we use proper division */
 
+#ifdef JANUS_SHARED_CC
+    /* The last thread runs up to the original upper bound. Since the loop boundary is
+     * no longer patched per thread, store it to [TLS, LOCAL_CHECK_OFFSET] first and
+     * the other threads overwrite it in emit_update_thread_loop_boundary */
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                            opnd_create_reg(DR_REG_RAX)));
+    if (stride.type == JVAR_CONSTANT && loop_exit_includes_check(loop)) {
+        INSERT(bb, trigger,
+            INSTR_CREATE_sub(drcontext,
+                             OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                             OPND_CREATE_INT32(stride.value)));
+    }
+#endif
+
     /* rax = rax - rdx; get total blocks */
     INSERT(bb, trigger,
         INSTR_CREATE_sub(drcontext,
@@ -630,14 +850,28 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
     if (stride.type != JVAR_CONSTANT){
         DR_ASSERT_MSG(false, "Error: non constant stride not supported in emit_divide_block_iteration");
     }
+    /* Small invocations are also run by the main thread */
+    int64_t min_iterations = rsched_info.number_of_threads * LOOP_BLOCK_GRANULARITY(loop);
+    if (min_iterations < loop->header->minIterations)
+        min_iterations = loop->header->minIterations;
     INSERT(bb, trigger,
         INSTR_CREATE_cmp(drcontext,
                          opnd_create_reg(DR_REG_RAX),
-                            OPND_CREATE_INT32(rsched_info.number_of_threads*stride.value)));
+                            OPND_CREATE_INT32(min_iterations*stride.value)));
     INSERT(bb, trigger,
         INSTR_CREATE_jcc(drcontext, OP_jge,
                          opnd_create_instr(skip_label)));
 
+    if (tid == JANUS_RUNTIME_TID) {
+        /* The thread id is only known at runtime */
+        INSERT(bb, trigger,
+            INSTR_CREATE_cmp(drcontext,
+                             OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET),
+                             OPND_CREATE_INT32(0)));
+        INSERT(bb, trigger,
+            INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(main_label)));
+    }
+
     if (tid) {
         //INSERT(bb, trigger,
         //    INSTR_CREATE_jmp_ind(drcontext, opnd_create_rel_addr(&(oracle[tid]->gen_code[loop->dynamic_id].thread_loop_finish), OPSZ_8)));
@@ -658,7 +892,13 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
                                 opnd_create_reg(s1)));
         INSERT(bb, trigger,
             INSTR_CREATE_jmp(drcontext, opnd_create_pc((void *)janus_reenter_thread_pool_app)));
-    } else if (rsched_info.number_of_threads > 1) {
+    }
+
+    if (tid == JANUS_RUNTIME_TID)
+        INSERT(bb, trigger, main_label);
+
+    if ((tid == 0 || tid == JANUS_RUNTIME_TID) &&
+        rsched_info.number_of_threads > 1) {
         /* For the main thread, simply recover and skip to the end
          * However we need to mark flag that we are in the special mode */
         //PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
@@ -669,11 +909,7 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
                              opnd_create_reg(DR_REG_RAX),
                              opnd_create_reg(DR_REG_RDX)));
 
-        uint32_t jccOpcode = loop->header->jumpInstructionOpcode;
-        if  ((loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JLE || jccOpcode == X86_INS_JBE || jccOpcode == X86_INS_JGE || jccOpcode == X86_INS_JBE)) || 
-            (!loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JL || jccOpcode == X86_INS_JB || jccOpcode == X86_INS_JG || jccOpcode == X86_INS_JB))){
+        if (loop_exit_includes_check(loop)) {
             //If our loop has a JLE instruction, RAX currently stores the value of one stride past what actually gets executed
             //(This is because we use that to compute number of iterations)
             //However, for JLE the check value must be exactly the last value with which the loop gets run
@@ -772,6 +1008,14 @@ emit_divide_block_iteration(EMIT_CONTEXT, JVar var, JVar stride, int tid, instr_
                                   opnd_create_reg(div_reg)));
     }
 
+    /* rax = rax & -granularity; whole vectors per thread */
+    if (LOOP_BLOCK_GRANULARITY(loop) > 1) {
+        INSERT(bb, trigger,
+            INSTR_CREATE_and(drcontext,
+                             opnd_create_reg(DR_REG_RAX),
+                             OPND_CREATE_INT32(-LOOP_BLOCK_GRANULARITY(loop))));
+    }
+
     if (redirect_div_reg) {
         INSERT(bb, trigger,
             INSTR_CREATE_mov_ld(drcontext,
@@ -862,11 +1106,7 @@ emit_update_thread_loop_boundary(EMIT_CONTEXT, JVar var, JVar init, JVar stride,
                                      opnd_create_reg(s2),
                                      opnd_create_reg(s2),
                                      OPND_CREATE_INT32(stride.value)));
-        uint32_t jccOpcode = loop->header->jumpInstructionOpcode;
-        if  ((loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JLE || jccOpcode == X86_INS_JBE || jccOpcode == X86_INS_JGE || jccOpcode == X86_INS_JBE)) || 
-            (!loop->header->jumpingGoesBack && 
-            (jccOpcode == X86_INS_JL || jccOpcode == X86_INS_JB || jccOpcode == X86_INS_JG || jccOpcode == X86_INS_JB))){
+        if (loop_exit_includes_check(loop)) {
             //If our loop has a JLE (as opposed to a JNE) instruction, we must increase the check value 
             //by one stride less for each thread
             //Same logic applies for a JG
@@ -939,3 +1179,78 @@ emit_update_thread_loop_boundary(EMIT_CONTEXT, JVar var, JVar init, JVar stride,
         DR_ASSERT_MSG(false, "Unrecognized check variable type in emit_update_thread_loop_boundary\n");
     }
 }
+
+static bool inline
+loop_exit_includes_check(loop_t *loop)
+{
+    uint32_t jccOpcode = loop->header->jumpInstructionOpcode;
+    return (loop->header->jumpingGoesBack &&
+            (jccOpcode == X86_INS_JLE || jccOpcode == X86_INS_JBE || jccOpcode == X86_INS_JGE || jccOpcode == X86_INS_JBE)) ||
+           (!loop->header->jumpingGoesBack &&
+            (jccOpcode == X86_INS_JL || jccOpcode == X86_INS_JB || jccOpcode == X86_INS_JG || jccOpcode == X86_INS_JB));
+}
+
+#ifdef JANUS_SHARED_CC
+static void inline
+emit_store_constant_thread_loop_boundary(EMIT_CONTEXT, JVar init, JVar stride, JVar check, int tid)
+{
+    //JAN-41, the static analysis outputs a check value one stride less than the cmp operand
+    int64_t bound = check.value + stride.value;
+    /* the same block division as loop_update_boundary_handler */
+    int64_t block = loop_thread_block(loop, (bound - init.value) / stride.value) * stride.value;
+
+    if (tid != JANUS_RUNTIME_TID) {
+        //for the last thread, keep the original loop boundary
+        if (tid != rsched_info.number_of_threads - 1)
+            bound = (tid + 1) * block + init.value;
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_st(drcontext,
+                                OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                                OPND_CREATE_INT32(bound)));
+        return;
+    }
+
+    instr_t *last_label = INSTR_CREATE_label(drcontext);
+    instr_t *end_label = INSTR_CREATE_label(drcontext);
+
+    /* s3 = [TLS, LOCAL_ID_OFFSET] */
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(s3),
+                            OPND_CREATE_MEM64(TLS, LOCAL_ID_OFFSET)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(rsched_info.number_of_threads - 1)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(last_label)));
+    /* bound = (tid + 1) * block + init */
+    INSERT(bb, trigger,
+        INSTR_CREATE_add(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(1)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_imul_imm(drcontext,
+                              opnd_create_reg(s3),
+                              opnd_create_reg(s3),
+                              OPND_CREATE_INT32(block)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_add(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(init.value)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                            opnd_create_reg(s3)));
+    INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(end_label)));
+
+    /* the last thread keeps the original loop boundary */
+    INSERT(bb, trigger, last_label);
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHECK_OFFSET),
+                            OPND_CREATE_INT32(bound)));
+    INSERT(bb, trigger, end_label);
+}
+#endif
@@ -1,6 +1,8 @@
 #include "control.h"
 #include "jthread.h"
 #include "loop.h"
+#include "jtemplate.h"
+#include "rcheck.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,6 +42,9 @@ int janus_thread_system_init()
     for (i = 0; i<nthreads; i++) {
         oracle[i] = (janus_thread_t *)malloc(sizeof(janus_thread_t));
         memset(oracle[i], 0, sizeof(janus_thread_t));
+        /* Loop code is generated lazily for all threads,
+         * so the slots must exist before the threads are spawned */
+        oracle[i]->gen_code = (loop_code_t *)calloc(header->numLoops, sizeof(loop_code_t));
     }
 
     /* Construct a ring of cores by linking the next and prev pointers */
@@ -62,7 +67,16 @@ int janus_thread_system_init()
         /* assign the point to variable section */
         loops[i].variables = (JVarProfile *)((uint64_t)header + loops[i].header->ruleDataOffset);
         loops[i].var_count = loops[i].header->ruleDataSize;
+        loops[i].code_ready = 0;
+        loop_runtime_check_init(&loops[i], (RRule *)((uint64_t)header + loops[i].header->ruleInstOffset),
+                                loops[i].header->ruleInstSize);
+        if (LOOP_CHUNK_SCHEDULED(&loops[i]))
+            loop_doacross_init(&loops[i]);
     }
+    shared->code_gen_lock = dr_mutex_create();
+
+    /* Loop code may be pre-assembled in the rewrite schedule */
+    janus_code_template_init();
 
 #ifdef JANUS_VERBOSE
     dr_printf("JANUS threading system initialised\n");
@@ -23,9 +23,13 @@
 /* JANUS Synchronisation Facility */
 //#include "sync.h"
 
+/* JANUS prefetch handlers for parallel loops */
+#include "pfetch.h"
+#include "pfhandler.h"
 
-#ifdef JANUS_VECT_SUPPORT
-/* Janus vector handlers */
+
+#ifdef JANUS_X86
+/* Janus vector handlers for the vectorised parallel loops */
 #include "vhandler.h"
 #endif
 
@@ -58,19 +62,29 @@ dr_init(client_id_t id)
     /* Initialise Janus components and file Janus global info */
     janus_init(id);
 
-    if(rsched_info.mode != JPARALLEL) {
+    if(rsched_info.mode != JPARALLEL && rsched_info.mode != JPARAFETCH && rsched_info.mode != JPARAVECT) {
         dr_fprintf(STDOUT,"Rewrite rules not intended for %s!\n",print_janus_mode(rsched_info.mode));
         return;
     }
 
-#ifdef JANUS_VECT_SUPPORT
-    /* Detect the current hardware */
-    myCPU = janus_detect_hardware();
+    /* Faults in the prefetch slices are skipped */
+    if (rsched_info.mode == JPARAFETCH)
+        prefetch_guard_init();
+
+#ifdef JANUS_X86
+    /* Detect the vector width of the current hardware */
+    if (rsched_info.mode == JPARAVECT)
+        myCPU = janus_detect_hardware();
 #endif
 
     /* Initialise Janus thread system as a dynamorio client */
     if (!janus_thread_system_init()) return;
 
+#ifdef JANUS_JITSTM
+    /* Find the speculative loops */
+    janus_stm_init();
+#endif
+
     /* Generate code cache for creating threads as application */
     create_call_func_code_cache();
 
@@ -86,6 +100,9 @@ static dr_emit_flags_t
 event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
 {
     RuleOp rule_opcode;
+#ifdef JANUS_JITSTM
+    loop_t *speculative_loop = NULL;
+#endif
     //get current basic block starting address
     PCAddress bbAddr = (PCAddress)dr_fragment_app_pc(tag);
 
@@ -104,7 +121,7 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
     do
     {
 #ifdef JANUS_VERBOSE
-        if (rsched_info.mode == JPARALLEL) {
+        if (rsched_info.mode == JPARALLEL || rsched_info.mode == JPARAFETCH || rsched_info.mode == JPARAVECT) {
             janus_thread_t *tls = (janus_thread_t *)dr_get_tls_field(drcontext);
             thread_print_rule(tls->id, rule);
         } else thread_print_rule(0, rule);
@@ -112,6 +129,14 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
 
         rule_opcode = rule->opcode;
 
+#ifdef SAFE_RUNTIME_CHECK
+        /* The loop runs its sequential version for the current invocation */
+        if (loop_rule_disabled(rule)) {
+            rule = rule->next;
+            continue;
+        }
+#endif
+
         switch (rule_opcode) {
             case APP_SPLIT_BLOCK:
                 split_block_handler(janus_context);
@@ -119,11 +144,6 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
             case THREAD_CREATE:
                 if (!janus_status) break;
                 insert_function_call_as_application(janus_context,janus_create_threads);
-                /* Special case: only 1 thread */
-                if (rsched_info.number_of_threads == 1) {
-                    janus_generate_loop_code(drcontext, oracle[0]);
-                    shared->code_ready = 1;
-                }
                 break;
             case THREAD_EXIT:
                 #ifdef SLOW_THREAD_EXIT
@@ -137,7 +157,12 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
                 //Any non-0 thread will jump out of this BB midway through 
                 //(at the end of the thread loop finish code the thread jumps to the thread pool)
                 //So following instructions at the comment on dr_redirect_native_target, we must tell DynamoRIO to end the trace here
+#ifdef JANUS_SHARED_CC
+                //The translation is shared by all threads
+                mustEndTrace = true;
+#else
                 if (tls->id != 0) mustEndTrace = true;
+#endif
                 loop_finish_handler(janus_context);
                 break;
             case PARA_LOOP_ITER:
@@ -187,14 +212,38 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
             case MEM_RECORD_BOUNDS:
                 loop_array_bound_record_handler(janus_context);
                 break;
+            case MEM_PREFETCH:
+                loop_prefetch_handler(janus_context);
+                break;
+            case INSTR_UPDATE:
+                loop_prefetch_update_handler(janus_context);
+                break;
+            case INSTR_CLONE:
+                loop_prefetch_clone_handler(janus_context);
+                break;
+            case PREFETCH_GUARD_START:
+                prefetch_guard_start_handler(janus_context);
+                break;
+            case PREFETCH_GUARD_END:
+                prefetch_guard_end_handler(janus_context);
+                break;
             case TX_START:
-                //TODO: JAN-79 Fix STM everything
-                //transaction_start_handler(janus_context);
+#ifdef JANUS_JITSTM
+                transaction_start_handler(janus_context);
+#endif
                 break;
             case TX_FINISH:
-                //transaction_finish_handler(janus_context);
+#ifdef JANUS_JITSTM
+                transaction_finish_handler(janus_context);
+#endif
                 break;
-#ifdef JANUS_VECT_SUPPORT
+            case TX_REDIRECT:
+#ifdef JANUS_JITSTM
+                /* The accesses are redirected after all other rules changed the block */
+                speculative_loop = &(shared->loops[rule->reg0]);
+#endif
+                break;
+#ifdef JANUS_X86
             case VECT_INDUCTION_STRIDE_UPDATE:
                 vector_induction_update_handler(janus_context);
                 break;
@@ -210,6 +259,15 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
             case VECT_BROADCAST:
                 vector_broadcast_handler(janus_context);
                 break;
+            case VECT_GATHER:
+                vector_gather_handler(janus_context);
+                break;
+            case VECT_SCATTER:
+                vector_scatter_handler(janus_context);
+                break;
+            case VECT_FMA:
+                vector_fma_handler(janus_context);
+                break;
 #endif
 #ifdef NOT_YET_WORKING_FOR_ALL
             case PARA_LOOP_ITER_DOALL:
@@ -320,6 +378,11 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
         rule = rule->next;
     } while (rule);
 
+#ifdef JANUS_JITSTM
+    if (speculative_loop)
+        speculative_loop_block_handler(drcontext, bb, speculative_loop);
+#endif
+
     if (mustEndTrace) return DR_EMIT_MUST_END_TRACE;
     else return DR_EMIT_DEFAULT;
 }
@@ -22,6 +22,11 @@ typedef struct _shared_state {
     /* The shared stamp for thread's epoch */
     uint64_t                global_lock;
     uint64_t                dummy2[7];
+    /* Number of DOACROSS chunks finished, published in chunk order */
+    volatile uint64_t       doacross_done;
+    /* Number of threads sleeping on doacross_done */
+    volatile uint32_t       doacross_waiters;
+    uint32_t                dummy3[13];
     /* Record of all loops that are in need of parallelisation */
     loop_t                  *loops;
     loop_t                  *current_loop;
@@ -32,8 +37,6 @@ typedef struct _shared_state {
     volatile uint32_t       ready;
     ///A flag to tell the warden thread to start JIT compilation
     volatile uint32_t       code_gen_start;
-    ///All code has finished JITing.
-    volatile uint32_t       code_ready;
     ///A flag to tell all threads to leave thread pool and jump to a PC
     volatile uint32_t       start_run;
     ///A flag to tell all threads to jump back to thread pool
@@ -50,12 +53,12 @@ typedef struct _shared_state {
     ///Currently not yet used
     volatile uint32_t       speculate_dummy;
 #endif
-    /** \brief runtime flag to indicate the runtime check fails */
-    volatile uint32_t       runtime_check_fail;
     /* Record of all functions that are involved */
     uint32_t                number_of_functions;
     //dynamic_code_t          **functions;
     uint64_t                warden_thread;
+    ///Serialise the lazy generation of loop code
+    void                    *code_gen_lock;
     uint64_t                *lockArray;
     /* Shared stacks */
     uint64_t                stack_ptr;
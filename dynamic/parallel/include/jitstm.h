@@ -7,71 +7,69 @@
 
 #include "emit.h"
 
-/* Enable read/write buffer size check in the JITSTM */
-#define JITSTM_BOUND_CHECK
-
 #define STM_READ_ONLY 0
 #define STM_WRITE_ONLY 1
 #define STM_READ_AND_WRITE 2
 
-/* The maximum size for read set should be less than the size
- * of the translation hash table */
-#define READ_SET_SIZE               HASH_TABLE_SIZE
-#define WRITE_SET_SIZE              (HASH_TABLE_SIZE / 2)
+/* The read and write sets are open-addressed tables with linear probing.
+ * Their sizes are powers of two and they are kept at most half full, so the
+ * probe sequences stay within one or two cache lines */
+#define READ_SET_WIDTH              14
+#define WRITE_SET_WIDTH             13
+#define READ_SET_SIZE               (1 << READ_SET_WIDTH)
+#define WRITE_SET_SIZE              (1 << WRITE_SET_WIDTH)
+#define READ_SET_LIMIT              (READ_SET_SIZE / 2)
+#define WRITE_SET_LIMIT             (WRITE_SET_SIZE / 2)
 #define CACHE_LINE_WIDTH            64
 
-/* Basic element for JITSTM storage */
-/* If mask is zero, then it is a read, otherwise it is a write */
+/* Fibonacci hashing of the word address, the top bits index the table */
+#define STM_HASH(addr, width) \
+    ((uint32_t)((((uint64_t)(addr) >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - (width))))
+
+/* Bloom signature of a set of addresses, one bit for each word touched.
+ * Two signatures intersect only if the AND of them is not zero */
+typedef uint64_t stm_sig_t;
+#define STM_SIG_BIT(addr)           (1ULL << STM_HASH(addr, 6))
+#define STM_SIG(addr, size)         (STM_SIG_BIT(addr) | STM_SIG_BIT((uint64_t)(addr) + (size) - 1))
+/* Number of published write signatures kept for validation */
+#define STM_SIG_HISTORY             64
+
+/* Basic element for JITSTM storage
+ * The data is kept in the table slot, so a redirected access points into the table.
+ * A slot is free if addr is zero */
 typedef struct _entry {
     uint64_t                data;           //8 bytes
-    uintptr_t               addr;           //8 bytes
+    uintptr_t               addr;           //8 bytes, aligned word
+    uint64_t                mask;           //0xff for each byte read (read set) or written (write set)
 } spec_item_t;
 
-/* JITSTM uses a translation table for address redirection
- * The first element is the original address
- * The second element is the redirected address
- * The redirected address always points to a pre-defined thread-private memory region to store data
- * It either points to read or write sets
- *
- * NOTE: IF YOU CHANGE THE SIZE OF THIS STRUCTURE
- * YOU NEED TO CHANGE THE HASHTABLE LOOKUP TOO
- */
-typedef struct _trans {
-    uintptr_t               original_addr;
-    spec_item_t             *redirect_addr;
-    uint32_t                rw;
-    uint32_t                rollback;
-} trans_t;
-
-/* Private transaction structure
- * don't change the order of the structure
- * the offset is being used in the assembly */
+/* Private transaction structure */
 typedef struct janus_tx
 {
-    /* \brief Translation table: must be the first element */
-    trans_t             *trans_table;               //+0
-    /* \brief Flush table
-     *
-     * Used for keeping track of already written entries for transaction clear */
-    trans_t             **flush_table;              //+8
     /* \brief Speculative read set
      *
-     * Keeps all the read entries */
-    spec_item_t         *read_set;                  //+16
-    /* \brief Speculative read set pointer
-     *
-     * It always points to a free entry in the read set */
-    spec_item_t         *rsptr;                     //+24
+     * Keeps the value of the first read of each location for validation */
+    spec_item_t         *read_set;
     /* \brief Speculative write set
      *
-     * Keeps all the write entries */
-    spec_item_t         *write_set;                 //+32
-    /* \brief Speculative write set pointer
+     * Keeps the value to be committed for each location written */
+    spec_item_t         *write_set;
+    /* \brief Used slots of the read and write set
+     *
+     * Validation, write back and clear only visit these slots */
+    uint32_t            *read_log;
+    uint32_t            *write_log;
+    uint32_t            read_size;
+    uint32_t            write_size;
+    /* \brief Bloom signatures of the read and write set
      *
-     * It always points to a free entry in the write set */
-    spec_item_t         *wsptr;                     //+40
-    /* \brief Size of the current transaction */
-    uint64_t            trans_size;                 //+48
+     * A load whose word is not in the write signature skips the write set lookup.
+     * Outside a transaction the write signature collects the direct writes of the
+     * oldest thread in the loop */
+    stm_sig_t           read_sig;
+    stm_sig_t           write_sig;
+    /* \brief Number of write signatures published when the transaction started */
+    uint64_t            start_commit;
     /* \brief Register buffers that store the initial value for shared registers */
     priv_state_t        check_point;
     /* \brief Record the initial value for each depending register */
@@ -80,12 +78,10 @@ typedef struct janus_tx
     priv_state_t        private_state;
     /* \brief Call back to TLS */
     void                *tls;
-#ifdef JITSTM_BOUND_CHECK
-    /* \brief Points to the end of the speculative read set */
-    spec_item_t         *read_set_end;
-    /* \brief Points to the end of the speculative write set */
-    spec_item_t         *write_set_end;
-#endif
+    /* \brief Application state at the start of the transaction
+     *
+     * A transaction that fails validation is executed again from this state */
+    dr_mcontext_t       start_state;
 } jtx_t;
 
 typedef struct _janus_jit_code
@@ -0,0 +1,32 @@
+/*! \file jtemplate.h
+ *  \brief Pre-assembled loop code stored in the rewrite schedule
+ *
+ *  When the environment variable JANUS_TEMPLATE_RECORD is set, the loop code
+ *  generated at runtime is recorded together with its relocations and written
+ *  to {rule file}.tpl at exit. The static analyser embeds the recorded file
+ *  into the next rewrite schedule, and later runs only copy and patch the code
+ *  instead of generating it.
+ */
+#ifndef _JANUS_LOOP_TEMPLATE_
+#define _JANUS_LOOP_TEMPLATE_
+
+#include "janus_api.h"
+#include "loop.h"
+
+/** \brief Locate the template section of the rewrite schedule and set up recording */
+void
+janus_code_template_init(void);
+
+/** \brief Create the loop code of all threads from the templates in the rewrite schedule
+ *
+ * Returns false if there is no usable template for this loop */
+bool
+janus_instantiate_loop_code(void *drcontext, loop_t *loop);
+
+/** \brief Encode the instrlist into a new code page and record it if requested
+ *
+ * The instrlist is destroyed, same as generate_runtime_code() */
+void *
+janus_encode_loop_code(void *drcontext, loop_t *loop, TemplateKind kind, instrlist_t *bb);
+
+#endif
@@ -80,6 +80,8 @@ typedef struct _thread_local {
     volatile uint64_t       dummy;
     /* Local stamp */
     uint64_t                local_stamp;
+    /* DOACROSS chunk the thread is running */
+    uint64_t                chunk;
     /** \brief Private register bank */
     priv_state_t            private_state;
     /* For conditional merging we record when we write to specific registers */
@@ -129,6 +131,11 @@ extern janus_thread_t **oracle;
 #define LOCAL_ID_OFFSET           (offsetof(janus_thread_t, id))
 #define LOCAL_GEN_CODE_OFFSET     (offsetof(janus_thread_t, gen_code))
 #define LOCAL_WRITTEN_REGS_OFFSET (offsetof(janus_thread_t, written_regs_mask))
+#define LOCAL_STAMP_OFFSET        (offsetof(janus_thread_t, local_stamp))
+#define LOCAL_CHUNK_OFFSET        (offsetof(janus_thread_t, chunk))
+#ifdef NOT_YET_WORKING_FOR_ALL
+#define LOCAL_BUFFER_OFFSET       (offsetof(janus_thread_t, buffer))
+#endif
 #ifdef JANUS_STATS
 #define LOCAL_STATS_OFFSET      (offsetof(janus_thread_t, stats))
 #endif
@@ -26,8 +26,52 @@ typedef struct _loop {
     SchedulePolicy          schedule;
     /** \brief loop header retrieved from the rewrite schedule */
     RSLoopHeader            *header;
+    /** \brief set when the init/finish code of this loop is generated for all threads */
+    volatile uint32_t       code_ready;
+    /** \brief lowest and highest block address with rules of this loop, flushed when the version changes */
+    app_pc                  code_start;
+    app_pc                  code_end;
+    /** \brief set if the array overlap check of the current invocation fails */
+    volatile uint32_t       check_fail;
+    /** \brief set if the code cache holds the sequential version of the loop */
+    volatile uint32_t       serial;
+    /** \brief number of runtime checks performed and failed */
+    uint64_t                check_count;
+    uint64_t                check_fail_count;
+    /** \brief DOACROSS and speculative only: iterations per chunk, number of chunks a chunk may start ahead
+     * of the finished chunks, number of chunks and the thread that runs the last chunk.
+     * doacross_chunks is 0 if the loop can't be run in chunks */
+    uint64_t                doacross_chunk;
+    uint64_t                doacross_lag;
+    uint64_t                doacross_chunks;
+    int                     doacross_last_tid;
 } loop_t;
 
+/** \brief Smallest DOACROSS chunk unless the dependence distance is shorter */
+#define DOACROSS_MIN_CHUNK      16
+/** \brief Number of pause iterations before a DOACROSS wait sleeps on the futex */
+#define DOACROSS_SPIN_COUNT     4096
+/** \brief Sleep timeout in nanoseconds, bounds the delay of a missed wake up */
+#define DOACROSS_SLEEP_NS       100000
+
+/** \brief Iterations of a speculative chunk, its accesses must fit in the read and write sets */
+#define SPEC_CHUNK_SIZE         64
+
+/** \brief DOACROSS and speculative loops run their iterations in chunks that finish in order */
+#define LOOP_CHUNK_SCHEDULED(loop) \
+    ((loop)->schedule == PARA_DOACROSS || (loop)->schedule == PARA_SPEC_CYCLIC_CHUNK)
+
+/** \brief Chunk scheduled loops run each of their chunks as a block of the thread */
+#define LOOP_BLOCK_SCHEDULED(loop) \
+    ((loop)->schedule == PARA_DOALL_BLOCK || LOOP_CHUNK_SCHEDULED(loop))
+
+/** \brief Widest vector register of the combined vector schedule, in bytes */
+#define LOOP_MAX_VECTOR_WIDTH   32
+
+/** \brief Iterations a thread block is a multiple of, whole vectors if the loop body is vectorised */
+#define LOOP_BLOCK_GRANULARITY(loop) \
+    ((loop)->header->vectorWordSize ? LOOP_MAX_VECTOR_WIDTH / (int64_t)(loop)->header->vectorWordSize : 1)
+
 /** \brief JIT compiled routine for loop init/finish
  *
  * This loop code is thread private and different per thread per loop. */
@@ -35,6 +79,8 @@ typedef struct _generated_code {
     void *thread_loop_init;
     void *thread_loop_finish;
     void *thread_transaction_rollback;
+    /** \brief moves the thread to its next chunk */
+    void *thread_loop_advance;
 } loop_code_t;
 
 /** \brief Janus dynamic handler for RRule: PARA_LOOP_INIT */
@@ -102,11 +148,24 @@ loop_outer_init_handler(JANUS_CONTEXT);
 void
 loop_outer_finish_handler(JANUS_CONTEXT);
 
-/** \brief Dynamically generate the init/finish code
- * This function is called by all threads immediately they are created and initialised
+/** \brief Divide a DOACROSS loop into chunks from its dependence distance,
+ * or a speculative loop into chunks of SPEC_CHUNK_SIZE iterations
+ *
+ * Only loops with constant bounds are supported, other loops are run sequentially */
+void
+loop_doacross_init(loop_t *loop);
+
+/** \brief Iterations of the block run by each thread except the last one
+ *
+ * The block is rounded down to the granularity of the loop, the last thread runs the rest */
+int64_t
+loop_thread_block(loop_t *loop, int64_t iterations);
+
+/** \brief Dynamically generate the init/finish code of a loop for all threads
+ * This function is called lazily when the loop is first encountered, loops that never run are not generated
  * The loop skeleton is used for quick execution of the loop components */
 void
-janus_generate_loop_code(void *drcontext, void *tls);
+janus_generate_loop_code(void *drcontext, loop_t *loop);
 
 /** \brief Constructs a dynamic instruction list for loop initialisation */
 instrlist_t *
@@ -0,0 +1,22 @@
+/*! \file pfetch.h
+ *  \brief Runtime handlers for software prefetches inside parallelised loops
+ */
+#ifndef _JANUS_PARA_PREFETCH_
+#define _JANUS_PARA_PREFETCH_
+
+#include "janus_api.h"
+
+/** \brief Janus dynamic handler for RRule: MEM_PREFETCH (combined parallel and prefetch schedule)
+ *
+ * The prefetch distance is fitted into the block of iterations of each thread */
+void
+loop_prefetch_handler(JANUS_CONTEXT);
+
+/** \brief Janus dynamic handler for RRule: INSTR_UPDATE (combined parallel and prefetch schedule) */
+void
+loop_prefetch_update_handler(JANUS_CONTEXT);
+
+/** \brief Janus dynamic handler for RRule: INSTR_CLONE (combined parallel and prefetch schedule) */
+void
+loop_prefetch_clone_handler(JANUS_CONTEXT);
+#endif
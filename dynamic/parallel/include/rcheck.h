@@ -8,6 +8,10 @@
 
 //#define SLOW_RUNTIME_CHECK
 
+/** \brief Up to this number of arrays, the ranges are compared pairwise with vector comparisons.
+ * Larger sets are sorted by start address and swept once */
+#define RCHECK_SIMD_MAX_ARRAYS 8
+
 /** \brief record the runtime array bound in thread local storage */
 void
 loop_array_bound_record_handler(JANUS_CONTEXT);
@@ -16,4 +20,14 @@ loop_array_bound_record_handler(JANUS_CONTEXT);
 void
 loop_array_bound_check_handler(JANUS_CONTEXT);
 
-#endif
\ No newline at end of file
+/** \brief Initialise the runtime check state of the loop
+ *
+ * The rules of the loop give the code range to flush when the loop changes version */
+void
+loop_runtime_check_init(loop_t *loop, RRule *rules, uint32_t size);
+
+/** \brief Returns true if the rule belongs to a loop that currently runs its sequential version */
+bool
+loop_rule_disabled(RRule *rule);
+
+#endif
@@ -7,11 +7,28 @@
 
 #include "janus_api.h"
 #include "jthread.h"
+#include "loop.h"
 
 #define JANUS_SLOW_STM
 //#define JANUS_STM_VERBOSE
 
+/* Spins of a waiting thread before it yields the core */
+#define STM_SPIN_LIMIT              1024
+/* DynamoRIO spill slots for the registers used by the redirection */
+#define STM_TLS_SLOT                SPILL_SLOT_1
+#define STM_PTR_SLOT                SPILL_SLOT_2
+/* If set, the number of transactions committed and executed again is printed at exit */
+#define STM_REPORT_ENV              "JANUS_STM_REPORT"
+/* Kinds of a redirected access */
+#define STM_ACCESS_READ             1
+#define STM_ACCESS_WRITE            2
+
 /* C implementation of Janus STM */
+/* \brief Return the address to access instead of original_addr
+ *
+ * In a transaction it points into the speculative copy of the aligned 64 bit word,
+ * otherwise it is the original address. The access is size bytes of STM_ACCESS_* kind */
+void *janus_spec_redirect(janus_thread_t *tls, uint64_t original_addr, uint64_t size, uint64_t access);
 /* \brief Janus speculative read 64 bit */
 uint64_t janus_spec_read(janus_thread_t *tls, uint64_t original_addr);
 /* \brief Janus speculative read 64 bit */
@@ -20,18 +37,25 @@ void janus_spec_write(janus_thread_t *tls, uint64_t original_addr, uint64_t data
  *
  * It can be used for partial memory writes, or read & write pairs */
 void *janus_spec_get_ptr(janus_thread_t *tls, uint64_t original_addr);
-/* \brief validate the read set and commit the write set */
-void *janus_transaction_commit(janus_thread_t *tls);
+/* \brief validate the read set and commit the write set
+ *
+ * Returns false and discards the transaction if a location read has changed */
+bool janus_transaction_commit(janus_thread_t *tls);
 /* \brief clear the current transaction */
-void *janus_transaction_clear(janus_thread_t *tls);
-/* \brief abort the current transaction and perform rollback */
-void *janus_transaction_abort(janus_thread_t *tls);
+void janus_transaction_clear(janus_thread_t *tls);
+/* \brief end the speculation of the current transaction
+ *
+ * It waits until all earlier threads have committed, then commits the transaction
+ * or executes it again from its start if validation fails */
+void janus_transaction_serialise(void);
 ///Initialise the data structure for JITSTM
 void janus_thread_init_jitstm(void *tls);
+///Find the speculative loops and the code that needs redirection
+void janus_stm_init(void);
 
 /* \brief Dynamic handlers in speculative mode
  *
- * This is only invoked when Janus is in speculative mode in shared library cals */
+ * This is only invoked when Janus is in speculative mode, in the external code called by speculative loops */
 void master_dynamic_speculative_handlers(void *drcontext, instrlist_t *bb);
 
 ///start a transaction
@@ -40,8 +64,10 @@ void transaction_start_handler(JANUS_CONTEXT);
 void transaction_finish_handler(JANUS_CONTEXT);
 ///commit a transaction, separated from transaction_finish
 void transaction_commit_handler(JANUS_CONTEXT);
+///redirect the memory accesses of a speculative loop body block, after all other rules of the block
+void speculative_loop_block_handler(void *drcontext, instrlist_t *bb, loop_t *loop);
 ///redirect the memory instruction to speculative read & write buffer, clean call version
-void speculative_memory_handler(void *drcontext, janus_thread_t *local, instrlist_t *bb, instr_t *instr, int *reg_index);
+void speculative_memory_handler(void *drcontext, instrlist_t *bb, instr_t *instr, reg_id_t tls_reg, reg_id_t ptr_reg);
 ///redirect the memory instruction to speculative read & write buffer, inline version
 void speculative_inline_memory_handler(void *drcontext, janus_thread_t *local, instrlist_t *bb, instr_t *instr);
 
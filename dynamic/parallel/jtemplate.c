@@ -0,0 +1,483 @@
+/* Pre-assembled loop code
+ *
+ * The loop init/finish code only depends on the rewrite schedule and the number
+ * of threads, apart from the addresses of the Janus runtime structures. So the
+ * code generated in one run is recorded with a relocation for every address and
+ * the following runs only need to copy the code and patch the addresses. */
+#include "jtemplate.h"
+#include "jthread.h"
+#include "control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEMPLATE_RECORD_ENV "JANUS_TEMPLATE_RECORD"
+
+/* Template section of the rewrite schedule, NULL if not present or not usable */
+static char                 *template_section;
+static RSTemplateHeader     *template_header;
+static RSCodeTemplate       *templates;
+
+#ifdef JANUS_X86
+/* Recorded templates, relocations and code, written to file at exit */
+static int                  record_on;
+static RSCodeTemplate       *record_templates;
+static uint32_t             record_count;
+static RSCodeReloc          *record_relocs;
+static uint32_t             record_reloc_count;
+static uint32_t             record_reloc_capacity;
+static byte                 *record_code;
+static uint32_t             record_code_size;
+
+static void
+write_recorded_templates(void);
+
+static void
+record_loop_code(void *drcontext, loop_t *loop, TemplateKind kind, byte *start, byte *end);
+#endif
+
+static RSCodeTemplate *
+find_template(loop_t *loop, TemplateKind kind);
+
+static byte *
+instantiate_template(void *drcontext, RSCodeTemplate *code);
+
+void
+janus_code_template_init()
+{
+    RSchedHeader *header = rsched_info.header;
+    RSTemplateHeader *theader;
+    uint64_t size;
+    int i;
+
+#ifdef JANUS_X86
+    /* Record mode always generates the code from scratch */
+    if (getenv(TEMPLATE_RECORD_ENV) != NULL) {
+        record_on = 1;
+        dr_register_exit_event(write_recorded_templates);
+        return;
+    }
+#endif
+
+    if (!header->templateOffset) return;
+    if (header->templateOffset + sizeof(RSTemplateHeader) > rsched_info.file_size) return;
+
+    theader = (RSTemplateHeader *)((char *)header + header->templateOffset);
+    if (theader->magic != RS_TEMPLATE_MAGIC ||
+        theader->version != RS_TEMPLATE_VERSION) return;
+
+    /* The code is only valid for the same runtime layout and number of threads */
+    if (theader->numberOfThreads != rsched_info.number_of_threads ||
+        theader->sharedSize != sizeof(janus_shared_t) ||
+        theader->threadSize != sizeof(janus_thread_t)) {
+#ifdef JANUS_VERBOSE
+        dr_fprintf(STDERR,"Loop code templates recorded for %d threads are not used\n",
+                   theader->numberOfThreads);
+#endif
+        return;
+    }
+
+    size = rsched_info.file_size - header->templateOffset;
+    if (sizeof(RSTemplateHeader) + theader->numTemplates * sizeof(RSCodeTemplate) > size) return;
+
+    templates = (RSCodeTemplate *)((char *)theader + sizeof(RSTemplateHeader));
+    for (i=0; i<theader->numTemplates; i++) {
+        if (templates[i].codeOffset + templates[i].codeSize > size ||
+            templates[i].codeSize >= PAGE_SIZE ||
+            templates[i].relocOffset + templates[i].numRelocs * sizeof(RSCodeReloc) > size) {
+            templates = NULL;
+            return;
+        }
+    }
+
+    template_section = (char *)theader;
+    template_header = theader;
+#ifdef JANUS_VERBOSE
+    dr_fprintf(STDERR,"%d loop code templates loaded\n",theader->numTemplates);
+#endif
+}
+
+bool
+janus_instantiate_loop_code(void *drcontext, loop_t *loop)
+{
+    RSCodeTemplate *code[TEMPLATE_KIND_COUNT];
+    byte *page[TEMPLATE_KIND_COUNT] = {NULL};
+    int lid = loop->dynamic_id;
+    int kind, tid;
+
+    if (!template_section) return false;
+
+    /* Step 1: all kinds of code must be available for this loop */
+    for (kind=0; kind<TEMPLATE_KIND_COUNT; kind++) {
+        code[kind] = find_template(loop, kind);
+        if (!code[kind]) return false;
+    }
+
+    /* Step 2: copy and patch the templates */
+    for (kind=0; kind<TEMPLATE_KIND_COUNT; kind++) {
+        page[kind] = instantiate_template(drcontext, code[kind]);
+        if (!page[kind]) {
+            /* Unreachable targets, fall back to code generation */
+            for (kind=0; kind<TEMPLATE_KIND_COUNT; kind++) {
+                if (page[kind]) dr_nonheap_free(page[kind], PAGE_SIZE);
+            }
+            return false;
+        }
+    }
+
+    /* Step 3: assign the code, the thread code is shared by all threads */
+    loop->loop_init = page[TEMPLATE_LOOP_INIT];
+    loop->loop_finish = page[TEMPLATE_LOOP_FINISH];
+    for (tid=0; tid<rsched_info.number_of_threads; tid++) {
+        oracle[tid]->gen_code[lid].thread_loop_init = page[TEMPLATE_THREAD_LOOP_INIT];
+        oracle[tid]->gen_code[lid].thread_loop_finish = page[TEMPLATE_THREAD_LOOP_FINISH];
+    }
+    return true;
+}
+
+void *
+janus_encode_loop_code(void *drcontext, loop_t *loop, TemplateKind kind, instrlist_t *bb)
+{
+    byte *end;
+    byte *code_cache = dr_nonheap_alloc(PAGE_SIZE,
+                                        DR_MEMPROT_READ  |
+                                        DR_MEMPROT_WRITE |
+                                        DR_MEMPROT_EXEC);
+
+    end = instrlist_encode(drcontext, bb, code_cache, true);
+    DR_ASSERT((end - code_cache) < PAGE_SIZE);
+
+    instrlist_clear_and_destroy(drcontext, bb);
+
+    dr_memory_protect(code_cache, PAGE_SIZE,
+                    DR_MEMPROT_READ | DR_MEMPROT_EXEC);
+
+#ifdef JANUS_X86
+    if (record_on)
+        record_loop_code(drcontext, loop, kind, code_cache, end);
+#endif
+    return code_cache;
+}
+
+static RSCodeTemplate *
+find_template(loop_t *loop, TemplateKind kind)
+{
+    int i;
+
+    for (i=0; i<template_header->numTemplates; i++) {
+        if (templates[i].loopID == loop->dynamic_id &&
+            templates[i].kind == kind &&
+            templates[i].loopStartAddr == loop->header->loopStartAddr)
+            return templates + i;
+    }
+    return NULL;
+}
+
+static byte *
+resolve_symbol(void *drcontext, RSCodeReloc *reloc)
+{
+    switch (reloc->symbol) {
+        case RELOC_SHARED:
+            return (byte *)shared + reloc->addend;
+        case RELOC_LOOP:
+            if (reloc->index >= rsched_info.header->numLoops) return NULL;
+            return (byte *)&(shared->loops[reloc->index]) + reloc->addend;
+        case RELOC_THREAD:
+            if (reloc->index >= rsched_info.number_of_threads) return NULL;
+            return (byte *)oracle[reloc->index] + reloc->addend;
+        case RELOC_THREAD_POOL:
+            return (byte *)janus_thread_pool_app + reloc->addend;
+        case RELOC_REENTER_THREAD_POOL:
+            return (byte *)janus_reenter_thread_pool_app + reloc->addend;
+        case RELOC_REDIRECT_NATIVE:
+            return dr_redirect_native_target(drcontext) + reloc->addend;
+        default:
+            return NULL;
+    }
+}
+
+static byte *
+instantiate_template(void *drcontext, RSCodeTemplate *code)
+{
+    RSCodeReloc *relocs = (RSCodeReloc *)(template_section + code->relocOffset);
+    byte *page = dr_nonheap_alloc(PAGE_SIZE,
+                                  DR_MEMPROT_READ  |
+                                  DR_MEMPROT_WRITE |
+                                  DR_MEMPROT_EXEC);
+    int64_t value;
+    int i;
+
+    memcpy(page, template_section + code->codeOffset, code->codeSize);
+
+    for (i=0; i<code->numRelocs; i++) {
+        RSCodeReloc *reloc = relocs + i;
+        byte *target = resolve_symbol(drcontext, reloc);
+
+        if (target == NULL || reloc->offset + 4 > code->codeSize) goto fail;
+
+        switch (reloc->type) {
+            case RELOC_ABS64:
+                if (reloc->offset + 8 > code->codeSize) goto fail;
+                *(uint64_t *)(page + reloc->offset) = (uint64_t)target;
+                break;
+            case RELOC_ABS32:
+                /* 32-bit immediates and displacements are sign extended */
+                value = (int64_t)target;
+                if (value != (int32_t)value) goto fail;
+                *(int32_t *)(page + reloc->offset) = (int32_t)value;
+                break;
+            case RELOC_PCREL32:
+                value = (int64_t)(target - (page + reloc->pcBase));
+                if (value != (int32_t)value) goto fail;
+                *(int32_t *)(page + reloc->offset) = (int32_t)value;
+                break;
+            default:
+                goto fail;
+        }
+    }
+
+    dr_memory_protect(page, PAGE_SIZE,
+                    DR_MEMPROT_READ | DR_MEMPROT_EXEC);
+    return page;
+
+fail:
+    dr_nonheap_free(page, PAGE_SIZE);
+    return NULL;
+}
+
+#ifdef JANUS_X86
+/* Returns true if the address belongs to a Janus runtime object that moves between runs */
+static bool
+classify_address(void *drcontext, byte *addr, RSCodeReloc *reloc)
+{
+    byte *base;
+    int i;
+
+    reloc->index = 0;
+
+    base = (byte *)shared;
+    if (addr >= base && addr < base + sizeof(janus_shared_t)) {
+        reloc->symbol = RELOC_SHARED;
+        reloc->addend = addr - base;
+        return true;
+    }
+
+    base = (byte *)shared->loops;
+    if (addr >= base && addr < base + rsched_info.header->numLoops * sizeof(loop_t)) {
+        reloc->symbol = RELOC_LOOP;
+        reloc->index = (addr - base) / sizeof(loop_t);
+        reloc->addend = (addr - base) % sizeof(loop_t);
+        return true;
+    }
+
+    for (i=0; i<rsched_info.number_of_threads; i++) {
+        base = (byte *)oracle[i];
+        if (addr >= base && addr < base + sizeof(janus_thread_t)) {
+            reloc->symbol = RELOC_THREAD;
+            reloc->index = i;
+            reloc->addend = addr - base;
+            return true;
+        }
+    }
+
+    reloc->addend = 0;
+    if (addr == (byte *)janus_thread_pool_app)
+        reloc->symbol = RELOC_THREAD_POOL;
+    else if (addr == (byte *)janus_reenter_thread_pool_app)
+        reloc->symbol = RELOC_REENTER_THREAD_POOL;
+    else if (addr == dr_redirect_native_target(drcontext))
+        reloc->symbol = RELOC_REDIRECT_NATIVE;
+    else
+        return false;
+    return true;
+}
+
+/* Find the unique location of an encoded field inside an instruction */
+static bool
+find_field(byte *pc, byte *next, void *value, int size, byte **field)
+{
+    byte *found = NULL;
+
+    for (; pc + size <= next; pc++) {
+        if (memcmp(pc, value, size) == 0) {
+            if (found) return false;
+            found = pc;
+        }
+    }
+    *field = found;
+    return found != NULL;
+}
+
+static bool
+add_reloc(RSCodeReloc *reloc)
+{
+    if (record_reloc_count == record_reloc_capacity) {
+        record_reloc_capacity = record_reloc_capacity ? record_reloc_capacity * 2 : 64;
+        record_relocs = (RSCodeReloc *)realloc(record_relocs,
+                            record_reloc_capacity * sizeof(RSCodeReloc));
+        if (!record_relocs) return false;
+    }
+    record_relocs[record_reloc_count++] = *reloc;
+    return true;
+}
+
+/* Add a relocation for the operand if it refers to a runtime object.
+ * Returns false if the operand cannot be relocated */
+static bool
+record_operand(void *drcontext, opnd_t opnd, byte *start, byte *end, byte *pc, byte *next)
+{
+    RSCodeReloc reloc;
+    byte *addr, *field;
+    int32_t value32;
+    int64_t value64;
+
+    if (opnd_is_rel_addr(opnd) || opnd_is_pc(opnd)) {
+        addr = opnd_is_pc(opnd) ? opnd_get_pc(opnd) : (byte *)opnd_get_addr(opnd);
+        /* Branches within the same code move together */
+        if (opnd_is_pc(opnd) && addr >= start && addr < end) return true;
+        if (!classify_address(drcontext, addr, &reloc)) return false;
+        value32 = (int32_t)(addr - next);
+        if (!find_field(pc, next, &value32, 4, &field)) return false;
+        reloc.type = RELOC_PCREL32;
+        reloc.pcBase = next - start;
+    } else if (opnd_is_abs_addr(opnd) || opnd_is_immed_int(opnd)) {
+        if (opnd_is_immed_int(opnd))
+            addr = (byte *)opnd_get_immed_int(opnd);
+        else if (opnd_is_base_disp(opnd))
+            addr = (byte *)(ptr_int_t)opnd_get_disp(opnd);
+        else
+            addr = (byte *)opnd_get_addr(opnd);
+        /* Plain constants are kept as they are */
+        if (!classify_address(drcontext, addr, &reloc))
+            return opnd_is_immed_int(opnd);
+        value64 = (int64_t)addr;
+        value32 = (int32_t)value64;
+        if (find_field(pc, next, &value64, 8, &field))
+            reloc.type = RELOC_ABS64;
+        else if (value64 == value32 && find_field(pc, next, &value32, 4, &field))
+            reloc.type = RELOC_ABS32;
+        else return false;
+        reloc.pcBase = 0;
+    } else return true;
+
+    reloc.offset = field - start;
+    return add_reloc(&reloc);
+}
+
+/* Decode the generated code and record it with its relocations */
+static void
+record_loop_code(void *drcontext, loop_t *loop, TemplateKind kind, byte *start, byte *end)
+{
+    uint32_t reloc_start = record_reloc_count;
+    RSCodeTemplate *code;
+    instr_t instr;
+    byte *pc = start;
+    byte *next;
+    int i;
+
+    instr_init(drcontext, &instr);
+    while (pc < end) {
+        instr_reset(drcontext, &instr);
+        next = decode(drcontext, pc, &instr);
+        if (next == NULL) goto fail;
+        for (i=0; i<instr_num_srcs(&instr); i++) {
+            if (!record_operand(drcontext, instr_get_src(&instr, i), start, end, pc, next)) goto fail;
+        }
+        for (i=0; i<instr_num_dsts(&instr); i++) {
+            if (!record_operand(drcontext, instr_get_dst(&instr, i), start, end, pc, next)) goto fail;
+        }
+        pc = next;
+    }
+    instr_free(drcontext, &instr);
+
+    /* Append the code and the template entry */
+    record_code = (byte *)realloc(record_code, record_code_size + (end - start));
+    record_templates = (RSCodeTemplate *)realloc(record_templates,
+                            (record_count + 1) * sizeof(RSCodeTemplate));
+    if (!record_code || !record_templates) {
+        record_on = 0;
+        return;
+    }
+    memcpy(record_code + record_code_size, start, end - start);
+
+    code = record_templates + record_count++;
+    code->loopID = loop->dynamic_id;
+    code->kind = kind;
+    code->loopStartAddr = loop->header->loopStartAddr;
+    /* Offsets are relative to the code and relocation arrays until written */
+    code->codeOffset = record_code_size;
+    code->codeSize = end - start;
+    code->relocOffset = reloc_start;
+    code->numRelocs = record_reloc_count - reloc_start;
+    record_code_size += end - start;
+    return;
+
+fail:
+    instr_free(drcontext, &instr);
+    record_reloc_count = reloc_start;
+#ifdef JANUS_VERBOSE
+    dr_fprintf(STDERR,"Loop %d code kind %d can not be recorded as template\n",loop->static_id, kind);
+#endif
+}
+
+static uint64_t
+main_module_checksum()
+{
+    module_data_t *main_module = dr_get_main_module();
+    uint64_t checksum = 0;
+    char buffer[4096];
+    size_t size;
+    FILE *file;
+
+    file = fopen(main_module->full_path, "r");
+    dr_free_module_data(main_module);
+    if (file == NULL) return 0;
+
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        checksum = rs_template_checksum(checksum, buffer, size);
+    fclose(file);
+    return checksum;
+}
+
+static void
+write_recorded_templates()
+{
+    RSTemplateHeader header;
+    uint32_t reloc_base, code_base;
+    char path[MAXIMUM_PATH];
+    FILE *file;
+    int i;
+
+    if (!record_count) return;
+
+    header.magic = RS_TEMPLATE_MAGIC;
+    header.version = RS_TEMPLATE_VERSION;
+    header.numberOfThreads = rsched_info.number_of_threads;
+    header.numTemplates = record_count;
+    header.sharedSize = sizeof(janus_shared_t);
+    header.threadSize = sizeof(janus_thread_t);
+    header.binaryChecksum = main_module_checksum();
+
+    /* Relocate the offsets to the start of the section */
+    reloc_base = sizeof(RSTemplateHeader) + record_count * sizeof(RSCodeTemplate);
+    code_base = reloc_base + record_reloc_count * sizeof(RSCodeReloc);
+    for (i=0; i<record_count; i++) {
+        record_templates[i].relocOffset = reloc_base + record_templates[i].relocOffset * sizeof(RSCodeReloc);
+        record_templates[i].codeOffset += code_base;
+    }
+
+    dr_snprintf(path, MAXIMUM_PATH, "%s.tpl", rsched_info.path);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        dr_fprintf(STDERR,"Error: can not write loop code templates to %s\n",path);
+        return;
+    }
+    fwrite(&header, sizeof(RSTemplateHeader), 1, file);
+    fwrite(record_templates, sizeof(RSCodeTemplate), record_count, file);
+    fwrite(record_relocs, sizeof(RSCodeReloc), record_reloc_count, file);
+    fwrite(record_code, 1, record_code_size, file);
+    fclose(file);
+
+    dr_fprintf(STDERR,"%d loop code templates recorded in %s\n",record_count,path);
+}
+#endif
@@ -110,12 +110,7 @@ void janus_thread_spawn_handler(void *drcontext)
     //initialise the TLS
     janus_thread_init(tls, tid);
 
-    //the main thread returns and resumes execution
-    if (tid == 0) return;
-
-    //the rest of threads continue to generate code
-    janus_generate_loop_code(drcontext, tls);
-
+    //loop code is generated lazily when a loop is first met
 #ifdef JANUS_VERBOSE
     dr_printf("A new janus thread %ld created in context %p\n", tid, drcontext);
 #endif
@@ -200,9 +195,6 @@ static void janus_thread_init(janus_thread_t *local, uint64_t tid)
 {
     local->id = tid;
 
-    //allocate thread private loop code
-    local->gen_code = (loop_code_t *)malloc(sizeof(loop_code_t) * rsched_info.header->numLoops);
-
 #ifdef JANUS_JITSTM
     //allocate data structures for the just-in-time STM
     janus_thread_init_jitstm(local);
@@ -246,8 +238,8 @@ int janus_thread_pool_app(janus_thread_t *tls, int status)
     while(1)
     {
         if (shared->start_run) {
-            /* Wait for the code to be ready */
-            while(!(shared->code_ready));
+            /* Wait for the code of this loop to be ready */
+            while(!(shared->current_loop->code_ready));
             /* When code is ready, assign the parallel function */
             parallel = (void (*)(void *, uint64_t))tls->gen_code[shared->current_loop->dynamic_id].thread_loop_init;
             /* Unset the flags */
@@ -3,7 +3,13 @@
 #include "emit.h"
 #include "iterator.h"
 #include "control.h"
+#include "jtemplate.h"
 #include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "janus_arch.h"
 
@@ -11,41 +17,160 @@
   #include "stats.h"
 #endif
 
+#ifdef JANUS_JITSTM
+  #include "stm.h"
+#endif
+
 /* Generate the shared loop code */
 static void generate_shared_loop_code(void *drcontext, loop_t *loop);
 
+#if !defined(JANUS_X86) || !defined(JANUS_SHARED_CC)
 /* Generate the thread private loop code */
 static void generate_thread_private_loop_code(void *drcontext, loop_t *loop, int tid);
+#endif
+
+#ifdef JANUS_X86
+/* Generate one copy of the per-thread loop code shared by all threads */
+static void generate_thread_shared_loop_code(void *drcontext, loop_t *loop);
+
+/* Load the pointer of the janus thread-local storage into reg */
+static void
+insert_load_local(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local, reg_id_t reg);
+
+/* Store reg into the janus thread-local storage when the TLS register is not available */
+static void
+insert_store_local_field(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local,
+                         int offset, reg_id_t reg);
+
+/* Load reg from the janus thread-local storage when the TLS register is not available */
+static void
+insert_load_local_field(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local,
+                        int offset, reg_id_t reg);
+
+#ifdef JANUS_SHARED_CC
+/* Generate the code that moves a thread to its next chunk */
+static void generate_thread_doacross_code(void *drcontext, loop_t *loop);
+
+/* Publish the finished chunk at the loop exit and start the next chunk of the thread */
+static void insert_doacross_next_chunk(EMIT_CONTEXT);
+#endif
+#endif
+
+int64_t
+loop_thread_block(loop_t *loop, int64_t iterations)
+{
+    int64_t granularity = LOOP_BLOCK_GRANULARITY(loop);
+    return iterations / rsched_info.number_of_threads / granularity * granularity;
+}
 
-/* This function is called by all the threads (except the main thread) */
 void
-janus_generate_loop_code(void *drcontext, void *tls)
+loop_doacross_init(loop_t *loop)
 {
-    int i;
-    janus_thread_t *local = (janus_thread_t *)tls;
-    int tid = local->id;
-    RSchedHeader *header = rsched_info.header;
-    RSLoopHeader *loop_header = rsched_info.loop_header;
-    /* Step 1:
-     * Wait for the main thread to update the loop structure */
-    while (!shared->loops);
-    loop_t *loops = shared->loops;
+    JVarProfile *iterator = NULL;
+    int64_t distance = loop->header->dependenceDistance;
+    int64_t nthreads = rsched_info.number_of_threads;
+    int64_t bound, iterations, chunk;
+    int i, checks = 0;
+
+    loop->doacross_chunks = 0;
+#if defined(JANUS_X86) && defined(JANUS_SHARED_CC)
+    for (i=0; i<loop->var_count; i++) {
+        JVarProfile *profile = loop->variables + i;
+        if (profile->type == INDUCTION_PROFILE &&
+            profile->induction.check.type != JVAR_UNKOWN) {
+            iterator = profile;
+            checks++;
+        }
+    }
 
-    if (tid == shared->warden_thread) {
-        /* Step 2: for warden thread, generate the shared code for each loop */
-        for (i=0; i<header->numLoops; i++) {
-            /* Generate shared_code for this loop */
-            generate_shared_loop_code(drcontext, &loops[i]);
+    if (checks == 1 && (distance > 0 || loop->schedule == PARA_SPEC_CYCLIC_CHUNK) &&
+        iterator->induction.init.type == JVAR_CONSTANT &&
+        iterator->induction.stride.type == JVAR_CONSTANT &&
+        iterator->induction.check.type == JVAR_CONSTANT &&
+        iterator->induction.stride.value != 0) {
+        int64_t init = iterator->induction.init.value;
+        int64_t stride = iterator->induction.stride.value;
+        //JAN-41, the static analysis outputs a check value one stride less than the cmp operand
+        bound = iterator->induction.check.value + stride;
+        iterations = (bound - init) / stride;
+
+        if (loop->schedule == PARA_SPEC_CYCLIC_CHUNK) {
+            /* A speculative chunk is one transaction, it starts without waiting
+             * and the commits order the chunks */
+            chunk = SPEC_CHUNK_SIZE;
+            distance = chunk * nthreads;
+        } else {
+            /* Chunks small enough to keep all threads busy within the distance,
+             * but not so small that the chunk switch dominates */
+            chunk = distance / nthreads;
+            if (chunk < DOACROSS_MIN_CHUNK)
+                chunk = (distance < DOACROSS_MIN_CHUNK) ? distance : DOACROSS_MIN_CHUNK;
+        }
 
-            //mark the shared loop code is ready
-            shared->code_ready = 1;
+        /* Every thread needs a chunk, the boundaries are 32-bit immediates in the loop code */
+        if (iterations >= chunk * nthreads &&
+            bound == (int32_t)bound &&
+            init + chunk * stride * nthreads == (int32_t)(init + chunk * stride * nthreads)) {
+            loop->doacross_chunk = chunk;
+            loop->doacross_lag = distance / chunk;
+            loop->doacross_chunks = (iterations + chunk - 1) / chunk;
+            loop->doacross_last_tid = (loop->doacross_chunks - 1) % nthreads;
         }
     }
+#endif
+
+    /* Otherwise the loop is run sequentially */
+    if (!loop->doacross_chunks)
+        loop->serial = 1;
+#ifdef JANUS_VERBOSE
+    if (loop->doacross_chunks && loop->schedule == PARA_SPEC_CYCLIC_CHUNK)
+        dr_printf("loop %d speculative: %ld chunks of %ld iterations\n",
+                  loop->static_id, loop->doacross_chunks, loop->doacross_chunk);
+    else if (loop->doacross_chunks)
+        dr_printf("loop %d DOACROSS distance %ld: %ld chunks of %ld iterations, %ld chunks ahead\n",
+                  loop->static_id, distance, loop->doacross_chunks, loop->doacross_chunk, loop->doacross_lag);
+    else
+        dr_printf("loop %d chunks not supported, run sequentially\n", loop->static_id);
+#endif
+}
 
-    //all the janus threads simply generate the code for itself for each loop
-    for (i=0; i<header->numLoops; i++) {
-        generate_thread_private_loop_code(drcontext, loops+i, tid);
+/* This function is called when a loop is first encountered,
+ * it generates the code of the loop for all the threads at once */
+void
+janus_generate_loop_code(void *drcontext, loop_t *loop)
+{
+    if (loop->code_ready) return;
+
+    dr_mutex_lock(shared->code_gen_lock);
+    /* The code may be generated by another thread while we are waiting */
+    if (!loop->code_ready) {
+#if defined(JANUS_X86) && defined(JANUS_SHARED_CC)
+        /* Pre-assembled code from the rewrite schedule only needs to be patched */
+        if (!janus_instantiate_loop_code(drcontext, loop)) {
+            /* Step 1: generate the shared code for this loop */
+            generate_shared_loop_code(drcontext, loop);
+
+            /* Step 2: generate the code shared by all threads for this loop */
+            generate_thread_shared_loop_code(drcontext, loop);
+        }
+        /* Step 3: the chunk switch is not part of the templates */
+        if (LOOP_CHUNK_SCHEDULED(loop))
+            generate_thread_doacross_code(drcontext, loop);
+#else
+        /* Step 1: generate the shared code for this loop */
+        generate_shared_loop_code(drcontext, loop);
+
+        /* Step 2: generate the private code of each thread for this loop */
+        int tid;
+        for (tid=0; tid<rsched_info.number_of_threads; tid++) {
+            generate_thread_private_loop_code(drcontext, loop, tid);
+        }
+#endif
+
+        //mark the loop code is ready
+        loop->code_ready = 1;
     }
+    dr_mutex_unlock(shared->code_gen_lock);
 }
 
 static void
@@ -55,13 +180,14 @@ generate_shared_loop_code(void *drcontext, loop_t *loop)
 
     /* Loop init procedure executed by the main thread */
     bb = build_loop_init_instrlist(drcontext, loop);
-    loop->loop_init = generate_runtime_code(drcontext, PAGE_SIZE, bb);
+    loop->loop_init = janus_encode_loop_code(drcontext, loop, TEMPLATE_LOOP_INIT, bb);
 
     /* Loop finish procedure for the main thread */
     bb = build_loop_finish_instrlist(drcontext, loop);
-    loop->loop_finish = generate_runtime_code(drcontext, PAGE_SIZE, bb);
+    loop->loop_finish = janus_encode_loop_code(drcontext, loop, TEMPLATE_LOOP_FINISH, bb);
 }
 
+#if !defined(JANUS_X86) || !defined(JANUS_SHARED_CC)
 static void
 generate_thread_private_loop_code(void *drcontext, loop_t *loop, int tid)
 {
@@ -76,6 +202,272 @@ generate_thread_private_loop_code(void *drcontext, loop_t *loop, int tid)
     bb = build_thread_loop_finish_instrlist(drcontext, loop, tid);
     oracle[tid]->gen_code[lid].thread_loop_finish = generate_runtime_code(drcontext, PAGE_SIZE, bb);
 }
+#endif
+
+#ifdef JANUS_X86
+static void
+generate_thread_shared_loop_code(void *drcontext, loop_t *loop)
+{
+    int lid = loop->dynamic_id;
+    int tid;
+    instrlist_t *bb = NULL;
+    void *thread_loop_init;
+    void *thread_loop_finish;
+
+    /* The thread id is loaded from [TLS, LOCAL_ID_OFFSET] at runtime */
+    bb = build_thread_loop_init_instrlist(drcontext, loop, JANUS_RUNTIME_TID);
+    thread_loop_init = janus_encode_loop_code(drcontext, loop, TEMPLATE_THREAD_LOOP_INIT, bb);
+
+    bb = build_thread_loop_finish_instrlist(drcontext, loop, JANUS_RUNTIME_TID);
+    thread_loop_finish = janus_encode_loop_code(drcontext, loop, TEMPLATE_THREAD_LOOP_FINISH, bb);
+
+    for (tid=0; tid<rsched_info.number_of_threads; tid++) {
+        oracle[tid]->gen_code[lid].thread_loop_init = thread_loop_init;
+        oracle[tid]->gen_code[lid].thread_loop_finish = thread_loop_finish;
+    }
+}
+
+#ifdef JANUS_SHARED_CC
+/* Entered from the loop exit with s2 and s3 saved in spill slot 2 and 3,
+ * resumes the application at the loop start */
+static instrlist_t *
+build_thread_loop_advance_instrlist(void *drcontext, loop_t *loop)
+{
+    instrlist_t *bb = instrlist_create(drcontext);
+
+    reg_id_t s0 = loop->header->scratchReg0;
+    reg_id_t s1 = loop->header->scratchReg1;
+    reg_id_t s2 = loop->header->scratchReg2;
+    reg_id_t s3 = loop->header->scratchReg3;
+
+    instr_t *trigger = INSTR_CREATE_jmp(drcontext, opnd_create_pc(dr_redirect_native_target(drcontext)));
+    APPEND(bb, trigger);
+
+    /* Step 1: move the loop boundary and the induction variables to the next chunk */
+    emit_doacross_next_chunk(emit_context);
+
+    /* Step 2: put the loop start into the redirect slot and restore s2, s3 */
+    INSERT(bb, trigger,
+        INSTR_CREATE_mov_imm(drcontext,
+                             opnd_create_reg(s3),
+                             OPND_CREATE_INTPTR(loop->start_addr)));
+    dr_save_reg(drcontext, bb, trigger, s3, SPILL_SLOT_REDIRECT_NATIVE_TGT);
+    dr_restore_reg(drcontext, bb, trigger, s2, SPILL_SLOT_2);
+    dr_restore_reg(drcontext, bb, trigger, s3, SPILL_SLOT_3);
+    return bb;
+}
+
+static void
+generate_thread_doacross_code(void *drcontext, loop_t *loop)
+{
+    int tid;
+    instrlist_t *bb = build_thread_loop_advance_instrlist(drcontext, loop);
+    void *thread_loop_advance = generate_runtime_code(drcontext, PAGE_SIZE, bb);
+
+    for (tid=0; tid<rsched_info.number_of_threads; tid++)
+        oracle[tid]->gen_code[loop->dynamic_id].thread_loop_advance = thread_loop_advance;
+}
+
+/* Slow path of the DOACROSS waits, returns when at least target chunks are finished.
+ * The count is published without a fence, so a thread may miss the wake up
+ * and the sleep is bounded by a timeout */
+static void
+loop_doacross_wait(int64_t target)
+{
+    struct timespec timeout = {0, DOACROSS_SLEEP_NS};
+    uint64_t done;
+    int i;
+
+    for (i=0; i<DOACROSS_SPIN_COUNT; i++) {
+        if ((int64_t)shared->doacross_done >= target) return;
+        __asm__ volatile("pause");
+    }
+
+    while (1) {
+        done = shared->doacross_done;
+        if ((int64_t)done >= target) return;
+        __sync_fetch_and_add(&shared->doacross_waiters, 1);
+        /* The futex word is the lower half of the count */
+        syscall(SYS_futex, (uint32_t *)&shared->doacross_done, FUTEX_WAIT_PRIVATE,
+                (uint32_t)done, &timeout, NULL, 0);
+        __sync_fetch_and_sub(&shared->doacross_waiters, 1);
+    }
+}
+
+static void
+loop_doacross_wake(void)
+{
+    syscall(SYS_futex, (uint32_t *)&shared->doacross_done, FUTEX_WAKE_PRIVATE,
+            INT_MAX, NULL, NULL, 0);
+}
+
+static void
+insert_doacross_next_chunk(EMIT_CONTEXT)
+{
+    instr_t *publishLabel = INSTR_CREATE_label(drcontext);
+    instr_t *publishWaitLabel = INSTR_CREATE_label(drcontext);
+    instr_t *wakeLabel = INSTR_CREATE_label(drcontext);
+    instr_t *nextLabel = INSTR_CREATE_label(drcontext);
+    instr_t *dependWaitLabel = INSTR_CREATE_label(drcontext);
+    instr_t *startLabel = INSTR_CREATE_label(drcontext);
+    instr_t *lastLabel = INSTR_CREATE_label(drcontext);
+    int offset = sizeof(loop_code_t)*loop->dynamic_id + offsetof(loop_code_t, thread_loop_advance);
+
+    dr_save_reg(drcontext, bb, trigger, s3, SPILL_SLOT_3);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(s3),
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHUNK_OFFSET)));
+
+    /* Step 1: chunks are published in order, wait for the earlier chunks */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_rel_addr((void *)&(shared->doacross_done), OPSZ_8),
+                         opnd_create_reg(s3)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_jl, opnd_create_instr(publishWaitLabel)));
+    PRE_INSERT(bb, trigger, publishLabel);
+#ifdef JANUS_JITSTM
+    /* A speculative chunk is the oldest now, its transaction is committed or
+     * executed again before the chunk is published */
+    if (loop->header->speculative)
+        dr_insert_clean_call(drcontext, bb, trigger,
+                             janus_transaction_serialise, true, 0);
+#endif
+    /* One store publishes all iterations of the chunk */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_add(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(1)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            opnd_create_rel_addr((void *)&(shared->doacross_done), OPSZ_8),
+                            opnd_create_reg(s3)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_rel_addr((void *)&(shared->doacross_waiters), OPSZ_4),
+                         OPND_CREATE_INT32(0)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_jnz, opnd_create_instr(wakeLabel)));
+    PRE_INSERT(bb, trigger, nextLabel);
+
+    /* Step 2: the next chunk of this thread, s3 = chunk + 1 */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_add(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(rsched_info.number_of_threads - 1)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_reg(s3),
+                         OPND_CREATE_INT32(loop->doacross_chunks)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_jge, opnd_create_instr(lastLabel)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(TLS, LOCAL_CHUNK_OFFSET),
+                            opnd_create_reg(s3)));
+
+    /* Step 3: wait for the chunks within the dependence distance */
+    if (loop->doacross_lag > 1)
+        PRE_INSERT(bb, trigger,
+            INSTR_CREATE_sub(drcontext,
+                             opnd_create_reg(s3),
+                             OPND_CREATE_INT32(loop->doacross_lag - 1)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_rel_addr((void *)&(shared->doacross_done), OPSZ_8),
+                         opnd_create_reg(s3)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jcc(drcontext, OP_jl, opnd_create_instr(dependWaitLabel)));
+    PRE_INSERT(bb, trigger, startLabel);
+
+    /* Step 4: the advance code updates the variables and restores s2, s3 */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(s2),
+                            OPND_CREATE_MEM64(TLS, LOCAL_GEN_CODE_OFFSET)));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp_ind(drcontext, OPND_CREATE_MEM64(s2, offset)));
+
+    /* Slow paths */
+    PRE_INSERT(bb, trigger, publishWaitLabel);
+    dr_insert_clean_call(drcontext, bb, trigger, loop_doacross_wait, false, 1,
+                         opnd_create_reg(s3));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(publishLabel)));
+
+    PRE_INSERT(bb, trigger, wakeLabel);
+    dr_insert_clean_call(drcontext, bb, trigger, loop_doacross_wake, false, 0);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(nextLabel)));
+
+    PRE_INSERT(bb, trigger, dependWaitLabel);
+    dr_insert_clean_call(drcontext, bb, trigger, loop_doacross_wait, false, 1,
+                         opnd_create_reg(s3));
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(startLabel)));
+
+    /* No chunk left, finish the loop */
+    PRE_INSERT(bb, trigger, lastLabel);
+    dr_restore_reg(drcontext, bb, trigger, s3, SPILL_SLOT_3);
+}
+#endif
+
+static void
+insert_load_local(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local, reg_id_t reg)
+{
+#ifdef JANUS_SHARED_CC
+    /* The translation is shared, read the DynamoRIO client TLS field at runtime */
+    dr_insert_read_tls_field(drcontext, bb, where, reg);
+#else
+    PRE_INSERT(bb, where,
+        INSTR_CREATE_mov_imm(drcontext,
+                             opnd_create_reg(reg),
+                             OPND_CREATE_INTPTR(local)));
+#endif
+}
+
+static void
+insert_store_local_field(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local,
+                         int offset, reg_id_t reg)
+{
+#ifdef JANUS_SHARED_CC
+    /* borrow a register to hold the TLS pointer */
+    reg_id_t tmp = (reg == DR_REG_RCX) ? DR_REG_RDX : DR_REG_RCX;
+
+    dr_save_reg(drcontext, bb, where, tmp, SPILL_SLOT_5);
+    dr_insert_read_tls_field(drcontext, bb, where, tmp);
+    PRE_INSERT(bb, where,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(tmp, offset),
+                            opnd_create_reg(reg)));
+    dr_restore_reg(drcontext, bb, where, tmp, SPILL_SLOT_5);
+#else
+    PRE_INSERT(bb, where,
+        INSTR_CREATE_mov_st(drcontext,
+                            opnd_create_rel_addr((void *)local + offset, OPSZ_8),
+                            opnd_create_reg(reg)));
+#endif
+}
+
+static void
+insert_load_local_field(void *drcontext, instrlist_t *bb, instr_t *where, janus_thread_t *local,
+                        int offset, reg_id_t reg)
+{
+#ifdef JANUS_SHARED_CC
+    dr_insert_read_tls_field(drcontext, bb, where, reg);
+    PRE_INSERT(bb, where,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(reg),
+                            OPND_CREATE_MEM64(reg, offset)));
+#else
+    PRE_INSERT(bb, where,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(reg),
+                            opnd_create_rel_addr((void *)local + offset, OPSZ_8)));
+#endif
+}
+#endif
 
 /* Initialise loop parallelisation
  * This handler is called by the main thread
@@ -97,14 +489,8 @@ void loop_init_handler(JANUS_CONTEXT)
     reg_id_t s1 = loop->header->scratchReg1;
     reg_id_t tls = s1;
 
-#ifdef SAFE_RUNTIME_CHECK
-    /* Switch to single-threaded mode if runtime check fails */
-    if (shared->runtime_check_fail)
-        ginfo.number_of_threads = 1;
-#endif
-
-    /* wait for the code to finish generation */
-    while (!shared->code_ready);
+    /* JIT the loop code the first time this loop is met */
+    janus_generate_loop_code(drcontext, loop);
 
 #ifdef JANUS_X86
     //retrieve thread local storage
@@ -153,19 +539,10 @@ void loop_init_handler(JANUS_CONTEXT)
 
         //Now we need to save EFLAGS, which might get modified during the loop init code
         //So that when we return, the original conditional jump (jcc) swings the same original way
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_st(drcontext,
-                                opnd_create_rel_addr(&(local->spill_space.slot6), OPSZ_8),
-                                opnd_create_reg(DR_REG_RAX)));
+        insert_store_local_field(drcontext, bb, trigger, local, LOCAL_SLOT6_OFFSET, DR_REG_RAX);
         dr_save_arith_flags_to_xax(drcontext, bb, trigger);
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_st(drcontext,
-                                opnd_create_rel_addr(&(local->spill_space.slot7), OPSZ_8),
-                                opnd_create_reg(DR_REG_RAX)));
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_ld(drcontext,
-                                opnd_create_reg(DR_REG_RAX),
-                                opnd_create_rel_addr(&(local->spill_space.slot6), OPSZ_8)));
+        insert_store_local_field(drcontext, bb, trigger, local, LOCAL_SLOT7_OFFSET, DR_REG_RAX);
+        insert_load_local_field(drcontext, bb, trigger, local, LOCAL_SLOT6_OFFSET, DR_REG_RAX);
 
         mustRestoreEflags = true;
     }
@@ -188,10 +565,7 @@ void loop_init_handler(JANUS_CONTEXT)
 #endif
 
     /* spill s1 */
-    PRE_INSERT(bb, trigger,
-        INSTR_CREATE_mov_st(drcontext,
-                            opnd_create_rel_addr(&(local->spill_space.s1), OPSZ_8),
-                            opnd_create_reg(s1)));
+    insert_store_local_field(drcontext, bb, trigger, local, LOCAL_S1_OFFSET, s1);
 
     /* load current loop pointer into s1 */
     PRE_INSERT(bb, trigger,
@@ -206,10 +580,7 @@ void loop_init_handler(JANUS_CONTEXT)
                             opnd_create_reg(s1)));
 
     /* Load TLS into s1 (the value stays alive throughout the entire loop) */
-    PRE_INSERT(bb, trigger,
-        INSTR_CREATE_mov_imm(drcontext,
-                             opnd_create_reg(tls),
-                             OPND_CREATE_INTPTR(local)));
+    insert_load_local(drcontext, bb, trigger, local, tls);
     /* Spill s0 */
     PRE_INSERT(bb, trigger,
         INSTR_CREATE_mov_st(drcontext,
@@ -236,19 +607,10 @@ void loop_init_handler(JANUS_CONTEXT)
     if (mustRestoreEflags){
         //Now we restore EFLAGS so that the trigger jcc swings the same way
         //This is for the case where we jump into the loop via a JCC
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_st(drcontext,
-                                opnd_create_rel_addr(&(local->spill_space.slot6), OPSZ_8),
-                                opnd_create_reg(DR_REG_RAX)));
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_ld(drcontext,
-                                opnd_create_reg(DR_REG_RAX),
-                                opnd_create_rel_addr(&(local->spill_space.slot7), OPSZ_8)));
+        insert_store_local_field(drcontext, bb, trigger, local, LOCAL_SLOT6_OFFSET, DR_REG_RAX);
+        insert_load_local_field(drcontext, bb, trigger, local, LOCAL_SLOT7_OFFSET, DR_REG_RAX);
         dr_restore_arith_flags_from_xax(drcontext, bb, trigger);
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_ld(drcontext,
-                                opnd_create_reg(DR_REG_RAX),
-                                opnd_create_rel_addr(&(local->spill_space.slot6), OPSZ_8)));
+        insert_load_local_field(drcontext, bb, trigger, local, LOCAL_SLOT6_OFFSET, DR_REG_RAX);
     }
 #ifdef JANUS_LOOP_TIMER
     /* Start measuring the loop body without loop init */
@@ -318,7 +680,122 @@ void loop_finish_handler(JANUS_CONTEXT)
     reg_id_t s3 = loop->header->scratchReg3;
     reg_id_t tls = s1;
 
+    /* The loop exit may be translated before the loop init */
+    janus_generate_loop_code(drcontext, loop);
+
 #ifdef JANUS_X86
+# ifdef JANUS_SHARED_CC
+    instr_t *returnLabel = INSTR_CREATE_label(drcontext);
+    instr_t *skipLabel = INSTR_CREATE_label(drcontext);
+    instr_t *mainLabel = INSTR_CREATE_label(drcontext);
+    instr_t *endLabel = INSTR_CREATE_label(drcontext);
+    int offset;
+
+    /* The translation is shared by all threads, so the thread is only known at runtime.
+     * Check the loop_on flag of the current thread. If true then the scratch regs are available */
+    dr_save_reg(drcontext, bb, trigger, s2, SPILL_SLOT_2);
+    dr_insert_read_tls_field(drcontext, bb, trigger, s2);
+    PRE_INSERT(bb, trigger,
+       INSTR_CREATE_cmp(drcontext,
+                        OPND_CREATE_MEM32(s2, LOOP_ON_FLAG_OFFSET),
+                        OPND_CREATE_INT32(0)));
+    PRE_INSERT(bb, trigger,
+       INSTR_CREATE_jcc(drcontext, OP_jz, opnd_create_instr(skipLabel)));
+
+    /* loop is on so scratch registers are available */
+    /* a chunk scheduled thread continues with its next chunk if there is one */
+    if (LOOP_CHUNK_SCHEDULED(loop))
+        insert_doacross_next_chunk(emit_context);
+
+    /* check to see if this is the main thread */
+    PRE_INSERT(bb, trigger,
+       INSTR_CREATE_cmp(drcontext,
+                        OPND_CREATE_MEM64(s2, LOCAL_ID_OFFSET),
+                        OPND_CREATE_INT32(0)));
+    PRE_INSERT(bb, trigger,
+       INSTR_CREATE_jcc(drcontext, OP_jz, opnd_create_instr(mainLabel)));
+
+    /* for the parallelising thread (tid != 0), jump to the thread loop finish code */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(s2),
+                            OPND_CREATE_MEM64(s2, LOCAL_GEN_CODE_OFFSET)));
+    offset = sizeof(loop_code_t)*loop->dynamic_id + offsetof(loop_code_t, thread_loop_finish);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp_ind(drcontext, OPND_CREATE_MEM64(s2, offset)));
+
+    /* for main thread (tid = 0), jump here */
+    PRE_INSERT(bb, trigger, mainLabel);
+#  ifdef JANUS_LOOP_TIMER
+    dr_save_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
+    dr_save_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_rdtsc(drcontext));
+    dr_insert_clean_call(drcontext, bb, trigger,
+                         loop_inner_timer_pause, false, 2,
+                         opnd_create_reg(DR_REG_RAX),
+                         opnd_create_reg(DR_REG_RDX));
+    dr_restore_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
+    dr_restore_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
+#  endif /* JANUS_LOOP_TIMER */
+
+    /* Load the return address pc */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_imm(drcontext,
+                             opnd_create_reg(s0),
+                             opnd_create_instr(returnLabel)));
+    /* Store the return address into [tls, #return_addr] */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext,
+                            OPND_CREATE_MEM64(tls, LOCAL_RETURN_OFFSET),
+                            opnd_create_reg(s0)));
+    /* Jump to loop finish dynamic code*/
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext,
+                         opnd_create_pc(loop->loop_finish)));
+    /* Return here after loop finish */
+    PRE_INSERT(bb, trigger, returnLabel);
+
+    /* Restore the final TLS register */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(TLS),
+                            OPND_CREATE_MEM64(TLS, LOCAL_TLS_OFFSET)));
+
+#  ifdef JANUS_STATS
+    //increment invocation counter
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_inc(drcontext,
+                         opnd_create_rel_addr((void *)&(shared->loop_invocation), OPSZ_8)));
+#  endif
+
+#  ifdef JANUS_LOOP_TIMER
+    dr_save_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
+    dr_save_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_rdtsc(drcontext));
+    dr_insert_clean_call(drcontext, bb, trigger,
+                         loop_outer_timer_pause, false, 2,
+                         opnd_create_reg(DR_REG_RAX),
+                         opnd_create_reg(DR_REG_RDX));
+    dr_restore_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
+    dr_restore_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
+#  endif /* JANUS_LOOP_TIMER */
+
+#ifdef JANUS_DEBUG_LOOP_START_END
+    PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
+#endif
+    /* jump over s2 restore */
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_jmp(drcontext, opnd_create_instr(endLabel)));
+
+    /* if not loop_on */
+    PRE_INSERT(bb, trigger, skipLabel);
+    dr_restore_reg(drcontext, bb, trigger, s2, SPILL_SLOT_2);
+
+    /* endLabel allows main thread to jump over dr_restore_reg of s2 if loop_on is true */
+    PRE_INSERT(bb, trigger, endLabel);
+# else
     //for the main thread
     if (local->id == 0) {
 # ifdef JANUS_LOOP_TIMER
@@ -400,6 +877,7 @@ void loop_finish_handler(JANUS_CONTEXT)
             INSTR_CREATE_jmp(drcontext,
                              opnd_create_pc(local->gen_code[loop->dynamic_id].thread_loop_finish)));
     }
+# endif /* JANUS_SHARED_CC */
 #elif JANUS_AARCH64
     int offset;
     //PRE_INSERT(bb,trigger,instr_create_0dst_1src(drcontext, OP_brk, OPND_CREATE_INT16(0)));
@@ -666,12 +1144,20 @@ loop_update_boundary_handler(JANUS_CONTEXT)
     dr_printf("\n");
 #endif
 
-    janus_thread_t *local = dr_get_tls_field(drcontext);
-    int thread_id = local->id;
-    if (loop->schedule == PARA_DOALL_BLOCK)
+    if (LOOP_BLOCK_SCHEDULED(loop))
     {
+#ifdef JANUS_SHARED_CC
+        /* The translation is shared by all threads, so constant boundaries are not patched.
+         * Each thread computes its own boundary into [TLS, LOCAL_CHECK_OFFSET] in the loop init code */
+        bool patch_constant = false;
+        int thread_id = 0;
+#else
+        janus_thread_t *local = dr_get_tls_field(drcontext);
+        int thread_id = local->id;
+        bool patch_constant = true;
         if (thread_id == rsched_info.number_of_threads - 1)
             return; //For the last thread, keep the original loop boundary
+#endif
         int num_srcs = instr_num_srcs(trigger);
         DR_ASSERT_MSG(num_srcs == 2, "PARA_LOOP_UPDATE_BOUNDS on irregular cmp without exactly 2 operands!\n");
         int checkVarOpndIndex = 1 - inductionVarOpndIndex;
@@ -679,7 +1165,7 @@ loop_update_boundary_handler(JANUS_CONTEXT)
         if (profile.induction.check.type == JVAR_CONSTANT) {
             //we need to check the init value
             
-            if (profile.induction.init.type != JVAR_CONSTANT) {
+            if (profile.induction.init.type != JVAR_CONSTANT || !patch_constant) {
                 //non-constant induction initiation value means we won't modify the constant in the instruction
                 //change to [TLS, local_check]
 
@@ -724,7 +1210,7 @@ loop_update_boundary_handler(JANUS_CONTEXT)
                     //Note: this branch doesn't currently account for different calculations with JL or JG exit instructions
                     offset -= profile.induction.init.value; //Init is constant, so we calculate the new thread iteration limits right here
                     offset = offset / profile.induction.stride.value;
-                    offset = offset / rsched_info.number_of_threads;
+                    offset = loop_thread_block(loop, offset);
                     offset = offset * profile.induction.stride.value;
                     offset = (thread_id + 1) * offset;
                     offset += profile.induction.init.value;
@@ -875,6 +1361,13 @@ build_loop_init_instrlist(void *drcontext, loop_t *loop)
     /* Step 3: wait for all other threads to be ready in thread pool */
     emit_wait_threads_in_pool(emit_context);
 
+    /* Step 3.1: no chunk is finished yet */
+    if (LOOP_CHUNK_SCHEDULED(loop))
+        INSERT(bb, trigger,
+            INSTR_CREATE_mov_st(drcontext,
+                                opnd_create_rel_addr((void *)&(shared->doacross_done), OPSZ_8),
+                                OPND_CREATE_INT32(0)));
+
     /* Step 4: set start_run and schedule threads to execute the loop */
     emit_schedule_threads(emit_context);
 
@@ -892,7 +1385,7 @@ build_loop_init_instrlist(void *drcontext, loop_t *loop)
                                 OPND_CREATE_INT32(0)));
     }
 
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
 #ifdef JANUS_X86
         /* step 6: restore s2, s3. We don't use them for block parallelisation */
         INSERT(bb, trigger,
@@ -1078,7 +1571,7 @@ build_thread_loop_init_instrlist(void *drcontext, loop_t *loop, int tid)
                                 OPND_CREATE_INT32(0)));
     }
 #ifdef JANUS_X86
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
         /* restore s2, s3. We don't use them for block parallelisation */
         // We need to do this because on MEM_SCRATCH_REG we don't restore s2 or s3!
         INSERT(bb, trigger,
@@ -1193,24 +1686,35 @@ build_thread_loop_finish_instrlist(void *drcontext, loop_t *loop, int tid)
         /* Save the thread pool to the redirect slot */
         INSERT(bb, trigger,
             INSTR_CREATE_mov_imm(drcontext,
-                                 opnd_create_reg(DR_REG_RDI),
+                                 opnd_create_reg(s0),
                                  OPND_CREATE_INTPTR(janus_thread_pool_app)));
-        /* Put rsi into redirect slot */
-        dr_save_reg(drcontext, bb, trigger, DR_REG_RDI, SPILL_SLOT_REDIRECT_NATIVE_TGT);
+        /* Put s0 into redirect slot */
+        dr_save_reg(drcontext, bb, trigger, s0, SPILL_SLOT_REDIRECT_NATIVE_TGT);
 
         /* Assign argument */
-        INSERT(bb, trigger,
-            INSTR_CREATE_mov_imm(drcontext,
-                                 opnd_create_reg(DR_REG_RDI),
-                                 OPND_CREATE_INTPTR(oracle[tid])));
+        if (tid == JANUS_RUNTIME_TID) {
+            /* The TLS register holds the janus_thread_t of the current thread */
+            if (TLS != DR_REG_RDI)
+                INSERT(bb, trigger,
+                    INSTR_CREATE_mov_ld(drcontext,
+                                        opnd_create_reg(DR_REG_RDI),
+                                        opnd_create_reg(TLS)));
+        } else {
+            INSERT(bb, trigger,
+                INSTR_CREATE_mov_imm(drcontext,
+                                     opnd_create_reg(DR_REG_RDI),
+                                     OPND_CREATE_INTPTR(oracle[tid])));
+        }
         INSERT(bb, trigger,
             INSTR_CREATE_mov_imm(drcontext,
                                  opnd_create_reg(DR_REG_ESI),
                                  OPND_CREATE_INT32(1)));
         /* Load Stack Pointer */
-        /* Perform an indirect jump to thread pool */
+        /* Perform an indirect jump to thread pool
+         * With a shared code cache the redirect routine is shared by all threads */
         INSERT(bb, trigger,
-            INSTR_CREATE_jmp(drcontext, opnd_create_pc(dr_redirect_native_target(oracle[tid]->drcontext))));
+            INSTR_CREATE_jmp(drcontext, opnd_create_pc(dr_redirect_native_target(
+                (tid == JANUS_RUNTIME_TID) ? drcontext : oracle[tid]->drcontext))));
     }
     else
     {
@@ -1478,24 +1982,15 @@ loop_scratch_register_handler(JANUS_CONTEXT)
         }
 
         if (read_s0) {
-            PRE_INSERT(bb, trigger,
-                INSTR_CREATE_mov_ld(drcontext,
-                                    opnd_create_reg(s0),
-                                    opnd_create_rel_addr(&(local->spill_space.s0), OPSZ_8)));
+            insert_load_local_field(drcontext, bb, trigger, local, LOCAL_S0_OFFSET, s0);
         }
 
         if (write_s0) {
-            PRE_INSERT(bb, trigger_next,
-                INSTR_CREATE_mov_st(drcontext,
-                                    opnd_create_rel_addr(&(local->spill_space.s0), OPSZ_8),
-                                    opnd_create_reg(s0)));
+            insert_store_local_field(drcontext, bb, trigger_next, local, LOCAL_S0_OFFSET, s0);
         }
 
         if (write_tls) {
-            PRE_INSERT(bb, trigger_next,
-                INSTR_CREATE_mov_st(drcontext,
-                                    opnd_create_rel_addr(&(local->spill_space.s1), OPSZ_8),
-                                    opnd_create_reg(TLS)));
+            insert_store_local_field(drcontext, bb, trigger_next, local, LOCAL_S1_OFFSET, TLS);
         }
     }
 
@@ -1509,10 +2004,7 @@ loop_scratch_register_handler(JANUS_CONTEXT)
 
     if (read_tls || write_tls) {
         //restore TLS
-        PRE_INSERT(bb, trigger_next,
-            INSTR_CREATE_mov_imm(drcontext,
-                                 opnd_create_reg(TLS),
-                                 OPND_CREATE_INTPTR(local)));
+        insert_load_local(drcontext, bb, trigger_next, local, TLS);
     }
 #elif JANUS_AARCH64
 
@@ -1716,15 +2208,9 @@ scratch_register_spill_handler(JANUS_CONTEXT)
     //if the TLS needs to be spilled
     if (regMask & get_reg_bit_array(TLS)) {
         //immediately spill s1 after the trigger instruction
-        POST_INSERT(bb, trigger,
-            INSTR_CREATE_mov_st(drcontext,
-                                opnd_create_rel_addr(&(local->spill_space.s1), OPSZ_8),
-                                opnd_create_reg(TLS)));
+        insert_store_local_field(drcontext, bb, instr_get_next(trigger), local, LOCAL_S1_OFFSET, TLS);
         //recover TLS at last
-        PRE_INSERT(bb, trigger_next,
-            INSTR_CREATE_mov_imm(drcontext,
-                                 opnd_create_reg(TLS),
-                                 OPND_CREATE_INTPTR(local)));
+        insert_load_local(drcontext, bb, trigger_next, local, TLS);
 
     }
 
@@ -1736,10 +2222,7 @@ scratch_register_spill_handler(JANUS_CONTEXT)
                                     OPND_CREATE_MEM64(TLS, LOCAL_S0_OFFSET),
                                     opnd_create_reg(s0)));
         } else {
-            POST_INSERT(bb, trigger,
-                INSTR_CREATE_mov_st(drcontext,
-                                    opnd_create_rel_addr(&(local->spill_space.s0), OPSZ_8),
-                                    opnd_create_reg(s0)));
+            insert_store_local_field(drcontext, bb, instr_get_next(trigger), local, LOCAL_S0_OFFSET, s0);
         }
 
         //restore shared stack pointer
@@ -1749,7 +2232,7 @@ scratch_register_spill_handler(JANUS_CONTEXT)
                                 opnd_create_rel_addr(&(shared->stack_ptr), OPSZ_8)));
     }
 
-    if (loop->schedule != PARA_DOALL_BLOCK) {
+    if (!LOOP_BLOCK_SCHEDULED(loop)) {
         if (regMask & get_reg_bit_array(s2)) {
             PRE_INSERT(bb, trigger_next,
                 INSTR_CREATE_mov_st(drcontext,
@@ -1831,7 +2314,7 @@ scratch_register_spill_handler(JANUS_CONTEXT)
 
     }
 
-    if (loop->schedule != PARA_DOALL_BLOCK) {
+    if (!LOOP_BLOCK_SCHEDULED(loop)) {
         if (regMask & get_reg_bit_array(s2)) {
             PRE_INSERT(bb, trigger_next,
                 instr_create_1dst_1src(drcontext,
@@ -1883,10 +2366,7 @@ scratch_register_restore_handler(JANUS_CONTEXT)
                                 OPND_CREATE_MEM64(TLS, LOCAL_TLS_OFFSET)));
         //if it is not writing back to TLS
         if (!instr_writes_to_reg(trigger, s0, DR_QUERY_INCLUDE_ALL)) {
-            PRE_INSERT(bb, trigger_next,
-                INSTR_CREATE_mov_imm(drcontext,
-                                     opnd_create_reg(TLS),
-                                     OPND_CREATE_INTPTR(local)));
+            insert_load_local(drcontext, bb, trigger_next, local, TLS);
         }
 
         if (regMask & get_reg_bit_array(s0)) {
@@ -1894,11 +2374,8 @@ scratch_register_restore_handler(JANUS_CONTEXT)
                 //if the instruction reads s0, we could not use s0 to buffer shared stack pointer
                 DR_ASSERT_MSG(false, "s0 is pre-occupied");
             } else {
-                //load s0 using pc-relative load
-                PRE_INSERT(bb, trigger,
-                    INSTR_CREATE_mov_ld(drcontext,
-                                        opnd_create_reg(s0),
-                                        opnd_create_rel_addr(&(local->spill_space.s0), OPSZ_8)));
+                //load s0 without the TLS register
+                insert_load_local_field(drcontext, bb, trigger, local, LOCAL_S0_OFFSET, s0);
                 if (!instr_writes_to_reg(trigger, s0, DR_QUERY_INCLUDE_ALL)) {
                     PRE_INSERT(bb, trigger_next,
                         INSTR_CREATE_mov_ld(drcontext,
@@ -1908,18 +2385,12 @@ scratch_register_restore_handler(JANUS_CONTEXT)
             }
         }
 
-        if (loop->schedule != PARA_DOALL_BLOCK) {
+        if (!LOOP_BLOCK_SCHEDULED(loop)) {
             if (regMask & get_reg_bit_array(s2)) {
-                PRE_INSERT(bb, trigger,
-                    INSTR_CREATE_mov_ld(drcontext,
-                                        opnd_create_reg(s2),
-                                        opnd_create_rel_addr(&(local->spill_space.s2), OPSZ_8)));
+                insert_load_local_field(drcontext, bb, trigger, local, LOCAL_S2_OFFSET, s2);
             }
             if (regMask & get_reg_bit_array(s3)) {
-                PRE_INSERT(bb, trigger,
-                    INSTR_CREATE_mov_ld(drcontext,
-                                        opnd_create_reg(s3),
-                                        opnd_create_rel_addr(&(local->spill_space.s3), OPSZ_8)));
+                insert_load_local_field(drcontext, bb, trigger, local, LOCAL_S3_OFFSET, s3);
             }
         }
     } else {
@@ -1938,7 +2409,7 @@ scratch_register_restore_handler(JANUS_CONTEXT)
             }
         }
 
-        if (loop->schedule != PARA_DOALL_BLOCK) {
+        if (!LOOP_BLOCK_SCHEDULED(loop)) {
             if (regMask & get_reg_bit_array(s2)) {
                 PRE_INSERT(bb, trigger,
                     INSTR_CREATE_mov_ld(drcontext,
@@ -2005,7 +2476,7 @@ scratch_register_restore_handler(JANUS_CONTEXT)
         }
     }
 
-    if (loop->schedule != PARA_DOALL_BLOCK) {
+    if (!LOOP_BLOCK_SCHEDULED(loop)) {
         if (regMask & get_reg_bit_array(s2)) {
             PRE_INSERT(bb, trigger,
                 instr_create_1dst_1src(drcontext,
@@ -2194,7 +2665,7 @@ loop_subcall_start_handler(JANUS_CONTEXT)
 
     /* Recover all scratch registers before performing the function call */
 #ifdef JANUS_X86
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
         //PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
         /* For block based parallelisation, only restore s0 and s1 */
         /* Load s0 */
@@ -2212,7 +2683,7 @@ loop_subcall_start_handler(JANUS_CONTEXT)
         DR_ASSERT_MSG(false, "Subcall handler not yet implemented");
     }
 #elif JANUS_AARCH64
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
     /* For block based parallelisation, only restore s0 and s1 */
         if(s0 < DR_REG_X19) { // Since regs x19-x29 are guaranteed to be preserved by the subcall anyway
             /* Load s0 */
@@ -2277,20 +2748,14 @@ loop_subcall_finish_handler(JANUS_CONTEXT)
 
 #ifdef JANUS_X86
     janus_thread_t *local = dr_get_tls_field(drcontext);
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
         //PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
         /* For block based parallelisation, only restore s0 and s1 */
         /* spill s1 (tls) */
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_st(drcontext,
-                                opnd_create_rel_addr(&(local->spill_space.s1), OPSZ_8),
-                                opnd_create_reg(s1)));
+        insert_store_local_field(drcontext, bb, trigger, local, LOCAL_S1_OFFSET, s1);
 
         /* Mov tls value */
-        PRE_INSERT(bb, trigger,
-            INSTR_CREATE_mov_imm(drcontext,
-                                 opnd_create_reg(s1),
-                                 OPND_CREATE_INTPTR(local)));
+        insert_load_local(drcontext, bb, trigger, local, s1);
         /* spill s0 */
         PRE_INSERT(bb, trigger,
             INSTR_CREATE_mov_st(drcontext,
@@ -2306,7 +2771,7 @@ loop_subcall_finish_handler(JANUS_CONTEXT)
         DR_ASSERT_MSG(false, "Subcall handler not yet implemented");
     }
 #elif JANUS_AARCH64
-    if (loop->schedule == PARA_DOALL_BLOCK) {
+    if (LOOP_BLOCK_SCHEDULED(loop)) {
         // Spill registers (that may contain return values) to the TLS
         if (s1 < DR_REG_X19) { // Since regs x19-x29 are guaranteed to be preserved by the subcall anyway
             /* Spill s1 value to TLS (currently in x19) */
@@ -2636,8 +3101,26 @@ privatise_address_handler(JANUS_CONTEXT)
         if (opnd_get_addr(op) != (app_pc)rule->reg1) {
             dr_printf("Rule for absolute variables not match at runtime! %lx - %lx",opnd_get_addr(op),rule->reg1);
         }
-        /* create a new operand */
+#ifdef JANUS_SHARED_CC
+        /* The translation is shared, address the buffer through the TLS pointer
+         * in a register not used by the instruction */
+        reg_id_t tmp = DR_REG_RCX;
+        while (instr_uses_reg(trigger, tmp)) tmp++;
+        if (instr_is_cti(trigger)) {
+            dr_printf("Absolute address in control transfer not privatised %lx\n",rule->reg1);
+            return;
+        }
+        instr_t *next = INSTR_CREATE_label(drcontext);
+        POST_INSERT(bb, trigger, next);
+        dr_save_reg(drcontext, bb, trigger, tmp, SPILL_SLOT_5);
+        dr_insert_read_tls_field(drcontext, bb, trigger, tmp);
+        dr_restore_reg(drcontext, bb, next, tmp, SPILL_SLOT_5);
+        new_op = opnd_create_base_disp(tmp, DR_REG_NULL, 0,
+                                       LOCAL_BUFFER_OFFSET + rule->ureg0.down * sizeof(uint64_t), opnd_get_size(op));
+#else
+        janus_thread_t *local = dr_get_tls_field(drcontext);
         new_op = opnd_create_rel_addr((void *)&(local->buffer[rule->ureg0.down]), OPSZ_8);
+#endif
         if (srci != -1)
             instr_set_src(trigger, srci, new_op);
         if (dsti != -1)
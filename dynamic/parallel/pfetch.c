@@ -0,0 +1,116 @@
+#include "pfetch.h"
+#include "pfhandler.h"
+#include "control.h"
+#include "loop.h"
+
+/* Prefetch rules are placed in the channel of their loop (static loop id) */
+static loop_t *
+get_loop_from_channel(uint32_t channel)
+{
+    int i;
+    for (i=0; i<rsched_info.header->numLoops; i++) {
+        if (shared->loops[i].static_id == channel)
+            return &(shared->loops[i]);
+    }
+    return NULL;
+}
+
+/* Get the number of iterations each thread should prefetch ahead.
+ * With the block schedule every thread walks its own block of iterations,
+ * prefetching further than the block only brings in the next thread's data */
+static int64_t
+get_thread_prefetch_distance(loop_t *loop)
+{
+    int i;
+    int64_t distance = loop->header->prefetchDistance;
+
+    if (loop->schedule != PARA_DOALL_BLOCK) return distance;
+
+    for (i=0; i<loop->var_count; i++) {
+        JVarProfile *profile = loop->variables + i;
+        if (profile->type != INDUCTION_PROFILE) continue;
+
+        JVar init = profile->induction.init;
+        JVar stride = profile->induction.stride;
+        JVar check = profile->induction.check;
+
+        /* Only constant bounds give the block size at JIT time */
+        if (init.type != JVAR_CONSTANT ||
+            stride.type != JVAR_CONSTANT ||
+            check.type != JVAR_CONSTANT ||
+            stride.value == 0) continue;
+
+        int64_t block = ((check.value - init.value) / stride.value + 1) / rsched_info.number_of_threads;
+        if (block < 0) block = -block;
+        if (block < distance) distance = block;
+    }
+    return distance;
+}
+
+/* Scale a prefetch offset from the static distance to the per-thread distance */
+static int64_t
+scale_prefetch_offset(loop_t *loop, int64_t offset)
+{
+    int64_t distance = loop->header->prefetchDistance;
+    if (!distance) return offset;
+    return offset * get_thread_prefetch_distance(loop) / distance;
+}
+
+/* Find the displacement of the application memory operand that the prefetch is derived from */
+static bool
+get_original_displacement(instrlist_t *bb, JVar mem, int *disp)
+{
+    instr_t *instr;
+    int i;
+
+    for (instr = instrlist_first_app(bb); instr != NULL; instr = instr_get_next_app(instr)) {
+        for (i = 0; i < instr_num_srcs(instr); i++) {
+            opnd_t op = instr_get_src(instr, i);
+            if (!opnd_is_base_disp(op)) continue;
+            if (opnd_get_base(op) == mem.base &&
+                opnd_get_index(op) == mem.index &&
+                (mem.index == DR_REG_NULL || opnd_get_scale(op) == mem.scale)) {
+                *disp = opnd_get_disp(op);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+loop_prefetch_handler(JANUS_CONTEXT)
+{
+    loop_t *loop = get_loop_from_channel(rule->channel);
+    JVar mem = decode_jvar(rule);
+    RRule scaled = *rule;
+    int disp;
+
+    /* The iterator based prefetch is the original operand plus stride * distance */
+    if (loop && mem.type == JVAR_MEMORY &&
+        get_original_displacement(bb, mem, &disp)) {
+        mem.value = disp + scale_prefetch_offset(loop, mem.value - disp);
+        encode_jvar(mem, &scaled);
+    }
+
+    memory_prefetch_handler(drcontext, bb, &scaled, tag);
+}
+
+void
+loop_prefetch_update_handler(JANUS_CONTEXT)
+{
+    loop_t *loop = get_loop_from_channel(rule->channel);
+    RRule scaled = *rule;
+
+    /* reg1 holds stride * distance/2 */
+    if (loop)
+        scaled.reg1 = scale_prefetch_offset(loop, (int64_t)rule->reg1);
+
+    instr_update_clone_handler(drcontext, bb, &scaled, tag);
+}
+
+void
+loop_prefetch_clone_handler(JANUS_CONTEXT)
+{
+    instr_clone_handler(janus_context);
+}
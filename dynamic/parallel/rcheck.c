@@ -2,35 +2,258 @@
 #include "janus_api.h"
 #include "control.h"
 #include "emit.h"
+#include <stdlib.h>
 
+/* Address range [start, end) accessed by one array during the loop */
+typedef struct _array_interval {
+    uint64_t        start;
+    uint64_t        end;
+    uint64_t        written;
+} array_interval_t;
+
+typedef uint64_t rcheck_vec_t __attribute__ ((vector_size (4 * sizeof(uint64_t))));
+typedef int64_t rcheck_mask_t __attribute__ ((vector_size (4 * sizeof(int64_t))));
+
+#define RCHECK_LANES 4
+
+static loop_t *
+get_loop_from_channel(uint32_t channel)
+{
+    uint32_t i;
+    for (i=0; i<rsched_info.header->numLoops; i++) {
+        if ((uint32_t)shared->loops[i].static_id == channel)
+            return &(shared->loops[i]);
+    }
+    return NULL;
+}
+
+/* Value of a register at the check, other variables are not read */
+static bool
+get_variable_value(dr_mcontext_t *mc, JVar var, int64_t *value)
+{
+    if (var.type == JVAR_CONSTANT) {
+        *value = var.value;
+        return true;
+    }
+    if (var.type != JVAR_REGISTER) return false;
+
+    reg_id_t reg = (reg_id_t)var.value;
+    reg_t raw = reg_get_value(reg, mc);
+    *value = (reg_get_size(reg) == OPSZ_4) ? (int64_t)(int32_t)raw : (int64_t)raw;
+    return true;
+}
+
+/* Bytes the array moves during the iterations counted at loop entry */
+static bool
+get_array_span(dr_mcontext_t *mc, Array *array, int64_t *span)
+{
+    int64_t trip = array->span_const;
+    int64_t last, term, value;
+    int i;
+
+    for (i=0; i<2; i++) {
+        if (!array->span_coeff[i]) continue;
+        if (!get_variable_value(mc, array->span_var[i], &value)) return false;
+        if (__builtin_mul_overflow(array->span_coeff[i], value, &term)) return false;
+        if (__builtin_add_overflow(trip, term, &trip)) return false;
+    }
+    /* the loop runs trip / step + 1 times, a negative count is not bounded */
+    last = trip / array->span_step;
+    if (last < 0) return false;
+    return !__builtin_mul_overflow(array->stride, last, span);
+}
+
+/* Collect the runtime ranges of all arrays of the loop.
+ * Returns false if any range can't be bounded, the loop then runs sequentially */
+static bool
+get_array_intervals(loop_t *loop, dr_mcontext_t *mc, array_interval_t *intervals, int *count)
+{
+    int i, n = 0;
+
+    for (i=0; i<loop->var_count; i++) {
+        JVarProfile *profile = loop->variables + i;
+        if (profile->type != ARRAY_PROFILE) continue;
+
+        Array *array = &profile->array;
+        int64_t span = 0;
+        if (array->unknown) return false;
+        if (array->stride && !get_array_span(mc, array, &span)) return false;
+
+        uint64_t base = array->runtime_base_value;
+        /* a negative span means the array is walked downwards */
+        intervals[n].start = base + array->low + (span < 0 ? span : 0);
+        intervals[n].end = base + array->high + (span > 0 ? span : 0);
+        intervals[n].written = array->written ? ~0ULL : 0;
+#ifdef JANUS_VERBOSE
+        dr_printf("loop %d array %d [%lx, %lx) %s\n", loop->static_id, n,
+                  intervals[n].start, intervals[n].end, array->written ? "written" : "read");
+#endif
+        n++;
+    }
+    *count = n;
+    return true;
+}
+
+/* Pairwise overlap test, each array is compared with RCHECK_LANES arrays at once */
+static uint32_t
+arrays_overlap_simd(array_interval_t *intervals, int n)
+{
+    int i, j, k;
+    int padded = (n + RCHECK_LANES - 1) / RCHECK_LANES * RCHECK_LANES;
+    uint64_t starts[RCHECK_SIMD_MAX_ARRAYS + RCHECK_LANES] __attribute__ ((aligned (32)));
+    uint64_t ends[RCHECK_SIMD_MAX_ARRAYS + RCHECK_LANES] __attribute__ ((aligned (32)));
+    uint64_t written[RCHECK_SIMD_MAX_ARRAYS + RCHECK_LANES] __attribute__ ((aligned (32)));
+
+    /* padding lanes are empty ranges which never overlap */
+    for (i=0; i<padded; i++) {
+        starts[i] = (i < n) ? intervals[i].start : 0;
+        ends[i] = (i < n) ? intervals[i].end : 0;
+        written[i] = (i < n) ? intervals[i].written : 0;
+    }
+
+    for (i=0; i<n; i++) {
+        rcheck_vec_t si = {starts[i], starts[i], starts[i], starts[i]};
+        rcheck_vec_t ei = {ends[i], ends[i], ends[i], ends[i]};
+        rcheck_vec_t wi = {written[i], written[i], written[i], written[i]};
+        if (starts[i] == ends[i]) continue;
+
+        /* only the arrays after i, the earlier pairs are already compared */
+        for (j=(i+1)/RCHECK_LANES*RCHECK_LANES; j<padded; j+=RCHECK_LANES) {
+            rcheck_vec_t sj = *(rcheck_vec_t *)(starts + j);
+            rcheck_vec_t ej = *(rcheck_vec_t *)(ends + j);
+            rcheck_vec_t wj = *(rcheck_vec_t *)(written + j);
+            rcheck_vec_t index = {j, j+1, j+2, j+3};
+            rcheck_vec_t self = {i, i, i, i};
+
+            rcheck_mask_t overlap = (si < ej) & (sj < ei) & (sj < ej) & (index > self) &
+                                    (rcheck_mask_t)(wi | wj);
+            for (k=0; k<RCHECK_LANES; k++)
+                if (overlap[k]) return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+compare_interval_start(const void *a, const void *b)
+{
+    uint64_t sa = ((array_interval_t *)a)->start;
+    uint64_t sb = ((array_interval_t *)b)->start;
+    return (sa > sb) - (sa < sb);
+}
+
+/* Sort the ranges by start address, a range overlaps an earlier one if it starts
+ * before the furthest end seen so far */
+static uint32_t
+arrays_overlap_sweep(array_interval_t *intervals, int n)
+{
+    int i;
+    uint64_t max_end = 0;
+    uint64_t max_written_end = 0;
+
+    qsort(intervals, n, sizeof(array_interval_t), compare_interval_start);
+
+    for (i=0; i<n; i++) {
+        array_interval_t *cur = intervals + i;
+        if (cur->start == cur->end) continue;
+        /* reads only conflict with writes */
+        if (cur->written) {
+            if (cur->start < max_end) return 1;
+            if (cur->end > max_written_end) max_written_end = cur->end;
+        } else if (cur->start < max_written_end) return 1;
+        if (cur->end > max_end) max_end = cur->end;
+    }
+    return 0;
+}
+
+/* Check all array ranges of the loop for this invocation.
+ * If the result needs the other version of the loop, the code of the loop is
+ * flushed and the block is executed again */
 static void
-dynamic_array_bound_check(uint64_t base1, uint64_t range1, uint64_t base2, uint64_t range2)
+dynamic_array_overlap_check(loop_t *loop, app_pc block_start)
 {
+    array_interval_t intervals[loop->var_count + 1];
+    uint32_t fail;
+    int n;
+
+    void *drcontext = dr_get_current_drcontext();
+    dr_mcontext_t mc;
+    mc.size = sizeof(mc);
+    mc.flags = DR_MC_ALL;
+    dr_get_mcontext(drcontext, &mc);
+
+    if (!get_array_intervals(loop, &mc, intervals, &n))
+        fail = 1;
+    else if (n <= RCHECK_SIMD_MAX_ARRAYS)
+        fail = arrays_overlap_simd(intervals, n);
+    else
+        fail = arrays_overlap_sweep(intervals, n);
+
+    loop->check_count++;
+    if (fail) loop->check_fail_count++;
+    loop->check_fail = fail;
+    /* a chunk scheduled loop without chunks always runs sequentially */
+    if (LOOP_CHUNK_SCHEDULED(loop) && !loop->doacross_chunks) fail = 1;
+
+    if (fail == loop->serial) return;
+
 #ifdef JANUS_VERBOSE
-    printf("base1 %lx range1 %lx, base2 %lx range2 %lx\n",base1,range1,base2,range2);
+    dr_printf("loop %d runtime check %s, switch to the %s version\n", loop->static_id,
+              fail ? "fails" : "passes", fail ? "sequential" : "parallel");
 #endif
-    if ((base1 < base2 && range1 < base2-base1) ||
-        (base1 > base2 && range2 < base1-base2)) {
-        shared->runtime_check_fail = 0;
-        return;
+    /* The code cache holds the other version, retranslate the loop */
+    loop->serial = fail;
+
+    dr_flush_region(loop->code_start, loop->code_end - loop->code_start);
+    /* The current fragment may be flushed, resume from the start of the block */
+    mc.pc = block_start;
+    dr_redirect_execution(&mc);
+}
+
+void
+loop_runtime_check_init(loop_t *loop, RRule *rules, uint32_t size)
+{
+    uint32_t i;
+    app_pc start = (app_pc)-1;
+    app_pc end = 0;
+
+    for (i=0; i<size; i++) {
+        app_pc block = (app_pc)rules[i].block_address;
+        if (block < start) start = block;
+        if (block + 1 > end) end = block + 1;
     }
+    if (start > end) start = end;
+
+    loop->code_start = start;
+    loop->code_end = end;
+    loop->check_fail = 0;
+    loop->serial = 0;
+    loop->check_count = 0;
+    loop->check_fail_count = 0;
+}
+
+bool
+loop_rule_disabled(RRule *rule)
+{
+    /* The runtime check itself always runs */
+    if (rule->opcode == MEM_BOUNDS_CHECK || rule->opcode == MEM_RECORD_BOUNDS)
+        return false;
 
-    printf("runtime check fails!\n");
-    shared->runtime_check_fail = 1;
+    loop_t *loop = get_loop_from_channel(rule->channel);
+    return loop && loop->serial;
 }
 
 void
 loop_array_bound_record_handler(JANUS_CONTEXT)
 {
-    int s0,s1,s2,s3;
     int varIndex = (int)rule->reg0;
-    //retrieve the current loop (loop id stored in rule reg0)
+    if (varIndex < 0) return;
+    //retrieve the current loop (loop id stored in rule reg1)
     loop_t *loop = &(shared->loops[rule->reg1]);
     JVarProfile profile = loop->variables[varIndex];
     if (profile.type != ARRAY_PROFILE) return;
 
     instr_t *trigger = get_trigger_instruction(bb,rule);
-    //PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
 
     JVar bound = profile.array.base;
 
@@ -47,48 +270,21 @@ loop_array_bound_record_handler(JANUS_CONTEXT)
 void
 loop_array_bound_check_handler(JANUS_CONTEXT)
 {
-    /* The loop array bound check is pairwise
-     * We take the input of two array bases and its recurrence form and
-     * perform runtime verification whether two ranges overlap
-     * If check fails, we flush the code cache and re-run the code sequentially
-    */
-    int varIndex1 = (int)rule->ureg0.up;
-    int varIndex2 = (int)rule->ureg0.down;
-    int s0,s1,s2,s3;
-    if (varIndex1 == -1 || varIndex2 == -1) return;
-
+    /* One check covers all arrays of the loop.
+     * The array bases are recorded by MEM_RECORD_BOUNDS when they are defined,
+     * the check runs at the start of the loop init block, or of the parent loop init
+     * block if the bases don't change in the parent loop.
+     * The result only applies to the current invocation of the loop.
+     * Ranges counted at loop entry read the loop bound registers here */
+#ifdef SAFE_RUNTIME_CHECK
     //retrieve loop profile
     loop_t *loop = &(shared->loops[rule->reg1]);
-
-    JVarProfile profile1 = loop->variables[varIndex1];
-    JVarProfile profile2 = loop->variables[varIndex2];
-
-    if (profile1.type != ARRAY_PROFILE || profile2.type != ARRAY_PROFILE) return;
-
     instr_t *trigger = get_trigger_instruction(bb,rule);
 
-#ifdef SAFE_RUNTIME_CHECK
-#ifdef SLOW_RUNTIME_CHECK
-    /* Insert the runtime check function call */
+    /* save_fpstate is required to redirect the execution */
     dr_insert_clean_call(drcontext, bb, trigger,
-                     dynamic_array_bound_check, false, 4,
-                     opnd_create_rel_addr(&(loop->variables[varIndex1].array.runtime_base_value), OPSZ_8),
-                     create_opnd(profile1.array.max_range),
-                     opnd_create_rel_addr(&(loop->variables[varIndex2].array.runtime_base_value), OPSZ_8),
-                     create_opnd(profile2.array.max_range));
-#else
-    dr_save_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
-    dr_save_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
-    dr_save_reg(drcontext, bb, trigger, DR_REG_RCX, SPILL_SLOT_3);
-    //PRE_INSERT(bb,trigger,INSTR_CREATE_int1(drcontext));
-    /* add max_range to base */
-    emit_move_janus_var(emit_context, reg_to_JVar(DR_REG_RAX), profile1.array.base, DR_REG_RCX);
-    emit_move_janus_var(emit_context, reg_to_JVar(DR_REG_RDX), profile2.array.base, DR_REG_RCX);
-    emit_add_janus_var(emit_context, reg_to_JVar(DR_REG_RAX), profile1.array.max_range, DR_REG_RCX, DR_REG_RCX);
-    emit_add_janus_var(emit_context, reg_to_JVar(DR_REG_RDX), profile2.array.max_range, DR_REG_RCX, DR_REG_RCX);
-    dr_restore_reg(drcontext, bb, trigger, DR_REG_RAX, SPILL_SLOT_1);
-    dr_restore_reg(drcontext, bb, trigger, DR_REG_RDX, SPILL_SLOT_2);
-    dr_restore_reg(drcontext, bb, trigger, DR_REG_RCX, SPILL_SLOT_3);
-#endif
+                         dynamic_array_overlap_check, true, 2,
+                         OPND_CREATE_INTPTR(loop),
+                         OPND_CREATE_INTPTR(rule->block_address));
 #endif
 }
@@ -1,7 +1,16 @@
 /* JANUS Transactional Memory
  *
  * It contains a C implementation of Janus STM
- * and also handlers to interact with rewrite rules */
+ * and also handlers to interact with rewrite rules
+ *
+ * Speculative loops are run in chunks of iterations, like DOACROSS loops, and
+ * each chunk is a transaction. A thread whose chunk is not the oldest runs it
+ * speculatively: every memory access of the loop body and of the external code it
+ * calls is redirected to a private copy of the word, recording the bytes read and
+ * the bytes to be written. At the end of the chunk the thread waits until all
+ * earlier chunks have committed, validates its read set by value and writes the
+ * write set back. If validation fails, the chunk is executed again directly by
+ * the thread, which is now the oldest, so no other thread is rolled back. */
 
 #include "stm.h"
 
@@ -14,294 +23,440 @@
 /* JANUS control library */
 #include "control.h"
 
+#include <signal.h>
+#include <stdlib.h>
+
 
 #define REG_IDX(reg) ((reg)-DR_REG_RAX)
 
 ///redirect all memory accesses of the basic block to thread speculative memory set
 static void
-basic_block_speculative_handler(void *drcontext, janus_thread_t *local, instrlist_t *bb);
-///Create a read entry in the transaction buffer
+basic_block_speculative_handler(void *drcontext, instrlist_t *bb);
+///Wait until the transaction is the oldest, then validate and commit it
+static bool
+transaction_end(janus_thread_t *tls);
+///Execute the failed transaction again from its start
 static void
-janus_spec_create_read_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr);
-///Create a write entry in the transaction buffer
+transaction_reexecute(janus_thread_t *tls);
+
+///Address range of the main module, only code outside it is redirected
+static app_pc main_module_start;
+static app_pc main_module_end;
+
+/* Write signatures of the commits and of the direct writes of the oldest thread.
+ * Only the oldest thread publishes, so the history is written in commit order.
+ * A transaction whose read signature misses all signatures published since it
+ * started has read no location written by another thread */
+static stm_sig_t commit_sigs[STM_SIG_HISTORY] __attribute__ ((aligned (CACHE_LINE_WIDTH)));
+static volatile uint64_t commit_count;
+
+///Transactions committed and executed again, only counted by the oldest thread
+static uint64_t commit_total;
+static uint64_t reexecute_total;
+
 static void
-janus_spec_create_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr, uint64_t data);
-///Create a read&write entry in the transaction buffer
-static void *
-janus_spec_create_read_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr);
-///Redirect a read entry to write entry
-static void *
-janus_spec_redirect_read_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr);
+janus_stm_report(void)
+{
+    dr_printf("STM: committed %ld, re-executed %ld\n", commit_total, reexecute_total);
+}
 
 void janus_thread_init_jitstm(void *tls)
 {
-    int i;
-
     jtx_t *tx = &(((janus_thread_t *)tls)->tx);
-    //allocate translation table and flush table
-    //we also need to initialise it with zero
-    tx->trans_table = (trans_t *)calloc(HASH_TABLE_SIZE, sizeof(trans_t));
-    tx->flush_table = (trans_t **)malloc(HASH_TABLE_SIZE * sizeof(trans_t *));
-    //allocate read and write sets
-    tx->read_set = (spec_item_t *)malloc(READ_SET_SIZE * sizeof(spec_item_t));
-    tx->write_set = (spec_item_t *)malloc(WRITE_SET_SIZE * sizeof(spec_item_t));
-    tx->rsptr = tx->read_set;
-    tx->wsptr = tx->write_set;
-
-#ifdef JITSTM_BOUND_CHECK
-    tx->read_set_end = &(tx->read_set[READ_SET_SIZE]);
-    tx->write_set_end = &(tx->write_set[WRITE_SET_SIZE]);;
-#endif
+    byte *arena;
+    size_t size = (READ_SET_SIZE + WRITE_SET_SIZE + WRITE_SET_LIMIT) * sizeof(spec_item_t) +
+                  (READ_SET_LIMIT + WRITE_SET_LIMIT) * sizeof(uint32_t);
+
+    //all sets of the thread are in one zeroed arena, the tables are page aligned
+    arena = dr_raw_mem_alloc(size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    tx->read_set = (spec_item_t *)arena;
+    arena += READ_SET_SIZE * sizeof(spec_item_t);
+    tx->write_set = (spec_item_t *)arena;
+    //the write back buffer follows the write set
+    arena += (WRITE_SET_SIZE + WRITE_SET_LIMIT) * sizeof(spec_item_t);
+    tx->read_log = (uint32_t *)arena;
+    arena += READ_SET_LIMIT * sizeof(uint32_t);
+    tx->write_log = (uint32_t *)arena;
+    tx->read_size = 0;
+    tx->write_size = 0;
+    tx->read_sig = 0;
+    tx->write_sig = 0;
 
     tx->tls = tls;
     //set threshold
     ((janus_thread_t *)tls)->spill_space.slot5 = 0x600000;
 }
 
-/* \brief Janus speculative read 64 bit - c version */
-uint64_t janus_spec_read(janus_thread_t *tls, uint64_t original_addr)
+void janus_stm_init(void)
 {
-    int key = HASH_GET_KEY(original_addr);
-#ifdef JANUS_STM_VERBOSE
-    printf("read %lx ",original_addr);
-    printf("key %d ", key);
-#endif
-    jtx_t *tx = &(tls->tx);
-    trans_t *entry = tx->trans_table + key;
-    while (entry->original_addr != original_addr) {
-        if (entry->original_addr == 0) {
-            janus_spec_create_read_entry(tx, entry, original_addr);
-            break;
-        } else {
-            entry++;
-            //wrap around
-            if (entry == tx->trans_table+HASH_TABLE_SIZE)
-                entry = tx->trans_table;
-        }
+    int i;
+    module_data_t *main_module = dr_get_main_module();
+
+    main_module_start = main_module->start;
+    main_module_end = main_module->end;
+    dr_free_module_data(main_module);
+
+    for (i=0; i<rsched_info.header->numLoops; i++) {
+        if (shared->loops[i].header->speculative)
+            shared->speculate_on = 1;
     }
-#ifdef JANUS_STM_VERBOSE
-    //now entry points to the indirect table
-    printf("data %lx\n", entry->redirect_addr->data);
-#endif
-    //put the returned data in slot4
-    tls->spill_space.slot4 = (uint64_t)entry->redirect_addr->data;
-    return entry->redirect_addr->data;
+
+    if (shared->speculate_on && getenv(STM_REPORT_ENV) != NULL)
+        dr_register_exit_event(janus_stm_report);
 }
 
 /* \brief Janus speculative read 64 bit - c version */
+uint64_t janus_spec_read(janus_thread_t *tls, uint64_t original_addr)
+{
+    return *(uint64_t *)janus_spec_redirect(tls, original_addr, sizeof(uint64_t),
+                                            STM_ACCESS_READ);
+}
+
+/* \brief Janus speculative write 64 bit - c version */
 void janus_spec_write(janus_thread_t *tls, uint64_t original_addr, uint64_t data)
 {
-    int key = HASH_GET_KEY(original_addr);
-#ifdef JANUS_STM_VERBOSE
-    printf("write %lx ",original_addr);
-    printf("key %d\n", key);
-#endif
+    *(uint64_t *)janus_spec_redirect(tls, original_addr, sizeof(uint64_t),
+                                     STM_ACCESS_WRITE) = data;
+}
 
-    jtx_t *tx = &(tls->tx);
-    trans_t *entry = tx->trans_table + key;
-    while (entry->original_addr != original_addr) {
-        if (entry->original_addr == 0) {
-            janus_spec_create_write_entry(tx, entry, original_addr, data);
-            break;
-        } else {
-            entry++;
-            //wrap around
-            if (entry == tx->trans_table+HASH_TABLE_SIZE)
-                entry = tx->trans_table;
-        }
+void *janus_spec_get_ptr(janus_thread_t *tls, uint64_t original_addr)
+{
+    return janus_spec_redirect(tls, original_addr, sizeof(uint64_t),
+                               STM_ACCESS_READ | STM_ACCESS_WRITE);
+}
+
+/* Find the slot of the word in the set, or the free slot to hold it */
+static inline spec_item_t *
+janus_spec_lookup(spec_item_t *set, uint32_t width, uint64_t word)
+{
+    uint32_t mask = (1 << width) - 1;
+    uint32_t key = STM_HASH(word, width);
+
+    while (set[key].addr != word && set[key].addr != 0)
+        key = (key + 1) & mask;
+    return set + key;
+}
+
+/* The bytes of the word covered by an access, 0xff for each byte */
+static inline uint64_t
+janus_spec_bytes(uint64_t offset, uint64_t size)
+{
+    if (size == sizeof(uint64_t)) return ~0ULL;
+    return ((1ULL << (size << 3)) - 1) << (offset << 3);
+}
+
+/* A full set or a fault on stale data ends the speculation,
+ * the access is then performed directly */
+static void *
+janus_spec_overflow(janus_thread_t *tls, uint64_t original_addr)
+{
+    if (!transaction_end(tls)) transaction_reexecute(tls);
+    tls->spill_space.slot4 = original_addr;
+    return (void *)original_addr;
+}
+
+/* Record the current value of the word in the read set and mark the bytes as read.
+ * Only the bytes read are validated, so writes to the rest of the word by
+ * other threads are no conflict */
+static spec_item_t *
+janus_spec_read_word(jtx_t *tx, uint64_t word, uint64_t bytes)
+{
+    spec_item_t *item = janus_spec_lookup(tx->read_set, READ_SET_WIDTH, word);
+
+    if (item->addr == 0) {
+        if (tx->read_size >= READ_SET_LIMIT ||
+            !dr_safe_read((void *)word, sizeof(uint64_t), &(item->data), NULL))
+            return NULL;
+        item->addr = word;
+        item->mask = 0;
+        tx->read_log[tx->read_size++] = item - tx->read_set;
+        tx->read_sig |= STM_SIG_BIT(word);
     }
-#ifdef JANUS_STM_VERBOSE
-    //now entry points to the indirect table
-    printf("data %lx\n", entry->redirect_addr->data);
-#endif
-    return;
+    item->mask |= bytes;
+    return item;
 }
 
-void *janus_spec_get_ptr(janus_thread_t *tls, uint64_t original_addr)
+void *janus_spec_redirect(janus_thread_t *tls, uint64_t original_addr, uint64_t size, uint64_t access)
 {
-    int key = HASH_GET_KEY(original_addr);
+    jtx_t *tx = &(tls->tx);
+    uint64_t word = original_addr & ~(uint64_t)(sizeof(uint64_t) - 1);
+    uint64_t offset = original_addr - word;
+    uint64_t bytes;
+    spec_item_t *item, *ritem;
+
 #ifdef JANUS_STM_VERBOSE
-    printf("read & write %lx ",original_addr);
-    printf("key %d\n", key);
+    printf("%s %lx %ld\n", (access & STM_ACCESS_WRITE) ? "write" : "read", original_addr, size);
 #endif
-    jtx_t *tx = &(tls->tx);
-    trans_t *entry = tx->trans_table + key;
-    while (entry->original_addr != original_addr) {
-        if (entry->original_addr == 0) {
-            janus_spec_create_read_write_entry(tx, entry, original_addr);
-            break;
-        } else {
-            entry++;
-            //wrap around
-            if (entry == tx->trans_table+HASH_TABLE_SIZE)
-                entry = tx->trans_table;
+    /* The code is shared with non-speculative execution */
+    if (!tls->flag_space.trans_on) {
+        //direct writes of the oldest thread are published for validation
+        if ((access & STM_ACCESS_WRITE) && tls->flag_space.loop_on)
+            tx->write_sig |= STM_SIG(original_addr, size);
+        tls->spill_space.slot4 = original_addr;
+        return (void *)original_addr;
+    }
+
+    /* The sets hold aligned words, an access across two words ends the speculation */
+    if (offset + size > sizeof(uint64_t))
+        return janus_spec_overflow(tls, original_addr);
+    bytes = janus_spec_bytes(offset, size);
+
+    if (!(access & STM_ACCESS_WRITE)) {
+        /* Most loads are of words not written by the transaction */
+        if (tx->write_sig & STM_SIG_BIT(word)) {
+            item = janus_spec_lookup(tx->write_set, WRITE_SET_WIDTH, word);
+            if (item->addr) goto merge;
         }
+        item = janus_spec_read_word(tx, word, bytes);
+        if (item == NULL)
+            return janus_spec_overflow(tls, original_addr);
+        goto redirect;
     }
-#ifdef JANUS_STM_VERBOSE
-    //now entry points to the indirect table
-    printf("addr %lx\n", entry->redirect_addr->data);
-#endif
-    tls->spill_space.slot4 = (uint64_t)entry->redirect_addr;
-    return entry->redirect_addr;
+
+    item = janus_spec_lookup(tx->write_set, WRITE_SET_WIDTH, word);
+    if (item->addr == 0) {
+        if (tx->write_size >= WRITE_SET_LIMIT)
+            return janus_spec_overflow(tls, original_addr);
+        //no byte is written yet, plain writes don't read the word
+        item->addr = word;
+        item->mask = 0;
+        tx->write_log[tx->write_size++] = item - tx->write_set;
+        tx->write_sig |= STM_SIG_BIT(word);
+    }
+
+merge:
+    /* Bytes read but not yet written by the transaction come from the read set */
+    if ((access & STM_ACCESS_READ) && (bytes & ~item->mask)) {
+        ritem = janus_spec_read_word(tx, word, bytes & ~item->mask);
+        if (ritem == NULL)
+            return janus_spec_overflow(tls, original_addr);
+        item->data = (item->data & item->mask) | (ritem->data & ~item->mask);
+    }
+    if (access & STM_ACCESS_WRITE)
+        item->mask |= bytes;
+
+redirect:
+    //the instrumented code loads the redirected address from slot4
+    tls->spill_space.slot4 = (uint64_t)((byte *)&(item->data) + offset);
+    return (byte *)&(item->data) + offset;
 }
 
+/* Each chunk of a speculative loop is a transaction, and the transactions commit
+ * in the order of the chunks, which is the sequential order of the iterations.
+ * shared->doacross_done holds the chunk that runs without speculation, its thread
+ * passes it on at the end of the chunk, see insert_doacross_next_chunk() */
+static inline bool
+transaction_is_oldest(janus_thread_t *tls)
+{
+    return shared->doacross_done == tls->chunk;
+}
 
 static void
-janus_spec_create_read_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr)
+transaction_wait_oldest(janus_thread_t *tls)
 {
-    entry->original_addr = original_addr;
-    //first copy the read value
-    spec_item_t *item = tx->rsptr;
-    item->addr = original_addr;
-    //fault might occur, jump to janus signal handler if fault occurs
-    item->data = *(uint64_t *)original_addr;
-    //assign pointer to read set
-    entry->redirect_addr = item;
-    entry->rw = 0;
-    //increment read pointer
-    tx->rsptr++;
-    //register in flush table
-    tx->flush_table[tx->trans_size] = entry;
-    //increment transaction size
-    tx->trans_size++;
-#ifdef JITSTM_BOUND_CHECK
-    if (tx->rsptr == tx->read_set_end) {
-        printf("Janus STM read set full\n");
-        exit(-1);
+    int spins = 0;
+
+    while (!transaction_is_oldest(tls)) {
+        if (++spins < STM_SPIN_LIMIT) {
+            __asm__ volatile("pause");
+        } else {
+            dr_thread_yield();
+            spins = 0;
+        }
     }
-#endif
 }
 
+/* Publish the write signature, only called by the oldest thread */
 static void
-janus_spec_create_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr, uint64_t data)
+transaction_publish(stm_sig_t sig)
 {
-    entry->original_addr = original_addr;
-    //first copy the read value
-    spec_item_t *item = tx->wsptr;
-    item->addr = original_addr;
-    //fault might occur, jump to janus signal handler if fault occurs
-    item->data = data;
-    //assign pointer to read set
-    entry->redirect_addr = item;
-    entry->rw = 1;
-    //increment write pointer
-    tx->wsptr++;
-    //register in flush table
-    tx->flush_table[tx->trans_size] = entry;
-    //increment transaction size
-    tx->trans_size++;
-#ifdef JITSTM_BOUND_CHECK
-    if (tx->wsptr == tx->write_set_end) {
-        printf("Janus STM write set full\n");
-        exit(-1);
-    }
-#endif
+    commit_sigs[commit_count % STM_SIG_HISTORY] = sig;
+    __sync_fetch_and_add(&commit_count, 1);
 }
 
-///Create a read&write entry in the transaction buffer
-static void *
-janus_spec_create_read_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr)
+/* True if no location read by the transaction can have been written since it started */
+static bool
+transaction_conflict_free(jtx_t *tx)
 {
-    entry->original_addr = original_addr;
-    //copy the read value
-    spec_item_t *ritem = tx->rsptr;
-    ritem->addr = original_addr;
-    ritem->data = *(uint64_t *)original_addr;
-    tx->rsptr++;
-
-    //copy the write value
-    spec_item_t *witem = tx->wsptr;
-    witem->addr = original_addr;
-    witem->data = ritem->data;
-    tx->wsptr++;
-    //assign pointer to write set
-    entry->redirect_addr = witem;
-    entry->rw = 1;
-    //register in flush table
-    tx->flush_table[tx->trans_size] = entry;
-    //increment transaction size
-    tx->trans_size++;
-#ifdef JITSTM_BOUND_CHECK
-    if (tx->rsptr == tx->read_set_end) {
-        printf("Janus STM read set full\n");
-        exit(-1);
-    }
-    if (tx->wsptr == tx->write_set_end) {
-        printf("Janus STM write set full\n");
-        exit(-1);
-    }
-#endif
+    uint64_t i, count = commit_count;
+
+    if (count - tx->start_commit > STM_SIG_HISTORY) return false;
+    for (i = tx->start_commit; i < count; i++)
+        if (commit_sigs[i % STM_SIG_HISTORY] & tx->read_sig) return false;
+    return true;
 }
 
-///Redirect a read entry to write entry
-static void *
-janus_spec_redirect_read_write_entry(jtx_t *tx, trans_t *entry, uint64_t original_addr)
+static int
+compare_spec_item(const void *a, const void *b)
 {
-    spec_item_t *witem = tx->wsptr;
-    witem->addr = original_addr;
-    witem->data = entry->redirect_addr->data;
-    tx->wsptr++;
-    entry->redirect_addr = witem;
-    entry->rw = 1;
+    uintptr_t addr_a = ((spec_item_t *)a)->addr;
+    uintptr_t addr_b = ((spec_item_t *)b)->addr;
+    return (addr_a > addr_b) - (addr_a < addr_b);
 }
 
-/* \brief validate the read set and commit the write set */
-void *janus_transaction_commit(janus_thread_t *tls)
+/* Write back the write set sorted by address, so the entries of the same cache
+ * line are written together while the next line is prefetched for writing.
+ * The write set is cleared on the way */
+static void
+janus_transaction_write_back(jtx_t *tx)
 {
-    /* Step 1: validation on the read set,
-     * if failed, abort the transaction */
-    spec_item_t *entry = tls->tx.read_set;
-    spec_item_t *end = tls->tx.rsptr;
+    spec_item_t *buffer = tx->write_set + WRITE_SET_SIZE;
+    spec_item_t *entry = buffer;
+    spec_item_t *end = buffer + tx->write_size;
+    spec_item_t *next;
+    uintptr_t line;
+    uint32_t i;
+
+    for (i=0; i<tx->write_size; i++) {
+        buffer[i] = tx->write_set[tx->write_log[i]];
+        tx->write_set[tx->write_log[i]].addr = 0;
+    }
+    tx->write_size = 0;
+
+    if (end - entry > 1)
+        qsort(entry, end - entry, sizeof(spec_item_t), compare_spec_item);
 
     while (entry != end) {
-        //compare the read set against the shared memory
-        if (entry->data != *(uint64_t *)entry->addr)
-            janus_transaction_abort(tls);
-        entry++;
+        line = entry->addr & ~(uintptr_t)(CACHE_LINE_WIDTH - 1);
+        for (next = entry; next != end; next++)
+            if ((next->addr & ~(uintptr_t)(CACHE_LINE_WIDTH - 1)) != line) break;
+        if (next != end)
+            __builtin_prefetch((void *)next->addr, 1);
+
+        for (; entry != next; entry++) {
+#if defined(GSTM_VERBOSE) && defined(GSTM_MEM_TRACE)
+            print_commit_memory(entry->addr, entry->data);
+#endif
+            //the bytes not written keep their value
+            if (entry->mask == ~0ULL)
+                *(uint64_t *)entry->addr = entry->data;
+            else
+                *(uint64_t *)entry->addr = (*(uint64_t *)entry->addr & ~entry->mask) |
+                                           (entry->data & entry->mask);
+        }
+    }
+}
+
+/* \brief validate the read set and commit the write set */
+bool janus_transaction_commit(janus_thread_t *tls)
+{
+    jtx_t *tx = &(tls->tx);
+    uint32_t i;
+
+    /* Step 1: validation on the read set by value,
+     * if any location changed, the transaction is discarded.
+     * The signatures published since the start rule out most conflicts at once */
+    if (!transaction_conflict_free(tx)) {
+        for (i=0; i<tx->read_size; i++) {
+            spec_item_t *entry = tx->read_set + tx->read_log[i];
+            //compare the bytes read against the shared memory
+            if ((entry->data ^ *(volatile uint64_t *)entry->addr) & entry->mask) {
+                janus_transaction_clear(tls);
+                return false;
+            }
+        }
     }
 
     /* Step 2: after all read items validated,
      * commit all writes to memory */
-    entry = tls->tx.write_set;
-    end = tls->tx.wsptr;
-
-    while (entry != end) {
-        //write the data to shared memory
-        *(uint64_t *)entry->addr = entry->data;
-        entry++;
+    if (tx->write_size) {
+        janus_transaction_write_back(tx);
+        transaction_publish(tx->write_sig);
     }
+    janus_transaction_clear(tls);
+    commit_total++;
+    return true;
 }
 
-/* \brief abort the current transaction and perform rollback */
-void *janus_transaction_abort(janus_thread_t *tls)
+/* \brief clear the current transaction */
+void janus_transaction_clear(janus_thread_t *tls)
 {
-    void (*rollback)(void *);
-    //flush the transaction based on the translation table
-    int i;
-    trans_t **flush_table = tls->tx.flush_table;
-    for (i=0; i<tls->tx.trans_size; i++) {
-        flush_table[i]->original_addr = 0;
-    }
-    //clear the read/write set
-    tls->tx.rsptr = tls->tx.read_set;
-    tls->tx.wsptr = tls->tx.write_set;
-    tls->tx.trans_size = 0;
-
-    //perform call to JIT code for transaction rollback
-    //assign function pointer
-    rollback = (void (*)(void *))tls->gen_code[shared->current_loop->dynamic_id].thread_loop_init;
-    //perform rollback
-    rollback(tls);
+    jtx_t *tx = &(tls->tx);
+    uint32_t i;
+
+    //only the used slots are freed
+    for (i=0; i<tx->read_size; i++)
+        tx->read_set[tx->read_log[i]].addr = 0;
+    for (i=0; i<tx->write_size; i++)
+        tx->write_set[tx->write_log[i]].addr = 0;
+    tx->read_size = 0;
+    tx->write_size = 0;
+    tx->read_sig = 0;
+    tx->write_sig = 0;
 }
 
-void master_dynamic_speculative_handlers(void *drcontext, instrlist_t *bb)
+static bool
+transaction_end(janus_thread_t *tls)
+{
+    tls->flag_space.trans_on = 0;
+    transaction_wait_oldest(tls);
+    return janus_transaction_commit(tls);
+}
+
+static void
+transaction_reexecute(janus_thread_t *tls)
+{
+    dr_mcontext_t mc = tls->tx.start_state;
+
+#ifdef JANUS_VERBOSE
+    dr_printf("thread %ld re-executes the transaction at %p\n", tls->id, mc.pc);
+#endif
+    tls->flag_space.rolledback = 1;
+    reexecute_total++;
+    dr_redirect_execution(&mc);
+}
+
+/* Clean call at the start of each iteration, it starts the transaction of the chunk */
+static void
+janus_transaction_start(app_pc start_pc)
 {
+    void *drcontext = dr_get_current_drcontext();
     janus_thread_t *tls = dr_get_tls_field(drcontext);
 
-    if (tls->flag_space.trans_on) {
-        //redirect all memory accesses to speculative memory set
-        basic_block_speculative_handler(drcontext, tls, bb);
+    /* Outside the parallel loop, in a transaction or as the oldest chunk, the iteration runs directly */
+    if (!tls->flag_space.loop_on || tls->flag_space.trans_on ||
+        transaction_is_oldest(tls))
+        return;
+
+    tls->tx.start_state.size = sizeof(dr_mcontext_t);
+    tls->tx.start_state.flags = DR_MC_ALL;
+    dr_get_mcontext(drcontext, &(tls->tx.start_state));
+    tls->tx.start_state.pc = start_pc;
+    tls->tx.start_commit = commit_count;
+    tls->flag_space.rolledback = 0;
+    tls->flag_space.trans_on = 1;
+}
+
+void janus_transaction_serialise(void)
+{
+    janus_thread_t *tls = dr_get_tls_field(dr_get_current_drcontext());
+
+    if (tls->flag_space.trans_on && !transaction_end(tls))
+        transaction_reexecute(tls);
+
+    /* The chunk ran directly as the oldest, publish what it wrote */
+    if (tls->tx.write_sig) {
+        transaction_publish(tls->tx.write_sig);
+        tls->tx.write_sig = 0;
     }
+}
+
+void master_dynamic_speculative_handlers(void *drcontext, instrlist_t *bb)
+{
+    instr_t *first;
+
+    if (shared == NULL || !shared->speculate_on) return;
+
+    /* The loop body is redirected by speculative_loop_block_handler(), here the
+     * external code it calls. The translation is shared by all threads, so the blocks
+     * are always redirected and the redirection checks at runtime whether the
+     * thread is speculating */
+    first = instrlist_first_app(bb);
+    if (first == NULL) return;
+    if (instr_get_app_pc(first) >= main_module_start &&
+        instr_get_app_pc(first) < main_module_end) return;
+
+    basic_block_speculative_handler(drcontext, bb);
 
     //add other pure dynamic handlers here
 }
@@ -309,46 +464,30 @@ void master_dynamic_speculative_handlers(void *drcontext, instrlist_t *bb)
 ///start a transaction
 void transaction_start_handler(JANUS_CONTEXT)
 {
-    //retrieve thread local storage
-    janus_thread_t *local = dr_get_tls_field(drcontext);
     instr_t *trigger = get_trigger_instruction(bb,rule);
 
-    //set local.trans_on
-    PRE_INSERT(bb, trigger,
-        INSTR_CREATE_mov_st(drcontext,
-                            opnd_create_rel_addr((void *)(&local->flag_space.trans_on), OPSZ_4),
-                            OPND_CREATE_INT32(1)));
-
-    //save stack pointer for the transaction
-    PRE_INSERT(bb, trigger,
-        INSTR_CREATE_mov_st(drcontext,
-                            opnd_create_rel_addr((void *)(&local->spill_space.slot4), OPSZ_8),
-                            opnd_create_reg(DR_REG_RSP)));
+    /* save_fpstate is required to re-execute from the saved state */
+    dr_insert_clean_call(drcontext, bb, trigger,
+                         janus_transaction_start, true, 1,
+                         OPND_CREATE_INTPTR(rule->pc));
 }
 
-///finish a transaction but no commits
+///finish a transaction, it is committed in order
 void transaction_finish_handler(JANUS_CONTEXT)
 {
-    janus_thread_t *local = dr_get_tls_field(drcontext);
     instr_t *trigger = get_trigger_instruction(bb,rule);
 
-    //unset local.trans_on
-    PRE_INSERT(bb, trigger,
-        INSTR_CREATE_mov_st(drcontext,
-                            opnd_create_rel_addr((void *)(&local->flag_space.trans_on), OPSZ_4),
-                            OPND_CREATE_INT32(0)));
+    dr_insert_clean_call(drcontext, bb, trigger,
+                         janus_transaction_serialise, true, 0);
 }
 
 ///validate and commit a transaction
 void transaction_commit_handler(JANUS_CONTEXT)
 {
-    //retrieve thread local storage
-    janus_thread_t *local = dr_get_tls_field(drcontext);
     instr_t *trigger = get_trigger_instruction(bb,rule);
 #ifdef JANUS_SLOW_STM
     dr_insert_clean_call(drcontext, bb, trigger,
-                         janus_transaction_commit, false, 1,
-                         OPND_CREATE_INTPTR(local));
+                         janus_transaction_serialise, true, 0);
 #else
 #ifdef NOT_YET_WORKING_FOR_ALL
     transaction_inline_commit_handler(janus_context);
@@ -356,6 +495,7 @@ void transaction_commit_handler(JANUS_CONTEXT)
 #endif
 }
 
+
 static void
 count_opnd_reg_uses(int *reg_uses, opnd_t opnd)
 {
@@ -372,13 +512,14 @@ count_opnd_reg_uses(int *reg_uses, opnd_t opnd)
     }
 }
 
+/* The registers in the reserved mask, one bit for each REG_IDX, are never chosen */
 static void
-get_least_used_registers(void *drcontext, instrlist_t *bb, int *reg_uses, int *reg_index)
+get_least_used_registers(void *drcontext, instrlist_t *bb, int *reg_uses, int *reg_index, uint64_t reserved)
 {
     int i,j;
 
     for (i=0; i<NUM_OF_GENERAL_REGS; i++) {
-        reg_uses[i]=0;
+        reg_uses[i] = (reserved & (1ULL << i)) ? 65536 : 0;
         reg_index[i]=i+DR_REG_RAX;
     }
 
@@ -412,60 +553,47 @@ get_least_used_registers(void *drcontext, instrlist_t *bb, int *reg_uses, int *r
     }
 }
 
+static bool
+instr_need_speculative_transformation(instr_t *instr) {
+    int is_read = instr_reads_memory(instr);
+    int is_write = instr_writes_memory(instr);
+    int is_local_stack = instr_reads_from_reg(instr, DR_REG_RSP, DR_QUERY_INCLUDE_ALL);
+    //branches only read their targets from read-only memory (e.g. the GOT)
+    if (instr_is_cti(instr)) return false;
+    if (instr_is_app(instr) && !is_local_stack && (is_read || is_write)) return true;
+    return false;
+}
+
 static bool
 basic_block_need_speculative_transformation(void *drcontext, instrlist_t *bb)
 {
     instr_t *instr;
-    int count = 0;
-    bool branchHasMem = false;
     for (instr = instrlist_first_app(bb); instr != NULL; instr = instr_get_next_app(instr)) {
-        int is_read = instr_reads_memory(instr);
-        int is_write = instr_writes_memory(instr);
-        int is_local_stack = instr_reads_from_reg(instr, DR_REG_RSP, DR_QUERY_INCLUDE_ALL);
-        int opcode = instr_get_opcode(instr);
-        //skip compare and bulk loads/stores
-        if (opcode == OP_cmp || opcode == OP_test ||
-            opcode == OP_rep_stos || opcode == OP_rep_lods) continue;
-        if (instr_is_app(instr) && !is_local_stack && (is_read || is_write)) {
-            if (instr_is_cti(instr)) branchHasMem = true;
-            count++;
-        }
-
+        if (instr_need_speculative_transformation(instr)) return true;
     }
-    if (branchHasMem && count == 1) return false;
-    if (count) return true;
     return false;
 }
 
 static bool
-instr_need_speculative_transformation(instr_t *instr) {
-    int is_read = instr_reads_memory(instr);
-    int is_write = instr_writes_memory(instr);
-    int is_local_stack = instr_reads_from_reg(instr, DR_REG_RSP, DR_QUERY_INCLUDE_ALL);
-    int opcode = instr_get_opcode(instr);
-    //currently 16-byte accesses are not handled
-    //skip compare and bulk loads/stores
-    if (opcode == OP_cmp || opcode == OP_test ||
-        opcode == OP_rep_stos || opcode == OP_rep_lods) return false;
-    if (instr_is_app(instr) && !is_local_stack && (is_read || is_write)) return true;
+basic_block_has_syscall(instrlist_t *bb)
+{
+    instr_t *instr;
+    for (instr = instrlist_first_app(bb); instr != NULL; instr = instr_get_next_app(instr)) {
+        if (instr_is_syscall(instr) || instr_is_interrupt(instr)) return true;
+    }
     return false;
 }
 
 static void
-basic_block_speculative_handler(void *drcontext, janus_thread_t *local, instrlist_t *bb)
+basic_block_speculative_handler(void *drcontext, instrlist_t *bb)
 {
-    instr_t *instr;
+    instr_t *instr, *next;
     int reg_uses[NUM_OF_GENERAL_REGS];
     int reg_index[NUM_OF_GENERAL_REGS];
-    int s0,s1,s2,s3;
-    ptr_uint_t aflags ,aflags_temp;
-    bool aflags_on = false; 
-    bool mem_after_aflag = false;
+    reg_id_t tls_reg, ptr_reg;
 
     instr_t *first = instrlist_first_app(bb);
     instr_t *last = instrlist_last_app(bb);
-    instr_t *temp;
-    instr_t *aflags_restore = NULL;
 
     /* Step 0: Check the basic block whether it requires transformation or not */
     if (!basic_block_need_speculative_transformation(drcontext, bb)) {
@@ -473,286 +601,175 @@ basic_block_speculative_handler(void *drcontext, janus_thread_t *local, instrlis
     }
 
     /* Step 1: Perform dynamic register liveness analysis
-     * we can't use drreg because TLS is occupied by the Janus TLS */
-    get_least_used_registers(drcontext,bb,reg_uses,reg_index);
-    /* get four scratch registers */
-    s0 = reg_index[0];
-    s1 = reg_index[1];
-    s2 = reg_index[2];
-    s3 = reg_index[3];
-
-    //dr_printf("%s %s %s %s\n",get_register_name(s0),get_register_name(s1),get_register_name(s2),get_register_name(s3));
-
-    /* Step 2: save scratch registers to TLS */
-    PRE_INSERT(bb, first,
-        INSTR_CREATE_mov_st(drcontext,
-                            opnd_create_rel_addr((void *)(&local->spill_space.slot0), OPSZ_8),
-                            opnd_create_reg(s0)));
-
-    /* move local to s0 */
-    PRE_INSERT(bb, first,
-        INSTR_CREATE_mov_imm(drcontext,
-                             opnd_create_reg(s0),
-                             OPND_CREATE_INTPTR(local)));
-
-    PRE_INSERT(bb, first,
-        INSTR_CREATE_mov_st(drcontext,
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT1_OFFSET),
-                            opnd_create_reg(s1)));
-
-    PRE_INSERT(bb, first,
-        INSTR_CREATE_mov_st(drcontext,
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT2_OFFSET),
-                            opnd_create_reg(s2)));
-
-    PRE_INSERT(bb, first,
-        INSTR_CREATE_mov_st(drcontext,
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT3_OFFSET),
-                            opnd_create_reg(s3)));
-
-    /* Step 3: generate speculative calls */
-    for (instr = first; instr != NULL; instr = instr_get_next_app(instr)) {
-        if (instr_need_speculative_transformation(instr)) {
-#ifdef JANUS_SLOW_STM
-            speculative_memory_handler(drcontext, local, bb, instr, reg_index);
-#else
-            speculative_inline_memory_handler(drcontext, local, bb, instr);
-#endif
-        }
-
-        aflags = instr_get_arith_flags(instr, DR_QUERY_INCLUDE_COND_SRCS);
-
-        if (aflags & EFLAGS_WRITE_ARITH) {
-            aflags_on = true;
-            mem_after_aflag = false;
-            //for this aflag write, check whether there is a speculative memory access before consumption
-            temp = instr_get_next_app(instr);
-            while (temp) {
-                aflags_temp = instr_get_arith_flags(temp, DR_QUERY_INCLUDE_COND_SRCS);
+     * we can't use drreg because TLS is occupied by the Janus TLS.
+     * Two registers not used by the block hold the TLS and the redirected address */
+    get_least_used_registers(drcontext,bb,reg_uses,reg_index,0);
+
+    /* System calls can't be undone, and blocks without free registers can't be
+     * redirected. The transaction is committed before such blocks */
+    if (reg_uses[1] || basic_block_has_syscall(bb)) {
+        dr_insert_clean_call(drcontext, bb, first,
+                             janus_transaction_serialise, true, 0);
+        return;
+    }
+    tls_reg = reg_index[0];
+    ptr_reg = reg_index[1];
+
+    /* Step 2: save scratch registers, the spill slots are private to each thread */
+    dr_save_reg(drcontext, bb, first, tls_reg, STM_TLS_SLOT);
+    dr_save_reg(drcontext, bb, first, ptr_reg, STM_PTR_SLOT);
+    dr_insert_read_tls_field(drcontext, bb, first, tls_reg);
+
+    /* Step 3: redirect the memory accesses */
+    for (instr = first; instr != NULL; instr = next) {
+        next = instr_get_next_app(instr);
+        if (instr_need_speculative_transformation(instr))
+            speculative_memory_handler(drcontext, bb, instr, tls_reg, ptr_reg);
+    }
 
-                if (instr_need_speculative_transformation(temp))
-                    mem_after_aflag = true;
-                if (aflags_temp & EFLAGS_READ_ARITH) {
-                    aflags_restore = temp;
-                    break;
-                }
+    /* Step 4: restore, branches are never redirected */
+    if (!instr_is_cti(last)) {
+        instr_t *end = INSTR_CREATE_label(drcontext);
+        instrlist_meta_postinsert(bb, last, end);
+        last = end;
+    }
+    dr_restore_reg(drcontext, bb, last, tls_reg, STM_TLS_SLOT);
+    dr_restore_reg(drcontext, bb, last, ptr_reg, STM_PTR_SLOT);
+}
 
-                if (aflags_temp & EFLAGS_WRITE_ARITH)
-                    break;
+void speculative_loop_block_handler(void *drcontext, instrlist_t *bb, loop_t *loop)
+{
+    instr_t *instr, *next, *end;
+    int reg_uses[NUM_OF_GENERAL_REGS];
+    int reg_index[NUM_OF_GENERAL_REGS];
+    reg_id_t scratch[4] = {loop->header->scratchReg0, loop->header->scratchReg1,
+                           loop->header->scratchReg2, loop->header->scratchReg3};
+    uint64_t reserved = 0;
+    reg_id_t tls_reg, ptr_reg;
+    int i;
 
-                temp = instr_get_next_app(temp);
-            }
+    if (!basic_block_need_speculative_transformation(drcontext, bb)) return;
 
-            if (mem_after_aflag && aflags_restore) {
-                instr_t *next = instr_get_next_app(instr);
-                //PRE_INSERT(bb,instr,INSTR_CREATE_int1(drcontext));
-                if (s0 != DR_REG_RAX) {
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT6_OFFSET),
-                                            opnd_create_reg(DR_REG_RAX)));
-                    dr_save_arith_flags_to_xax(drcontext, bb, next);
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT7_OFFSET),
-                                            opnd_create_reg(DR_REG_RAX)));
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_ld(drcontext,
-                                            opnd_create_reg(DR_REG_RAX),
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT6_OFFSET)));
-
-                    //insert restore
-                    PRE_INSERT(bb, aflags_restore,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT6_OFFSET),
-                                            opnd_create_reg(DR_REG_RAX)));
-                    PRE_INSERT(bb, aflags_restore,
-                        INSTR_CREATE_mov_ld(drcontext,
-                                            opnd_create_reg(DR_REG_RAX),
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT7_OFFSET)));                    
-                    dr_restore_arith_flags_from_xax(drcontext, bb, aflags_restore);
-                    PRE_INSERT(bb, aflags_restore,
-                        INSTR_CREATE_mov_ld(drcontext,
-                                            opnd_create_reg(DR_REG_RAX),
-                                            OPND_CREATE_MEM64(s0, LOCAL_SLOT6_OFFSET)));
-                } else {
-                    //s0 is the same as RAX
-                    //move s0 to s1
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            opnd_create_reg(s1),
-                                            opnd_create_reg(s0)));
-                    dr_save_arith_flags_to_xax(drcontext, bb, next);
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            OPND_CREATE_MEM64(s1, LOCAL_SLOT7_OFFSET),
-                                            opnd_create_reg(DR_REG_RAX)));
-                    //move back
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            opnd_create_reg(s0),
-                                            opnd_create_reg(s1)));
-
-                    //insert restore
-                    PRE_INSERT(bb, aflags_restore,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            opnd_create_reg(s1),
-                                            opnd_create_reg(s0)));
-                    PRE_INSERT(bb, aflags_restore,
-                        INSTR_CREATE_mov_ld(drcontext,
-                                            opnd_create_reg(DR_REG_RAX),
-                                            OPND_CREATE_MEM64(s1, LOCAL_SLOT7_OFFSET)));                    
-                    dr_restore_arith_flags_from_xax(drcontext, bb, aflags_restore);
-                    //move back
-                    PRE_INSERT(bb, next,
-                        INSTR_CREATE_mov_st(drcontext,
-                                            opnd_create_reg(s0),
-                                            opnd_create_reg(s1)));
-                }
-            }
-        }
+    /* The scratch registers of the loop hold the Janus state in the loop body */
+    for (i=0; i<4; i++)
+        reserved |= 1ULL << REG_IDX(scratch[i]);
+    get_least_used_registers(drcontext,bb,reg_uses,reg_index,reserved);
 
-        //if (reg_uses[0] || reg_uses[1] || reg_uses[2] || reg_uses[3]) PRE_INSERT(bb,instr,INSTR_CREATE_int1(drcontext));
-        if (reg_uses[0] && instr_uses_reg(instr, s0)) {
-            PRE_INSERT(bb, instr,
-                INSTR_CREATE_mov_ld(drcontext,
-                                    opnd_create_reg(s0),
-                                    opnd_create_rel_addr((void *)(&local->spill_space.slot0), OPSZ_8)));
-            POST_INSERT(bb, instr,
-                INSTR_CREATE_mov_imm(drcontext,
-                                     opnd_create_reg(s0),
-                                     OPND_CREATE_INTPTR(local)));
-            POST_INSERT(bb, instr,
-                INSTR_CREATE_mov_st(drcontext,
-                                    opnd_create_rel_addr((void *)(&local->spill_space.slot0), OPSZ_8),
-                                    opnd_create_reg(s0)));
-        }
-        if (reg_uses[1] && instr_uses_reg(instr, s1)) {
-            PRE_INSERT(bb, instr,
-                INSTR_CREATE_mov_ld(drcontext,
-                                    opnd_create_reg(s1),
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT1_OFFSET)));
-            POST_INSERT(bb, instr,
-                INSTR_CREATE_mov_st(drcontext,
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT1_OFFSET),
-                                    opnd_create_reg(s1)));
-        }
-        if (reg_uses[2] && instr_uses_reg(instr, s2)) {
-            PRE_INSERT(bb, instr,
-                INSTR_CREATE_mov_ld(drcontext,
-                                    opnd_create_reg(s2),
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT2_OFFSET)));
-            POST_INSERT(bb, instr,
-                INSTR_CREATE_mov_st(drcontext,
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT2_OFFSET),
-                                    opnd_create_reg(s2)));
-        }
-        if (reg_uses[3] && instr_uses_reg(instr, s3)) {
-            PRE_INSERT(bb, instr,
-                INSTR_CREATE_mov_ld(drcontext,
-                                    opnd_create_reg(s3),
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT3_OFFSET)));
-            POST_INSERT(bb, instr,
-                INSTR_CREATE_mov_st(drcontext,
-                                    OPND_CREATE_MEM64(s0, LOCAL_SLOT3_OFFSET),
-                                    opnd_create_reg(s3)));
-        }
+    if (reg_uses[1] || basic_block_has_syscall(bb)) {
+        dr_insert_clean_call(drcontext, bb, instrlist_first_app(bb),
+                             janus_transaction_serialise, true, 0);
+        return;
     }
+    tls_reg = reg_index[0];
+    ptr_reg = reg_index[1];
+
+    /* The other rules of the block use the spill slots and the free registers in
+     * their own code, so each access saves and restores the registers itself */
+    for (instr = instrlist_first_app(bb); instr != NULL; instr = next) {
+        next = instr_get_next_app(instr);
+        if (!instr_need_speculative_transformation(instr)) continue;
+        //accesses to the Janus TLS through the scratch registers are private
+        for (i=0; i<4; i++)
+            if (instr_uses_reg(instr, scratch[i])) break;
+        if (i < 4) continue;
+
+        end = INSTR_CREATE_label(drcontext);
+        instrlist_meta_postinsert(bb, instr, end);
+        dr_save_reg(drcontext, bb, instr, tls_reg, STM_TLS_SLOT);
+        dr_save_reg(drcontext, bb, instr, ptr_reg, STM_PTR_SLOT);
+        dr_insert_read_tls_field(drcontext, bb, instr, tls_reg);
+        speculative_memory_handler(drcontext, bb, instr, tls_reg, ptr_reg);
+        dr_restore_reg(drcontext, bb, end, tls_reg, STM_TLS_SLOT);
+        dr_restore_reg(drcontext, bb, end, ptr_reg, STM_PTR_SLOT);
+    }
+}
 
-    /* Restore */
-    PRE_INSERT(bb, last,
-        INSTR_CREATE_mov_ld(drcontext,
-                            opnd_create_reg(s1),
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT1_OFFSET)));
-
-    PRE_INSERT(bb, last,
-        INSTR_CREATE_mov_ld(drcontext,
-                            opnd_create_reg(s2),
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT2_OFFSET)));
-
-    PRE_INSERT(bb, last,
-        INSTR_CREATE_mov_ld(drcontext,
-                            opnd_create_reg(s3),
-                            OPND_CREATE_MEM64(s0, LOCAL_SLOT3_OFFSET)));
-
-    PRE_INSERT(bb, last,
-        INSTR_CREATE_mov_ld(drcontext,
-                            opnd_create_reg(s0),
-                            opnd_create_rel_addr((void *)(&local->spill_space.slot0), OPSZ_8)));
+/* String operations access memory through implicit, repeated operands */
+static bool
+instr_is_string(instr_t *instr)
+{
+    switch (instr_get_opcode(instr)) {
+        case OP_ins: case OP_rep_ins:
+        case OP_outs: case OP_rep_outs:
+        case OP_movs: case OP_rep_movs:
+        case OP_stos: case OP_rep_stos:
+        case OP_lods: case OP_rep_lods:
+        case OP_cmps: case OP_rep_cmps: case OP_repne_cmps:
+        case OP_scas: case OP_rep_scas: case OP_repne_scas:
+        case OP_xlat:
+            return true;
+        default:
+            return false;
+    }
 }
 
 ///redirect the memory instruction to speculative read & write buffer, clean call version
-void speculative_memory_handler(void *drcontext, janus_thread_t *local, instrlist_t *bb, instr_t *instr, int *reg_index)
+void speculative_memory_handler(void *drcontext, instrlist_t *bb, instr_t *instr, reg_id_t tls_reg, reg_id_t ptr_reg)
 {
-    int i, dsti, srci;
-    int s0,s1,s2,s3;
-    opnd_size_t size;
-    instr_t *skipLabel = INSTR_CREATE_label(drcontext);
-
-    s0 = reg_index[0];
-    s1 = reg_index[1];
-    s2 = reg_index[2];
-    s3 = reg_index[3];
+    int i, count = 0;
+    opnd_t mem = opnd_create_null();
+    opnd_t op, redirect;
+    uint64_t size, access = 0;
 
 #ifdef JANUS_STM_VERBOSE
     instr_disassemble(drcontext, instr,STDOUT);
-    dr_printf(" %d\n",local->id);
+    dr_printf("\n");
 #endif
-    int is_read = instr_reads_memory(instr);
-    int is_write = instr_writes_memory(instr);
-    int opcode = instr_get_opcode(instr);
-    if (size > OPSZ_8) return;
-    opnd_t mem;
-
-    if (is_read) {
-        for (i = 0; i < instr_num_srcs(instr); i++) {
-            if (opnd_is_memory_reference(instr_get_src(instr, i))) break;
+    /* The same memory operand may be both a source and a destination */
+    for (i = 0; i < instr_num_srcs(instr); i++) {
+        op = instr_get_src(instr, i);
+        if (opnd_is_memory_reference(op) && (count == 0 || !opnd_same(op, mem))) {
+            mem = op;
+            count++;
         }
-        mem = instr_get_src(instr,i);
-        size = opnd_get_size(mem);
-        srci = i;
     }
-    if (is_write) {
-        for (i = 0; i < instr_num_dsts(instr); i++) {
-            if (opnd_is_memory_reference(instr_get_dst(instr, i))) break;
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        op = instr_get_dst(instr, i);
+        if (opnd_is_memory_reference(op) && (count == 0 || !opnd_same(op, mem))) {
+            mem = op;
+            count++;
         }
-        mem = instr_get_dst(instr,i);
-        size = opnd_get_size(mem);
-        dsti = i;
     }
 
-    load_effective_address(drcontext,bb,instr,mem,s1,s2);
-
-    //skip accesses beyond dynamic threshold
-    PRE_INSERT(bb, instr,
-       INSTR_CREATE_cmp(drcontext,
-                        opnd_create_reg(s1),
-                        OPND_CREATE_MEM64(s0, LOCAL_TX_THRESHOLD_BASE)));
-    PRE_INSERT(bb, instr,
-       INSTR_CREATE_jcc(drcontext, OP_jg, opnd_create_instr(skipLabel)));
-
-    if (is_read && !is_write) {
-        //read only
+    /* Only single accesses of up to 8 bytes are redirected, string operations,
+     * vector accesses, atomics and segment based accesses commit the transaction first */
+    size = opnd_size_in_bytes(opnd_get_size(mem));
+    if (count != 1 || size == 0 || size > sizeof(uint64_t) ||
+        opnd_is_far_base_disp(mem) || instr_get_prefix_flag(instr, PREFIX_LOCK) ||
+        instr_is_string(instr)) {
         dr_insert_clean_call(drcontext, bb, instr,
-                             janus_spec_read, false, 2,
-                             opnd_create_reg(s0),
-                             opnd_create_reg(s1));
-    } else if (!is_read && is_write) {
-        //write only
-        dr_insert_clean_call(drcontext, bb, instr,
-                             janus_spec_write, false, 3,
-                             opnd_create_reg(s0),
-                             opnd_create_reg(s1),
-                             opnd_create_reg(s2));
-    } else {
-        //read/write, or partial write
-        dr_insert_clean_call(drcontext, bb, instr,
-                             janus_spec_get_ptr, false, 3,
-                             opnd_create_reg(s0),
-                             opnd_create_reg(s1));
+                             janus_transaction_serialise, true, 0);
+        return;
     }
 
-    PRE_INSERT(bb, instr, skipLabel);
+    if (instr_reads_memory(instr)) access |= STM_ACCESS_READ;
+    if (instr_writes_memory(instr)) access |= STM_ACCESS_WRITE;
+
+    /* Step 1: compute the original address */
+    load_effective_address(drcontext, bb, instr, mem, ptr_reg, DR_REG_NULL);
+
+    /* Step 2: get the address of the speculative copy, it is returned in slot4 */
+    dr_insert_clean_call(drcontext, bb, instr,
+                         janus_spec_redirect, true, 4,
+                         opnd_create_reg(tls_reg),
+                         opnd_create_reg(ptr_reg),
+                         OPND_CREATE_INT32(size),
+                         OPND_CREATE_INT32(access));
+    PRE_INSERT(bb, instr,
+        INSTR_CREATE_mov_ld(drcontext,
+                            opnd_create_reg(ptr_reg),
+                            OPND_CREATE_MEM64(tls_reg, LOCAL_SLOT4_OFFSET)));
+
+    /* Step 3: access the copy instead */
+    redirect = opnd_create_base_disp(ptr_reg, DR_REG_NULL, 0, 0, opnd_get_size(mem));
+    for (i = 0; i < instr_num_srcs(instr); i++) {
+        if (opnd_same(instr_get_src(instr, i), mem))
+            instr_set_src(instr, i, redirect);
+    }
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        if (opnd_same(instr_get_dst(instr, i), mem))
+            instr_set_dst(instr, i, redirect);
+    }
 }
 
 ///redirect the memory instruction to speculative read & write buffer, inline version
@@ -1564,106 +1581,31 @@ transaction_privatise_handler(JANUS_CONTEXT)
 dr_signal_action_t
 stm_signal_handler(void *drcontext, dr_siginfo_t *siginfo)
 {
-    //XXX: currently directly deliver signal
-    return DR_SIGNAL_DELIVER;
-#ifdef NOT_YET_WORKING_FOR_ALL
-#ifdef JANUS_VERBOSE
-    printf("thread %ld segfault\n",local->id);
-#endif
-    int i;
-
-    if (!local->flag_space.loop_on) return DR_SIGNAL_DELIVER;
-    /* In the signal handler, wait until it is the oldest */
-    while (!(local->flag_space.can_commit)) {
-        /* If it finds the need yield flag is on, jump back to the pool */
-        if (shared->need_yield) {
-YIELD_IN_SIGNAL:
-#ifdef JANUS_VERBOSE
-            printf("thread %ld yield in the signal handler\n",local->id);
-#endif
-            local->flag_space.can_commit = 0;
-            local->flag_space.trans_on = 0;
-            local->flag_space.rolledback = 0;
-            //we need to clear the transaction before jump to pool
-            tx_clear_c(&(local->tx));
-            //clear the sync structure
-            sync_clear_c(&(local->sync));
-            /* Copy pool state */
-            if (local->id) {
-#ifdef JANUS_VERBOSE
-                dr_printf("Thread %ld jumps back to pool from signal handler\n",local->id);
-#endif
-                //longjmp(local->pool_state, 1);
-                siginfo->mcontext->pc = (void *)shared->current_loop->app_loop_end_addr;
-            } else {
-                //wait all threads jumps to pool
-                for (i = 1; i<ginfo.number_of_threads; i++) {
-                    while(!(oracle[i]->flag_space.in_pool));
-                }
-#ifdef JANUS_VERBOSE
-                dr_printf("main thread will resume execution\n");
-#endif
-                siginfo->mcontext->rdi = shared->registers.rdi;
-                siginfo->mcontext->rsi = shared->registers.rsi;
-                siginfo->mcontext->rbp = shared->registers.rbp;
-                siginfo->mcontext->rsp = shared->stack_ptr;
-                siginfo->mcontext->rbx = shared->registers.rbx;
-                siginfo->mcontext->rdx = shared->registers.rdx;
-                siginfo->mcontext->rcx = shared->registers.rcx;
-                siginfo->mcontext->rax = shared->registers.rax;
-                siginfo->mcontext->r8 = shared->registers.r8;
-                siginfo->mcontext->r9 = shared->registers.r9;
-                siginfo->mcontext->r10 = shared->registers.r10;
-                siginfo->mcontext->r11 = shared->registers.r11;
-                siginfo->mcontext->r12 = shared->registers.r12;
-                siginfo->mcontext->r13 = shared->registers.r13;
-                siginfo->mcontext->r14 = shared->registers.r14;
-                siginfo->mcontext->r15 = shared->registers.r15;
-                siginfo->mcontext->pc = (void *)shared->current_loop->app_loop_end_addr;
-            }
-            return DR_SIGNAL_REDIRECT;
-        }
-    }
-
-    if (shared->need_yield) goto YIELD_IN_SIGNAL;
-    /* If the thread jumps out the loop, then it is the oldest */
-    /* For the moment we just rollback, since we assume the application won't
-       trigger the seg-fault
-       XXX: put validation code and if it is correct, deliver the signal to the app */
-    if (local->flag_space.rolledback) {
-        local->flag_space.rolledback = 0;
+    janus_thread_t *tls = (janus_thread_t *)dr_get_tls_field(drcontext);
+    dr_mcontext_t *mc = siginfo->mcontext;
+    size_t size;
+    dr_mcontext_flags_t flags;
+
+    if (tls == NULL || !tls->flag_space.trans_on) return DR_SIGNAL_DELIVER;
+    if (siginfo->sig != SIGSEGV && siginfo->sig != SIGBUS &&
+        siginfo->sig != SIGFPE && siginfo->sig != SIGILL)
         return DR_SIGNAL_DELIVER;
-    }
+
 #ifdef JANUS_VERBOSE
-    printf("thread %ld rollback in the signal handler\n",local->id);
+    dr_printf("thread %ld faults in a transaction\n", tls->id);
 #endif
-    if (ginfo.number_of_threads == 1)
-        return DR_SIGNAL_DELIVER;
-
-    tx_clear_c(&(local->tx));
-    local->flag_space.trans_on = 0;
-    local->flag_space.rolledback = 1;
-    /* Copy all the machine states */
-    siginfo->mcontext->rdi = local->tx.check_point.state.rdi;
-    siginfo->mcontext->rsi = local->tx.check_point.state.rsi;
-    siginfo->mcontext->rbp = local->tx.check_point.state.rbp;
-    siginfo->mcontext->rsp = local->tx.check_point.state.rsp;
-    siginfo->mcontext->rbx = local->tx.check_point.state.rbx;
-    siginfo->mcontext->rdx = local->tx.check_point.state.rdx;
-    siginfo->mcontext->rcx = local->tx.check_point.state.rcx;
-    siginfo->mcontext->rax = local->tx.check_point.state.rax;
-    siginfo->mcontext->r8 = local->tx.check_point.state.r8;
-    siginfo->mcontext->r9 = local->tx.check_point.state.r9;
-    siginfo->mcontext->r10 = local->tx.check_point.state.r10;
-    siginfo->mcontext->r11 = local->tx.check_point.state.r11;
-    siginfo->mcontext->r12 = local->tx.check_point.state.r12;
-    siginfo->mcontext->r13 = local->tx.check_point.state.r13;
-    siginfo->mcontext->r14 = local->tx.check_point.state.r14;
-    siginfo->mcontext->r15 = local->tx.check_point.state.r15;
-    //siginfo->mcontext->pc = (void *)local->tx.check_point.state.pc;
-    siginfo->mcontext->pc = (void *)shared->current_loop->loop_start_addr;
-
+    /* The fault may come from stale speculative data. Discard the transaction and
+     * execute it again once all earlier transactions are committed, a real fault
+     * then happens again without speculation */
+    tls->flag_space.trans_on = 0;
+    janus_transaction_clear(tls);
+    transaction_wait_oldest(tls);
+    tls->flag_space.rolledback = 1;
+
+    size = mc->size;
+    flags = mc->flags;
+    *mc = tls->tx.start_state;
+    mc->size = size;
+    mc->flags = flags;
     return DR_SIGNAL_REDIRECT;
-#endif
 }
-
@@ -1,5 +1,10 @@
 #include "pfhandler.h"
 #include "code_gen.h"
+#include <signal.h>
+
+/* Mark the positions where the guard end code is placed */
+#define PREFETCH_GUARD_NOTE ((void *)0x4a504647)
+#define PREFETCH_GUARD_END_NOTE ((void *)0x4a504648)
 
 void memory_prefetch_handler(JANUS_CONTEXT) {
     instr_t *trigger = get_trigger_instruction(bb,rule);
@@ -43,6 +48,21 @@ void instr_clone_handler(JANUS_CONTEXT) {
             PRE_INSERT(bb, trigger, cloned);
             instr = instr_get_next_app(instr);
         }
+    } else if (mode == 2) {
+        //the instructions are in another block, decode them from the application
+        app_pc pc = (app_pc)rule->reg1;
+        length = rule->ureg0.down;
+        while (length && pc) {
+            length--;
+            instr_t *cloned = instr_create(drcontext);
+            pc = decode(drcontext, pc, cloned);
+            if (!pc) {
+                instr_destroy(drcontext, cloned);
+                break;
+            }
+            instr_set_meta_no_translation(cloned);
+            PRE_INSERT(bb, trigger, cloned);
+        }
     } else {
         dr_printf("Instruction clone mode not yet implemented\n");
     }
@@ -82,4 +102,184 @@ void instr_update_clone_handler(JANUS_CONTEXT) {
     } else {
         dr_printf("Instruction clone mode not yet implemented\n");
     }
-}
\ No newline at end of file
+}
+
+static reg_id_t guard_tls_seg;
+static uint guard_tls_offs;
+
+static opnd_t
+guard_slot(void *drcontext, int slot)
+{
+    return dr_raw_tls_opnd(drcontext, guard_tls_seg, guard_tls_offs + slot * sizeof(reg_t));
+}
+
+static void
+guard_save(void *drcontext, instrlist_t *bb, instr_t *where, reg_id_t reg, int slot)
+{
+    dr_insert_write_raw_tls(drcontext, bb, where, guard_tls_seg, guard_tls_offs + slot * sizeof(reg_t), reg);
+}
+
+static void
+guard_restore(void *drcontext, instrlist_t *bb, instr_t *where, reg_id_t reg, int slot)
+{
+    dr_insert_read_raw_tls(drcontext, bb, where, guard_tls_seg, guard_tls_offs + slot * sizeof(reg_t), reg);
+}
+
+/* The guard state of the current thread if the cache pc is between the start of its running
+ * slice and the address in the given slot */
+static reg_t *
+get_running_slice(app_pc pc, int end_slot)
+{
+    reg_t *slots = (reg_t *)((byte *)dr_get_dr_segment_base(guard_tls_seg) + guard_tls_offs);
+
+    if (slots[PREFETCH_GUARD_END_SLOT] == 0) return NULL;
+    if (pc < (app_pc)slots[PREFETCH_GUARD_START_SLOT] || pc >= (app_pc)slots[end_slot])
+        return NULL;
+    return slots;
+}
+
+/* The slice loads a future iteration, which may be beyond the end of an array.
+ * A fault in the slice resumes at the guard end, which restores the registers */
+static dr_signal_action_t
+prefetch_guard_signal_handler(void *drcontext, dr_siginfo_t *info)
+{
+    reg_t *slots;
+
+    if (info->sig != SIGSEGV && info->sig != SIGBUS) return DR_SIGNAL_DELIVER;
+    if (!info->raw_mcontext_valid) return DR_SIGNAL_DELIVER;
+
+    slots = get_running_slice(info->raw_mcontext->pc, PREFETCH_GUARD_RESUME_SLOT);
+    if (slots == NULL) return DR_SIGNAL_DELIVER;
+
+    info->raw_mcontext->pc = (app_pc)slots[PREFETCH_GUARD_RESUME_SLOT];
+    return DR_SIGNAL_SUPPRESS;
+}
+
+/* Translate a state in the slice or in the register restore to the state before the slice */
+static bool
+prefetch_guard_restore_state(void *drcontext, bool restore_memory, dr_restore_state_info_t *info)
+{
+    dr_mcontext_t *mc = info->mcontext;
+    reg_t *slots;
+    uint64_t mask;
+    int i;
+
+    if (!info->raw_mcontext_valid) return true;
+    slots = get_running_slice(info->raw_mcontext->pc, PREFETCH_GUARD_END_SLOT);
+    if (slots == NULL) return true;
+
+    mask = slots[PREFETCH_GUARD_MASK_SLOT];
+    reg_set_value(DR_REG_XAX, mc, slots[PREFETCH_GUARD_REG_SLOT]);
+    for (i=1; i<16; i++) {
+        if (!(mask & (1ULL << i))) continue;
+        reg_set_value(DR_REG_XAX + i, mc, slots[PREFETCH_GUARD_REG_SLOT + i]);
+    }
+    if (mask & PREFETCH_GUARD_FLAGS) {
+        /* saved with lahf; seto al */
+        reg_t flags = slots[PREFETCH_GUARD_FLAGS_SLOT];
+        mc->xflags = (mc->xflags & ~0x8d5) | ((flags >> 8) & 0xd5) | ((flags & 0xff) ? 0x800 : 0);
+    }
+    return true;
+}
+
+static void
+prefetch_guard_exit(void)
+{
+    dr_raw_tls_cfree(guard_tls_offs, PREFETCH_GUARD_NUM_SLOTS);
+}
+
+void prefetch_guard_init(void)
+{
+    if (!dr_raw_tls_calloc(&guard_tls_seg, &guard_tls_offs, PREFETCH_GUARD_NUM_SLOTS, 0)) {
+        dr_fprintf(STDERR,"Prefetch guard thread-local storage not allocated\n");
+        return;
+    }
+    dr_register_signal_event(prefetch_guard_signal_handler);
+    dr_register_restore_state_ex_event(prefetch_guard_restore_state);
+    dr_register_exit_event(prefetch_guard_exit);
+}
+
+void prefetch_guard_start_handler(JANUS_CONTEXT) {
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    uint64_t mask = rule->reg0;
+    instr_t *start = INSTR_CREATE_label(drcontext);
+    instr_t *resume = INSTR_CREATE_label(drcontext);
+    instr_t *end = INSTR_CREATE_label(drcontext);
+    int i;
+
+    //rax is always saved, it holds the flags and the slice addresses
+    guard_save(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_REG_SLOT);
+    if (mask & PREFETCH_GUARD_FLAGS) {
+        dr_save_arith_flags_to_xax(drcontext, bb, trigger);
+        guard_save(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_FLAGS_SLOT);
+    }
+    for (i=1; i<16; i++) {
+        if (!(mask & (1ULL << i))) continue;
+        guard_save(drcontext, bb, trigger, DR_REG_XAX + i, PREFETCH_GUARD_REG_SLOT + i);
+    }
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext, guard_slot(drcontext, PREFETCH_GUARD_MASK_SLOT),
+                            OPND_CREATE_INT32((int)mask)));
+    //the slice runs from the start label to the resume label
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_imm(drcontext, opnd_create_reg(DR_REG_XAX), opnd_create_instr(start)));
+    guard_save(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_START_SLOT);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_imm(drcontext, opnd_create_reg(DR_REG_XAX), opnd_create_instr(resume)));
+    guard_save(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_RESUME_SLOT);
+    //a non-zero end address marks the slice as running
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_imm(drcontext, opnd_create_reg(DR_REG_XAX), opnd_create_instr(end)));
+    guard_save(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_END_SLOT);
+    guard_restore(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_REG_SLOT);
+    PRE_INSERT(bb, trigger, start);
+
+    //placeholders, the guard end moves them after the slice
+    instr_set_note(resume, PREFETCH_GUARD_NOTE);
+    PRE_INSERT(bb, trigger, resume);
+    instr_set_note(end, PREFETCH_GUARD_END_NOTE);
+    PRE_INSERT(bb, trigger, end);
+}
+
+void prefetch_guard_end_handler(JANUS_CONTEXT) {
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    uint64_t mask = rule->reg0;
+    instr_t *resume = NULL, *end = NULL, *instr;
+    int i;
+
+    for (instr = instr_get_prev(trigger); instr != NULL; instr = instr_get_prev(instr)) {
+        if (instr_is_label(instr) && instr_get_note(instr) == PREFETCH_GUARD_END_NOTE)
+            end = instr;
+        if (instr_is_label(instr) && instr_get_note(instr) == PREFETCH_GUARD_NOTE) {
+            resume = instr;
+            break;
+        }
+    }
+    if (resume == NULL || end == NULL) return;
+
+    //the loads of the slice may fault, they are translated to the trigger
+    for (instr = instr_get_next(end); instr != trigger; instr = instr_get_next(instr)) {
+        if (instr_reads_memory(instr))
+            instr_set_translation(instr, instr_get_app_pc(trigger));
+    }
+    instrlist_remove(bb, resume);
+    instr_set_note(resume, NULL);
+    PRE_INSERT(bb, trigger, resume);
+    instrlist_remove(bb, end);
+    instr_set_note(end, NULL);
+
+    if (mask & PREFETCH_GUARD_FLAGS) {
+        guard_restore(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_FLAGS_SLOT);
+        dr_restore_arith_flags_from_xax(drcontext, bb, trigger);
+    }
+    guard_restore(drcontext, bb, trigger, DR_REG_XAX, PREFETCH_GUARD_REG_SLOT);
+    for (i=1; i<16; i++) {
+        if (!(mask & (1ULL << i))) continue;
+        guard_restore(drcontext, bb, trigger, DR_REG_XAX + i, PREFETCH_GUARD_REG_SLOT + i);
+    }
+    //the registers are restored, no slice is running
+    PRE_INSERT(bb, trigger, end);
+    PRE_INSERT(bb, trigger,
+        INSTR_CREATE_mov_st(drcontext, guard_slot(drcontext, PREFETCH_GUARD_END_SLOT),
+                            OPND_CREATE_INT32(0)));
+}
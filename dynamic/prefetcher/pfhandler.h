@@ -8,4 +8,27 @@ void memory_prefetch_handler(JANUS_CONTEXT);
 void instr_clone_handler(JANUS_CONTEXT);
 
 void instr_update_clone_handler(JANUS_CONTEXT);
+
+/* PREFETCH_GUARD_START mask: bit i saves general register i (rax is 0), this bit saves the flags */
+#define PREFETCH_GUARD_FLAGS (1ULL << 16)
+
+/* The guard keeps its state in raw TLS slots of its own: the cache addresses of the start
+ * and the end of the running slice and of the end of the register restore, the mask and
+ * the saved flags and registers */
+#define PREFETCH_GUARD_START_SLOT 0
+#define PREFETCH_GUARD_RESUME_SLOT 1
+#define PREFETCH_GUARD_END_SLOT 2
+#define PREFETCH_GUARD_MASK_SLOT 3
+#define PREFETCH_GUARD_FLAGS_SLOT 4
+#define PREFETCH_GUARD_REG_SLOT 5
+#define PREFETCH_GUARD_NUM_SLOTS (PREFETCH_GUARD_REG_SLOT + 16)
+/* spill slot free for other instrumentation inside the guard */
+#define PREFETCH_GUARD_FREE_SLOT SPILL_SLOT_5
+
+/** \brief Register the fault handling of the prefetch slices */
+void prefetch_guard_init(void);
+
+void prefetch_guard_start_handler(JANUS_CONTEXT);
+
+void prefetch_guard_end_handler(JANUS_CONTEXT);
 #endif
\ No newline at end of file
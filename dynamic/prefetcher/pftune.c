@@ -0,0 +1,279 @@
+/* Runtime tuning of the prefetch distance
+ *
+ * The static distance is a cost model estimate. In tuning mode the iterations of
+ * each prefetched loop are counted and sampled periodically. The distance is then
+ * hill-climbed by doubling or halving it as long as the loop runs more iterations
+ * per sample, and the blocks holding the prefetch code are retranslated with the
+ * new offsets. The sampling runs in a client thread, since a timer signal may interrupt
+ * a thread holding the DynamoRIO locks that the flush takes */
+#include "pftune.h"
+#include "pfhandler.h"
+#include "drx.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum _tune_phase {
+    TUNE_UP,            //trying larger distances
+    TUNE_DOWN,          //trying smaller distances
+    TUNE_DONE
+} tune_phase_t;
+
+/* Tuning state of one loop (rule channel) */
+typedef struct _loop_tune {
+    uint32_t            channel;
+    /* distance the static rules are encoded with */
+    uint32_t            static_distance;
+    /* distance used in the code cache */
+    volatile uint32_t   distance;
+    uint32_t            best_distance;
+    tune_phase_t        phase;
+    /* incremented by the instrumented code */
+    uint64_t            iterations;
+    uint64_t            last_iterations;
+    uint64_t            window_iterations;
+    uint32_t            window_samples;
+    uint64_t            best_rate;
+    int                 block_count;
+    app_pc              blocks[PREFETCH_TUNE_MAX_BLOCKS];
+} loop_tune_t;
+
+bool prefetch_tune_on = false;
+
+/* The table is guarded by tune_lock, the sampling thread and the block builders share it */
+static loop_tune_t tunes[PREFETCH_TUNE_MAX_LOOPS];
+static int tune_count = 0;
+static void *tune_lock;
+static int tune_interval;
+static volatile bool tune_exiting = false;
+
+static void tune_thread(void *param);
+
+void
+prefetch_tune_init(void)
+{
+    char *interval = getenv(PREFETCH_TUNE_ENV);
+    int millis;
+
+    if (interval == NULL) return;
+    millis = atoi(interval);
+    if (millis <= 0) millis = PREFETCH_TUNE_INTERVAL_MS;
+
+    drx_init();
+    tune_lock = dr_mutex_create();
+    tune_interval = millis;
+    prefetch_tune_on = true;
+    if (!dr_create_client_thread(tune_thread, NULL)) {
+        dr_fprintf(STDERR,"Prefetch distance tuning thread not created\n");
+        prefetch_tune_on = false;
+    }
+    IF_VERBOSE(dr_fprintf(STDOUT,"Prefetch distance tuning every %d ms\n", millis));
+}
+
+void
+prefetch_tune_exit(void)
+{
+    if (tune_lock == NULL) return;
+
+    /* DynamoRIO has stopped the client threads before the exit event */
+    tune_exiting = true;
+#ifdef JANUS_VERBOSE
+    int i;
+    for (i=0; i<tune_count; i++)
+        dr_fprintf(STDOUT,"Loop %d prefetch distance %d (static %d)\n",
+                   tunes[i].channel, tunes[i].distance, tunes[i].static_distance);
+#endif
+    dr_mutex_destroy(tune_lock);
+    drx_exit();
+}
+
+/* Get the tuning state of the channel, registers the block for retranslation */
+static loop_tune_t *
+get_loop_tune(RRule *rule, uint32_t static_distance)
+{
+    loop_tune_t *tune = NULL;
+    int i;
+
+    dr_mutex_lock(tune_lock);
+    for (i=0; i<tune_count; i++) {
+        if (tunes[i].channel == rule->channel) {
+            tune = tunes + i;
+            break;
+        }
+    }
+
+    if (!tune && tune_count < PREFETCH_TUNE_MAX_LOOPS && static_distance) {
+        tune = tunes + tune_count;
+        memset(tune, 0, sizeof(loop_tune_t));
+        tune->channel = rule->channel;
+        tune->static_distance = static_distance;
+        tune->distance = static_distance;
+        tune->best_distance = static_distance;
+        tune->phase = TUNE_UP;
+        tune_count++;
+    }
+
+    if (tune) {
+        for (i=0; i<tune->block_count; i++)
+            if (tune->blocks[i] == (app_pc)rule->block_address) break;
+        if (i == tune->block_count && i < PREFETCH_TUNE_MAX_BLOCKS)
+            tune->blocks[tune->block_count++] = (app_pc)rule->block_address;
+    }
+    dr_mutex_unlock(tune_lock);
+    return tune;
+}
+
+static loop_tune_t *
+find_loop_tune(uint32_t channel)
+{
+    loop_tune_t *tune = NULL;
+    int i;
+
+    dr_mutex_lock(tune_lock);
+    for (i=0; i<tune_count; i++) {
+        if (tunes[i].channel == channel) {
+            tune = tunes + i;
+            break;
+        }
+    }
+    dr_mutex_unlock(tune_lock);
+    return tune;
+}
+
+/* Find the displacement of the application memory operand that the prefetch is derived from */
+static bool
+get_original_displacement(instrlist_t *bb, JVar mem, int *disp)
+{
+    instr_t *instr;
+    int i;
+
+    for (instr = instrlist_first_app(bb); instr != NULL; instr = instr_get_next_app(instr)) {
+        for (i = 0; i < instr_num_srcs(instr); i++) {
+            opnd_t op = instr_get_src(instr, i);
+            if (!opnd_is_base_disp(op)) continue;
+            if (opnd_get_base(op) == mem.base &&
+                opnd_get_index(op) == mem.index &&
+                (mem.index == DR_REG_NULL || opnd_get_scale(op) == mem.scale)) {
+                *disp = opnd_get_disp(op);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+tuned_prefetch_handler(JANUS_CONTEXT)
+{
+    loop_tune_t *tune = find_loop_tune(rule->channel);
+    JVar mem = decode_jvar(rule);
+    RRule scaled = *rule;
+    int disp;
+
+    /* The iterator based prefetch is the original operand plus stride * distance */
+    if (tune && mem.type == JVAR_MEMORY &&
+        get_original_displacement(bb, mem, &disp)) {
+        mem.value = disp + (mem.value - disp) * tune->distance / tune->static_distance;
+        encode_jvar(mem, &scaled);
+    }
+
+    memory_prefetch_handler(drcontext, bb, &scaled, tag);
+}
+
+void
+tuned_update_clone_handler(JANUS_CONTEXT)
+{
+    /* ureg0.down holds the static distance, reg1 holds stride * distance/2 */
+    loop_tune_t *tune = get_loop_tune(rule, rule->ureg0.down);
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    RRule scaled = *rule;
+
+    if (tune) {
+        scaled.reg1 = (int64_t)rule->reg1 * tune->distance / tune->static_distance;
+        /* The cloned instruction runs once per iteration */
+        drx_insert_counter_update(drcontext, bb, trigger, PREFETCH_GUARD_FREE_SLOT,
+                                  &tune->iterations, 1, DRX_COUNTER_64BIT);
+    }
+
+    instr_update_clone_handler(drcontext, bb, &scaled, tag);
+}
+
+/* Move to the next distance to try */
+static void
+next_distance(loop_tune_t *tune, uint64_t rate)
+{
+    uint32_t current = tune->distance;
+
+    /* Keep a new distance only if it is clearly faster */
+    if (rate > tune->best_rate + tune->best_rate / 32) {
+        tune->best_rate = rate;
+        tune->best_distance = current;
+    } else if (tune->phase == TUNE_UP) {
+        /* Larger is not better, try smaller than the best */
+        tune->phase = TUNE_DOWN;
+        current = tune->best_distance;
+    } else {
+        tune->phase = TUNE_DONE;
+    }
+
+    if (tune->phase == TUNE_UP) {
+        if (current * 2 > PREFETCH_TUNE_MAX_DISTANCE) tune->phase = TUNE_DOWN;
+        else tune->distance = current * 2;
+    }
+    if (tune->phase == TUNE_DOWN) {
+        if (current / 2 < PREFETCH_TUNE_MIN_DISTANCE) tune->phase = TUNE_DONE;
+        else tune->distance = current / 2;
+    }
+    if (tune->phase == TUNE_DONE)
+        tune->distance = tune->best_distance;
+}
+
+/* Sample the iteration counters, the rate of a distance is the number of iterations
+ * per sample while the loop runs. The blocks of the loops whose distance changed
+ * are returned for retranslation */
+static int
+sample_loops(app_pc *flush)
+{
+    int i, j, count = 0;
+
+    dr_mutex_lock(tune_lock);
+    for (i=0; i<tune_count; i++) {
+        loop_tune_t *tune = tunes + i;
+        uint64_t iterations = tune->iterations;
+        uint64_t delta = iterations - tune->last_iterations;
+        uint32_t previous = tune->distance;
+
+        tune->last_iterations = iterations;
+        if (tune->phase == TUNE_DONE || delta == 0) continue;
+
+        tune->window_iterations += delta;
+        if (++tune->window_samples < PREFETCH_TUNE_SAMPLES) continue;
+
+        next_distance(tune, tune->window_iterations / tune->window_samples);
+        tune->window_iterations = 0;
+        tune->window_samples = 0;
+
+        if (tune->distance != previous) {
+            for (j=0; j<tune->block_count; j++)
+                flush[count++] = tune->blocks[j];
+        }
+    }
+    dr_mutex_unlock(tune_lock);
+    return count;
+}
+
+static void
+tune_thread(void *param)
+{
+    static app_pc flush[PREFETCH_TUNE_MAX_LOOPS * PREFETCH_TUNE_MAX_BLOCKS];
+    int i, count;
+
+    while (!tune_exiting) {
+        dr_sleep(tune_interval);
+        if (tune_exiting) break;
+
+        count = sample_loops(flush);
+        /* The flush is delayed until no thread is in the code cache */
+        for (i=0; i<count; i++)
+            dr_delay_flush_region(flush[i], 1, 0, NULL);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef _JANUS_PREFETCH_TUNE_
+#define _JANUS_PREFETCH_TUNE_
+
+#include "janus_api.h"
+
+/* Runtime tuning of the prefetch distance, enabled by setting the environment
+ * variable below to the sampling interval in milliseconds */
+#define PREFETCH_TUNE_ENV "JANUS_PREFETCH_TUNE"
+#define PREFETCH_TUNE_INTERVAL_MS 10
+/* Number of samples with the loop running before a distance is judged */
+#define PREFETCH_TUNE_SAMPLES 8
+#define PREFETCH_TUNE_MAX_LOOPS 64
+#define PREFETCH_TUNE_MAX_BLOCKS 8
+#define PREFETCH_TUNE_MIN_DISTANCE 2
+#define PREFETCH_TUNE_MAX_DISTANCE 1024
+
+extern bool prefetch_tune_on;
+
+/** \brief Read the environment and start sampling if tuning is requested */
+void prefetch_tune_init(void);
+
+void prefetch_tune_exit(void);
+
+/** \brief MEM_PREFETCH with the iterator offset scaled to the tuned distance */
+void tuned_prefetch_handler(JANUS_CONTEXT);
+
+/** \brief INSTR_UPDATE with the tuned distance, also counts the loop iterations */
+void tuned_update_clone_handler(JANUS_CONTEXT);
+
+#endif
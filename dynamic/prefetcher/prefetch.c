@@ -5,10 +5,14 @@
 
 /* Janus prefetch handlers */
 #include "pfhandler.h"
+#include "pftune.h"
 
 static dr_emit_flags_t
 event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating);
 
+static void
+event_exit(void);
+
 DR_EXPORT void 
 dr_init(client_id_t id)
 {
@@ -28,6 +32,13 @@ dr_init(client_id_t id)
         return;
     }
 
+    /* Faults in the prefetch slices are skipped */
+    prefetch_guard_init();
+
+    /* Optional runtime tuning of the prefetch distance */
+    prefetch_tune_init();
+    dr_register_exit_event(event_exit);
+
     IF_VERBOSE(dr_fprintf(STDOUT,"DynamoRIO client initialised\n"));
 }
 
@@ -56,14 +67,26 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
                 split_block_handler(janus_context);
                 return DR_EMIT_DEFAULT;
             case MEM_PREFETCH:
-                memory_prefetch_handler(janus_context);
+                if (prefetch_tune_on)
+                    tuned_prefetch_handler(janus_context);
+                else
+                    memory_prefetch_handler(janus_context);
                 break;
             case INSTR_UPDATE:
-                instr_update_clone_handler(janus_context);
+                if (prefetch_tune_on)
+                    tuned_update_clone_handler(janus_context);
+                else
+                    instr_update_clone_handler(janus_context);
                 break;
             case INSTR_CLONE:
                 instr_clone_handler(janus_context);
                 break;
+            case PREFETCH_GUARD_START:
+                prefetch_guard_start_handler(janus_context);
+                break;
+            case PREFETCH_GUARD_END:
+                prefetch_guard_end_handler(janus_context);
+                break;
             default:
                 fprintf(stderr,"In basic block 0x%lx static rule not recognised %d\n",bbAddr,rule_opcode);
                 break;
@@ -74,3 +97,9 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
 
     return DR_EMIT_DEFAULT;
 }
+
+static void
+event_exit(void)
+{
+    prefetch_tune_exit();
+}
@@ -47,6 +47,22 @@ void vector_extend_transform_2opnds_avx(JANUS_CONTEXT, instr_t *trigger, int opc
         case OP_vdivsd:
             instr = INSTR_CREATE_vdivpd(drcontext, *dst, *dst, *src);
             break;
+        case OP_minss:
+        case OP_vminss:
+            instr = INSTR_CREATE_vminps(drcontext, *dst, *dst, *src);
+            break;
+        case OP_maxss:
+        case OP_vmaxss:
+            instr = INSTR_CREATE_vmaxps(drcontext, *dst, *dst, *src);
+            break;
+        case OP_minsd:
+        case OP_vminsd:
+            instr = INSTR_CREATE_vminpd(drcontext, *dst, *dst, *src);
+            break;
+        case OP_maxsd:
+        case OP_vmaxsd:
+            instr = INSTR_CREATE_vmaxpd(drcontext, *dst, *dst, *src);
+            break;
     }
     PRE_INSERT(bb,trigger,instr);
 }
@@ -86,6 +102,22 @@ void vector_extend_transform_2opnds_sse(JANUS_CONTEXT, instr_t *trigger, int opc
         case OP_vdivsd:
             instr = INSTR_CREATE_divpd(drcontext, *dst, *src);
             break;
+        case OP_minss:
+        case OP_vminss:
+            instr = INSTR_CREATE_minps(drcontext, *dst, *src);
+            break;
+        case OP_maxss:
+        case OP_vmaxss:
+            instr = INSTR_CREATE_maxps(drcontext, *dst, *src);
+            break;
+        case OP_minsd:
+        case OP_vminsd:
+            instr = INSTR_CREATE_minpd(drcontext, *dst, *src);
+            break;
+        case OP_maxsd:
+        case OP_vmaxsd:
+            instr = INSTR_CREATE_maxpd(drcontext, *dst, *src);
+            break;
     }
     PRE_INSERT(bb,trigger,instr);
 }
@@ -152,6 +184,30 @@ void vector_extend_transform_3opnds_avx(JANUS_CONTEXT, instr_t *trigger, int opc
         case OP_vdivsd:
             instr = INSTR_CREATE_vdivpd(drcontext, *dst, *src1, *src2);
             break;
+        case OP_minss:
+            instr = INSTR_CREATE_vminps(drcontext, *dst, *dst, *src1);
+            break;
+        case OP_vminss:
+            instr = INSTR_CREATE_vminps(drcontext, *dst, *src1, *src2);
+            break;
+        case OP_maxss:
+            instr = INSTR_CREATE_vmaxps(drcontext, *dst, *dst, *src1);
+            break;
+        case OP_vmaxss:
+            instr = INSTR_CREATE_vmaxps(drcontext, *dst, *src1, *src2);
+            break;
+        case OP_minsd:
+            instr = INSTR_CREATE_vminpd(drcontext, *dst, *dst, *src1);
+            break;
+        case OP_vminsd:
+            instr = INSTR_CREATE_vminpd(drcontext, *dst, *src1, *src2);
+            break;
+        case OP_maxsd:
+            instr = INSTR_CREATE_vmaxpd(drcontext, *dst, *dst, *src1);
+            break;
+        case OP_vmaxsd:
+            instr = INSTR_CREATE_vmaxpd(drcontext, *dst, *src1, *src2);
+            break;
     }
     PRE_INSERT(bb,trigger,instr);
 }
@@ -169,8 +225,9 @@ void vector_extend_transform_3opnds_sse(JANUS_CONTEXT, instr_t *trigger, int opc
             vector_extend_transform_2opnds_sse(janus_context, trigger, opcode, dst, src2);
         }
         // else dst == src2.
-        else if (opcode == OP_vdivss || opcode == OP_vsubss || opcode == OP_vdivsd || opcode == OP_vsubsd) {
-            // Must maintain operand order (assumes spill != src1 otherwise we can't resolve).
+        else if (opcode == OP_vdivss || opcode == OP_vsubss || opcode == OP_vdivsd || opcode == OP_vsubsd
+              || opcode == OP_vminss || opcode == OP_vmaxss || opcode == OP_vminsd || opcode == OP_vmaxsd) {
+            // Must maintain operand order, min and max return the second operand for NaN and equal values (assumes spill != src1 otherwise we can't resolve).
             if (opnd_get_reg(*spill) != opnd_get_reg(*src1)) {
                 instr = get_movap(drcontext, spill, src1, vectorWordSize);
                 PRE_INSERT(bb,trigger,instr);
@@ -266,12 +323,159 @@ void vector_extend_handler_mov(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *
     instrlist_remove(bb, trigger);
 }
 
-void vector_extend_handler_pxor(JANUS_CONTEXT, instr_t *trigger, int opcode, opnd_t *dst, opnd_t *src1,
+void vector_extend_handler_sqrt(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigger, int opcode,
+        opnd_t *dst, int vectorWordSize, int unrollFactor) {
+    instr_t *instr;
+    // The square root is taken of the last source, vsqrtss copies the upper part from the first one.
+    opnd_t src = instr_get_src(trigger, instr_num_srcs(trigger) - 1);
+    adjust_displacement_for_extension(info, &src, unrollFactor);
+    if (!CPU_HAS_AVX(myCPU) && opnd_is_memory_reference(src) && !isAligned(info, vectorWordSize, unrollFactor)) {
+        opnd_t spill = getFreeVectReg(drcontext, info, vectorWordSize * unrollFactor);
+        PRE_INSERT(bb,trigger,get_movup(drcontext, &spill, &src, vectorWordSize));
+        src = spill;
+    }
+    if (vectorWordSize == 4) {
+        if (CPU_HAS_AVX(myCPU))
+            instr = INSTR_CREATE_vsqrtps(drcontext, *dst, src);
+        else
+            instr = INSTR_CREATE_sqrtps(drcontext, *dst, src);
+    }
+    else {
+        if (CPU_HAS_AVX(myCPU))
+            instr = INSTR_CREATE_vsqrtpd(drcontext, *dst, src);
+        else
+            instr = INSTR_CREATE_sqrtpd(drcontext, *dst, src);
+    }
+    PRE_INSERT(bb,trigger,instr);
+    instrlist_remove(bb, trigger);
+}
+
+// Returns the VEX encoded opcode of a packed operation, OP_INVALID if not supported.
+static int get_packed_avx_opcode(int opcode) {
+    switch (opcode) {
+        case OP_andps: case OP_vandps: return OP_vandps;
+        case OP_andnps: case OP_vandnps: return OP_vandnps;
+        case OP_orps: case OP_vorps: return OP_vorps;
+        case OP_xorps: case OP_vxorps: return OP_vxorps;
+        case OP_andpd: case OP_vandpd: return OP_vandpd;
+        case OP_andnpd: case OP_vandnpd: return OP_vandnpd;
+        case OP_orpd: case OP_vorpd: return OP_vorpd;
+        case OP_xorpd: case OP_vxorpd: return OP_vxorpd;
+        case OP_pand: case OP_vpand: return OP_vpand;
+        case OP_pandn: case OP_vpandn: return OP_vpandn;
+        case OP_por: case OP_vpor: return OP_vpor;
+        case OP_pxor: case OP_vpxor: return OP_vpxor;
+        case OP_paddb: case OP_vpaddb: return OP_vpaddb;
+        case OP_paddw: case OP_vpaddw: return OP_vpaddw;
+        case OP_paddd: case OP_vpaddd: return OP_vpaddd;
+        case OP_paddq: case OP_vpaddq: return OP_vpaddq;
+        case OP_psubb: case OP_vpsubb: return OP_vpsubb;
+        case OP_psubw: case OP_vpsubw: return OP_vpsubw;
+        case OP_psubd: case OP_vpsubd: return OP_vpsubd;
+        case OP_psubq: case OP_vpsubq: return OP_vpsubq;
+        case OP_pmullw: case OP_vpmullw: return OP_vpmullw;
+        case OP_pmulld: case OP_vpmulld: return OP_vpmulld;
+        case OP_pminsb: case OP_vpminsb: return OP_vpminsb;
+        case OP_pminsw: case OP_vpminsw: return OP_vpminsw;
+        case OP_pminsd: case OP_vpminsd: return OP_vpminsd;
+        case OP_pminub: case OP_vpminub: return OP_vpminub;
+        case OP_pminuw: case OP_vpminuw: return OP_vpminuw;
+        case OP_pminud: case OP_vpminud: return OP_vpminud;
+        case OP_pmaxsb: case OP_vpmaxsb: return OP_vpmaxsb;
+        case OP_pmaxsw: case OP_vpmaxsw: return OP_vpmaxsw;
+        case OP_pmaxsd: case OP_vpmaxsd: return OP_vpmaxsd;
+        case OP_pmaxub: case OP_vpmaxub: return OP_vpmaxub;
+        case OP_pmaxuw: case OP_vpmaxuw: return OP_vpmaxuw;
+        case OP_pmaxud: case OP_vpmaxud: return OP_vpmaxud;
+        case OP_pcmpeqb: case OP_vpcmpeqb: return OP_vpcmpeqb;
+        case OP_pcmpeqw: case OP_vpcmpeqw: return OP_vpcmpeqw;
+        case OP_pcmpeqd: case OP_vpcmpeqd: return OP_vpcmpeqd;
+        case OP_pcmpeqq: case OP_vpcmpeqq: return OP_vpcmpeqq;
+        case OP_pcmpgtb: case OP_vpcmpgtb: return OP_vpcmpgtb;
+        case OP_pcmpgtw: case OP_vpcmpgtw: return OP_vpcmpgtw;
+        case OP_pcmpgtd: case OP_vpcmpgtd: return OP_vpcmpgtd;
+        case OP_pcmpgtq: case OP_vpcmpgtq: return OP_vpcmpgtq;
+        default: return OP_INVALID;
+    }
+}
+
+// AVX without AVX2 has the 256-bit logic operations only in the floating point domain.
+static int get_packed_avx1_opcode(int vopcode) {
+    switch (vopcode) {
+        case OP_vpand: return OP_vandps;
+        case OP_vpandn: return OP_vandnps;
+        case OP_vpor: return OP_vorps;
+        case OP_vpxor: return OP_vxorps;
+        case OP_vandps: case OP_vandnps: case OP_vorps: case OP_vxorps:
+        case OP_vandpd: case OP_vandnpd: case OP_vorpd: case OP_vxorpd:
+            return vopcode;
+        default:
+            return OP_INVALID;
+    }
+}
+
+bool vector_extend_is_packed(int opcode) {
+    return get_packed_avx_opcode(opcode) != OP_INVALID;
+}
+
+INSTR_INLINE
+static reg_id_t get_xmm(reg_id_t ymm) {
+    return ymm - DR_REG_YMM0 + DR_REG_XMM0;
+}
+
+INSTR_INLINE
+static instr_t *swap_halves(void *drcontext, reg_id_t ymm) {
+    return INSTR_CREATE_vperm2f128(drcontext, opnd_create_reg(ymm), opnd_create_reg(ymm), opnd_create_reg(ymm),
+        OPND_CREATE_INT8(0x01));
+}
+
+// Integer operation on AVX without AVX2, each 128-bit half is computed separately.
+static void insert_packed_halves(JANUS_CONTEXT, instr_t *trigger, int vopcode, reg_id_t dst, reg_id_t src1,
+        reg_id_t src2, reg_id_t spill) {
+    // Lower half into the free register.
+    PRE_INSERT(bb,trigger,instr_create_1dst_2src(drcontext, vopcode, opnd_create_reg(get_xmm(spill)),
+        opnd_create_reg(get_xmm(src1)), opnd_create_reg(get_xmm(src2))));
+    // Bring the upper halves down, the sources are swapped back unless overwritten.
+    PRE_INSERT(bb,trigger,swap_halves(drcontext, src1));
+    if (src2 != src1)
+        PRE_INSERT(bb,trigger,swap_halves(drcontext, src2));
+    PRE_INSERT(bb,trigger,instr_create_1dst_2src(drcontext, vopcode, opnd_create_reg(get_xmm(dst)),
+        opnd_create_reg(get_xmm(src1)), opnd_create_reg(get_xmm(src2))));
+    if (src1 != dst)
+        PRE_INSERT(bb,trigger,swap_halves(drcontext, src1));
+    if (src2 != dst && src2 != src1)
+        PRE_INSERT(bb,trigger,swap_halves(drcontext, src2));
+    // dst = [spill.lo, dst.lo]
+    PRE_INSERT(bb,trigger,INSTR_CREATE_vperm2f128(drcontext, opnd_create_reg(dst), opnd_create_reg(spill),
+        opnd_create_reg(dst), OPND_CREATE_INT8(0x20)));
+}
+
+void vector_extend_handler_packed(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigger, int opcode,
         int vectorSize) {
-    if (vectorSize == 32 && opcode == OP_pxor) {
-        // Extend pxor to cover ymm.
-        instr_t *instr = INSTR_CREATE_vpxor(drcontext, *dst, *dst, *src1);
-        PRE_INSERT(bb,trigger,instr);
-        instrlist_remove(bb, trigger);
+    // The operation already covers a whole SSE register.
+    if (vectorSize == 16) return;
+
+    int vopcode = get_packed_avx_opcode(opcode);
+    opnd_t dst = instr_get_dst(trigger, 0);
+    opnd_t src1, src2;
+    if (opcode == vopcode) {
+        src1 = instr_get_src(trigger, 0);
+        src2 = instr_get_src(trigger, 1);
+    }
+    else {
+        // The destination is the first source of the SSE form.
+        src1 = dst;
+        src2 = instr_get_src(trigger, 0);
+    }
+
+    if (CPU_HAS_AVX2(myCPU) || get_packed_avx1_opcode(vopcode) != OP_INVALID) {
+        if (!CPU_HAS_AVX2(myCPU)) vopcode = get_packed_avx1_opcode(vopcode);
+        PRE_INSERT(bb,trigger,instr_create_1dst_2src(drcontext, vopcode, dst, src1, src2));
     }
+    else {
+        opnd_t spill = getFreeVectReg(drcontext, info, vectorSize);
+        insert_packed_halves(janus_context, trigger, vopcode, opnd_get_reg(dst), opnd_get_reg(src1),
+            opnd_get_reg(src2), opnd_get_reg(spill));
+    }
+    instrlist_remove(bb, trigger);
 }
\ No newline at end of file
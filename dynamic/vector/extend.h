@@ -30,5 +30,13 @@ vector_extend_handler_mov(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigg
         opnd_t *src1, int vectorWordSize, int unrollFactor);
 
 void
-vector_extend_handler_pxor(JANUS_CONTEXT, instr_t *trigger, int opcode, opnd_t *dst, opnd_t *src1,
+vector_extend_handler_sqrt(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigger, int opcode,
+        opnd_t *dst, int vectorWordSize, int unrollFactor);
+
+/* Whether the opcode is a packed logic or integer operation on the whole register */
+bool
+vector_extend_is_packed(int opcode);
+
+void
+vector_extend_handler_packed(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigger, int opcode,
         int vectorSize);
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "fma.h"
+#include "utilities.h"
+
+static bool is_single(int opcode) {
+    return opcode == OP_addss || opcode == OP_vaddss || opcode == OP_mulss || opcode == OP_vmulss;
+}
+
+// The SSE form uses the destination as the first source.
+static void get_sources(instr_t *instr, opnd_t *first, opnd_t *second) {
+    int opcode = instr_get_opcode(instr);
+    if (opcode == OP_addss || opcode == OP_addsd || opcode == OP_mulss || opcode == OP_mulsd) {
+        *first = instr_get_dst(instr, 0);
+        *second = instr_get_src(instr, 0);
+    }
+    else {
+        *first = instr_get_src(instr, 0);
+        *second = instr_get_src(instr, 1);
+    }
+}
+
+static bool same_reg(opnd_t a, opnd_t b) {
+    return opnd_is_reg(a) && opnd_is_reg(b) && opnd_get_reg(a) == opnd_get_reg(b);
+}
+
+static opnd_t widen(opnd_t opnd, VECT_FMA_rule *info, bool afterModification, int unrollFactor) {
+    if (opnd_is_reg(opnd)) {
+        reg_id_t reg = opnd_get_reg(opnd);
+        return opnd_create_reg(reg_is_xmm(reg) ? reg - DR_REG_XMM0 + DR_REG_YMM0 : reg);
+    }
+    if (opnd_is_memory_reference(opnd)) {
+        opnd_set_size(&opnd, OPSZ_32);
+        // If after induction update, displacement that expected original increment must be updated.
+        if (afterModification)
+            opnd_set_disp(&opnd, opnd_get_disp(opnd) - (unrollFactor-1)*info->stride);
+    }
+    return opnd;
+}
+
+static instr_t *create_fma(void *dc, int form, bool single, opnd_t dst, opnd_t src1, opnd_t src2) {
+    switch (form) {
+        case 132:
+            return single ? INSTR_CREATE_vfmadd132ps(dc, dst, src1, src2) : INSTR_CREATE_vfmadd132pd(dc, dst, src1, src2);
+        case 213:
+            return single ? INSTR_CREATE_vfmadd213ps(dc, dst, src1, src2) : INSTR_CREATE_vfmadd213pd(dc, dst, src1, src2);
+        default:
+            return single ? INSTR_CREATE_vfmadd231ps(dc, dst, src1, src2) : INSTR_CREATE_vfmadd231pd(dc, dst, src1, src2);
+    }
+}
+
+bool vector_fused_mul_add(JANUS_CONTEXT, VECT_FMA_rule *info, instr_t *mul, instr_t *add, int vectorSize) {
+    if (!myFMA || vectorSize != 32) return false;
+
+    bool single = is_single(instr_get_opcode(add));
+    int wordSize = single ? 4 : 8;
+    int unrollFactor = vectorSize / wordSize;
+    opnd_t product = instr_get_dst(mul, 0);
+    opnd_t m1, m2, a1, a2, addend;
+    get_sources(mul, &m1, &m2);
+    get_sources(add, &a1, &a2);
+
+    // dst = m1 * m2 + addend
+    if (same_reg(a1, product) && !same_reg(a2, product)) addend = a2;
+    else if (same_reg(a2, product) && !same_reg(a1, product)) addend = a1;
+    else return false;
+    // Only the last source of a fused multiply-add can be in memory.
+    if (opnd_is_memory_reference(m1) + opnd_is_memory_reference(m2) + opnd_is_memory_reference(addend) > 1)
+        return false;
+    if (opnd_is_memory_reference(m1)) {
+        opnd_t temp = m1;
+        m1 = m2;
+        m2 = temp;
+    }
+
+    opnd_t dst = widen(instr_get_dst(add, 0), info, false, unrollFactor);
+    m1 = widen(m1, info, info->mulAfterModification, unrollFactor);
+    m2 = widen(m2, info, info->mulAfterModification, unrollFactor);
+    addend = widen(addend, info, info->addAfterModification, unrollFactor);
+
+    instr_t *instr;
+    if (same_reg(addend, dst)) {
+        // dst = m1 * m2 + dst
+        instr = create_fma(drcontext, 231, single, dst, m1, m2);
+    }
+    else if (same_reg(m1, dst) || same_reg(m2, dst)) {
+        opnd_t other = same_reg(m1, dst) ? m2 : m1;
+        if (opnd_is_memory_reference(other))
+            // dst = dst * other + addend
+            instr = create_fma(drcontext, 132, single, dst, addend, other);
+        else
+            // dst = other * dst + addend
+            instr = create_fma(drcontext, 213, single, dst, other, addend);
+    }
+    else {
+        // The destination is not a source, start from the addend.
+        if (opnd_is_memory_reference(addend))
+            PRE_INSERT(bb,add,get_movup(drcontext, &dst, &addend, wordSize));
+        else
+            PRE_INSERT(bb,add,get_movap(drcontext, &dst, &addend, wordSize));
+        instr = create_fma(drcontext, 231, single, dst, m1, m2);
+    }
+    PRE_INSERT(bb,add,instr);
+    instrlist_remove(bb, mul);
+    instrlist_remove(bb, add);
+    return true;
+}
@@ -0,0 +1,9 @@
+#include "janus_api.h"
+#include "VECT_rule_structs.h"
+#include "vhandler.h"
+#include <stdio.h>
+
+/* Replace the multiplication and the addition by a fused multiply-add.
+ * Returns false if the pair can't be fused, then both are extended separately */
+bool
+vector_fused_mul_add(JANUS_CONTEXT, VECT_FMA_rule *info, instr_t *mul, instr_t *add, int vectorSize);
@@ -0,0 +1,264 @@
+#include "gather.h"
+#include "extend.h"
+#include "utilities.h"
+
+#define LANE_OFFSET_TABLES 64
+
+/* Lane offsets of the AVX2 gather index, in units of the memory operand scale.
+ * The tables are shared by all the code cache and never freed */
+typedef struct _lane_offsets {
+    volatile int        ready;
+    int                 wordSize;
+    int64_t             step;
+    union {
+        int32_t         dwords[8];
+        int64_t         qwords[4];
+    };
+} lane_offsets_t;
+
+static lane_offsets_t lane_offsets[LANE_OFFSET_TABLES];
+static volatile int lane_offsets_count = 0;
+
+INSTR_INLINE
+static reg_id_t get_xmm(reg_id_t reg) {
+    return reg_is_ymm(reg) ? reg - DR_REG_YMM0 + DR_REG_XMM0 : reg;
+}
+
+INSTR_INLINE
+static reg_id_t get_ymm(reg_id_t reg) {
+    return reg_is_xmm(reg) ? reg - DR_REG_XMM0 + DR_REG_YMM0 : reg;
+}
+
+static lane_offsets_t *get_lane_offsets(int64_t step, int wordSize) {
+    int lanes = 32 / wordSize;
+    int i, count = lane_offsets_count;
+
+    for (i = 0; i < count && i < LANE_OFFSET_TABLES; i++) {
+        if (lane_offsets[i].ready && lane_offsets[i].step == step && lane_offsets[i].wordSize == wordSize)
+            return lane_offsets + i;
+    }
+    // Single precision lanes use dword indices.
+    if (wordSize == 4 && (step * (lanes - 1) > INT32_MAX || step * (lanes - 1) < INT32_MIN))
+        return NULL;
+    // A table may be created twice by concurrent translations, both are valid.
+    i = __sync_fetch_and_add(&lane_offsets_count, 1);
+    if (i >= LANE_OFFSET_TABLES) return NULL;
+
+    lane_offsets[i].step = step;
+    lane_offsets[i].wordSize = wordSize;
+    for (int lane = 0; lane < lanes; lane++) {
+        if (wordSize == 4) lane_offsets[i].dwords[lane] = (int32_t)(step * lane);
+        else lane_offsets[i].qwords[lane] = step * lane;
+    }
+    __sync_synchronize();
+    lane_offsets[i].ready = 1;
+    return lane_offsets + i;
+}
+
+static int get_memory_source(instr_t *instr) {
+    for (int i = 0; i < instr_num_srcs(instr); i++) {
+        if (opnd_is_memory_reference(instr_get_src(instr, i))) return i;
+    }
+    return -1;
+}
+
+static bool is_scalar_move(int opcode) {
+    return opcode == OP_movss || opcode == OP_vmovss || opcode == OP_movsd || opcode == OP_vmovsd;
+}
+
+// Memory operand of the first lane.
+static void get_first_lane(VECT_STRIDED_rule *info, opnd_t *mem, int lanes) {
+    // If after induction update, the first lane is the iteration lanes-1 steps before.
+    if (info->afterModification) {
+        opnd_set_disp(mem, opnd_get_disp(*mem) - (lanes - 1) * info->stride);
+    }
+    opnd_set_size(mem, opnd_size_from_bytes(info->vectorWordSize));
+}
+
+static instr_t *get_lane_load(void *dc, opnd_t *d, opnd_t *s, int lane, int vectorWordSize) {
+    if (vectorWordSize == 4) {
+        if (lane == 0)
+            return CPU_HAS_AVX(myCPU) ? INSTR_CREATE_vmovss(dc, *d, *s) : INSTR_CREATE_movss(dc, *d, *s);
+        if (CPU_HAS_AVX(myCPU))
+            return INSTR_CREATE_vinsertps(dc, *d, *d, *s, OPND_CREATE_INT8(lane << 4));
+        else
+            return INSTR_CREATE_insertps(dc, *d, *s, OPND_CREATE_INT8(lane << 4));
+    }
+    else {
+        if (lane == 0)
+            return CPU_HAS_AVX(myCPU) ? INSTR_CREATE_vmovsd(dc, *d, *s) : INSTR_CREATE_movsd(dc, *d, *s);
+        if (CPU_HAS_AVX(myCPU))
+            return instr_create_1dst_2src(dc, OP_vmovhpd, *d, *d, *s);
+        else
+            return INSTR_CREATE_movhpd(dc, *d, *s);
+    }
+}
+
+static instr_t *get_lane_store(void *dc, opnd_t *d, opnd_t *s, int lane, int vectorWordSize) {
+    if (vectorWordSize == 4) {
+        if (lane == 0)
+            return CPU_HAS_AVX(myCPU) ? INSTR_CREATE_vmovss(dc, *d, *s) : INSTR_CREATE_movss(dc, *d, *s);
+        if (CPU_HAS_AVX(myCPU))
+            return INSTR_CREATE_vextractps(dc, *d, *s, OPND_CREATE_INT8(lane));
+        else
+            return INSTR_CREATE_extractps(dc, *d, *s, OPND_CREATE_INT8(lane));
+    }
+    else {
+        if (lane == 0)
+            return CPU_HAS_AVX(myCPU) ? INSTR_CREATE_vmovsd(dc, *d, *s) : INSTR_CREATE_movsd(dc, *d, *s);
+        return CPU_HAS_AVX(myCPU) ? INSTR_CREATE_vmovhpd(dc, *d, *s) : INSTR_CREATE_movhpd(dc, *d, *s);
+    }
+}
+
+// Gather with a vector of indices, the memory operand index register is added to each lane.
+static bool insert_gather_avx2(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, opnd_t *mem,
+        reg_id_t dst) {
+    instr_t *instr;
+    reg_id_t index = opnd_get_index(*mem);
+    int scale = index == DR_REG_NULL ? 1 : opnd_get_scale(*mem);
+    int vectorWordSize = info->vectorWordSize;
+
+    if (info->stride % scale != 0 || (index != DR_REG_NULL && !reg_is_64bit(index))) return false;
+    lane_offsets_t *offsets = get_lane_offsets(info->stride / scale, vectorWordSize);
+    if (!offsets) return false;
+
+    opnd_t xIndex = opnd_create_reg(info->indexVectReg);
+    opnd_t yIndex = opnd_create_reg(get_ymm(info->indexVectReg));
+    opnd_t yMask = opnd_create_reg(get_ymm(info->maskVectReg));
+    opnd_t table = opnd_create_rel_addr(offsets->dwords, OPSZ_32);
+    if (index == DR_REG_NULL) {
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vmovdqu(drcontext, yIndex, table));
+    }
+    else if (vectorWordSize == 4) {
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vmovd(drcontext, xIndex, opnd_create_reg(reg_64_to_32(index))));
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vpbroadcastd(drcontext, yIndex, xIndex));
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vpaddd(drcontext, yIndex, yIndex, table));
+    }
+    else {
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vmovd(drcontext, xIndex, opnd_create_reg(index)));
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vpbroadcastq(drcontext, yIndex, xIndex));
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vpaddq(drcontext, yIndex, yIndex, table));
+    }
+    // The gather clears the mask, it is set to all lanes every time.
+    PRE_INSERT(bb,trigger,INSTR_CREATE_vpcmpeqd(drcontext, yMask, yMask, yMask));
+
+    opnd_t vsib = opnd_create_base_disp(opnd_get_base(*mem), get_ymm(info->indexVectReg), scale,
+        opnd_get_disp(*mem), opnd_size_from_bytes(vectorWordSize));
+    if (vectorWordSize == 4)
+        instr = INSTR_CREATE_vgatherdps(drcontext, opnd_create_reg(get_ymm(dst)), vsib, yMask);
+    else
+        instr = INSTR_CREATE_vgatherqpd(drcontext, opnd_create_reg(get_ymm(dst)), vsib, yMask);
+    PRE_INSERT(bb,trigger,instr);
+    return true;
+}
+
+// Load the lanes one by one into each 16-byte half, the upper half is built in tmp.
+static void insert_load_lanes(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, opnd_t *mem,
+        reg_id_t dst, reg_id_t tmp, int vectorSize) {
+    int vectorWordSize = info->vectorWordSize;
+    int halfLanes = 16 / vectorWordSize;
+
+    for (int half = 0; half < vectorSize / 16; half++) {
+        opnd_t x = opnd_create_reg(half ? get_xmm(tmp) : get_xmm(dst));
+        for (int lane = 0; lane < halfLanes; lane++) {
+            opnd_t src = *mem;
+            opnd_set_disp(&src, opnd_get_disp(*mem) + (half * halfLanes + lane) * info->stride);
+            PRE_INSERT(bb,trigger,get_lane_load(drcontext, &x, &src, lane, vectorWordSize));
+        }
+    }
+    if (vectorSize == 32) {
+        opnd_t y = opnd_create_reg(get_ymm(dst));
+        PRE_INSERT(bb,trigger,INSTR_CREATE_vperm2f128(drcontext, y, y, opnd_create_reg(get_ymm(tmp)),
+            OPND_CREATE_INT8(0x20)));
+    }
+}
+
+// Every lane reads the same element, the access doesn't move with the vectorised loop.
+static void insert_broadcast_lanes(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, opnd_t *mem,
+        reg_id_t dst, int vectorSize) {
+    bool single = info->vectorWordSize == 4;
+    opnd_t x = opnd_create_reg(get_xmm(dst));
+    if (CPU_HAS_AVX(myCPU)) {
+        opnd_t y = opnd_create_reg(vectorSize == 32 ? get_ymm(dst) : get_xmm(dst));
+        if (single)
+            PRE_INSERT(bb,trigger,INSTR_CREATE_vbroadcastss(drcontext, y, *mem));
+        else if (vectorSize == 32)
+            PRE_INSERT(bb,trigger,INSTR_CREATE_vbroadcastsd(drcontext, y, *mem));
+        else
+            PRE_INSERT(bb,trigger,INSTR_CREATE_vmovddup(drcontext, x, *mem));
+    }
+    else {
+        PRE_INSERT(bb,trigger,get_lane_load(drcontext, &x, mem, 0, info->vectorWordSize));
+        PRE_INSERT(bb,trigger,single ? INSTR_CREATE_shufps(drcontext, x, x, OPND_CREATE_INT8(0))
+                                     : INSTR_CREATE_shufpd(drcontext, x, x, OPND_CREATE_INT8(0)));
+    }
+}
+
+// Store the lanes one by one from each 16-byte half, the upper half is extracted to tmp.
+static void insert_store_lanes(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, opnd_t *mem,
+        reg_id_t src, reg_id_t tmp, int vectorSize) {
+    int vectorWordSize = info->vectorWordSize;
+    int halfLanes = 16 / vectorWordSize;
+
+    for (int half = 0; half < vectorSize / 16; half++) {
+        opnd_t x = opnd_create_reg(half ? get_xmm(tmp) : get_xmm(src));
+        if (half) {
+            PRE_INSERT(bb,trigger,INSTR_CREATE_vextractf128(drcontext, x, opnd_create_reg(get_ymm(src)),
+                OPND_CREATE_INT8(1)));
+        }
+        for (int lane = 0; lane < halfLanes; lane++) {
+            opnd_t dst = *mem;
+            opnd_set_disp(&dst, opnd_get_disp(*mem) + (half * halfLanes + lane) * info->stride);
+            PRE_INSERT(bb,trigger,get_lane_store(drcontext, &dst, &x, lane, vectorWordSize));
+        }
+    }
+}
+
+void vector_gather(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, int vectorSize) {
+    int opcode = instr_get_opcode(trigger);
+    int memIndex = get_memory_source(trigger);
+    if (memIndex < 0 || !opnd_is_base_disp(instr_get_src(trigger, memIndex))) {
+        dr_printf("gather handler: memory operand not yet implemented: ");
+        instr_disassemble(drcontext, trigger, STDOUT);
+        dr_printf("\n");
+        return;
+    }
+    opnd_t mem = instr_get_src(trigger, memIndex);
+    get_first_lane(info, &mem, vectorSize / info->vectorWordSize);
+
+    // A move gathers straight into its destination, arithmetic into the free register.
+    bool move = is_scalar_move(opcode);
+    reg_id_t lanes = move ? opnd_get_reg(instr_get_dst(trigger, 0)) : info->freeVectReg;
+    if (info->stride == 0) {
+        insert_broadcast_lanes(janus_context, info, trigger, &mem, lanes, vectorSize);
+    }
+    else if (!(CPU_HAS_AVX2(myCPU) && insert_gather_avx2(janus_context, info, trigger, &mem, lanes))) {
+        insert_load_lanes(janus_context, info, trigger, &mem, lanes, info->indexVectReg, vectorSize);
+    }
+
+    if (!move) {
+        instr_set_src(trigger, memIndex, opnd_create_reg(info->freeVectReg));
+        set_all_opnd_size(trigger, opnd_size_from_bytes(vectorSize));
+        opnd_t dst = instr_get_dst(trigger, 0);
+        opnd_t src1 = instr_get_src(trigger, 0);
+        opnd_t src2 = instr_get_src(trigger, 1);
+        opnd_t spill = opnd_create_reg(vectorSize == 32 ? get_ymm(info->freeVectReg) : info->freeVectReg);
+        vector_extend_transform_3opnds(janus_context, trigger, opcode, &dst, &src1, &src2, &spill,
+            info->vectorWordSize);
+    }
+    instrlist_remove(bb, trigger);
+}
+
+void vector_scatter(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, int vectorSize) {
+    opnd_t mem = instr_get_dst(trigger, 0);
+    opnd_t src = instr_get_src(trigger, 0);
+    if (!is_scalar_move(instr_get_opcode(trigger)) || !opnd_is_base_disp(mem) || !opnd_is_reg(src)) {
+        dr_printf("scatter handler: instruction not yet implemented: ");
+        instr_disassemble(drcontext, trigger, STDOUT);
+        dr_printf("\n");
+        return;
+    }
+    get_first_lane(info, &mem, vectorSize / info->vectorWordSize);
+    insert_store_lanes(janus_context, info, trigger, &mem, opnd_get_reg(src), info->freeVectReg, vectorSize);
+    instrlist_remove(bb, trigger);
+}
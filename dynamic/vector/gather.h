@@ -0,0 +1,10 @@
+#include "janus_api.h"
+#include "VECT_rule_structs.h"
+#include "vhandler.h"
+#include <stdio.h>
+
+void
+vector_gather(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, int vectorSize);
+
+void
+vector_scatter(JANUS_CONTEXT, VECT_STRIDED_rule *info, instr_t *trigger, int vectorSize);
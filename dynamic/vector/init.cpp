@@ -1,138 +1,118 @@
 #include "init.h"
+#include "reduce.h"
+#include "utilities.h"
 
-// Post insert executes from last inserted up.
+// Instructions are pre inserted before the last instruction of the init block, in program order.
 
-void vector_init_single_avx(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    // Restore original initial reduction value from spill into first lane.
-    instr_t *instr = INSTR_CREATE_insertps(drcontext, *reductReg, *spillVector, OPND_CREATE_INT8(0));
-    POST_INSERT(bb,trigger,instr);
-    opnd_t bigReduct = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-    // Copy xmm into ymm.
-    instr = INSTR_CREATE_vperm2f128(drcontext, bigReduct, bigReduct, bigReduct, OPND_CREATE_INT8(0));
-    POST_INSERT(bb,trigger,instr);
-    if (info->init) {
-        // Convert currently int values into floats.
-        instr = INSTR_CREATE_vcvtdq2ps(drcontext, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
-        // Replicate init value across all lanes in xmm.
-        instr = INSTR_CREATE_vshufps(drcontext, *reductReg, *reductReg, *reductReg, OPND_CREATE_INT8(0));
-        POST_INSERT(bb,trigger,instr);
-        // Insert init value from reg into xmm.
-        instr = INSTR_CREATE_vpinsrd(drcontext, *reductReg, *reductReg, *freeDoubleReg, OPND_CREATE_INT8(0));
-        POST_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_mov_imm(drcontext, *freeDoubleReg, OPND_CREATE_INT32(info->init));
-        POST_INSERT(bb,trigger,instr);
+static void shift_lanes(JANUS_CONTEXT, instr_t *trigger, opnd_t *reg, bool left, bool single, int bits) {
+    instr_t *instr;
+    if (CPU_HAS_AVX(myCPU)) {
+        if (single)
+            instr = left ? INSTR_CREATE_vpslld(drcontext, *reg, OPND_CREATE_INT8(bits), *reg)
+                         : INSTR_CREATE_vpsrld(drcontext, *reg, OPND_CREATE_INT8(bits), *reg);
+        else
+            instr = left ? INSTR_CREATE_vpsllq(drcontext, *reg, OPND_CREATE_INT8(bits), *reg)
+                         : INSTR_CREATE_vpsrlq(drcontext, *reg, OPND_CREATE_INT8(bits), *reg);
     }
     else {
-        // init == 0 so xoring self works.
-        instr = INSTR_CREATE_vpxor(drcontext, *reductReg, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
+        if (single)
+            instr = left ? INSTR_CREATE_pslld(drcontext, *reg, OPND_CREATE_INT8(bits))
+                         : INSTR_CREATE_psrld(drcontext, *reg, OPND_CREATE_INT8(bits));
+        else
+            instr = left ? INSTR_CREATE_psllq(drcontext, *reg, OPND_CREATE_INT8(bits))
+                         : INSTR_CREATE_psrlq(drcontext, *reg, OPND_CREATE_INT8(bits));
     }
-    // Store original initial reduction value in spill.
-    instr = INSTR_CREATE_vmovss(drcontext, *spillVector, *reductReg);
-    POST_INSERT(bb,trigger,instr);
+    PRE_INSERT(bb,trigger,instr);
 }
 
-void vector_init_single_sse(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    // Restore original initial reduction value from spill into first lane.
-    instr_t *instr = INSTR_CREATE_insertps(drcontext, *reductReg, *spillVector, OPND_CREATE_INT8(0));
-    POST_INSERT(bb,trigger,instr);
-    if (info->init) {
-        // Convert currently int values into floats.
-        instr = INSTR_CREATE_cvtdq2ps(drcontext, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
-        // Replicate init value across all lanes in xmm.
-        instr = INSTR_CREATE_shufps(drcontext, *reductReg, *reductReg, OPND_CREATE_INT8(0));
-        POST_INSERT(bb,trigger,instr);
-        // Insert init value from reg into xmm.
-        instr = INSTR_CREATE_pinsrd(drcontext, *reductReg, *freeDoubleReg, OPND_CREATE_INT8(0));
-        POST_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_mov_imm(drcontext, *freeDoubleReg, OPND_CREATE_INT32(info->init));
-        POST_INSERT(bb,trigger,instr);
+// Set every lane of the free register to the identity of the operation without a memory constant.
+static void init_identity(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger, bool single) {
+    bool avx = CPU_HAS_AVX(myCPU);
+    opnd_t freeVectReg = opnd_create_reg(info->freeVectReg);
+    instr_t *instr;
+    if (info->op == REDUCE_OR || info->op == REDUCE_XOR) {
+        instr = avx ? INSTR_CREATE_vpxor(drcontext, freeVectReg, freeVectReg, freeVectReg)
+                    : INSTR_CREATE_pxor(drcontext, freeVectReg, freeVectReg);
+        PRE_INSERT(bb,trigger,instr);
     }
     else {
-        // init == 0 so xoring self works.
-        instr = INSTR_CREATE_pxor(drcontext, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
+        instr = avx ? INSTR_CREATE_vpcmpeqd(drcontext, freeVectReg, freeVectReg, freeVectReg)
+                    : INSTR_CREATE_pcmpeqd(drcontext, freeVectReg, freeVectReg);
+        PRE_INSERT(bb,trigger,instr);
+        if (info->op == REDUCE_ADD) {
+            // Only the sign bit: -0.0 is the identity of the addition, +0.0 is not.
+            shift_lanes(janus_context, trigger, &freeVectReg, true, single, single ? 31 : 63);
+        }
+        else if (info->op == REDUCE_MUL) {
+            // Exponent bits except the top one: 1.0.
+            shift_lanes(janus_context, trigger, &freeVectReg, true, single, single ? 25 : 54);
+            shift_lanes(janus_context, trigger, &freeVectReg, false, single, 2);
+        }
+    }
+    if (avx) {
+        // Copy xmm into the upper half of ymm.
+        opnd_t bigFree = get_reduce_reg(info->freeVectReg, avx);
+        instr = INSTR_CREATE_vperm2f128(drcontext, bigFree, bigFree, bigFree, OPND_CREATE_INT8(0));
+        PRE_INSERT(bb,trigger,instr);
     }
-    // Store original initial reduction value in spill.
-    instr = INSTR_CREATE_movss(drcontext, *spillVector, *reductReg);
-    POST_INSERT(bb,trigger,instr);
 }
 
-void vector_init_single(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-        vector_init_single_avx(janus_context, info, trigger, reductReg, spillVector, freeDoubleReg);
+// Min and max accumulators start with the initial value in every lane.
+static void init_broadcast(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger, bool single) {
+    bool avx = CPU_HAS_AVX(myCPU);
+    opnd_t reductReg = opnd_create_reg(info->reg);
+    opnd_t bigReduct = get_reduce_reg(info->reg, avx);
+    instr_t *instr;
+    if (avx) {
+        instr = single ? INSTR_CREATE_vshufps(drcontext, reductReg, reductReg, reductReg, OPND_CREATE_INT8(0))
+                       : INSTR_CREATE_vshufpd(drcontext, reductReg, reductReg, reductReg, OPND_CREATE_INT8(0));
+        PRE_INSERT(bb,trigger,instr);
+        instr = INSTR_CREATE_vperm2f128(drcontext, bigReduct, bigReduct, bigReduct, OPND_CREATE_INT8(0));
     }
     else {
-        vector_init_single_sse(janus_context, info, trigger, reductReg, spillVector, freeDoubleReg);
+        instr = single ? INSTR_CREATE_shufps(drcontext, reductReg, reductReg, OPND_CREATE_INT8(0))
+                       : INSTR_CREATE_shufpd(drcontext, reductReg, reductReg, OPND_CREATE_INT8(0));
     }
-}
-
-void vector_init_double_avx(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    opnd_t bigReduct = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-    opnd_t bigSpill = opnd_create_reg(info->freeVectReg - DR_REG_XMM0 + DR_REG_YMM0);
-    // Copy xmm into ymm.
-    instr_t *instr = INSTR_CREATE_vperm2f128(drcontext, bigReduct, bigSpill, bigReduct, OPND_CREATE_INT8(2));
-    POST_INSERT(bb,trigger,instr);
-    // Convert currently int values into doubles.
-    instr = INSTR_CREATE_vcvtdq2pd(drcontext, *spillVector, *spillVector);
-    POST_INSERT(bb,trigger,instr);
-    for (int i = 0; i < 2; i++) {
-        // Insert init value from reg into both xmm lanes.
-        instr = INSTR_CREATE_vpinsrd(drcontext, *spillVector, *spillVector, *freeDoubleReg, OPND_CREATE_INT8(i));
-        POST_INSERT(bb,trigger,instr);
+    PRE_INSERT(bb,trigger,instr);
+    for (int i = 0; i < 16; i++) {
+        if (!(info->accMask & (1 << i))) continue;
+        opnd_t extra = get_reduce_reg(DR_REG_XMM0 + i, avx);
+        instr = get_movap(drcontext, &extra, &bigReduct, info->vectorWordSize);
+        PRE_INSERT(bb,trigger,instr);
     }
-    // Convert currently int values into doubles.
-    instr = INSTR_CREATE_vcvtdq2pd(drcontext, *reductReg, *reductReg);
-    POST_INSERT(bb,trigger,instr);
-    // Insert init value from reg into upper xmm lane.
-    instr = INSTR_CREATE_vpinsrd(drcontext, *reductReg, *reductReg, *freeDoubleReg, OPND_CREATE_INT8(1));
-    POST_INSERT(bb,trigger,instr);
-    instr = INSTR_CREATE_mov_imm(drcontext, *freeDoubleReg, OPND_CREATE_INT32(info->init));
-    POST_INSERT(bb,trigger,instr);
-    // Convert currently initial reduction value to int.
-    instr = INSTR_CREATE_vcvtdq2pd(drcontext, *reductReg, *reductReg);
-    POST_INSERT(bb,trigger,instr);
 }
 
-void vector_init_double_sse(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    // Restore original initial reduction value from spill into first lane.
-    instr_t *instr = INSTR_CREATE_movsd(drcontext, *reductReg, *spillVector);
-    POST_INSERT(bb,trigger,instr);
-    if (info->init) {
-        // Convert currently int values into doubles.
-        instr = INSTR_CREATE_cvtdq2pd(drcontext, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
-        for (int i = 0; i < 2; i++) {
-            // Insert init value from reg into both xmm lanes.
-            instr = INSTR_CREATE_pinsrd(drcontext, *reductReg, *freeDoubleReg, OPND_CREATE_INT8(i));
-            POST_INSERT(bb,trigger,instr);
-        }
-        instr = INSTR_CREATE_mov_imm(drcontext, *freeDoubleReg, OPND_CREATE_INT32(info->init));
-        POST_INSERT(bb,trigger,instr);
-    }
-    else {
-        // init == 0 so xoring self works.
-        instr = INSTR_CREATE_pxor(drcontext, *reductReg, *reductReg);
-        POST_INSERT(bb,trigger,instr);
+void vector_init_reduction(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger) {
+    bool single = info->vectorWordSize == 4;
+    bool avx = CPU_HAS_AVX(myCPU);
+    if (info->op == REDUCE_MIN || info->op == REDUCE_MAX) {
+        init_broadcast(janus_context, info, trigger, single);
+        return;
     }
-    // Store original initial reduction value in spill.
-    instr = INSTR_CREATE_movsd(drcontext, *spillVector, *reductReg);
-    POST_INSERT(bb,trigger,instr);
-}
+    init_identity(janus_context, info, trigger, single);
 
-void vector_init_double(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg) {
-    if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-        vector_init_double_avx(janus_context, info, trigger, reductReg, spillVector, freeDoubleReg);
+    opnd_t reductReg = opnd_create_reg(info->reg);
+    opnd_t freeVectReg = opnd_create_reg(info->freeVectReg);
+    opnd_t bigReduct = get_reduce_reg(info->reg, avx);
+    opnd_t bigFree = get_reduce_reg(info->freeVectReg, avx);
+    instr_t *instr;
+    for (int i = 0; i < 16; i++) {
+        if (!(info->accMask & (1 << i))) continue;
+        opnd_t extra = get_reduce_reg(DR_REG_XMM0 + i, avx);
+        instr = get_movap(drcontext, &extra, &bigFree, info->vectorWordSize);
+        PRE_INSERT(bb,trigger,instr);
+    }
+    // Keep the initial value in the first lane, the other lanes take the identity.
+    if (avx) {
+        instr = single ? INSTR_CREATE_vblendps(drcontext, bigReduct, bigFree, bigReduct, OPND_CREATE_INT8(1))
+                       : INSTR_CREATE_vblendpd(drcontext, bigReduct, bigFree, bigReduct, OPND_CREATE_INT8(1));
+        PRE_INSERT(bb,trigger,instr);
     }
     else {
-        vector_init_double_sse(janus_context, info, trigger, reductReg, spillVector, freeDoubleReg);
+        instr = single ? INSTR_CREATE_movss(drcontext, freeVectReg, reductReg)
+                       : INSTR_CREATE_movsd(drcontext, freeVectReg, reductReg);
+        PRE_INSERT(bb,trigger,instr);
+        instr = get_movap(drcontext, &reductReg, &freeVectReg, info->vectorWordSize);
+        PRE_INSERT(bb,trigger,instr);
     }
 }
@@ -3,25 +3,7 @@
 #include "vhandler.h"
 #include <stdio.h>
 
+/* Keep the initial value in the first lane of the accumulator and set the other lanes
+ * and the extra accumulators to the identity of the reduction operation */
 void
-vector_init_single_avx(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
-
-void
-vector_init_single_sse(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
-
-void
-vector_init_single(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
-
-void
-vector_init_double_avx(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
-
-void
-vector_init_double_sse(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
-
-void vector_init_double(JANUS_CONTEXT, VECT_REDUCE_INIT_rule *info, instr_t *trigger, opnd_t *reductReg, 
-        opnd_t *spillVector, opnd_t *freeDoubleReg);
\ No newline at end of file
+vector_init_reduction(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger);
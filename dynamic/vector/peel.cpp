@@ -0,0 +1,139 @@
+#include "peel.h"
+#include "utilities.h"
+
+// The scalar iterations are copied from the application, the loop body is in another fragment.
+static instr_t *decode_app_instr(void *drcontext, app_pc pc) {
+    instr_t *instr = instr_create(drcontext);
+    if (!decode(drcontext, pc, instr)) {
+        instr_destroy(drcontext, instr);
+        return NULL;
+    }
+    return instr;
+}
+
+// Insert a loop running the body up to the compare of the loop branch count times, count is left at 0.
+static void insert_scalar_loop(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, app_pc start, opnd_t *count,
+        instr_t *where) {
+    instr_t *loop = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    PRE_INSERT(bb,where,INSTR_CREATE_test(drcontext, *count, *count));
+    PRE_INSERT(bb,where,INSTR_CREATE_jcc(drcontext, OP_jz, opnd_create_instr(done)));
+    PRE_INSERT(bb,where,loop);
+    app_pc pc = start;
+    while (pc < start + info->compareOffset) {
+        instr_t *instr = decode_app_instr(drcontext, pc);
+        if (!instr) break;
+        pc += instr_length(drcontext, instr);
+        instr_set_meta_no_translation(instr);
+        PRE_INSERT(bb,where,instr);
+    }
+    PRE_INSERT(bb,where,INSTR_CREATE_dec(drcontext, *count));
+    PRE_INSERT(bb,where,INSTR_CREATE_jcc(drcontext, OP_jnz, opnd_create_instr(loop)));
+    PRE_INSERT(bb,where,done);
+}
+
+// The peel goes after the init block. The rest of the fragment is removed, so that the loop
+// starts its own fragment and the vector rules apply from the first iteration.
+static instr_t *get_peel_point(JANUS_CONTEXT, instr_t *trigger) {
+    instr_t *point = INSTR_CREATE_label(drcontext);
+    if (instr_is_cti(trigger)) {
+        PRE_INSERT(bb,trigger,point);
+        return point;
+    }
+    instr_t *last = trigger;
+    instr_t *instr = instr_get_next(trigger);
+    while (instr) {
+        instr_t *next = instr_get_next(instr);
+        if (instr_is_app(instr)) {
+            instrlist_remove(bb, instr);
+            instr_destroy(drcontext, instr);
+        }
+        else last = instr;
+        instr = next;
+    }
+    POST_INSERT(bb,last,point);
+    return point;
+}
+
+// Index of the compare's source holding the iterator.
+static int get_iterator_src(instr_t *compare, reg_id_t iterReg) {
+    for (int i = 0; i < instr_num_srcs(compare); i++) {
+        opnd_t src = instr_get_src(compare, i);
+        if (opnd_is_reg(src) && reg_to_pointer_sized(opnd_get_reg(src)) == reg_to_pointer_sized(iterReg))
+            return i;
+    }
+    return -1;
+}
+
+void vector_align_peel(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger, int vectorSize) {
+    app_pc start = instr_get_app_pc(trigger) + info->startOffset;
+    int lanes = vectorSize / info->vectorWordSize;
+    opnd_t bound = opnd_create_reg(info->boundReg);
+    opnd_t count = opnd_create_reg(info->countReg);
+    instr_t *store = decode_app_instr(drcontext, start + info->storeOffset);
+    instr_t *compare = decode_app_instr(drcontext, start + info->compareOffset);
+    int iterSrc = compare ? get_iterator_src(compare, info->iterReg) : -1;
+    if (!store || iterSrc < 0) {
+        if (store) instr_destroy(drcontext, store);
+        if (compare) instr_destroy(drcontext, compare);
+        return;
+    }
+    instr_t *point = get_peel_point(janus_context, trigger);
+
+    // Elements up to the next vector aligned address of the store.
+    opnd_t mem = opnd_create_null();
+    for (int i = 0; i < instr_num_dsts(store); i++) {
+        if (opnd_is_memory_reference(instr_get_dst(store, i))) mem = instr_get_dst(store, i);
+    }
+    if (opnd_is_base_disp(mem)) {
+        opnd_t addr = opnd_create_base_disp(opnd_get_base(mem), opnd_get_index(mem), opnd_get_scale(mem),
+            opnd_get_disp(mem), OPSZ_lea);
+        PRE_INSERT(bb,point,INSTR_CREATE_lea(drcontext, bound, addr));
+    }
+    else {
+        PRE_INSERT(bb,point,INSTR_CREATE_mov_imm(drcontext, bound, OPND_CREATE_INT64((ptr_int_t)opnd_get_addr(mem))));
+    }
+    // A store that is not aligned to its element never becomes vector aligned, no iteration is peeled.
+    instr_t *misaligned = INSTR_CREATE_label(drcontext);
+    instr_t *peeled = INSTR_CREATE_label(drcontext);
+    PRE_INSERT(bb,point,INSTR_CREATE_test(drcontext, bound, OPND_CREATE_INT32(info->vectorWordSize - 1)));
+    PRE_INSERT(bb,point,INSTR_CREATE_jcc(drcontext, OP_jnz, opnd_create_instr(misaligned)));
+    PRE_INSERT(bb,point,INSTR_CREATE_neg(drcontext, bound));
+    PRE_INSERT(bb,point,INSTR_CREATE_and(drcontext, bound, OPND_CREATE_INT32((vectorSize - 1) & ~(info->vectorWordSize - 1))));
+    PRE_INSERT(bb,point,INSTR_CREATE_shr(drcontext, bound, OPND_CREATE_INT8(info->vectorWordSize == 4 ? 2 : 3)));
+    PRE_INSERT(bb,point,INSTR_CREATE_jmp(drcontext, opnd_create_instr(peeled)));
+    PRE_INSERT(bb,point,misaligned);
+    PRE_INSERT(bb,point,INSTR_CREATE_xor(drcontext, bound, bound));
+    PRE_INSERT(bb,point,peeled);
+
+    // Iterations left over by the vector loop.
+    PRE_INSERT(bb,point,INSTR_CREATE_mov_imm(drcontext, count, OPND_CREATE_INT32(info->iterCount % lanes)));
+    PRE_INSERT(bb,point,INSTR_CREATE_sub(drcontext, count, bound));
+    PRE_INSERT(bb,point,INSTR_CREATE_and(drcontext, count, OPND_CREATE_INT32(lanes - 1)));
+
+    insert_scalar_loop(janus_context, info, start, &bound, point);
+
+    // The vector loop stops the left over iterations before the original bound.
+    opnd_t iter = instr_get_src(compare, iterSrc);
+    opnd_t limit = instr_get_src(compare, 1 - iterSrc);
+    opnd_t sizedBound = opnd_create_reg(reg_resize_to_opsz(info->boundReg, opnd_get_size(iter)));
+    PRE_INSERT(bb,point,INSTR_CREATE_imul_imm(drcontext, bound, count, OPND_CREATE_INT32(info->stride)));
+    PRE_INSERT(bb,point,INSTR_CREATE_neg(drcontext, bound));
+    PRE_INSERT(bb,point,INSTR_CREATE_add(drcontext, sizedBound, limit));
+
+    instr_destroy(drcontext, store);
+    instr_destroy(drcontext, compare);
+}
+
+void vector_align_bound(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger) {
+    int iterSrc = get_iterator_src(trigger, info->iterReg);
+    if (iterSrc < 0) return;
+    opnd_t iter = instr_get_src(trigger, iterSrc);
+    instr_set_src(trigger, 1 - iterSrc, opnd_create_reg(reg_resize_to_opsz(info->boundReg, opnd_get_size(iter))));
+}
+
+void vector_align_tail(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger) {
+    app_pc start = instr_get_app_pc(trigger) + info->startOffset;
+    opnd_t count = opnd_create_reg(info->countReg);
+    insert_scalar_loop(janus_context, info, start, &count, trigger);
+}
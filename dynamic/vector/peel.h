@@ -0,0 +1,17 @@
+#include "janus_api.h"
+#include "VECT_rule_structs.h"
+#include "vhandler.h"
+#include <stdio.h>
+
+/* Run scalar iterations after the init block until the store stream is aligned to the
+ * vector width, then set the bound of the vector loop and the count of the left over iterations */
+void
+vector_align_peel(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger, int vectorSize);
+
+/* Compare the iterator with the bound set by the peel */
+void
+vector_align_bound(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger);
+
+/* Run the left over scalar iterations before the exit block */
+void
+vector_align_tail(JANUS_CONTEXT, VECT_LOOP_ALIGN_rule *info, instr_t *trigger);
@@ -1,119 +1,100 @@
 #include "reduce.h"
+#include "utilities.h"
 
-void reduce_multiply_single(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, 
-        opnd_t *reductReg, opnd_t *freeVectReg) {
-    instr_t *instr;
-    if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-        opnd_t bigReductReg = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-        // Copy upper ymm into free xmm.
-        instr = INSTR_CREATE_vextractf128(drcontext, *freeVectReg, bigReductReg, OPND_CREATE_INT8(1));
-        PRE_INSERT(bb,trigger,instr);
-        // Multiply copied upper ymm with lower ymm.
-        instr = INSTR_CREATE_vmulps(drcontext, *reductReg, *freeVectReg, *reductReg);
-        PRE_INSERT(bb,trigger,instr);
-        // First iteration: Multiply upper xmm two lanes by lower xmm two lanes.
-        // Second iteration: Multiply lower xmm two lanes together.
-        for (int shift = 8; shift >= 4; shift -= 4) {
-            instr = INSTR_CREATE_vmovaps(drcontext, *freeVectReg, *reductReg);
-            PRE_INSERT(bb,trigger,instr);
-            // Shift lanes right.
-            instr = INSTR_CREATE_vpsrldq(drcontext, *freeVectReg, OPND_CREATE_INT8(shift), *freeVectReg);
-            PRE_INSERT(bb,trigger,instr);
-            instr = INSTR_CREATE_vmulps(drcontext, *reductReg, *freeVectReg, *reductReg);
-            PRE_INSERT(bb,trigger,instr);
-        }
-    }
-    else {
-        // First iteration: Multiply upper two lanes by lower two lanes.
-        // Second iteration: Multiply lower two lanes together.
-        for (int shift = 8; shift >= 4; shift -= 4) {
-            instr = INSTR_CREATE_movaps(drcontext, *freeVectReg, *reductReg);
-            PRE_INSERT(bb,trigger,instr);
-            // Shift lanes right.
-            instr = INSTR_CREATE_psrldq(drcontext, *freeVectReg, OPND_CREATE_INT8(shift));
-            PRE_INSERT(bb,trigger,instr);
-            instr = INSTR_CREATE_mulps(drcontext, *reductReg, *freeVectReg);
-            PRE_INSERT(bb,trigger,instr);
-        }
+opnd_t get_reduce_reg(reg_id_t reg, bool avx) {
+    return opnd_create_reg(avx ? reg - DR_REG_XMM0 + DR_REG_YMM0 : reg);
+}
+
+instr_t *create_reduce_op(void *dc, ReduceOp op, bool single, bool avx, opnd_t dst, opnd_t src) {
+    switch (op) {
+        case REDUCE_ADD:
+            if (avx) return single ? INSTR_CREATE_vaddps(dc, dst, dst, src) : INSTR_CREATE_vaddpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_addps(dc, dst, src) : INSTR_CREATE_addpd(dc, dst, src);
+        case REDUCE_MUL:
+            if (avx) return single ? INSTR_CREATE_vmulps(dc, dst, dst, src) : INSTR_CREATE_vmulpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_mulps(dc, dst, src) : INSTR_CREATE_mulpd(dc, dst, src);
+        case REDUCE_MIN:
+            if (avx) return single ? INSTR_CREATE_vminps(dc, dst, dst, src) : INSTR_CREATE_vminpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_minps(dc, dst, src) : INSTR_CREATE_minpd(dc, dst, src);
+        case REDUCE_MAX:
+            if (avx) return single ? INSTR_CREATE_vmaxps(dc, dst, dst, src) : INSTR_CREATE_vmaxpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_maxps(dc, dst, src) : INSTR_CREATE_maxpd(dc, dst, src);
+        case REDUCE_AND:
+            if (avx) return single ? INSTR_CREATE_vandps(dc, dst, dst, src) : INSTR_CREATE_vandpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_andps(dc, dst, src) : INSTR_CREATE_andpd(dc, dst, src);
+        case REDUCE_OR:
+            if (avx) return single ? INSTR_CREATE_vorps(dc, dst, dst, src) : INSTR_CREATE_vorpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_orps(dc, dst, src) : INSTR_CREATE_orpd(dc, dst, src);
+        default:
+            if (avx) return single ? INSTR_CREATE_vxorps(dc, dst, dst, src) : INSTR_CREATE_vxorpd(dc, dst, dst, src);
+            return single ? INSTR_CREATE_xorps(dc, dst, src) : INSTR_CREATE_xorpd(dc, dst, src);
     }
 }
 
-void reduce_multiply_double(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger,
-        opnd_t *reductReg, opnd_t *freeVectReg) {
+void reduce_lanes(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger) {
+    bool single = info->vectorWordSize == 4;
+    bool avx = CPU_HAS_AVX(myCPU);
+    opnd_t reductReg = opnd_create_reg(info->reg);
+    opnd_t freeVectReg = opnd_create_reg(info->freeVectReg);
     instr_t *instr;
-    if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-        opnd_t bigReductReg = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-        // Copy upper ymm into free xmm.
-        instr = INSTR_CREATE_vextractf128(drcontext, *freeVectReg, bigReductReg, OPND_CREATE_INT8(1));
-        PRE_INSERT(bb,trigger,instr);
-        // Multiply copied upper ymm with lower ymm.
-        instr = INSTR_CREATE_vmulpd(drcontext, *reductReg, *freeVectReg, *reductReg);
-        PRE_INSERT(bb,trigger,instr);
-        // Multiply two xmm lanes together.
-        instr = INSTR_CREATE_vmovapd(drcontext, *freeVectReg, *reductReg);
-        PRE_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_vpsrldq(drcontext, *freeVectReg, OPND_CREATE_INT8(8), *freeVectReg);
-        PRE_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_vmulpd(drcontext, *reductReg, *freeVectReg, *reductReg);
+
+    // Fold the extra accumulators into the accumulator.
+    for (int i = 0; i < 16; i++) {
+        if (!(info->accMask & (1 << i))) continue;
+        instr = create_reduce_op(drcontext, info->op, single, avx, get_reduce_reg(info->reg, avx),
+            get_reduce_reg(DR_REG_XMM0 + i, avx));
         PRE_INSERT(bb,trigger,instr);
     }
-    else {
-        // Multiply two lanes together.
-        instr = INSTR_CREATE_movapd(drcontext, *freeVectReg, *reductReg);
+    if (avx) {
+        // Fold the upper xmm onto the lower xmm.
+        instr = INSTR_CREATE_vextractf128(drcontext, freeVectReg, get_reduce_reg(info->reg, avx), OPND_CREATE_INT8(1));
         PRE_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_psrldq(drcontext, *freeVectReg, OPND_CREATE_INT8(8));
+        instr = create_reduce_op(drcontext, info->op, single, avx, reductReg, freeVectReg);
         PRE_INSERT(bb,trigger,instr);
-        instr = INSTR_CREATE_mulpd(drcontext, *reductReg, *freeVectReg);
-        PRE_INSERT(bb,trigger,instr);
-    }
-}
-
-void reduce_multiply(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *freeVectReg) {
-    if (info->vectorWordSize == 4) {
-        reduce_multiply_single(janus_context, info, trigger, reductReg, freeVectReg);
-    }
-    else {
-        reduce_multiply_double(janus_context, info,trigger, reductReg, freeVectReg);
-    }
-}
-
-void reduce_add(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, 
-        opnd_t *reductReg, opnd_t *freeVectReg) {
-    instr_t *instr;
-    if (info->vectorWordSize == 4) {
-        if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-            opnd_t bigReductReg = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-            // Copy upper ymm into free xmm.
-            instr = INSTR_CREATE_vextractf128(drcontext, *freeVectReg, bigReductReg, OPND_CREATE_INT8(1));
+        // Fold the upper two lanes onto the lower two lanes, then the second lane onto the first.
+        if (single) {
+            instr = INSTR_CREATE_vpermilps(drcontext, freeVectReg, reductReg, OPND_CREATE_INT8(0x0E));
             PRE_INSERT(bb,trigger,instr);
-            // Add copied upper ymm onto lower ymm.
-            instr = INSTR_CREATE_vaddps(drcontext, *reductReg, *freeVectReg, *reductReg);
+            instr = create_reduce_op(drcontext, info->op, single, avx, reductReg, freeVectReg);
             PRE_INSERT(bb,trigger,instr);
-            instr = INSTR_CREATE_vhaddps(drcontext, *reductReg, *reductReg, *reductReg);
+            instr = INSTR_CREATE_vpermilps(drcontext, freeVectReg, reductReg, OPND_CREATE_INT8(0x01));
         }
         else {
-            instr = INSTR_CREATE_haddps(drcontext, *reductReg, *reductReg);
+            instr = INSTR_CREATE_vpermilpd(drcontext, freeVectReg, reductReg, OPND_CREATE_INT8(0x01));
         }
-        // Two horizontal additions sum up all xmm values into the first lane.
-        PRE_INSERT(bb,trigger,instr_clone(drcontext, instr));
+        PRE_INSERT(bb,trigger,instr);
+        instr = create_reduce_op(drcontext, info->op, single, avx, reductReg, freeVectReg);
         PRE_INSERT(bb,trigger,instr);
     }
-    else if (info->vectorWordSize == 8) {
-        if (myCPU == AVX_SUPPORT || myCPU == AVX2_SUPPORT) {
-            opnd_t bigReductReg = opnd_create_reg(info->reg - DR_REG_XMM0 + DR_REG_YMM0);
-            // Copy upper ymm into free xmm.
-            instr = INSTR_CREATE_vextractf128(drcontext, *freeVectReg, bigReductReg, OPND_CREATE_INT8(1));
+    else {
+        // The upper 64 bits hold the second double or the upper two singles.
+        instr = INSTR_CREATE_pshufd(drcontext, freeVectReg, reductReg, OPND_CREATE_INT8(0x0E));
+        PRE_INSERT(bb,trigger,instr);
+        instr = create_reduce_op(drcontext, info->op, single, avx, reductReg, freeVectReg);
+        PRE_INSERT(bb,trigger,instr);
+        if (single) {
+            instr = INSTR_CREATE_pshufd(drcontext, freeVectReg, reductReg, OPND_CREATE_INT8(0x01));
             PRE_INSERT(bb,trigger,instr);
-            // Add copied upper ymm onto lower ymm.
-            instr = INSTR_CREATE_vaddpd(drcontext, *reductReg, *freeVectReg, *reductReg);
+            instr = create_reduce_op(drcontext, info->op, single, avx, reductReg, freeVectReg);
             PRE_INSERT(bb,trigger,instr);
-            instr = INSTR_CREATE_vhaddpd(drcontext, *reductReg, *reductReg, *reductReg);
-        }
-        else {
-            instr = INSTR_CREATE_haddpd(drcontext, *reductReg, *reductReg);
         }
-        // A horizontal addition sums up the two xmm lanes into the first lane.
+    }
+}
+
+void reduce_rotate(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger) {
+    bool avx = CPU_HAS_AVX(myCPU);
+    opnd_t freeVectReg = get_reduce_reg(info->freeVectReg, avx);
+    opnd_t prev = get_reduce_reg(info->reg, avx);
+    // The register moves are eliminated at renaming.
+    instr_t *instr = get_movap(drcontext, &freeVectReg, &prev, info->vectorWordSize);
+    PRE_INSERT(bb,trigger,instr);
+    for (int i = 0; i < 16; i++) {
+        if (!(info->accMask & (1 << i))) continue;
+        opnd_t extra = get_reduce_reg(DR_REG_XMM0 + i, avx);
+        instr = get_movap(drcontext, &prev, &extra, info->vectorWordSize);
         PRE_INSERT(bb,trigger,instr);
+        prev = extra;
     }
-}
\ No newline at end of file
+    instr = get_movap(drcontext, &prev, &freeVectReg, info->vectorWordSize);
+    PRE_INSERT(bb,trigger,instr);
+}
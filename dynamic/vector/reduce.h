@@ -3,18 +3,18 @@
 #include "vhandler.h"
 #include <stdio.h>
 
-void 
-reduce_multiply_single(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, 
-        opnd_t *reductReg, opnd_t *freeVectReg);
+/* Accumulators are full ymm registers under AVX */
+opnd_t
+get_reduce_reg(reg_id_t reg, bool avx);
 
-void
-reduce_multiply_double(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger,
-        opnd_t *reductReg, opnd_t *freeVectReg);
+/* Packed form of the reduction operation, dst = dst op src */
+instr_t *
+create_reduce_op(void *dc, ReduceOp op, bool single, bool avx, opnd_t dst, opnd_t src);
 
+/* Combine the extra accumulators and the lanes of the accumulator into its first lane */
 void
-reduce_multiply(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, opnd_t *reductReg,
-        opnd_t *freeVectReg);
+reduce_lanes(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger);
 
+/* Move each accumulator into the next one, so every register is only used once per round */
 void
-reduce_add(JANUS_CONTEXT, VECT_REDUCE_AFTER_rule *info, instr_t *trigger, 
-        opnd_t *reductReg, opnd_t *freeVectReg);
\ No newline at end of file
+reduce_rotate(JANUS_CONTEXT, VECT_REDUCE_rule *info, instr_t *trigger);
@@ -89,6 +89,36 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
             case VECT_BROADCAST:
                 vector_broadcast_handler(janus_context);
                 break;
+            case VECT_GATHER:
+                vector_gather_handler(janus_context);
+                break;
+            case VECT_SCATTER:
+                vector_scatter_handler(janus_context);
+                break;
+            case VECT_FMA:
+                vector_fma_handler(janus_context);
+                break;
+            case VECT_REDUCE_INIT:
+                vector_init_handler(janus_context);
+                break;
+            case VECT_REDUCE_ROTATE:
+                vector_reduce_rotate_handler(janus_context);
+                break;
+            case VECT_REDUCE_AFTER:
+                vector_reduce_handler(janus_context);
+                break;
+            case VECT_ALIGN_PEEL:
+                vector_align_peel_handler(janus_context);
+                break;
+            case VECT_ALIGN_BOUND:
+                vector_align_bound_handler(janus_context);
+                break;
+            case VECT_ALIGN_TAIL:
+                vector_align_tail_handler(janus_context);
+                break;
+            case APP_SPLIT_BLOCK:
+                split_block_handler(janus_context);
+                break;
             case PARA_LOOP_INIT:
                 vector_loop_init(janus_context);
                 break;
@@ -104,9 +134,6 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
             #ifdef FIX
             case VECT_FORCE_SSE:
                 break;
-            case VECT_REDUCE_INIT:
-                vector_init_handler(janus_context);
-                break;
             case VECT_REG_CHECK:
                 reg_check = rule;
                 break;
@@ -119,13 +146,6 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, b
                 vector_loop_unroll_handler(janus_context);
                 break;
 
-            case VECT_REDUCE_AFTER:
-                if (reg_check) {
-                    vector_reg_check_handler(drcontext,bb,reg_check,tag);
-                    reg_check = NULL;
-                }
-                vector_reduce_handler(janus_context);
-                break;
             case VECT_REVERT:
                 if (reg_check) {
                     vector_reg_check_handler(drcontext,bb,reg_check,tag);
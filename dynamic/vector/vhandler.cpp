@@ -3,11 +3,15 @@
 #include "extend.h"
 #include "reduce.h"
 #include "init.h"
+#include "peel.h"
 #include "broadcast.h"
+#include "gather.h"
+#include "fma.h"
 #include "VECT_rule_structs.h"
 #include <stdio.h>
 
 GHardware myCPU;
+bool myFMA;
 #define SSE4_1_FLAG     0x80000
 #define SSE4_2_FLAG     0x100000
 
@@ -24,7 +28,7 @@ static inline void _native_cpuid(int* cpuinfo, int info)
         "cpuid;"
         "xchg %%ebx, %%edi;"
         :"=a" (cpuinfo[0]), "=D" (cpuinfo[1]), "=c" (cpuinfo[2]), "=d" (cpuinfo[3])
-        :"0" (info)
+        :"0" (info), "2" (0)
     );
 }
 
@@ -64,6 +68,7 @@ janus_detect_hardware()
     sse4_1Supportted    = cpuinfo[2] & (1 << 19) || false;
     sse4_2Supportted    = cpuinfo[2] & (1 << 20) || false;
     avxSupportted       = cpuinfo[2] & (1 << 28) || false;
+    bool fmaSupported   = cpuinfo[2] & (1 << 12) || false;
     bool osxsaveSupported = cpuinfo[2] & (1 << 27) || false;
     if (osxsaveSupported && avxSupportted)
     {
@@ -71,6 +76,8 @@ janus_detect_hardware()
         unsigned long long xcrFeatureMask = _xgetbv(0);
         avxSupportted = (xcrFeatureMask & 0x6) == 0x6;
     }
+    // FMA uses the ymm state enabled for AVX
+    myFMA = fmaSupported && avxSupportted;
     _native_cpuid(cpuinfo, 7);
     avx2Supportted      = cpuinfo[1] & (1 << 5)  || false;
 
@@ -172,10 +179,34 @@ vector_loop_peel_handler(JANUS_CONTEXT)
     }
 }
 
-// Extend vector register instructions to use all lanes.
-void vector_extend_handler(JANUS_CONTEXT)
+// Align the store stream of the loop with scalar iterations before it.
+void
+vector_align_peel_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_LOOP_ALIGN_rule info = VECT_LOOP_ALIGN_rule(*rule);
+    vector_align_peel(janus_context, &info, trigger, get_my_vector_width());
+}
+
+void
+vector_align_bound_handler(JANUS_CONTEXT)
 {
     instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_LOOP_ALIGN_rule info = VECT_LOOP_ALIGN_rule(*rule);
+    vector_align_bound(janus_context, &info, trigger);
+}
+
+void
+vector_align_tail_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_LOOP_ALIGN_rule info = VECT_LOOP_ALIGN_rule(*rule);
+    vector_align_tail(janus_context, &info, trigger);
+}
+
+// Extend vector register instructions to use all lanes.
+static void vector_extend(JANUS_CONTEXT, VECT_CONVERT_rule *info, instr_t *trigger)
+{
 #ifdef JANUS_VERBOSE
     instr_disassemble(drcontext, trigger,STDOUT);
     dr_printf("\n");
@@ -186,24 +217,86 @@ void vector_extend_handler(JANUS_CONTEXT)
     set_all_opnd_size(trigger, opnd_size_from_bytes(vectorSize));
     opnd_t dst = instr_get_dst(trigger, 0);
     opnd_t src1 = instr_get_src(trigger, 0);
-    VECT_CONVERT_rule info = VECT_CONVERT_rule(*rule);
     if (opcode == OP_vaddss || opcode == OP_addss || opcode == OP_vsubss || opcode == OP_subss 
-     || opcode == OP_vmulss || opcode == OP_mulss || opcode == OP_vdivss || opcode == OP_divss) {
-        vector_extend_handler_arith(janus_context, &info, trigger, opcode, &dst, &src1, 4, vectorSize/4);
+     || opcode == OP_vmulss || opcode == OP_mulss || opcode == OP_vdivss || opcode == OP_divss
+     || opcode == OP_vminss || opcode == OP_minss || opcode == OP_vmaxss || opcode == OP_maxss) {
+        vector_extend_handler_arith(janus_context, info, trigger, opcode, &dst, &src1, 4, vectorSize/4);
     }
     else if (opcode == OP_vaddsd || opcode == OP_addsd || opcode == OP_vsubsd || opcode == OP_subsd
-          || opcode == OP_vmulsd || opcode == OP_mulsd || opcode == OP_vdivsd || opcode == OP_divsd) {
-        vector_extend_handler_arith(janus_context, &info, trigger, opcode, &dst, &src1, 8, vectorSize/8);
+          || opcode == OP_vmulsd || opcode == OP_mulsd || opcode == OP_vdivsd || opcode == OP_divsd
+          || opcode == OP_vminsd || opcode == OP_minsd || opcode == OP_vmaxsd || opcode == OP_maxsd) {
+        vector_extend_handler_arith(janus_context, info, trigger, opcode, &dst, &src1, 8, vectorSize/8);
+    }
+    else if (opcode == OP_vsqrtss || opcode == OP_sqrtss) {
+        vector_extend_handler_sqrt(janus_context, info, trigger, opcode, &dst, 4, vectorSize/4);
+    }
+    else if (opcode == OP_vsqrtsd || opcode == OP_sqrtsd) {
+        vector_extend_handler_sqrt(janus_context, info, trigger, opcode, &dst, 8, vectorSize/8);
     }
     else if (opcode == OP_vmovss || opcode == OP_movss || opcode == OP_movaps) {
-        vector_extend_handler_mov(janus_context, &info, trigger, &dst, &src1, 4, vectorSize/4);
+        vector_extend_handler_mov(janus_context, info, trigger, &dst, &src1, 4, vectorSize/4);
     }
     else if (opcode == OP_vmovsd || opcode == OP_movsd || opcode == OP_movapd) {
-        vector_extend_handler_mov(janus_context, &info, trigger, &dst, &src1, 8, vectorSize/8);
+        vector_extend_handler_mov(janus_context, info, trigger, &dst, &src1, 8, vectorSize/8);
+    }
+    else if (vector_extend_is_packed(opcode)) {
+        vector_extend_handler_packed(janus_context, info, trigger, opcode, vectorSize);
     }
-    else if (opcode == OP_pxor || opcode == OP_vpxor) {
-        vector_extend_handler_pxor(janus_context, trigger, opcode, &dst, &src1, vectorSize);
+}
+
+void vector_extend_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_CONVERT_rule info = VECT_CONVERT_rule(*rule);
+    vector_extend(janus_context, &info, trigger);
+}
+
+// Fuse a multiplication with the addition using its result.
+void vector_fma_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_FMA_rule info = VECT_FMA_rule(*rule);
+    app_pc mulPC = instr_get_app_pc(trigger) - info.mulOffset;
+    instr_t *mul = instrlist_first_app(bb);
+    while (mul && instr_get_app_pc(mul) != mulPC)
+        mul = instr_get_next_app(mul);
+    if (!mul) {
+        dr_printf("fma handler: multiplication not found\n");
+        return;
     }
+    if (vector_fused_mul_add(janus_context, &info, mul, trigger, get_my_vector_width())) return;
+
+    // Without FMA both instructions are extended on their own.
+    VECT_CONVERT_rule mulInfo = VECT_CONVERT_rule(NULL, 0, 0, 0, info.mulAfterModification, info.stride,
+        info.freeVectReg, ALIGNED, 0, info.iterCount);
+    VECT_CONVERT_rule addInfo = VECT_CONVERT_rule(NULL, 0, 0, 0, info.addAfterModification, info.stride,
+        info.freeVectReg, ALIGNED, 0, info.iterCount);
+    vector_extend(janus_context, &mulInfo, mul);
+    vector_extend(janus_context, &addInfo, trigger);
+}
+
+// Load the lanes of a strided read, with an AVX2 gather if available.
+void vector_gather_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_STRIDED_rule info = VECT_STRIDED_rule(*rule);
+#ifdef JANUS_VERBOSE
+    instr_disassemble(drcontext, trigger,STDOUT);
+    dr_printf("\n");
+#endif
+    vector_gather(janus_context, &info, trigger, get_my_vector_width());
+}
+
+// Store the lanes of a strided write one by one.
+void vector_scatter_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_STRIDED_rule info = VECT_STRIDED_rule(*rule);
+#ifdef JANUS_VERBOSE
+    instr_disassemble(drcontext, trigger,STDOUT);
+    dr_printf("\n");
+#endif
+    vector_scatter(janus_context, &info, trigger, get_my_vector_width());
 }
 
 // Broadcast loaded constant to all lanes.
@@ -315,32 +408,24 @@ void vector_loop_unaligned_handler(JANUS_CONTEXT)
 void vector_reduce_handler(JANUS_CONTEXT)
 {
     instr_t *trigger = get_trigger_instruction(bb,rule);
-    VECT_REDUCE_AFTER_rule info = VECT_REDUCE_AFTER_rule(*rule);
-    opnd_t reductReg = opnd_create_reg(info.reg);
-    opnd_t freeVectReg = opnd_create_reg(info.freeVectReg);
-    if (info.isMultiply) {
-        reduce_multiply(janus_context, &info, trigger, &reductReg, &freeVectReg);
-    }
-    else {
-        reduce_add(janus_context, &info, trigger, &reductReg, &freeVectReg);
-    }
+    VECT_REDUCE_rule info = VECT_REDUCE_rule(*rule);
+    reduce_lanes(janus_context, &info, trigger);
 }
 
-// Initialise a vector register's extra lanes with 0s or 1s for reduction.
+// Initialise a vector register's extra lanes with the identity of the reduction.
 void vector_init_handler(JANUS_CONTEXT) 
 {
     instr_t *trigger = get_trigger_instruction(bb,rule);
-    VECT_REDUCE_INIT_rule info = VECT_REDUCE_INIT_rule(*rule);
-    opnd_t reductReg = opnd_create_reg(info.reg);
-    opnd_t freeVectReg = opnd_create_reg(info.freeVectReg);
-    opnd_t freeDoubleReg = opnd_create_reg(info.freeReg - DR_REG_RAX + DR_REG_EAX);
-    // Instructions execute from last inserted to first inserted.
-    if (info.vectorWordSize == 4) {
-        vector_init_single(janus_context, &info, trigger, &reductReg, &freeVectReg, &freeDoubleReg);
-    }
-    else {
-        vector_init_double(janus_context, &info, trigger, &reductReg, &freeVectReg, &freeDoubleReg);
-    }
+    VECT_REDUCE_rule info = VECT_REDUCE_rule(*rule);
+    vector_init_reduction(janus_context, &info, trigger);
+}
+
+// Rotate the reduction accumulators before the loop branch.
+void vector_reduce_rotate_handler(JANUS_CONTEXT)
+{
+    instr_t *trigger = get_trigger_instruction(bb,rule);
+    VECT_REDUCE_rule info = VECT_REDUCE_rule(*rule);
+    reduce_rotate(janus_context, &info, trigger);
 }
 
 // Check a register's value before the loop to decide whether to vectorise.
@@ -11,6 +11,10 @@ typedef enum _hardware
 	AVX2_SUPPORT
 } GHardware;
 
+/* The 32-byte AVX sequences, and the AVX2 integer and gather forms */
+#define CPU_HAS_AVX(cpu) ((cpu) == AVX_SUPPORT || (cpu) == AVX2_SUPPORT)
+#define CPU_HAS_AVX2(cpu) ((cpu) == AVX2_SUPPORT)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -36,6 +40,9 @@ vector_reduce_handler(JANUS_CONTEXT);
 void
 vector_init_handler(JANUS_CONTEXT);
 
+void
+vector_reduce_rotate_handler(JANUS_CONTEXT);
+
 void
 vector_reg_check_handler(JANUS_CONTEXT);
 
@@ -51,6 +58,24 @@ vector_induction_recover_handler(JANUS_CONTEXT);
 void
 vector_loop_peel_handler(JANUS_CONTEXT);
 
+void
+vector_align_peel_handler(JANUS_CONTEXT);
+
+void
+vector_align_bound_handler(JANUS_CONTEXT);
+
+void
+vector_align_tail_handler(JANUS_CONTEXT);
+
+void
+vector_gather_handler(JANUS_CONTEXT);
+
+void
+vector_scatter_handler(JANUS_CONTEXT);
+
+void
+vector_fma_handler(JANUS_CONTEXT);
+
 void
 vector_loop_init(JANUS_CONTEXT);
 
@@ -58,6 +83,8 @@ void
 vector_loop_finish(JANUS_CONTEXT);
 
 extern GHardware myCPU;
+/* Fused multiply-add is available, the rules are only generated with -vreassoc */
+extern bool myFMA;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Benchmark the static analyser on the polybench binaries.
+# Runs analyze -stats=json on every benchmark, prints a summary per benchmark
+# and per analysis stage, and stores all reports in one JSON file.
+
+import sys, os, json, argparse, platform, subprocess
+
+DIR = os.path.dirname(os.path.abspath(__file__))
+
+def defaultBenchDir():
+    arch = "arm-gcc" if platform.machine() == "aarch64" else "x86-gcc"
+    return os.path.join(DIR, "..", "tests", "polybench", arch)
+
+def findBenchmarks(benchDir):
+    benchmarks = []
+    for name in sorted(os.listdir(benchDir)):
+        path = os.path.join(benchDir, name)
+        if '.' in name or not os.path.isfile(path) or not os.access(path, os.X_OK):
+            continue
+        benchmarks.append(name)
+    return benchmarks
+
+def runAnalysis(analyze, modes, benchDir, name):
+    cmd = [analyze, "-stats=json"] + modes + [name]
+    proc = subprocess.run(cmd, cwd=benchDir, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    if proc.returncode != 0:
+        print("Error: "+" ".join(cmd)+" failed: "+proc.stderr.decode("utf-8", "replace"))
+        return None
+    with open(os.path.join(benchDir, name+".stats.json")) as f:
+        return json.load(f)
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure the cost of each static analysis stage")
+    parser.add_argument("-a", "--analyze", default=os.path.join(DIR, "..", "bin", "analyze"),
+                        help="path to the analyze binary")
+    parser.add_argument("-m", "--mode", action="append",
+                        help="analysis mode option, can be repeated (default: -p)")
+    parser.add_argument("-r", "--repeat", type=int, default=1,
+                        help="runs per benchmark, the fastest run is reported")
+    parser.add_argument("-o", "--output", default="analysis_bench.json",
+                        help="file to store all reports")
+    parser.add_argument("benchmarks", nargs="*", help="benchmarks to run (default: all)")
+    parser.add_argument("-d", "--dir", default=defaultBenchDir(), help="benchmark directory")
+    args = parser.parse_args()
+
+    modes = args.mode if args.mode else ["-p"]
+    benchDir = os.path.abspath(args.dir)
+    benchmarks = args.benchmarks if args.benchmarks else findBenchmarks(benchDir)
+    analyze = os.path.abspath(args.analyze)
+
+    reports = {}
+    phases = {}
+    print("%-20s %10s %10s %12s %10s  %s" % ("benchmark", "wall(s)", "cpu(s)", "peak(MB)", "loops", "slowest stage"))
+    for name in benchmarks:
+        best = None
+        for i in range(args.repeat):
+            report = runAnalysis(analyze, modes, benchDir, name)
+            if report and (best is None or report["total"]["wall"] < best["total"]["wall"]):
+                best = report
+        if best is None:
+            continue
+        reports[name] = best
+        slowest = max(best["phases"], key=lambda p: p["cost"]["wall"]) if best["phases"] else None
+        for p in best["phases"]:
+            phases[p["name"]] = phases.get(p["name"], 0.0) + p["cost"]["wall"]
+        print("%-20s %10.3f %10.3f %12.1f %10d  %s" % (name, best["total"]["wall"], best["total"]["cpu"],
+              best["total"]["peak_rss_kb"] / 1024.0, best["objects"]["loops"],
+              slowest["name"] if slowest else "-"))
+
+    if not reports:
+        sys.exit(1)
+
+    total = sum(r["total"]["wall"] for r in reports.values())
+    print()
+    print("%-28s %10s %8s" % ("stage", "wall(s)", "%"))
+    for name, wall in sorted(phases.items(), key=lambda p: -p[1]):
+        print("%-28s %10.3f %8.1f" % (name, wall, wall * 100 / total if total else 0))
+    print("%-28s %10.3f" % ("total", total))
+
+    with open(args.output, "w") as f:
+        json.dump({"modes": modes, "benchmarks": reports}, f, indent=2)
+    print("Reports written to "+args.output)
+
+if __name__ == "__main__":
+    main()
@@ -13,6 +13,8 @@ typedef enum _para_schedule
     PARA_DOALL_CYCLIC_CHUNK,
     ///Each thread execute a chunk of iterations in speculative mode
     PARA_SPEC_CYCLIC_CHUNK,
+    ///Each thread executes chunks of iterations in turn, waiting for the chunks within the dependence distance
+    PARA_DOACROSS,
 } SchedulePolicy;
 
 
@@ -67,7 +69,10 @@ typedef struct loop_header {
     uint8_t         saveflag;
     /** \brief If set true, it means this loop is an inner loop, please use lightweight threading support */
     uint32_t        isInnerLoop;
-    /** \brief original SIMD word size */
+    /** \brief original SIMD word size
+     *
+     * Only set by the combined parallel and vector schedule, the runtime rounds the
+     * per-thread block to whole vectors. 0 if the loop body is not vectorised */
     uint32_t        vectorWordSize;
     /* The following is required by dynamic code generation */
     uint32_t        validateGPRMask;
@@ -81,6 +86,21 @@ typedef struct loop_header {
     uint32_t        jumpInstructionOpcode;
     /* True if the loop jcc jumps to start a new iteration (false if jumping ends the loop) */
     uint8_t         jumpingGoesBack; 
+    /** \brief Number of iterations the prefetch rules of this loop fetch ahead, 0 if none
+     *
+     * Only used by the combined parallel and prefetch schedule, the runtime clamps it to the per-thread block */
+    uint32_t        prefetchDistance;
+    /** \brief True if the iterations run as transactions (TX_START/TX_REDIRECT)
+     *
+     * The transactions are committed in the order of the chunks of iterations */
+    uint32_t        speculative;
+    /** \brief Minimum loop-carried dependence distance in iterations, only used by PARA_DOACROSS */
+    uint32_t        dependenceDistance;
+    /** \brief Minimum number of iterations to run the loop in parallel
+     *
+     * Checked at loop entry when the iteration count is only known at runtime,
+     * smaller invocations are run by the main thread */
+    uint32_t        minIterations;
 } RSLoopHeader;
 
 #endif
@@ -8,11 +8,13 @@
  *  Loop Header
  *  Rule instructions
  *  Rule data
+ *  Loop code templates (optional, see template_format.h)
  */
 #ifndef _JANUS_REWRITE_SCHEDULE_FORMAT_
 #define _JANUS_REWRITE_SCHEDULE_FORMAT_
 
 #include "loop_format.h"
+#include "template_format.h"
 
 /** \brief Rewrite schedule header */
 typedef struct rsched_header {
@@ -27,7 +29,8 @@ typedef struct rsched_header {
     uint32_t        numRules;
     uint32_t        numLoops;
     uint32_t        numFuncs;
-    uint32_t        dummy;
+    /** \brief Offset of the loop code template section, 0 if not present */
+    uint32_t        templateOffset;
 } RSchedHeader;
 
 /** \brief Rewrite schedule meta information
@@ -39,6 +42,9 @@ typedef struct _janus_info {
     uint32_t        number_of_cores;
     uint32_t        number_of_functions;
     RSchedHeader    *header;
+    ///Path and size of the rewrite schedule file
+    const char      *path;
+    uint64_t        file_size;
     RSLoopHeader    *loop_header;
     uint32_t        channel;
     uint32_t        number_of_variables;
@@ -0,0 +1,124 @@
+/*! \file template_format.h
+ *  \brief Defines the format of the pre-assembled loop code section in the rewrite schedule
+ *
+ *  The section is optional and is appended after the rule data. It is located
+ *  by RSchedHeader::templateOffset and contains the following structure
+ *  Template header
+ *  Code templates
+ *  Relocations
+ *  Code
+ *
+ *  The templates are recorded by the parallel client (JANUS_TEMPLATE_RECORD)
+ *  and embedded into the schedule by the static analyser on the next run.
+ */
+#ifndef _JANUS_RS_TEMPLATE_FORMAT_
+#define _JANUS_RS_TEMPLATE_FORMAT_
+
+/** \brief Magic number of the template section: "JTPL" */
+#define RS_TEMPLATE_MAGIC        0x4c50544a
+/** \brief Increase when the layout of the section or the generated code changes */
+#define RS_TEMPLATE_VERSION      1
+
+/** \brief Kind of loop code stored in a template */
+typedef enum _template_kind
+{
+    ///Loop init executed by the main thread
+    TEMPLATE_LOOP_INIT,
+    ///Loop finish executed by the main thread
+    TEMPLATE_LOOP_FINISH,
+    ///Loop init shared by all parallelising threads
+    TEMPLATE_THREAD_LOOP_INIT,
+    ///Loop finish shared by all parallelising threads
+    TEMPLATE_THREAD_LOOP_FINISH,
+    TEMPLATE_KIND_COUNT
+} TemplateKind;
+
+/** \brief Runtime object a relocation refers to */
+typedef enum _reloc_symbol
+{
+    ///Field in the janus_shared_t structure
+    RELOC_SHARED,
+    ///Field in the loop_t array, index is the dynamic loop id
+    RELOC_LOOP,
+    ///Field in janus_thread_t of the thread index
+    RELOC_THREAD,
+    ///janus_thread_pool_app
+    RELOC_THREAD_POOL,
+    ///janus_reenter_thread_pool_app
+    RELOC_REENTER_THREAD_POOL,
+    ///dr_redirect_native_target()
+    RELOC_REDIRECT_NATIVE
+} RelocSymbol;
+
+/** \brief How the relocated value is encoded in the code */
+typedef enum _reloc_type
+{
+    ///64-bit absolute address
+    RELOC_ABS64,
+    ///32-bit absolute address
+    RELOC_ABS32,
+    ///32-bit displacement relative to the end of the instruction
+    RELOC_PCREL32
+} RelocType;
+
+/** \brief Header of the template section */
+typedef struct template_header {
+    uint32_t        magic;
+    uint32_t        version;
+    /** \brief The generated code depends on the number of threads */
+    uint32_t        numberOfThreads;
+    uint32_t        numTemplates;
+    /** \brief Size of janus_shared_t and janus_thread_t of the recording client */
+    uint32_t        sharedSize;
+    uint32_t        threadSize;
+    /** \brief Checksum of the executable the templates were recorded for */
+    uint64_t        binaryChecksum;
+} RSTemplateHeader;
+
+/** \brief Pre-assembled code for one kind of loop code of one loop */
+typedef struct code_template {
+    /** \brief Dynamic loop id */
+    uint32_t        loopID;
+    /** \brief TemplateKind */
+    uint32_t        kind;
+    /** \brief Loop start address to check the template against the loop header */
+    uint64_t        loopStartAddr;
+    /** \brief Code offset relative to the start of the section */
+    uint32_t        codeOffset;
+    uint32_t        codeSize;
+    /** \brief Relocation offset relative to the start of the section */
+    uint32_t        relocOffset;
+    uint32_t        numRelocs;
+} RSCodeTemplate;
+
+/** \brief Location in a template to be patched at load time */
+typedef struct code_reloc {
+    /** \brief Offset of the patched field relative to the start of the code */
+    uint32_t        offset;
+    /** \brief Offset the PC relative displacement is relative to */
+    uint32_t        pcBase;
+    /** \brief RelocType */
+    uint8_t         type;
+    /** \brief RelocSymbol */
+    uint8_t         symbol;
+    uint16_t        index;
+    /** \brief Offset added to the symbol address */
+    int64_t         addend;
+} RSCodeReloc;
+
+/** \brief FNV-1a hash used for the binary checksum */
+static inline uint64_t
+rs_template_checksum(uint64_t hash, const void *data, uint64_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t i;
+
+    if (!hash) hash = 0xcbf29ce484222325ULL;
+    for (i=0; i<size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif
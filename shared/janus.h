@@ -44,7 +44,6 @@ typedef uint32_t        FuncID;
 typedef uint32_t        LoopID;
 
 #define NUM_OF_GENERAL_REGS     16
-//#define JANUS_VECT_SUPPORT
 
 /** \brief Rewrite rule generation mode for Janus
 
@@ -74,7 +73,11 @@ typedef enum _jmode {
     ///custom tool mode for Cinnamon domain specific language 
     JCUSTOM,
     //testing mode for DLL instrumentation
-    JDLL
+    JDLL,
+    ///parallelisation with software prefetch mode
+    JPARAFETCH,
+    ///parallelisation with vectorised loop bodies mode
+    JPARAVECT
 } JMode;
 
 /* Rule ISA header defines the supported static rules */
@@ -131,8 +131,13 @@ void print_profile(JVarProfile *profile)
     } else if (profile->type == ARRAY_PROFILE) {
         printf("Array base ");
         print_var(profile->array.base);
-        printf(" range ");
-        print_var(profile->array.max_range);
+        if (profile->array.unknown)
+            printf(" range unknown");
+        else {
+            printf(" range [%ld, %ld)", profile->array.low, profile->array.high);
+            if (profile->array.stride)
+                printf(" stride %ld per iteration", profile->array.stride);
+        }
         printf("\n");
     }
 }
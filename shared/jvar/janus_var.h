@@ -96,10 +96,23 @@ typedef struct _array {
     JVar                base;
     /** \brief runtime value for this array base, filled by MEM_RECORD_BOUNDS */
     uint64_t            runtime_base_value;
-    /** \brief static storage for this array range */
-    JVar                max_range;
-    /** \brief runtime value for this array base, filled by MEM_RECORD_RANGE */
-    uint64_t            runtime_range_value;
+    /** \brief byte offsets [low, high) from the base accessed by one loop invocation,
+     * including the access width, without the iterations counted at runtime */
+    int64_t             low;
+    int64_t             high;
+    /** \brief bytes the accesses move per iteration if the loop count is only known at loop entry */
+    int64_t             stride;
+    /** \brief final minus initial value of the loop main iterator:
+     * span_const + span_coeff[0] * span_var[0] + span_coeff[1] * span_var[1] */
+    JVar                span_var[2];
+    int64_t             span_coeff[2];
+    int64_t             span_const;
+    /** \brief stride of the loop main iterator, the loop runs span / span_step + 1 times */
+    int64_t             span_step;
+    /** \brief set if the loop writes to this array, reads only overlap with writes */
+    uint32_t            written;
+    /** \brief set if the range can't be bounded, the loop then always runs sequentially */
+    uint32_t            unknown;
 } Array;
 
 /** \brief Types of variable profile loaded by GVM */
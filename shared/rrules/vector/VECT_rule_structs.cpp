@@ -19,34 +19,34 @@ RewriteRule *VECT_RULE::encode() {
 }
     #endif
 
-//INIT
-VECT_REDUCE_INIT_rule::VECT_REDUCE_INIT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint16_t reg, uint16_t init, 
-        uint32_t freeReg, uint32_t freeVectReg): 
-            VECT_RULE(bb, pc, ID, VECT_REDUCE_INIT), reg(reg), init(init), freeReg(freeReg), freeVectReg(freeVectReg) 
+//REDUCE
+VECT_REDUCE_rule::VECT_REDUCE_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode, uint16_t reg,
+        ReduceOp op, uint16_t accMask, uint16_t freeVectReg):
+            VECT_RULE(bb, pc, ID, opcode), reg(reg), op(op), accMask(accMask), freeVectReg(freeVectReg),
+            vectorWordSize(0)
 {
-    opcode = VECT_REDUCE_INIT;
 }
 
-VECT_REDUCE_INIT_rule::VECT_REDUCE_INIT_rule(RRule &rule) {
+VECT_REDUCE_rule::VECT_REDUCE_rule(RRule &rule) {
     pc = rule.pc;
-    freeReg = rule.ureg0.down;
-    init = (uint16_t) (rule.ureg0.up >> 16);
-    reg = (uint16_t) (rule.ureg0.up & 0xffff);
+    opcode = (RuleOp) rule.opcode;
+    reg = (uint16_t) (rule.ureg0.down & 0xffff);
+    op = (ReduceOp) (rule.ureg0.down >> 16);
+    accMask = (uint16_t) (rule.ureg0.up & 0xffff);
+    freeVectReg = (uint16_t) (rule.ureg0.up >> 16);
     vectorWordSize = rule.ureg1.down;
-    freeVectReg = rule.ureg1.up;
 }
 
     #ifdef _STATIC_ANALYSIS_COMPILED
-RewriteRule *VECT_REDUCE_INIT_rule::encode() {
+RewriteRule *VECT_REDUCE_rule::encode() {
     RewriteRule *res = VECT_RULE::encode();
-    res->ureg0.down = freeReg;
-    res->ureg0.up = (init << 16) | (reg & 0xffff);
+    res->ureg0.down = ((uint32_t)op << 16) | (reg & 0xffff);
+    res->ureg0.up = ((uint32_t)freeVectReg << 16) | accMask;
     res->ureg1.down = vectorWordSize;
-    res->ureg1.up = freeVectReg;
     return res;
 }
 
-void VECT_REDUCE_INIT_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
+void VECT_REDUCE_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
     vectorWordSize = _vectorWordSize;
 }
     #endif
@@ -85,6 +85,45 @@ void VECT_LOOP_PEEL_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
 }
     #endif
 
+//ALIGN
+VECT_LOOP_ALIGN_rule::VECT_LOOP_ALIGN_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode,
+        int32_t startOffset, uint16_t compareOffset, uint16_t storeOffset, uint16_t iterReg, uint16_t boundReg,
+        uint16_t countReg, int8_t stride, uint32_t iterCount):
+            VECT_RULE(bb, pc, ID, opcode), startOffset(startOffset), compareOffset(compareOffset),
+            storeOffset(storeOffset), iterReg(iterReg), boundReg(boundReg), countReg(countReg),
+            vectorWordSize(0), iterCount(iterCount), stride(stride)
+{
+}
+
+VECT_LOOP_ALIGN_rule::VECT_LOOP_ALIGN_rule(RRule &rule) {
+    pc = rule.pc;
+    opcode = (RuleOp) rule.opcode;
+    startOffset = (int32_t) rule.ureg0.down;
+    compareOffset = (uint16_t) (rule.ureg0.up & 0xffff);
+    storeOffset = (uint16_t) (rule.ureg0.up >> 16);
+    iterReg = (uint16_t) (rule.ureg1.down & 0xff);
+    boundReg = (uint16_t) ((rule.ureg1.down >> 8) & 0xff);
+    countReg = (uint16_t) ((rule.ureg1.down >> 16) & 0xff);
+    vectorWordSize = rule.ureg1.down >> 24;
+    iterCount = rule.ureg1.up & 0xffffff;
+    stride = (int8_t) (rule.ureg1.up >> 24);
+}
+
+    #ifdef _STATIC_ANALYSIS_COMPILED
+RewriteRule *VECT_LOOP_ALIGN_rule::encode() {
+    RewriteRule *res = VECT_RULE::encode();
+    res->ureg0.down = (uint32_t) startOffset;
+    res->ureg0.up = ((uint32_t)storeOffset << 16) | compareOffset;
+    res->ureg1.down = (vectorWordSize << 24) | ((countReg & 0xff) << 16) | ((boundReg & 0xff) << 8) | (iterReg & 0xff);
+    res->ureg1.up = ((uint32_t)(uint8_t)stride << 24) | (iterCount & 0xffffff);
+    return res;
+}
+
+void VECT_LOOP_ALIGN_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
+    vectorWordSize = _vectorWordSize;
+}
+    #endif
+
 //REG_CHECK
 VECT_REG_CHECK_rule::VECT_REG_CHECK_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint64_t startOffset, 
         uint32_t reg, uint32_t value):
@@ -171,55 +210,88 @@ void VECT_INDUCTION_STRIDE_UPDATE_rule::updateVectorWordSize(uint32_t _vectorWor
 }
     #endif
 
-//REDUCE
-VECT_REDUCE_AFTER_rule::VECT_REDUCE_AFTER_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint32_t reg, uint32_t freeVectReg, 
-        bool isMultiply):
-            VECT_RULE(bb, pc, ID, VECT_REDUCE_AFTER), reg(reg), freeVectReg(freeVectReg), isMultiply(isMultiply) 
+//REVERT
+VECT_REVERT_rule::VECT_REVERT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint64_t reg):
+            VECT_RULE(bb, pc, ID, VECT_REVERT), reg(reg) 
 {
-    opcode = VECT_REDUCE_AFTER;
+    opcode = VECT_REVERT;
 }
 
-VECT_REDUCE_AFTER_rule::VECT_REDUCE_AFTER_rule(RRule &rule) {
+VECT_REVERT_rule::VECT_REVERT_rule(RRule &rule) {
     
     pc = rule.pc;
-    freeVectReg = rule.ureg0.down;
-    reg = rule.ureg0.up;
-    vectorWordSize = rule.ureg1.down;
-    isMultiply = (bool) rule.ureg1.up;
+    reg = rule.reg0;
 }
 
     #ifdef _STATIC_ANALYSIS_COMPILED
-RewriteRule *VECT_REDUCE_AFTER_rule::encode() {
+RewriteRule *VECT_REVERT_rule::encode() {
     RewriteRule *res = VECT_RULE::encode();
-    res->ureg0.down = freeVectReg;
-    res->ureg0.up = reg;
-    res->ureg1.down = vectorWordSize;
-    res->ureg1.up = isMultiply ? 1 : 0;
+    res->reg0 = reg;
+    return res;
+}
+    #endif
+
+//GATHER/SCATTER
+VECT_STRIDED_rule::VECT_STRIDED_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode,
+        int32_t stride, bool afterModification, uint16_t freeVectReg, uint16_t indexVectReg, uint16_t maskVectReg):
+            VECT_RULE(bb, pc, ID, opcode), stride(stride), vectorWordSize(0), afterModification(afterModification),
+            freeVectReg(freeVectReg), indexVectReg(indexVectReg), maskVectReg(maskVectReg)
+{
+}
+
+VECT_STRIDED_rule::VECT_STRIDED_rule(RRule &rule) {
+    pc = rule.pc;
+    opcode = (RuleOp) rule.opcode;
+    stride = (int32_t) rule.ureg0.down;
+    afterModification = (bool) (rule.ureg0.up >> 16);
+    vectorWordSize = (uint16_t) (rule.ureg0.up & 0xffff);
+    indexVectReg = (uint16_t) (rule.ureg1.down >> 16);
+    freeVectReg = (uint16_t) (rule.ureg1.down & 0xffff);
+    maskVectReg = (uint16_t) (rule.ureg1.up & 0xffff);
+}
+
+    #ifdef _STATIC_ANALYSIS_COMPILED
+RewriteRule *VECT_STRIDED_rule::encode() {
+    RewriteRule *res = VECT_RULE::encode();
+    res->ureg0.down = (uint32_t) stride;
+    res->ureg0.up = ((afterModification ? 1 : 0) << 16) | (vectorWordSize & 0xffff);
+    res->ureg1.down = (indexVectReg << 16) | (freeVectReg & 0xffff);
+    res->ureg1.up = maskVectReg & 0xffff;
     return res;
 }
 
-void VECT_REDUCE_AFTER_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
+void VECT_STRIDED_rule::updateVectorWordSize(uint32_t _vectorWordSize) {
     vectorWordSize = _vectorWordSize;
 }
     #endif
 
-//REVERT
-VECT_REVERT_rule::VECT_REVERT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint64_t reg):
-            VECT_RULE(bb, pc, ID, VECT_REVERT), reg(reg) 
+//FMA
+VECT_FMA_rule::VECT_FMA_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint16_t mulOffset, uint16_t stride,
+        bool mulAfterModification, bool addAfterModification, uint16_t freeVectReg, uint16_t iterCount):
+            VECT_RULE(bb, pc, ID, VECT_FMA), mulOffset(mulOffset), stride(stride),
+            mulAfterModification(mulAfterModification), addAfterModification(addAfterModification),
+            freeVectReg(freeVectReg), iterCount(iterCount)
 {
-    opcode = VECT_REVERT;
 }
 
-VECT_REVERT_rule::VECT_REVERT_rule(RRule &rule) {
-    
+VECT_FMA_rule::VECT_FMA_rule(RRule &rule) {
     pc = rule.pc;
-    reg = rule.reg0;
+    opcode = (RuleOp) rule.opcode;
+    mulOffset = (uint16_t) (rule.ureg0.down & 0xffff);
+    stride = (uint16_t) (rule.ureg0.down >> 16);
+    mulAfterModification = (bool) (rule.ureg0.up & 0xffff);
+    addAfterModification = (bool) (rule.ureg0.up >> 16);
+    freeVectReg = (uint16_t) (rule.ureg1.down & 0xffff);
+    iterCount = (uint16_t) (rule.ureg1.down >> 16);
 }
 
     #ifdef _STATIC_ANALYSIS_COMPILED
-RewriteRule *VECT_REVERT_rule::encode() {
+RewriteRule *VECT_FMA_rule::encode() {
     RewriteRule *res = VECT_RULE::encode();
-    res->reg0 = reg;
+    res->ureg0.down = (stride << 16) | mulOffset;
+    res->ureg0.up = ((addAfterModification ? 1 : 0) << 16) | (mulAfterModification ? 1 : 0);
+    res->ureg1.down = (iterCount << 16) | freeVectReg;
+    res->ureg1.up = 0;
     return res;
 }
-    #endif
\ No newline at end of file
+    #endif
@@ -51,27 +51,42 @@ struct VECT_RULE {
 };
 
 //structs storing and coding-decoding specific rules:
-/** \brief Struct storing, encoding and decoding VECT rules.
+/** \brief Operation of a reduction, the extra lanes start with its identity */
+enum ReduceOp {
+    REDUCE_ADD,
+    REDUCE_MUL,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_AND,
+    REDUCE_OR,
+    REDUCE_XOR
+};
+
+/** \brief Struct storing, encoding and decoding VECT_REDUCE_INIT, VECT_REDUCE_ROTATE and
+ *         VECT_REDUCE_AFTER rules.
+ *
+ * The extra accumulators are free SIMD registers, bit i of accMask stands for xmm i.
+ * They are rotated through the accumulator register at the end of each iteration.
  *
  * Layout:\n
- *     + reg0: [0-31] freeReg, [31-47] reg, [48-63] init\n
- *     + reg1: [0-31] vectorWordSize, [32-63] freeVectReg
+ *     + reg0: [0-15] reg, [16-31] op, [32-47] accMask, [48-63] freeVectReg\n
+ *     + reg1: [0-31] vectorWordSize
  */
-struct VECT_REDUCE_INIT_rule : public VECT_RULE {
-    /** \brief Vector word size in bytes of loop. */
-    uint32_t vectorWordSize;
-    /** \brief Register to be initialised. */
+struct VECT_REDUCE_rule : public VECT_RULE {
+    /** \brief Accumulator register of the scalar loop. */
     uint16_t reg;
-    /** \brief Value to be used for initialisation. */
-    uint16_t init;
-    /** \brief Free 8-byte register. */
-    uint32_t freeReg;
+    /** \brief Operation of the reduction. */
+    ReduceOp op;
+    /** \brief Registers of the extra accumulators. */
+    uint16_t accMask;
     /** \brief Free vector register. */
-    uint32_t freeVectReg;
+    uint16_t freeVectReg;
+    /** \brief Vector word size in bytes of loop. */
+    uint32_t vectorWordSize;
 
-    VECT_REDUCE_INIT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint16_t reg, uint16_t init, 
-        uint32_t freeReg, uint32_t freeVectReg);
-    VECT_REDUCE_INIT_rule(RRule &rule);
+    VECT_REDUCE_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode, uint16_t reg, ReduceOp op,
+        uint16_t accMask, uint16_t freeVectReg);
+    VECT_REDUCE_rule(RRule &rule);
     #ifdef _STATIC_ANALYSIS_COMPILED
     virtual janus::RewriteRule *encode();
     virtual void updateVectorWordSize(uint32_t vectorWordSize);
@@ -105,6 +120,48 @@ struct VECT_LOOP_PEEL_rule : public VECT_RULE {
     #endif
 };
 
+/** \brief Struct storing, encoding and decoding VECT_ALIGN_PEEL, VECT_ALIGN_BOUND and
+ *         VECT_ALIGN_TAIL rules.
+ *
+ * The peel runs scalar iterations until the store stream is aligned to the vector width,
+ * leaves the bound of the vector loop in boundReg and the left over iterations in countReg.
+ * Only the remainder of iterCount by the number of lanes is used, so its low 24 bits are kept.
+ *
+ * Layout:\n
+ *     + reg0: [0-31] startOffset, [32-47] compareOffset, [48-63] storeOffset\n
+ *     + reg1: [0-7] iterReg, [8-15] boundReg, [16-23] countReg, [24-31] vectorWordSize,
+ *             [32-55] iterCount, [56-63] stride
+ */
+struct VECT_LOOP_ALIGN_rule : public VECT_RULE {
+    /** \brief Start of loop's pc's offset from trigger pc. */
+    int32_t startOffset;
+    /** \brief Offset of the compare of the loop branch from the start of the loop. */
+    uint16_t compareOffset;
+    /** \brief Offset of the aligned store from the start of the loop. */
+    uint16_t storeOffset;
+    /** \brief Iterator register tested by the compare. */
+    uint16_t iterReg;
+    /** \brief Free 8-byte register holding the bound of the vector loop. */
+    uint16_t boundReg;
+    /** \brief Free 8-byte register holding the number of scalar iterations after the loop. */
+    uint16_t countReg;
+    /** \brief Vector word size in bytes of loop. */
+    uint32_t vectorWordSize;
+    /** \brief Loop's iteration count. */
+    uint32_t iterCount;
+    /** \brief Stride of the iterator. */
+    int8_t stride;
+
+    VECT_LOOP_ALIGN_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode, int32_t startOffset,
+        uint16_t compareOffset, uint16_t storeOffset, uint16_t iterReg, uint16_t boundReg, uint16_t countReg,
+        int8_t stride, uint32_t iterCount);
+    VECT_LOOP_ALIGN_rule(RRule &rule);
+    #ifdef _STATIC_ANALYSIS_COMPILED
+    virtual janus::RewriteRule *encode();
+    virtual void updateVectorWordSize(uint32_t vectorWordSize);
+    #endif
+};
+
 /** \brief Struct storing, encoding and decoding VECT rules.
  *
  * Layout:\n
@@ -186,39 +243,73 @@ struct VECT_INDUCTION_STRIDE_UPDATE_rule : public VECT_RULE {
 /** \brief Struct storing, encoding and decoding VECT rules.
  *
  * Layout:\n
- *     + reg0: [0-31] freeVectReg, [32-63] reg\n
- *     + reg1: [0-31] vectorWordSize, [32-63] isMultiply
+ *     + reg0: [0-63] reg\n
  */
-struct VECT_REDUCE_AFTER_rule : public VECT_RULE {
-    /** \brief Vector word size in bytes of loop. */
-    uint32_t vectorWordSize;
+struct VECT_REVERT_rule : public VECT_RULE {
     /** \brief Reduction register. */
-    uint32_t reg;
-    /** \brief Free vector register. */
-    uint32_t freeVectReg;
-    /** \brief Does the reduction use multiplication or division. */
-    bool isMultiply;
+    uint64_t reg;
+
+    VECT_REVERT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint64_t reg);
+    VECT_REVERT_rule(RRule &rule);
+    #ifdef _STATIC_ANALYSIS_COMPILED
+    virtual janus::RewriteRule *encode();
+    #endif
+};
+
+/** \brief Struct storing, encoding and decoding VECT_GATHER and VECT_SCATTER rules.
+ *
+ * Layout:\n
+ *     + reg0: [0-31] stride, [32-47] vectorWordSize, [48-63] afterModification\n
+ *     + reg1: [0-15] freeVectReg, [16-31] indexVectReg, [32-47] maskVectReg
+ */
+struct VECT_STRIDED_rule : public VECT_RULE {
+    /** \brief Distance in bytes between the accesses of two consecutive iterations. */
+    int32_t stride;
+    /** \brief Vector word size in bytes of loop. */
+    uint16_t vectorWordSize;
+    /** \brief Is the instruction after the modification of the induction variable. */
+    bool afterModification;
+    /** \brief Free vector register holding the loaded lanes. */
+    uint16_t freeVectReg;
+    /** \brief Free vector register for the lane indices. */
+    uint16_t indexVectReg;
+    /** \brief Free vector register for the gather mask. */
+    uint16_t maskVectReg;
 
-    VECT_REDUCE_AFTER_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint32_t reg, uint32_t freeVectReg, 
-        bool isMultiply);
-    VECT_REDUCE_AFTER_rule(RRule &rule);
+    VECT_STRIDED_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, RuleOp opcode, int32_t stride,
+        bool afterModification, uint16_t freeVectReg, uint16_t indexVectReg, uint16_t maskVectReg);
+    VECT_STRIDED_rule(RRule &rule);
     #ifdef _STATIC_ANALYSIS_COMPILED
     virtual janus::RewriteRule *encode();
     virtual void updateVectorWordSize(uint32_t vectorWordSize);
     #endif
 };
 
-/** \brief Struct storing, encoding and decoding VECT rules.
+/** \brief Struct storing, encoding and decoding VECT_FMA rules.
+ *
+ * The rule is attached to the addition, the multiplication is found at mulOffset bytes before it.
  *
  * Layout:\n
- *     + reg0: [0-63] reg\n
+ *     + reg0: [0-15] mulOffset, [16-31] stride, [32-47] mulAfterModification, [48-63] addAfterModification\n
+ *     + reg1: [0-15] freeVectReg, [16-31] iterCount
  */
-struct VECT_REVERT_rule : public VECT_RULE {
-    /** \brief Reduction register. */
-    uint64_t reg;
+struct VECT_FMA_rule : public VECT_RULE {
+    /** \brief Distance in bytes from the multiplication to the addition. */
+    uint16_t mulOffset;
+    /** \brief Stride in bytes of the memory operand of the pair. */
+    uint16_t stride;
+    /** \brief Is the multiplication after the modification of the induction variable. */
+    bool mulAfterModification;
+    /** \brief Is the addition after the modification of the induction variable. */
+    bool addAfterModification;
+    /** \brief Free vector register. */
+    uint16_t freeVectReg;
+    /** \brief Loop iteration count. */
+    uint16_t iterCount;
 
-    VECT_REVERT_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint64_t reg);
-    VECT_REVERT_rule(RRule &rule);
+    VECT_FMA_rule(janus::BasicBlock *bb, PCAddress pc, uint32_t ID, uint16_t mulOffset, uint16_t stride,
+        bool mulAfterModification, bool addAfterModification, uint16_t freeVectReg, uint16_t iterCount);
+    VECT_FMA_rule(RRule &rule);
     #ifdef _STATIC_ANALYSIS_COMPILED
     virtual janus::RewriteRule *encode();
     #endif
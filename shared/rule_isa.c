@@ -15,6 +15,8 @@ const char *print_janus_mode(JMode mode) {
         case JFETCH: return "Automatic software prefetch";
         case JCUSTOM: return "Custom DSL Execution";
         case JDLL: return "DLL Instrumentation Testing";
+        case JPARAFETCH: return "Automatic Parallelisation with Prefetch";
+        case JPARAVECT: return "Automatic Parallelisation with Vectorisation";
         default: return "Free Mode";
     }
 }
@@ -72,6 +74,7 @@ const char *print_rule_opcode(RuleOp op)
         case APP_SPLIT_BLOCK: return "APP_SPLIT_BLOCK";
         case TX_START: return "TX_START";
         case TX_FINISH: return "TX_FINISH";
+        case TX_REDIRECT: return "TX_REDIRECT";
         case THREAD_SCHEDULE: return "THREAD_SCHEDULE";
         case THREAD_YIELD: return "THREAD_YIELD";
         case TRANS_START: return "TRANS_START";
@@ -104,6 +107,8 @@ const char *print_rule_opcode(RuleOp op)
         case PARA_OUTER_LOOP_INIT: return "PARA_OUTER_LOOP_INIT";
         case PARA_OUTER_LOOP_END: return "PARA_OUTER_LOOP_END";
         case MEM_PREFETCH: return "MEM_PREFETCH";
+        case PREFETCH_GUARD_START: return "PREFETCH_GUARD_START";
+        case PREFETCH_GUARD_END: return "PREFETCH_GUARD_END";
         case INSTR_CLONE: return "INSTR_CLONE";
         case INSTR_UPDATE: return "INSTR_UPDATE";
         case INSTR_NOP: return "INSTR_NOP";
@@ -172,6 +177,13 @@ const char *print_rule_opcode(RuleOp op)
         case VECT_BROADCAST: return "VECT_BROADCAST";
         case VECT_REDUCE_AFTER: return "VECT_REDUCE_AFTER";
         case VECT_REVERT: return "VECT_REVERT";
+        case VECT_GATHER: return "VECT_GATHER";
+        case VECT_SCATTER: return "VECT_SCATTER";
+        case VECT_FMA: return "VECT_FMA";
+        case VECT_REDUCE_ROTATE: return "VECT_REDUCE_ROTATE";
+        case VECT_ALIGN_PEEL: return "VECT_ALIGN_PEEL";
+        case VECT_ALIGN_BOUND: return "VECT_ALIGN_BOUND";
+        case VECT_ALIGN_TAIL: return "VECT_ALIGN_TAIL";
         default: return "Null";
     }
 }
@@ -68,6 +68,8 @@ typedef enum _rr_type {
     TX_START,
     ///Validate and commit a software transaction
     TX_FINISH,
+    ///Redirect the memory accesses of a speculative loop body block to the transaction
+    TX_REDIRECT,
     ///Schedule threads to jump to a code address. (Separated rule)
     THREAD_SCHEDULE,
     ///Send threads back to the thread pool
@@ -85,12 +87,28 @@ typedef enum _rr_type {
     ///Recover the stride of the induction variable (variable stride)
     VECT_INDUCTION_STRIDE_RECOVER,
     VECT_FORCE_SSE,
+    ///Set the extra lanes of a reduction accumulator to the identity of the operation
     VECT_REDUCE_INIT,
     VECT_REG_CHECK,
     ///Convert a scalar instruction to SIMD version
     VECT_CONVERT,
+    ///Combine the lanes and the accumulators of a reduction after the loop
     VECT_REDUCE_AFTER,
     VECT_REVERT,
+    ///Load the lanes of a strided memory read into a SIMD register
+    VECT_GATHER,
+    ///Store the lanes of a SIMD register to a strided memory write
+    VECT_SCATTER,
+    ///Fuse a multiplication and the addition using its result into a fused multiply-add
+    VECT_FMA,
+    ///Rotate the accumulators of a reduction at the end of the iteration
+    VECT_REDUCE_ROTATE,
+    ///Run the scalar iterations that align the store stream of the loop before it
+    VECT_ALIGN_PEEL,
+    ///Compare the iterator of the vector loop with the bound left by the alignment peel
+    VECT_ALIGN_BOUND,
+    ///Run the scalar iterations left over by the aligned vector loop after it
+    VECT_ALIGN_TAIL,
     /* ----------------------------------------------------
      * Automatic Prefetch Rewrite Rules 
      * ----------------------------------------------------*/
@@ -100,6 +118,10 @@ typedef enum _rr_type {
     INSTR_CLONE,
     ///Insert a prefetch instruction with given memory operand
     MEM_PREFETCH,
+    ///Save the registers written by the following prefetch slice, faults in the slice skip to PREFETCH_GUARD_END
+    PREFETCH_GUARD_START,
+    ///Restore the registers saved by PREFETCH_GUARD_START
+    PREFETCH_GUARD_END,
     ///Insert n number of NOP operations
     INSTR_NOP,
     /* ----------------------------------------------------
@@ -1,22 +1,141 @@
 #include "Affine.h"
+#include "Function.h"
+#include "MemoryLocation.h"
+#include "IO.h"
 
 using namespace janus;
 using namespace std;
 
+static bool
+isInvariantExpr(Loop *loop, Expr &expr);
+
+/* A leaf is invariant if it is not an iterator of the loop or of its inner loops
+ * and its variable is not modified in the loop */
+static bool
+isInvariantLeaf(Loop *loop, Expr &node)
+{
+    if (node.kind == Expr::INTEGER) return true;
+    if (node.kind == Expr::ADDREC) return false;
+    if (node.kind == Expr::EXPANDED) return isInvariantExpr(loop, node);
+
+    Iterator *iter = node.iteratorTo;
+    if (iter && iter->loop->isDescendantOf(loop)) return false;
+    if (!node.vs || !loop->isConstant(node.vs)) return false;
+
+    //a memory leaf keeps its value only if the loop doesn't write to its address
+    if (node.vs->type == JVAR_MEMORY) {
+        for (auto write: loop->memoryWrites) {
+            if (write->vs && (Variable)*write->vs == (Variable)*node.vs) return false;
+        }
+    }
+    return true;
+}
+
+static bool
+isInvariantExpr(Loop *loop, Expr &expr)
+{
+    if (expr.kind != Expr::EXPANDED) return isInvariantLeaf(loop, expr);
+    ExpandedExpr *ee = expr.ee;
+    if (ee->kind != ExpandedExpr::SUM && ee->kind != ExpandedExpr::MUL) return false;
+
+    for (auto &term: ee->exprs) {
+        Expr node = term.first;
+        Expr coeff = term.second;
+        if (!isInvariantLeaf(loop, node) || !isInvariantExpr(loop, coeff)) return false;
+    }
+    return true;
+}
+
+/* The main iterator runs span / stride + 1 times, where the span is the difference of its
+ * final and initial value. The span must be invariant so that it can be evaluated at loop entry */
+static bool
+analyseTripCount(Loop *loop)
+{
+    Iterator *miter = loop->mainIterator;
+    loop->tripCountSpan = Expr();
+
+    if (!miter || miter->kind != Iterator::INDUCTION_IMM) return false;
+    if (miter->strideKind != Iterator::INTEGER || miter->stride == 0) return false;
+
+    if (loop->staticIterCount > 0) {
+        loop->tripCountSpan = Expr((int64_t)(loop->staticIterCount - 1) * miter->stride);
+        return true;
+    }
+
+    if (miter->stepKind != Iterator::CONSTANT_EXPR || !miter->stepExprs) return false;
+    Expr span(miter->stepExprs);
+    if (!isInvariantExpr(loop, span)) {
+        LOOPLOG2("\t\tLoop bound varies in the loop: "<<*miter->stepExprs<<endl);
+        return false;
+    }
+    loop->tripCountSpan = span;
+    return true;
+}
+
+/* Express the address as start + A*i + B*j + ... over the iterators of the loop nest,
+ * where the start and the coefficients are invariant in the loop */
+static MemoryLocation::AddressType
+getAddressType(Loop *loop, MemoryLocation *location)
+{
+    if (location->type == MemoryLocation::Unknown) return MemoryLocation::Unknown;
+    ExpandedExpr &expr = location->expr;
+    if (expr.kind != ExpandedExpr::SUM) return MemoryLocation::Complex;
+
+    //the address doesn't move in the loop
+    bool varies = false;
+    for (auto &term: expr.exprs) {
+        Expr node = term.first;
+        if (node.kind == Expr::ADDREC) varies = true;
+        if (node.iteratorTo && node.iteratorTo->loop->isDescendantOf(loop)) varies = true;
+    }
+    if (!varies) {
+        Expr address(&expr);
+        return isInvariantExpr(loop, address) ? MemoryLocation::Constant : MemoryLocation::Complex;
+    }
+
+    ExpandedSCEV *escev = location->escev;
+    if (!escev || escev->kind != ExpandedSCEV::Normal) return MemoryLocation::Complex;
+    if (!isInvariantExpr(loop, escev->start)) return MemoryLocation::Complex;
+
+    bool innerIterator = false;
+    for (auto &strideP: escev->strides) {
+        Iterator *iter = strideP.first;
+        if (iter->kind != Iterator::INDUCTION_IMM && iter->kind != Iterator::INDUCTION_VAR)
+            return MemoryLocation::Complex;
+        if (!isInvariantExpr(loop, strideP.second)) return MemoryLocation::Complex;
+        if (iter->loop != loop && iter->loop->isDescendantOf(loop)) innerIterator = true;
+    }
+    return innerIterator ? MemoryLocation::AffinemD : MemoryLocation::Affine1D;
+}
+
 void affineAnalysis(janus::Loop *loop)
 {
-    if (loop->staticIterCount <= 0) return;
-    if (loop->unsafe) return;
+    loop->affine = false;
 
-    //no break statement in the loop body
-    if (loop->exit.size() > 1) return;
+    LOOPLOG2("\n\tAffine analysis:"<<endl);
+    bool boundAffine = analyseTripCount(loop);
+    if (boundAffine) {
+        LOOPLOG2("\t\tTrip count ("<<loop->tripCountSpan<<")/"<<dec<<loop->mainIterator->stride<<" + 1"<<endl);
+    }
 
-    //assume the memory accesses are already constructed
-    //for (auto &memBase: loop->memoryAccesses) {
-    //    ScalarEvolution se(memBase)
-    //}
+    //classify every access even if the loop is not affine, the passes check the locations
+    bool accessAffine = true;
+    set<MemoryLocation *> locations(loop->memoryReads);
+    locations.insert(loop->memoryWrites.begin(), loop->memoryWrites.end());
+    for (auto location: locations) {
+        location->type = getAddressType(loop, location);
+        if (location->type == MemoryLocation::Complex ||
+            location->type == MemoryLocation::Unknown) {
+            LOOPLOG2("\t\tNon-affine access "<<*location<<endl);
+            accessAffine = false;
+        }
+    }
 
+    if (!boundAffine || !accessAffine) return;
+    if (loop->unsafe) return;
+    //no break statement in the loop body
+    if (loop->exit.size() > 1) return;
 
-    //cout<<"loop "<<loop->id<<" is affine loop with bound "<<dec<<loop->staticIterCount <<endl;
+    LOOPLOG2("\t\tLoop "<<dec<<loop->id<<" is affine"<<endl);
     loop->affine = true;
-}
\ No newline at end of file
+}
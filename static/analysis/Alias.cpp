@@ -10,6 +10,8 @@
 #include "MemoryLocation.h"
 #include <map>
 #include <set>
+#include <vector>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <queue>
@@ -18,10 +20,8 @@
 using namespace janus;
 using namespace std;
 
-//lamport test for single variables
-static AliasType lamportTest(ExpandedSCEV &diff);
-static AliasType GCDTest(ExpandedSCEV &e1, ExpandedSCEV &e2, ExpandedSCEV &diff, Loop &loop);
-static AliasType banerjeeTest(ExpandedSCEV &diff);
+static bool
+encodeArrayRange(Loop *loop, vector<MemoryLocation *> &locations, Array &array);
 
 void
 aliasAnalysis(janus::Loop *loop)
@@ -37,10 +37,6 @@ aliasAnalysis(janus::Loop *loop)
     LOOPLOG2("---------------------------------------------------------"<<endl);
     LOOPLOG2("Loop "<<dec<<loop->id<<" Alias Analysis"<<endl);
 
-    //step 0: affine analysis
-    //scan for a specific affine conditions for the given loop
-    affineAnalysis(loop);
-
     LOOPLOG2("\n\tStep 0: Extracting loop ranges in the loop nest:"<<endl);
     LOOPLOG2("\t\tMain Loop "<<dec<<loop->id<<" range "<<*loop->mainIterator<<" trip count "<<loop->staticIterCount<<endl);
 
@@ -116,6 +112,9 @@ aliasAnalysis(janus::Loop *loop)
         loopLog2<<endl;
     });
 
+    //scan for the affine conditions of the loop bound and the memory accesses
+    affineAnalysis(loop);
+
     //step 2: perform alias analysis on each memory write with respect to each memory read with the same array base
     //alias analysis is only performed within the same memory base
     LOOPLOG2("\n\tStep 2: Performing SCEV-based alias analysis on loop memory accesses"<<endl);
@@ -156,20 +155,27 @@ aliasAnalysis(janus::Loop *loop)
         }
     }
 
-    for (auto &memBase: loop->arrayIterators) {
+    for (auto &memBase: loop->arrayAccesses) {
         JVarProfile profile;
+        memset(&profile, 0, sizeof(JVarProfile));
         profile.type = ARRAY_PROFILE;
         //temp fix
         if (memBase.first.kind == Expr::EXPANDED) continue;
         if (memBase.first.vs == NULL) continue;
         profile.array.base = *(JVar *)memBase.first.vs;
         profile.version = memBase.first.vs->version;
-        long max_range = 0;
-        for (auto iter:memBase.second) {
-            max_range += iter->stride * iter->loop->staticIterCount;
-        }
-        profile.array.max_range.type = JVAR_CONSTANT;
-        profile.array.max_range.value = max_range;
+        //an array without a bounded range makes the runtime check fail
+        profile.array.unknown = !encodeArrayRange(loop, memBase.second, profile.array);
+        profile.array.written = loop->arrayToCheck.find(memBase.first) != loop->arrayToCheck.end();
+        IF_LOOPLOG2(
+        loopLog2<<"\tArray "<<memBase.first<<" range ";
+        if (profile.array.unknown) loopLog2<<"unknown"<<endl;
+        else {
+            loopLog2<<"["<<dec<<profile.array.low<<", "<<profile.array.high<<")";
+            if (profile.array.stride)
+                loopLog2<<" + "<<profile.array.stride<<" per iteration, counted at loop entry";
+            loopLog2<<endl;
+        });
         loop->encodedVariables.push_back(profile);
     }
 
@@ -182,6 +188,463 @@ aliasAnalysis(janus::Loop *loop)
     });
 }
 
+/* Direction names for logging */
+static const char *
+directionString(uint32_t dirs)
+{
+    static const char *names[8] = {"none", "<", "=", "<=", ">", "<>", ">=", "*"};
+    return names[dirs & DEP_DIR_ANY];
+}
+
+/* Iterations of a loop nest level seen by both memory accesses.
+ * The source access is at iteration x and the sink access at iteration y */
+struct CoupledIteration {
+    Loop                *loop;
+    ///coefficient of x in the source address
+    int64_t             a;
+    ///coefficient of y in the sink address
+    int64_t             b;
+    ///last iteration number, -1 if unknown
+    int64_t             upper;
+};
+
+/* Dependence equation of two affine addresses:
+ * constant + sum(coupled: a*x - b*y) + sum(terms: coeff*z) */
+struct DependenceEquation {
+    int64_t             constant;
+    std::vector<CoupledIteration> coupled;
+    ///independent variables: coefficient and last iteration (-1 if unknown)
+    std::vector<std::pair<int64_t, int64_t>> terms;
+};
+
+/* Closed or half-open integer range */
+struct Bounds {
+    int64_t             lo;
+    int64_t             hi;
+    bool                loInf;
+    bool                hiInf;
+
+    Bounds(int64_t v):lo(v),hi(v),loInf(false),hiInf(false) {}
+
+    void add(int64_t v) { lo += v; hi += v; }
+
+    /* add coeff*z where z in [0, upper], upper -1 means unbounded */
+    void addTerm(int64_t coeff, int64_t upper) {
+        if (coeff == 0) return;
+        if (upper < 0) {
+            if (coeff > 0) hiInf = true;
+            else loInf = true;
+        } else if (coeff > 0) hi += coeff * upper;
+        else lo += coeff * upper;
+    }
+
+    bool intersects(int64_t l, int64_t h) {
+        return (loInf || lo <= h) && (hiInf || hi >= l);
+    }
+};
+
+static int64_t get_gcd(int64_t a, int64_t b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    return b == 0 ? a : get_gcd(b, a % b);
+}
+
+/* Last iteration number of the loop, -1 if the trip count is not known statically */
+static int64_t
+lastIteration(Loop *loop)
+{
+    if (loop->staticIterCount > 0 && loop->staticIterCount <= INT32_MAX)
+        return (int64_t)loop->staticIterCount - 1;
+    return -1;
+}
+
+/* Constant byte offset of an address start from its array base */
+static bool
+getBaseOffset(Expr &start, int64_t &offset)
+{
+    offset = 0;
+    if (start.kind == Expr::VAR) return true;
+    if (start.kind != Expr::EXPANDED || start.ee->kind != ExpandedExpr::SUM) return false;
+
+    for (auto &term: start.ee->exprs) {
+        if (term.second.kind != Expr::INTEGER) return false;
+        if (term.first.kind == Expr::INTEGER)
+            offset += term.first.i * term.second.i;
+        //the base itself
+        else if (term.second.i != 1) return false;
+    }
+    return true;
+}
+
+/* Returns true if the variable is written in the init blocks of the loop,
+ * where the runtime check reads it */
+static bool
+writtenInLoopInit(Loop *loop, VarState *vs)
+{
+    BasicBlock *entry = loop->parent->entry;
+
+    for (auto bid: loop->init) {
+        BasicBlock &bb = entry[bid];
+        for (uint32_t i = 0; i < bb.size; i++) {
+            for (auto output: bb.instrs[i].outputs) {
+                if (output->type == vs->type && output->value == vs->value)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Encode the trip count span of the loop with the registers it is computed from,
+ * they are evaluated by the runtime check at loop entry.
+ * The span is the difference of the final and initial value of the main iterator */
+static bool
+encodeTripCountSpan(Loop *loop, Array &array)
+{
+    Expr &span = loop->tripCountSpan;
+    map<Expr, Expr> terms;
+    int vars = 0;
+
+    if (span.kind == Expr::VAR)
+        terms[span] = Expr(1);
+    else if (span.kind == Expr::EXPANDED && span.ee->kind == ExpandedExpr::SUM)
+        terms = span.ee->exprs;
+    else return false;
+
+    array.span_step = loop->mainIterator->stride;
+    array.span_const = 0;
+    for (auto &term: terms) {
+        Expr node = term.first;
+        if (term.second.kind != Expr::INTEGER) return false;
+        if (node.kind == Expr::INTEGER) {
+            array.span_const += node.i * term.second.i;
+            continue;
+        }
+        if (node.kind != Expr::VAR || !node.v || vars == 2) return false;
+        if (node.v->type != JVAR_REGISTER || writtenInLoopInit(loop, node.v)) return false;
+        array.span_var[vars] = *(JVar *)node.v;
+        array.span_coeff[vars] = term.second.i;
+        vars++;
+    }
+    return true;
+}
+
+/* Encode the bytes accessed from an array base in one invocation of the loop.
+ * The iterations of loops with a static count are folded into [low, high),
+ * the iterations of the loop itself may be counted at loop entry instead.
+ * Returns false if the range can't be bounded */
+static bool
+encodeArrayRange(Loop *loop, vector<MemoryLocation *> &locations, Array &array)
+{
+    bool counted = false;
+    bool first = true;
+
+    for (auto ml: locations) {
+        ExpandedSCEV *escev = ml->escev;
+        int64_t offset;
+        if (!escev || escev->kind != ExpandedSCEV::Normal) return false;
+        if (!ml->vs || !ml->vs->size) return false;
+        if (!getBaseOffset(escev->start, offset)) return false;
+
+        int64_t low = offset;
+        int64_t high = offset + ml->vs->size;
+        int64_t stride = 0;
+        for (auto &term: escev->strides) {
+            Loop *l = term.first->loop;
+            if (term.second.kind != Expr::INTEGER || !l) return false;
+            int64_t coeff = term.second.i;
+            if (l == loop && !loop->staticIterCount) {
+                stride += coeff;
+                continue;
+            }
+            int64_t last = lastIteration(l);
+            if (last < 0) return false;
+            if (coeff > 0) high += coeff * last;
+            else low += coeff * last;
+        }
+        //accesses moving at different rates don't share a single runtime span
+        if (stride) {
+            if (counted && stride != array.stride) return false;
+            array.stride = stride;
+            counted = true;
+        }
+        if (first || low < array.low) array.low = low;
+        if (first || high > array.high) array.high = high;
+        first = false;
+    }
+
+    if (first) return false;
+    if (counted) return encodeTripCountSpan(loop, array);
+    return true;
+}
+
+/* Build the dependence equation of the source and sink addresses.
+ * Returns false if any coefficient is not a compile time integer */
+static bool
+buildDependenceEquation(ExpandedSCEV &e1, ExpandedSCEV &e2, Loop *loop, DependenceEquation &eq)
+{
+    Expr start(0);
+    start.add(e1.start);
+    start.subtract(e2.start);
+    start.simplify();
+    if (start.kind != Expr::INTEGER) return false;
+    eq.constant = start.i;
+
+    //iterators of the same loop share the iteration number, merge their coefficients
+    map<Loop *, int64_t> src, dst;
+    for (auto term: e1.strides) {
+        if (term.second.kind != Expr::INTEGER || !term.first->loop) return false;
+        src[term.first->loop] += term.second.i;
+    }
+    for (auto term: e2.strides) {
+        if (term.second.kind != Expr::INTEGER || !term.first->loop) return false;
+        dst[term.first->loop] += term.second.i;
+    }
+
+    //the analysed loop is always the first coupled level
+    CoupledIteration current = {loop, src[loop], dst[loop], lastIteration(loop)};
+    eq.coupled.push_back(current);
+
+    for (auto s: src) {
+        Loop *l = s.first;
+        if (l == loop) continue;
+        auto d = dst.find(l);
+        int64_t b = (d == dst.end()) ? 0 : d->second;
+        if (l->isAncestorOf(loop)) {
+            //outer loops are at the same iteration for both accesses
+            eq.terms.push_back(make_pair(s.second - b, lastIteration(l)));
+        } else if (l->isDescendantOf(loop) && d != dst.end()) {
+            CoupledIteration inner = {l, s.second, b, lastIteration(l)};
+            eq.coupled.push_back(inner);
+        } else {
+            eq.terms.push_back(make_pair(s.second, lastIteration(l)));
+            if (d != dst.end())
+                eq.terms.push_back(make_pair(-b, lastIteration(l)));
+        }
+    }
+    for (auto d: dst) {
+        if (d.first == loop || src.find(d.first) != src.end()) continue;
+        eq.terms.push_back(make_pair(-d.second, lastIteration(d.first)));
+    }
+    return true;
+}
+
+/* Constant added to the equation once a direction is substituted:
+ * x < y is written as y = x+1+t and x > y as x = y+1+t */
+static int64_t
+directionConstant(CoupledIteration &c, uint32_t dir)
+{
+    if (dir == DEP_DIR_LT) return -c.b;
+    if (dir == DEP_DIR_GT) return c.a;
+    return 0;
+}
+
+/** \brief GCD test
+ *
+ * The equation has an integer solution only if the gcd of all coefficients divides
+ * one of the address differences that make the accesses overlap */
+static AliasType
+GCDTest(DependenceEquation &eq, vector<uint32_t> &dirs, int64_t lo, int64_t hi)
+{
+    int64_t gcd = 0;
+    int64_t constant = eq.constant;
+
+    for (auto term: eq.terms)
+        gcd = get_gcd(gcd, term.first);
+
+    for (size_t i = 0; i < eq.coupled.size(); i++) {
+        CoupledIteration &c = eq.coupled[i];
+        if (dirs[i] == DEP_DIR_ANY) {
+            gcd = get_gcd(gcd, c.a);
+            gcd = get_gcd(gcd, c.b);
+            continue;
+        }
+        gcd = get_gcd(gcd, c.a - c.b);
+        if (dirs[i] == DEP_DIR_LT) gcd = get_gcd(gcd, c.b);
+        else if (dirs[i] == DEP_DIR_GT) gcd = get_gcd(gcd, c.a);
+        constant += directionConstant(c, dirs[i]);
+    }
+
+    //look for a multiple of gcd in [lo-constant, hi-constant]
+    int64_t l = lo - constant;
+    int64_t h = hi - constant;
+    if (gcd == 0) {
+        if (l <= 0 && h >= 0) return UnknownAlias;
+        return MustNotAlias;
+    }
+    int64_t first = (l >= 0) ? ((l + gcd - 1) / gcd) * gcd : -((-l) / gcd) * gcd;
+    if (first <= h) return UnknownAlias;
+    return MustNotAlias;
+}
+
+/* Range of a*x - b*y for x, y in [0, upper] under the given direction */
+static bool
+coupledBounds(CoupledIteration &c, uint32_t dir, Bounds &bounds)
+{
+    int64_t a = c.a, b = c.b, u = c.upper;
+
+    if (dir == DEP_DIR_ANY) {
+        bounds.addTerm(a, u);
+        bounds.addTerm(-b, u);
+        return true;
+    }
+
+    if (u < 0) {
+        //unbounded, use the substituted form with x, y, t >= 0
+        bounds.add(directionConstant(c, dir));
+        bounds.addTerm(a - b, -1);
+        if (dir == DEP_DIR_LT) bounds.addTerm(-b, -1);
+        else if (dir == DEP_DIR_GT) bounds.addTerm(a, -1);
+        return true;
+    }
+
+    //a linear function reaches its extremes on the vertices of the region
+    vector<pair<int64_t, int64_t>> vertices;
+    if (dir == DEP_DIR_EQ) {
+        vertices.push_back(make_pair(0, 0));
+        vertices.push_back(make_pair(u, u));
+    } else {
+        //no pair of different iterations in a single iteration loop
+        if (u < 1) return false;
+        if (dir == DEP_DIR_LT) {
+            vertices.push_back(make_pair(0, 1));
+            vertices.push_back(make_pair(0, u));
+            vertices.push_back(make_pair(u - 1, u));
+        } else {
+            vertices.push_back(make_pair(1, 0));
+            vertices.push_back(make_pair(u, 0));
+            vertices.push_back(make_pair(u, u - 1));
+        }
+    }
+
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    for (auto v: vertices) {
+        int64_t f = a * v.first - b * v.second;
+        lo = min(lo, f);
+        hi = max(hi, f);
+    }
+    bounds.lo += lo;
+    bounds.hi += hi;
+    return true;
+}
+
+/** \brief Banerjee test
+ *
+ * Bounds the address difference over the iteration space constrained by the directions,
+ * there is no dependence if the bounds can't reach an overlapping difference */
+static AliasType
+banerjeeTest(DependenceEquation &eq, vector<uint32_t> &dirs, int64_t lo, int64_t hi)
+{
+    Bounds bounds(eq.constant);
+
+    for (auto term: eq.terms)
+        bounds.addTerm(term.first, term.second);
+
+    for (size_t i = 0; i < eq.coupled.size(); i++) {
+        if (!coupledBounds(eq.coupled[i], dirs[i], bounds))
+            return MustNotAlias;
+    }
+
+    if (bounds.intersects(lo, hi)) return UnknownAlias;
+    return MustNotAlias;
+}
+
+/* A dependence is possible under the directions if neither test disproves it */
+static bool
+dependenceFeasible(DependenceEquation &eq, vector<uint32_t> &dirs, int64_t lo, int64_t hi)
+{
+    if (GCDTest(eq, dirs, lo, hi) == MustNotAlias) return false;
+    if (banerjeeTest(eq, dirs, lo, hi) == MustNotAlias) return false;
+    return true;
+}
+
+/** \brief Dependence test of two affine memory accesses in the loop
+ *
+ * Computes the possible directions for the loop and for the inner loops common to
+ * both accesses. Returns MustNotAlias if no loop carried dependence is possible,
+ * MustAlias if one may exist and UnknownAlias if the addresses are not affine. */
+static AliasType
+dependenceTest(MemoryLocation &m1, MemoryLocation &m2, Loop *loop, DependenceVector &dv)
+{
+    DependenceEquation eq;
+    if (!buildDependenceEquation(*m1.escev, *m2.escev, loop, eq))
+        return UnknownAlias;
+
+    //the accesses overlap if addr1-addr2 is in [-(size1-1), size2-1]
+    int64_t size1 = (m1.vs && m1.vs->size) ? m1.vs->size : 1;
+    int64_t size2 = (m2.vs && m2.vs->size) ? m2.vs->size : 1;
+    int64_t lo = -(size1 - 1);
+    int64_t hi = size2 - 1;
+
+    static const uint32_t directions[3] = {DEP_DIR_LT, DEP_DIR_EQ, DEP_DIR_GT};
+    vector<uint32_t> dirs(eq.coupled.size(), DEP_DIR_ANY);
+
+    //directions of the analysed loop
+    uint32_t loopDirs = 0;
+    for (auto d: directions) {
+        dirs[0] = d;
+        if (dependenceFeasible(eq, dirs, lo, hi)) loopDirs |= d;
+    }
+
+    dv.src = &m1;
+    dv.dst = &m2;
+    dv.distance = 0;
+    dv.distanceKnown = false;
+    dv.directions.clear();
+    dv.directions.push_back(make_pair(loop, loopDirs));
+
+    if (!(loopDirs & (DEP_DIR_LT | DEP_DIR_GT))) {
+        LOOPLOG2("\t\t\tGCD/Banerjee: directions ("<<directionString(loopDirs)<<"), no loop carried dependence"<<endl);
+        return MustNotAlias;
+    }
+
+    //directions of the common inner loops under the carried directions of this loop
+    for (size_t i = 1; i < eq.coupled.size(); i++) {
+        uint32_t innerDirs = 0;
+        for (auto outer: directions) {
+            if (!(loopDirs & outer) || outer == DEP_DIR_EQ) continue;
+            dirs[0] = outer;
+            for (auto d: directions) {
+                dirs[i] = d;
+                if (dependenceFeasible(eq, dirs, lo, hi)) innerDirs |= d;
+            }
+        }
+        dirs[i] = DEP_DIR_ANY;
+        dv.directions.push_back(make_pair(eq.coupled[i].loop, innerDirs));
+    }
+
+    //exact distance when the iteration difference is the only unknown
+    CoupledIteration &c = eq.coupled[0];
+    bool single = (c.a == c.b && c.a != 0 && eq.coupled.size() == 1);
+    for (auto term: eq.terms)
+        if (term.first != 0) single = false;
+    if (single) {
+        //constant + a*(x-y) = e for e in [lo, hi]
+        set<int64_t> distances;
+        for (int64_t e = lo; e <= hi; e++) {
+            if ((eq.constant - e) % c.a) continue;
+            int64_t delta = (eq.constant - e) / c.a;
+            if (delta == 0) continue;
+            if (c.upper >= 0 && (delta > c.upper || delta < -c.upper)) continue;
+            distances.insert(delta);
+        }
+        if (distances.size() == 1) {
+            dv.distance = *distances.begin();
+            dv.distanceKnown = true;
+        }
+    }
+
+    IF_LOOPLOG2(
+        loopLog2<<"\t\t\tGCD/Banerjee: direction vector (";
+        for (size_t i = 0; i < dv.directions.size(); i++)
+            loopLog2<<(i ? "," : "")<<directionString(dv.directions[i].second);
+        loopLog2<<")";
+        if (dv.distanceKnown) loopLog2<<" distance "<<dv.distance;
+        loopLog2<<", therefore a dependency may exist"<<endl;
+    );
+    return MustAlias;
+}
+
 /** \brief Check alias relation for two memory locations
  */
 void checkAliasRelation(MemoryLocation &m1, MemoryLocation &m2, Loop *loop)
@@ -208,33 +671,16 @@ void checkAliasRelation(MemoryLocation &m1, MemoryLocation &m2, Loop *loop)
         //get the range difference of the two expressions
         ExpandedSCEV rdiff = getRangeDiff(e1, e2, loop);
         LOOPLOG2("\t\t\trdiff: "<<rdiff<<endl);
-        //if both are single index variable with the same scale, we use lamport test
-        if (e1.strides.size()==1 &&
-            e2.strides.size()==1 &&
-            rdiff.strides.size() == 1 &&
-            (*e1.strides.begin()).second.i == (*e2.strides.begin()).second.i) {
-            result = lamportTest(rdiff);
-            if (result == MustAlias) {
-                loop->memoryDependences[&m1].insert(&m2);
-                return;
-            } else if (result == MustNotAlias) return;
-        }
-
-        //perform the GCD dependence test
-        result = GCDTest(e1,e2,rdiff,*loop);
-        if (result == MustAlias) {
-            loop->memoryDependences[&m1].insert(&m2);
-            return;
-        } else if (result == MustNotAlias) return;
-
-        //perform the banerjee dependence test
-        result = banerjeeTest(rdiff);
+        //perform the GCD and banerjee dependence tests in each direction
+        //single index accesses with the same scale are solved exactly (lamport test)
+        DependenceVector dv;
+        result = dependenceTest(m1, m2, loop, dv);
         if (result == MustAlias) {
             loop->memoryDependences[&m1].insert(&m2);
+            loop->dependenceVectors.push_back(dv);
             return;
         } else if (result == MustNotAlias) return;
 
-
         //TODO: use integer set solver for polyhedral dependence analysis
         //at last if all tests failed, put it in undecided pool
         loop->undecidedMemAccesses.insert(&m1);
@@ -273,96 +719,6 @@ void checkAliasRelation(MemoryLocation &m1, MemoryLocation &m2, Loop *loop)
     }
 }
 
-static AliasType lamportTest(ExpandedSCEV &diff)
-{
-    if (diff.start.kind == Expr::INTEGER) {
-        //try to solve the diff equation
-        int64_t diffImm = diff.start.i;
-        //if diffImm is zero, it means local reads and writes
-        if (diffImm == 0) {
-            LOOPLOG2("\t\t\tLocal exact self-dependence pairs"<<endl);
-            return MustNotAlias;
-        }
-        //get the difference of iterators
-        Iterator *iter = (*diff.strides.begin()).first;
-        Expr scale = (*diff.strides.begin()).second;
-        if (scale.kind != Expr::INTEGER) return UnknownAlias;
-        int64_t strideImm = scale.i;
-        if (iter == NULL) return UnknownAlias;
-        /* lamport test:
-         * Dependency for [a*i+c1] vs [a*i+c2] occurs when
-         * -(c1-c2)/a has integer solution in the iterator range
-         */
-        if (diffImm % strideImm == 0) {
-            //it must falls in range of the iterator
-            if (iter &&
-                iter->initKind == Iterator::INTEGER &&
-                iter->finalKind == Iterator::INTEGER) {
-                if (!((diffImm >= iter->initImm) &&
-                      (diffImm <= iter->finalImm))) {
-                    LOOPLOG2("\t\t\tDistance "<<diffImm<<" beyond loop range, therefore no dependence"<<endl);
-                    return MustNotAlias;
-                } else if (diffImm >= abs(iter->initImm - iter->finalImm)) {
-                    LOOPLOG2("\t\t\tDistance "<<diffImm<<" beyond loop range"<<abs(iter->initImm - iter->finalImm)<<", therefore no dependence"<<endl);
-                    return MustNotAlias;
-                }
-            }
-            LOOPLOG2("\t\t\tFound a cross iteration dependence of distance "<<diffImm<<" within range "<<abs(iter->initImm - iter->finalImm)<<" for this write-read pair"<<endl);
-            return MustAlias;
-        }
-    }
-
-    return UnknownAlias;
-}
-
-static int get_gcd(int a, int b) {
-    return b == 0 ? a : get_gcd(b, a % b);
-}
-
-static AliasType GCDTest(ExpandedSCEV &e1, ExpandedSCEV &e2, ExpandedSCEV &diff, Loop &loop)
-{
-    //get the strides for all iterators in both e1 and e2
-    int gcd = -1;
-    for (auto term: e1.strides) {
-        if (term.second.kind == Expr::INTEGER) {
-            if (gcd == -1) gcd = term.second.i;
-            else gcd = get_gcd(gcd, term.second.i);
-        } else return UnknownAlias;
-    }
-    for (auto term: e2.strides) {
-        if (term.second.kind == Expr::INTEGER) {
-            if (gcd == -1) gcd = term.second.i;
-            else gcd = get_gcd(gcd, term.second.i);
-        } else return UnknownAlias;
-    }
-
-    //get the start difference
-    if (diff.start.kind == Expr::INTEGER) {
-        //try to solve the diff equation
-        int64_t diffImm = abs(diff.start.i);
-
-        if (diffImm % gcd == 0) {
-            if (loop.staticIterCount > 0 && diffImm/gcd > loop.staticIterCount) {
-                LOOPLOG2("\t\t\tFound stride GCD of "<<gcd<<" for distance "<<diffImm<<", which is beyond loop boundary"<<endl);
-                return MustNotAlias;
-            } else {
-                LOOPLOG2("\t\t\tFound stride GCD of "<<gcd<<" for distance "<<diffImm<<",therefore a dependency exists"<<endl);
-                return MustAlias;
-            }
-        } else {
-            LOOPLOG2("\t\t\tFound stride GCD of "<<gcd<<" could not divide distance "<<diffImm<<", therefore no dependency"<<endl);
-            return MustNotAlias;
-        }
-    }
-
-    return UnknownAlias;
-}
-
-static AliasType banerjeeTest(ExpandedSCEV &diff)
-{
-    return UnknownAlias;
-}
-
 ExpandedSCEV getRangeDiff(ExpandedSCEV &e1, ExpandedSCEV &e2, janus::Loop *loop)
 {
     LOOPLOG2("\t\t\tSCEV: "<<e1<<" - "<<e2<<endl);
@@ -3,6 +3,7 @@
 #include "Function.h"
 #include "JanusContext.h"
 #include "Utility.h"
+#include "PhaseStats.h"
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
@@ -30,26 +31,34 @@ buildCFG(Function &function)
 {
     /* step 1: construct a vector of basic blocks
      * and link them together */
-    buildBasicBlocks(function);
+    {
+        PhaseTimer timer("basic blocks", &function);
+        buildBasicBlocks(function);
+        timer.addObjects(function.blocks.size());
+    }
     /* set function entry */
     function.entry = function.blocks.data();
     function.numBlocks = function.blocks.size();
 
     if (function.numBlocks <= 1) return;
 
-    /* step 2: analyse the CFG and build dominance tree */
-    buildDominanceTree(function);
+    {
+        PhaseTimer timer("dominators", &function);
+        /* step 2: analyse the CFG and build dominance tree */
+        buildDominanceTree(function);
 
-    /* step 3: analyse the CFG and build post-dominance tree */
-    buildPostDominanceTree(function);
+        /* step 3: analyse the CFG and build post-dominance tree */
+        buildPostDominanceTree(function);
 
-    /* step 4: analyse the CFG and build dominance frontiers */
-    buildDominanceFrontiers(function);
+        /* step 4: analyse the CFG and build dominance frontiers */
+        buildDominanceFrontiers(function);
 
-    /* step 5: analyse the CFG and build post dominance frontiers */
-    buildPostDominanceFrontiers(function);
+        /* step 5: analyse the CFG and build post dominance frontiers */
+        buildPostDominanceFrontiers(function);
+    }
 
     /* step 6: traverse the CFG */
+    PhaseTimer timer("CFG traversal", &function);
     traverseCFG(function);
 }
 
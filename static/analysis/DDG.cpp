@@ -61,7 +61,8 @@ Tarjan::Tarjan(DDG *graph)
         node.onStack = false;
     }
 
-    index = 0;
+    //index 0 marks the nodes not yet visited
+    index = 1;
 }
 
 TarjanNode *Tarjan::getTarjanNode(uint32_t id) {
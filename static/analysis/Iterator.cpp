@@ -4,12 +4,17 @@
 #include "Variable.h"
 #include "IO.h"
 #include "Dependence.h"
+#include "janus_arch.h"
+#ifdef JANUS_X86
+#include "capstone/capstone.h"
+#endif
 #include <queue>
 
 using namespace janus;
 using namespace std;
 
 static void getIteratorFinalValue(ExpandedExpr &boundExpr, Iterator &iterator);
+static bool reductionAnalysis(Loop *loop, VarState *phiVar);
 
 Iterator::Iterator(VarState *vs, janus::Loop *loop)
 :vs(vs),loop(loop),main(false)
@@ -337,6 +342,81 @@ bool writeAfterWriteAnalysis(janus::Loop *loop, janus::VarState *phiVar){
     return true;
 }
 
+/* Return the operation of an instruction accumulating into a SIMD register */
+static Reduction::ReductionOp getReductionOp(Instruction *instr, bool &exact)
+{
+    exact = false;
+#ifdef JANUS_X86
+    switch (instr->minstr->opcode) {
+        case X86_INS_ADDSS: case X86_INS_ADDSD: case X86_INS_VADDSS: case X86_INS_VADDSD:
+            return Reduction::REDUCTION_ADD;
+        case X86_INS_MULSS: case X86_INS_MULSD: case X86_INS_VMULSS: case X86_INS_VMULSD:
+            return Reduction::REDUCTION_MUL;
+        case X86_INS_MINSS: case X86_INS_MINSD: case X86_INS_VMINSS: case X86_INS_VMINSD:
+            return Reduction::REDUCTION_MIN;
+        case X86_INS_MAXSS: case X86_INS_MAXSD: case X86_INS_VMAXSS: case X86_INS_VMAXSD:
+            return Reduction::REDUCTION_MAX;
+        default: break;
+    }
+    //bitwise operations give the same result in any order
+    exact = true;
+    switch (instr->minstr->opcode) {
+        case X86_INS_ANDPS: case X86_INS_ANDPD: case X86_INS_PAND:
+        case X86_INS_VANDPS: case X86_INS_VANDPD: case X86_INS_VPAND:
+            return Reduction::REDUCTION_AND;
+        case X86_INS_ORPS: case X86_INS_ORPD: case X86_INS_POR:
+        case X86_INS_VORPS: case X86_INS_VORPD: case X86_INS_VPOR:
+            return Reduction::REDUCTION_OR;
+        case X86_INS_XORPS: case X86_INS_XORPD: case X86_INS_PXOR:
+        case X86_INS_VXORPS: case X86_INS_VXORPD: case X86_INS_VPXOR:
+            if (instr->minstr->isXORself()) break;
+            return Reduction::REDUCTION_XOR;
+        default: break;
+    }
+#endif
+    return Reduction::REDUCTION_NONE;
+}
+
+/* Checks whether the phi variable is a SIMD register only accumulated by one instruction
+ * Records the reduction in the loop if it is */
+static bool reductionAnalysis(Loop *loop, VarState *phiVar)
+{
+    if (phiVar->type != JVAR_REGISTER || !jreg_is_simd(phiVar->value)) return false;
+
+    //the accumulator is only read by the update in the loop
+    Instruction *update = NULL;
+    for (auto instr: phiVar->dependants) {
+        if (!loop->contains(instr->block->bid)) continue;
+        if (update) return false;
+        update = instr;
+    }
+    if (!update) return false;
+
+    bool exact;
+    Reduction::ReductionOp op = getReductionOp(update, exact);
+    if (op == Reduction::REDUCTION_NONE) return false;
+
+    //the update writes the accumulator back
+    VarState *result = NULL;
+    for (auto vo: update->outputs) {
+        if (vo->type == JVAR_REGISTER && vo->value == phiVar->value) result = vo;
+    }
+    if (!result) return false;
+
+    //which is only used by the next iteration
+    for (auto instr: result->dependants) {
+        if (loop->contains(instr->block->bid)) return false;
+    }
+    if (result->succ.find(phiVar) == result->succ.end()) return false;
+    for (auto pred: phiVar->pred) {
+        if (pred != result && loop->contains(pred->block->bid)) return false;
+    }
+
+    loop->reductions[phiVar] = Reduction(phiVar, update, op, exact);
+    LOOPLOG("\t\t"<<phiVar<<" is a reduction variable accumulated by "<<*update<<endl);
+    return true;
+}
+
 bool postIteratorAnalysis(janus::Loop *loop)
 {
     if (loop->unsafe) return false;
@@ -374,6 +454,9 @@ bool postIteratorAnalysis(janus::Loop *loop)
                 LOOPLOG("\t\t"<<unPhi<<" is only a WAW dependence, and will be resolved with conditional merging after the loop finishes!"<<endl);
                 iter = loop->undecidedPhiVariables.erase(iter);
                 continue; //Don't do the rest of iterator checks (because this is not an iterator!)
+            } else if (reductionAnalysis(loop, unPhi)) {
+                iter = loop->undecidedPhiVariables.erase(iter);
+                continue; //Not an iterator, the vectoriser accumulates it in separate lanes
             } else {
                 loop->unsafe = true;
                 LOOPLOG("\tCould not find cyclic expressions for phi node "<<unPhi<<endl);
@@ -559,6 +642,7 @@ bool postIteratorAnalysis(janus::Loop *loop)
                 loop->constPhiVars.find(varStride) == loop->constPhiVars.end()) {
                 LOOPLOG("\t\tLoop "<<dec<<loop->id<<" stride "<<iter.second<<" is a reduction variable"<<endl);
                 iter.second.kind = Iterator::REDUCTION_PLUS;
+                if (reductionAnalysis(loop, iter.first)) continue;
                 LOOPLOG("\t\tReduction variables not supported!" << endl);
                 loop->unsafe = true;
                 return false; //Reduction variables not supported!
@@ -572,6 +656,7 @@ bool postIteratorAnalysis(janus::Loop *loop)
                 LOOPLOG("\t\tLoop "<<dec<<loop->id<<" stride "<<iter.second<<" is a reduction variable"<<endl);
                 iter.second.kind = Iterator::REDUCTION_PLUS;
                 iter.second.strideKind = Iterator::EXPANDED_EXPR;
+                if (reductionAnalysis(loop, iter.first)) continue;
                 LOOPLOG("\t\tReduction variables not supported!" << endl);
                 loop->unsafe = true;
                 return false; //Reduction variables not supported!
@@ -668,7 +753,8 @@ std::ostream& janus::operator<<(std::ostream& out, const Iterator& iter)
     /* print stride */
     if (iter.kind == Iterator::INDUCTION_IMM)
         out <<dec<<iter.stride;
-    else if (iter.kind == Iterator::INDUCTION_VAR)
+    else if (iter.kind == Iterator::INDUCTION_VAR ||
+             (iter.kind == Iterator::REDUCTION_PLUS && iter.strideKind == Iterator::SINGLE_VAR))
         out <<iter.strideVar;
     else
         out <<*iter.strideExprs;
@@ -0,0 +1,298 @@
+#include "PhaseStats.h"
+#include "JanusContext.h"
+
+#include <chrono>
+#include <ctime>
+#include <sys/resource.h>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+using namespace janus;
+
+bool phaseStatsOn = false;
+
+/* Accumulated cost of one stage */
+struct PhaseRecord {
+    double              wall;
+    double              cpu;
+    ///Peak resident set size (KB) seen at the end of the stage
+    long                peakRSS;
+    ///Growth of the peak resident set size (KB) during the stage
+    long                rssGrowth;
+    uint64_t            objects;
+    uint64_t            calls;
+
+    PhaseRecord():wall(0),cpu(0),peakRSS(0),rssGrowth(0),objects(0),calls(0) {}
+};
+
+/* Stages in the order they are first seen */
+static vector<string> phaseOrder;
+static map<string, PhaseRecord> phaseTotals;
+/* Function id -> stage -> cost */
+static map<FuncID, map<string, PhaseRecord>> funcRecords;
+/* Innermost running timer */
+static PhaseTimer *currentTimer = NULL;
+static double runStartWall;
+static double runStartCPU;
+
+static double
+wallTime()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double
+cpuTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Peak resident set size in KB */
+static long
+peakRSS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void
+accumulate(PhaseRecord &record, double wall, double cpu, long rss, long growth, uint64_t objects)
+{
+    record.wall += wall;
+    record.cpu += cpu;
+    record.peakRSS = max(record.peakRSS, rss);
+    record.rssGrowth += growth;
+    record.objects += objects;
+    record.calls++;
+}
+
+void
+PhaseStats_Init()
+{
+    phaseStatsOn = true;
+    runStartWall = wallTime();
+    runStartCPU = cpuTime();
+}
+
+PhaseTimer::PhaseTimer(const char *phase, Function *func)
+:phase(phase), func(func), outer(NULL), active(phaseStatsOn), objects(0),
+ innerWall(0), innerCPU(0)
+{
+    if (!active) return;
+    outer = currentTimer;
+    currentTimer = this;
+    startRSS = peakRSS();
+    startCPU = cpuTime();
+    startWall = wallTime();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (!active) return;
+
+    double wall = wallTime() - startWall;
+    double cpu = cpuTime() - startCPU;
+    long rss = peakRSS();
+
+    /* Only the time not spent in nested stages counts for this stage */
+    string name(phase);
+    if (phaseTotals.find(name) == phaseTotals.end())
+        phaseOrder.push_back(name);
+    accumulate(phaseTotals[name], wall - innerWall, cpu - innerCPU,
+               rss, rss - startRSS, objects);
+    if (func)
+        accumulate(funcRecords[func->fid][name], wall - innerWall, cpu - innerCPU,
+                   rss, rss - startRSS, objects);
+
+    if (outer) {
+        outer->innerWall += wall;
+        outer->innerCPU += cpu;
+    }
+    currentTimer = outer;
+}
+
+/* Total cost of a function over all stages */
+static PhaseRecord
+functionTotal(map<string, PhaseRecord> &records)
+{
+    PhaseRecord total;
+    for (auto &r: records) {
+        total.wall += r.second.wall;
+        total.cpu += r.second.cpu;
+        total.peakRSS = max(total.peakRSS, r.second.peakRSS);
+        total.rssGrowth += r.second.rssGrowth;
+    }
+    return total;
+}
+
+/* Functions ordered by decreasing wall time */
+static vector<pair<FuncID, PhaseRecord>>
+sortedFunctions()
+{
+    vector<pair<FuncID, PhaseRecord>> funcs;
+    for (auto &f: funcRecords)
+        funcs.push_back(make_pair(f.first, functionTotal(f.second)));
+    sort(funcs.begin(), funcs.end(),
+         [](const pair<FuncID, PhaseRecord> &a, const pair<FuncID, PhaseRecord> &b) {
+             return a.second.wall > b.second.wall;
+         });
+    return funcs;
+}
+
+/* Number of objects alive at the end of the analysis */
+struct ObjectCounts {
+    uint64_t functions;
+    uint64_t instructions;
+    uint64_t irInstructions;
+    uint64_t blocks;
+    uint64_t variables;
+    uint64_t ssaStates;
+    uint64_t expressions;
+    uint64_t loops;
+};
+
+static ObjectCounts
+countObjects(JanusContext *gc)
+{
+    ObjectCounts c = {};
+    for (auto &func: gc->functions) {
+        c.functions++;
+        c.instructions += func.minstrs.size();
+        c.irInstructions += func.instrs.size();
+        c.blocks += func.blocks.size();
+        c.variables += func.allVars.size();
+        c.ssaStates += func.allStates.size();
+        c.expressions += func.exprs.size();
+    }
+    c.loops = gc->loops.size();
+    return c;
+}
+
+#define MAX_REPORTED_FUNCTIONS 20
+
+void
+PhaseStats_Report(JanusContext *gc, ostream &os)
+{
+    double totalWall = wallTime() - runStartWall;
+    double totalCPU = cpuTime() - runStartCPU;
+
+    os<<"---------------------------------------------------------------"<<endl;
+    os<<"Analysis cost of "<<gc->name<<endl;
+    os<<"---------------------------------------------------------------"<<endl;
+    os<<left<<setw(28)<<"stage"<<right<<setw(10)<<"wall(s)"<<setw(10)<<"cpu(s)"
+      <<setw(8)<<"%"<<setw(12)<<"peak(MB)"<<setw(12)<<"grow(MB)"<<setw(12)<<"objects"<<endl;
+    os<<fixed;
+
+    double accounted = 0;
+    for (auto &name: phaseOrder) {
+        PhaseRecord &r = phaseTotals[name];
+        accounted += r.wall;
+        os<<left<<setw(28)<<name<<right<<setprecision(3)
+          <<setw(10)<<r.wall<<setw(10)<<r.cpu
+          <<setprecision(1)<<setw(8)<<(totalWall > 0 ? r.wall * 100 / totalWall : 0)
+          <<setw(12)<<r.peakRSS / 1024.0<<setw(12)<<r.rssGrowth / 1024.0
+          <<setw(12)<<r.objects<<endl;
+    }
+    os<<left<<setw(28)<<"(other)"<<right<<setprecision(3)
+      <<setw(10)<<totalWall - accounted<<endl;
+    os<<left<<setw(28)<<"total"<<right<<setprecision(3)
+      <<setw(10)<<totalWall<<setw(10)<<totalCPU
+      <<setprecision(1)<<setw(8)<<100.0<<setw(12)<<peakRSS() / 1024.0<<endl;
+
+    auto funcs = sortedFunctions();
+    if (funcs.size()) {
+        os<<endl<<"Most expensive functions ("<<min((size_t)MAX_REPORTED_FUNCTIONS, funcs.size())
+          <<" of "<<funcs.size()<<"):"<<endl;
+        os<<left<<setw(40)<<"function"<<right<<setw(10)<<"wall(s)"<<setw(10)<<"cpu(s)"
+          <<setw(10)<<"blocks"<<setw(12)<<"states"<<endl;
+        for (size_t i = 0; i < funcs.size() && i < MAX_REPORTED_FUNCTIONS; i++) {
+            Function &func = gc->functions[funcs[i].first];
+            string name = func.name.substr(0, 38);
+            os<<left<<setw(40)<<name<<right<<setprecision(3)
+              <<setw(10)<<funcs[i].second.wall<<setw(10)<<funcs[i].second.cpu
+              <<setw(10)<<func.blocks.size()<<setw(12)<<func.allStates.size()<<endl;
+        }
+    }
+
+    ObjectCounts c = countObjects(gc);
+    os<<endl<<"Objects: "<<c.functions<<" functions, "<<c.instructions<<" instructions, "
+      <<c.irInstructions<<" IR instructions, "<<c.blocks<<" blocks, "
+      <<c.variables<<" variables, "<<c.ssaStates<<" SSA states, "
+      <<c.expressions<<" expressions, "<<c.loops<<" loops"<<endl;
+    os.unsetf(ios::fixed);
+}
+
+static string
+jsonString(const string &s)
+{
+    string out = "\"";
+    for (char ch: s) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        if ((unsigned char)ch < 0x20) continue;
+        out += ch;
+    }
+    return out + "\"";
+}
+
+static void
+jsonRecord(ostream &os, const PhaseRecord &r)
+{
+    os<<"{\"wall\": "<<r.wall<<", \"cpu\": "<<r.cpu
+      <<", \"peak_rss_kb\": "<<r.peakRSS<<", \"rss_growth_kb\": "<<r.rssGrowth
+      <<", \"objects\": "<<r.objects<<", \"calls\": "<<r.calls<<"}";
+}
+
+void
+PhaseStats_ReportJSON(JanusContext *gc, ostream &os)
+{
+    double totalWall = wallTime() - runStartWall;
+    double totalCPU = cpuTime() - runStartCPU;
+    ObjectCounts c = countObjects(gc);
+
+    os<<setprecision(6)<<fixed;
+    os<<"{"<<endl;
+    os<<"  \"executable\": "<<jsonString(gc->name)<<","<<endl;
+    os<<"  \"total\": {\"wall\": "<<totalWall<<", \"cpu\": "<<totalCPU
+      <<", \"peak_rss_kb\": "<<peakRSS()<<"},"<<endl;
+    os<<"  \"objects\": {\"functions\": "<<c.functions<<", \"instructions\": "<<c.instructions
+      <<", \"ir_instructions\": "<<c.irInstructions<<", \"blocks\": "<<c.blocks
+      <<", \"variables\": "<<c.variables<<", \"ssa_states\": "<<c.ssaStates
+      <<", \"expressions\": "<<c.expressions<<", \"loops\": "<<c.loops<<"},"<<endl;
+
+    os<<"  \"phases\": ["<<endl;
+    for (size_t i = 0; i < phaseOrder.size(); i++) {
+        os<<"    {\"name\": "<<jsonString(phaseOrder[i])<<", \"cost\": ";
+        jsonRecord(os, phaseTotals[phaseOrder[i]]);
+        os<<"}"<<(i + 1 < phaseOrder.size() ? "," : "")<<endl;
+    }
+    os<<"  ],"<<endl;
+
+    auto funcs = sortedFunctions();
+    os<<"  \"functions\": ["<<endl;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        FuncID fid = funcs[i].first;
+        os<<"    {\"fid\": "<<fid<<", \"name\": "<<jsonString(gc->functions[fid].name)
+          <<", \"wall\": "<<funcs[i].second.wall<<", \"cpu\": "<<funcs[i].second.cpu
+          <<", \"phases\": {";
+        bool first = true;
+        for (auto &name: phaseOrder) {
+            auto it = funcRecords[fid].find(name);
+            if (it == funcRecords[fid].end()) continue;
+            if (!first) os<<", ";
+            first = false;
+            os<<jsonString(name)<<": ";
+            jsonRecord(os, it->second);
+        }
+        os<<"}}"<<(i + 1 < funcs.size() ? "," : "")<<endl;
+    }
+    os<<"  ]"<<endl;
+    os<<"}"<<endl;
+    os.unsetf(ios::fixed);
+}
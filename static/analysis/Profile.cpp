@@ -8,6 +8,8 @@
 #include <cstdio>
 
 #include <map>
+#include <set>
+#include <vector>
 
 using namespace std;
 using namespace janus;
@@ -70,6 +72,85 @@ filterParallelisableLoop(JanusContext *gc)
     }
 }
 
+bool
+selectHotFunctions(JanusContext *gc)
+{
+    set<FuncID> hot;
+    bool hasProfile = false;
+    string line;
+
+    /* Step 1: functions of the hot loops */
+    ifstream lcov;
+    lcov.open(gc->name+".lcov", ios::in);
+    if (lcov.good()) {
+        GSTEPCONT("\tReading "<<gc->name<<".lcov for hot analysis"<<endl);
+        hasProfile = true;
+        /* Skip the top four lines */
+        getline(lcov, line);
+        getline(lcov, line);
+        getline(lcov, line);
+        getline(lcov, line);
+        int loopID, inaccurate;
+        uint64_t invocation, iteration;
+        float coverage;
+        string name;
+        while (lcov >> loopID >> coverage >> invocation>>iteration>>inaccurate>>name) {
+            if (loopID < 1 || loopID > gc->loops.size()) continue;
+            if (coverage > JANUS_LOOP_COVERAGE_THRESHOLD)
+                hot.insert(gc->loops[loopID-1].parent->fid);
+        }
+    }
+    lcov.close();
+
+    /* Step 2: hot functions that contain loops */
+    ifstream fcov;
+    fcov.open(gc->name+".fcov", ios::in);
+    if (fcov.good()) {
+        GSTEPCONT("\tReading "<<gc->name<<".fcov for hot analysis"<<endl);
+        hasProfile = true;
+        int funcID;
+        double coverage, callCoverage;
+        while (fcov >> funcID >> coverage >> callCoverage) {
+            if (funcID < 0 || funcID >= gc->functions.size()) continue;
+            if (coverage > JANUS_FUNC_COVERAGE_THRESHOLD &&
+                gc->functions[funcID].loops.size())
+                hot.insert(funcID);
+        }
+    }
+    fcov.close();
+
+    /* Step 3: manually selected loops are always analysed */
+    ifstream iselect;
+    iselect.open(gc->name+".loop.select", ios::in);
+    if (iselect.good()) {
+        hasProfile = true;
+        int loopID,type;
+        while (iselect >> loopID >> type) {
+            if (loopID < 1 || loopID > gc->loops.size()) continue;
+            hot.insert(gc->loops[loopID-1].parent->fid);
+        }
+    }
+    iselect.close();
+
+    if (!hasProfile) return false;
+
+    /* Step 4: the side effects of the sub calls are needed by the loop analysis */
+    vector<FuncID> worklist(hot.begin(), hot.end());
+    while (!worklist.empty()) {
+        FuncID fid = worklist.back();
+        worklist.pop_back();
+        for (auto sub: gc->functions[fid].subCalls) {
+            if (hot.insert(sub).second)
+                worklist.push_back(sub);
+        }
+    }
+
+    for (auto &func: gc->functions)
+        func.hot = (hot.find(func.fid) != hot.end());
+
+    return true;
+}
+
 void
 loadLoopSelection(JanusContext *jc)
 {
@@ -0,0 +1,599 @@
+#include "SideEffect.h"
+#include "JanusContext.h"
+#include "BasicBlock.h"
+#include "Arch.h"
+#include "IO.h"
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+using namespace janus;
+
+/* Summaries are owned here, functions only keep a pointer to theirs */
+static map<FuncID, FunctionSummary> summaries;
+
+/* ---------------------------------------------------------------------
+ * Summaries of shared library functions
+ * ------------------------------------------------------------------- */
+#define ARG(i)          (1u << (i))
+#define ALL_ARGS        0xffu
+
+enum ExternalFlags {
+    EXT_NONE = 0,
+    ///Never returns to the caller (exit, abort, throw)
+    EXT_EXIT = 1
+};
+
+struct ExternalSummary {
+    const char          *name;
+    ///Pointer arguments read and written, in integer argument order
+    uint32_t            reads;
+    uint32_t            writes;
+    uint32_t            flags;
+};
+
+/* errno is thread local, so the libm functions setting it on domain errors
+ * are treated as free of side effects */
+static const ExternalSummary externalTable[] = {
+    /* libm */
+    {"sqrt",        0, 0, EXT_NONE},
+    {"cbrt",        0, 0, EXT_NONE},
+    {"pow",         0, 0, EXT_NONE},
+    {"exp",         0, 0, EXT_NONE},
+    {"exp2",        0, 0, EXT_NONE},
+    {"exp10",       0, 0, EXT_NONE},
+    {"expm1",       0, 0, EXT_NONE},
+    {"log",         0, 0, EXT_NONE},
+    {"log2",        0, 0, EXT_NONE},
+    {"log10",       0, 0, EXT_NONE},
+    {"log1p",       0, 0, EXT_NONE},
+    {"logb",        0, 0, EXT_NONE},
+    {"sin",         0, 0, EXT_NONE},
+    {"cos",         0, 0, EXT_NONE},
+    {"tan",         0, 0, EXT_NONE},
+    {"asin",        0, 0, EXT_NONE},
+    {"acos",        0, 0, EXT_NONE},
+    {"atan",        0, 0, EXT_NONE},
+    {"atan2",       0, 0, EXT_NONE},
+    {"sinh",        0, 0, EXT_NONE},
+    {"cosh",        0, 0, EXT_NONE},
+    {"tanh",        0, 0, EXT_NONE},
+    {"asinh",       0, 0, EXT_NONE},
+    {"acosh",       0, 0, EXT_NONE},
+    {"atanh",       0, 0, EXT_NONE},
+    {"hypot",       0, 0, EXT_NONE},
+    {"erf",         0, 0, EXT_NONE},
+    {"erfc",        0, 0, EXT_NONE},
+    {"tgamma",      0, 0, EXT_NONE},
+    {"fabs",        0, 0, EXT_NONE},
+    {"floor",       0, 0, EXT_NONE},
+    {"ceil",        0, 0, EXT_NONE},
+    {"round",       0, 0, EXT_NONE},
+    {"lround",      0, 0, EXT_NONE},
+    {"llround",     0, 0, EXT_NONE},
+    {"trunc",       0, 0, EXT_NONE},
+    {"rint",        0, 0, EXT_NONE},
+    {"lrint",       0, 0, EXT_NONE},
+    {"nearbyint",   0, 0, EXT_NONE},
+    {"fmod",        0, 0, EXT_NONE},
+    {"remainder",   0, 0, EXT_NONE},
+    {"fmin",        0, 0, EXT_NONE},
+    {"fmax",        0, 0, EXT_NONE},
+    {"fdim",        0, 0, EXT_NONE},
+    {"fma",         0, 0, EXT_NONE},
+    {"copysign",    0, 0, EXT_NONE},
+    {"ldexp",       0, 0, EXT_NONE},
+    {"scalbn",      0, 0, EXT_NONE},
+    {"frexp",       0, ARG(0), EXT_NONE},
+    {"modf",        0, ARG(0), EXT_NONE},
+    {"sincos",      0, ARG(0)|ARG(1), EXT_NONE},
+    /* libc, pure */
+    {"abs",         0, 0, EXT_NONE},
+    {"labs",        0, 0, EXT_NONE},
+    {"llabs",       0, 0, EXT_NONE},
+    {"toupper",     0, 0, EXT_NONE},
+    {"tolower",     0, 0, EXT_NONE},
+    /* only reached when the stack is corrupted */
+    {"__stack_chk_fail", 0, 0, EXT_NONE},
+    /* libc, reading memory */
+    {"strlen",      ARG(0), 0, EXT_NONE},
+    {"strnlen",     ARG(0), 0, EXT_NONE},
+    {"strcmp",      ARG(0)|ARG(1), 0, EXT_NONE},
+    {"strncmp",     ARG(0)|ARG(1), 0, EXT_NONE},
+    {"memcmp",      ARG(0)|ARG(1), 0, EXT_NONE},
+    {"bcmp",        ARG(0)|ARG(1), 0, EXT_NONE},
+    {"strchr",      ARG(0), 0, EXT_NONE},
+    {"strrchr",     ARG(0), 0, EXT_NONE},
+    {"memchr",      ARG(0), 0, EXT_NONE},
+    {"strstr",      ARG(0)|ARG(1), 0, EXT_NONE},
+    {"atoi",        ARG(0), 0, EXT_NONE},
+    {"atol",        ARG(0), 0, EXT_NONE},
+    {"atof",        ARG(0), 0, EXT_NONE},
+    /* libc, writing memory */
+    {"memcpy",      ARG(1), ARG(0), EXT_NONE},
+    {"memmove",     ARG(1), ARG(0), EXT_NONE},
+    {"memset",      0, ARG(0), EXT_NONE},
+    {"bzero",       0, ARG(0), EXT_NONE},
+    {"strcpy",      ARG(1), ARG(0), EXT_NONE},
+    {"strncpy",     ARG(1), ARG(0), EXT_NONE},
+    {"strtod",      ARG(0), ARG(1), EXT_NONE},
+    {"strtol",      ARG(0), ARG(1), EXT_NONE},
+    /* no return */
+    {"exit",        0, 0, EXT_EXIT},
+    {"_exit",       0, 0, EXT_EXIT},
+    {"abort",       0, 0, EXT_EXIT},
+    {"__assert_fail", 0, 0, EXT_EXIT},
+    {"__cxa_throw", 0, 0, EXT_EXIT},
+    {"__cxa_rethrow", 0, 0, EXT_EXIT},
+    {"_Unwind_Resume", 0, 0, EXT_EXIT},
+    {"longjmp",     0, 0, EXT_EXIT},
+    {"siglongjmp",  0, 0, EXT_EXIT},
+    {"__longjmp_chk", 0, 0, EXT_EXIT},
+    {NULL,          0, 0, EXT_NONE}
+};
+
+static const ExternalSummary *
+findExternal(const string &name)
+{
+    for (const ExternalSummary *e = externalTable; e->name; e++) {
+        if (name == e->name) return e;
+    }
+    return NULL;
+}
+
+/* Look up a shared library function by name, also matching the
+ * float/long double variants (expf, expl) and the fast math
+ * entry points (__exp_finite) */
+static const ExternalSummary *
+lookupExternal(string name)
+{
+    //strip @plt and symbol versions
+    size_t at = name.find('@');
+    if (at != string::npos) name = name.substr(0, at);
+
+    if (name.compare(0, 2, "__") == 0 &&
+        name.size() > 9 && name.compare(name.size() - 7, 7, "_finite") == 0)
+        name = name.substr(2, name.size() - 9);
+
+    const ExternalSummary *e = findExternal(name);
+    if (e) return e;
+
+    char suffix = name.size() > 1 ? name.back() : 0;
+    if (suffix == 'f' || suffix == 'l') {
+        e = findExternal(name.substr(0, name.size() - 1));
+        //only maths functions have float variants
+        if (e && !e->reads && e->flags == EXT_NONE) return e;
+    }
+    return NULL;
+}
+
+static void
+summariseExternal(Function *function, FunctionSummary &s)
+{
+    const ExternalSummary *e = lookupExternal(function->name);
+    if (!e) {
+        s.unknown = true;
+        return;
+    }
+
+    if (e->flags & EXT_EXIT) s.mayExit = true;
+    for (int i=0; i<8; i++) {
+        ArgRange r = {i, 0, 0, false};
+        if (e->reads & ARG(i)) s.argReads.push_back(r);
+        if (e->writes & ARG(i)) s.argWrites.push_back(r);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * SSA helpers
+ * ------------------------------------------------------------------- */
+static const vector<uint32_t> &
+argumentRegisters()
+{
+    static vector<uint32_t> regs;
+    if (regs.empty()) {
+        vector<Variable> args;
+        getInputCallConvention(args);
+        for (auto &arg: args)
+            regs.push_back(arg.value);
+    }
+    return regs;
+}
+
+static bool
+isStackRegister(Function *function, uint32_t reg)
+{
+#ifdef JANUS_X86
+    return reg == JREG_RSP || (reg == JREG_RBP && function->hasBasePointer);
+#elif JANUS_AARCH64
+    return reg == JREG_SP || reg == JREG_WSP || (reg == JREG_X29 && function->hasBasePointer);
+#else
+    return false;
+#endif
+}
+
+/* The state of the base register of a memory operand */
+static VarState *
+getBaseState(VarState *mem)
+{
+    for (auto pred: mem->pred) {
+        if (pred->type == JVAR_REGISTER && pred->value == mem->base)
+            return pred;
+    }
+    return NULL;
+}
+
+/* Follow register copies back to the original definition */
+static VarState *
+resolveCopies(VarState *vs)
+{
+    while (vs && vs->lastModified &&
+           vs->lastModified->opcode == Instruction::Mov &&
+           vs->lastModified->inputs.size() == 1) {
+        VarState *src = vs->lastModified->inputs[0];
+        if (src->type != JVAR_REGISTER || src == vs) break;
+        vs = src;
+    }
+    return vs;
+}
+
+/* Returns the argument index if the state is the initial value of an argument register */
+static int
+getArgumentIndex(VarState *vs)
+{
+    if (!vs || vs->type != JVAR_REGISTER) return -1;
+    if (vs->lastModified || vs->isPHI) return -1;
+
+    auto &regs = argumentRegisters();
+    for (size_t i=0; i<regs.size(); i++) {
+        if (vs->value == regs[i]) return i;
+    }
+    return -1;
+}
+
+/* The state of the given argument register at a call site */
+static VarState *
+getCallArgument(Instruction *call, int arg)
+{
+    auto &regs = argumentRegisters();
+    if (arg < 0 || (size_t)arg >= regs.size()) return NULL;
+    for (auto vs: call->inputs) {
+        if (vs->type == JVAR_REGISTER && vs->value == regs[arg])
+            return vs;
+    }
+    return NULL;
+}
+
+/* Whether the state is a pointer into the function's own stack frame */
+static bool
+pointsToStack(Function *function, VarState *vs)
+{
+    if (!vs || !vs->lastModified ||
+        vs->lastModified->opcode != Instruction::GetPointer) return false;
+    for (auto in: vs->lastModified->inputs) {
+        if (in->type == JVAR_POLYNOMIAL && isStackRegister(function, in->base))
+            return true;
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------------
+ * Function summaries
+ * ------------------------------------------------------------------- */
+/* Keep one range per argument, widened to cover all accesses */
+static void
+addRange(vector<ArgRange> &ranges, ArgRange r)
+{
+    for (auto &old: ranges) {
+        if (old.arg != r.arg) continue;
+        if (old.bounded && r.bounded) {
+            old.lo = min(old.lo, r.lo);
+            old.hi = max(old.hi, r.hi);
+        } else old.bounded = false;
+        return;
+    }
+    ranges.push_back(r);
+}
+
+static void
+addGlobal(map<PCAddress, uint32_t> &globals, PCAddress addr, uint32_t size)
+{
+    uint32_t &old = globals[addr];
+    old = max(old, size);
+}
+
+static void
+addMemoryAccess(FunctionSummary &s, Function *function, MemoryInstruction &mi)
+{
+    VarState *mem = mi.mem;
+    if (!mem) {
+        s.unknown = true;
+        return;
+    }
+
+    bool read = (mi.type != MemoryInstruction::Write);
+    bool write = (mi.type == MemoryInstruction::Write ||
+                  mi.type == MemoryInstruction::ReadAndWrite ||
+                  mi.type == MemoryInstruction::Unknown);
+
+    switch (mem->type) {
+    case JVAR_STACK:
+    case JVAR_STACKFRAME:
+        return;
+    case JVAR_ABSOLUTE:
+        if (read) addGlobal(s.globalReads, mem->value, mem->size);
+        if (write) addGlobal(s.globalWrites, mem->value, mem->size);
+        return;
+    case JVAR_MEMORY: {
+        if (isStackRegister(function, mem->base)) return;
+        int arg = getArgumentIndex(resolveCopies(getBaseState(mem)));
+        if (arg < 0) {
+            if (read) s.readsUnknown = true;
+            if (write) s.writesUnknown = true;
+            return;
+        }
+        ArgRange r = {arg, mem->value, mem->value + mem->size, mem->index == 0};
+        if (read) addRange(s.argReads, r);
+        if (write) addRange(s.argWrites, r);
+        return;
+    }
+    default:
+        s.unknown = true;
+    }
+}
+
+/* Translate an argument relative range of the callee to the caller */
+static void
+mapArgRange(FunctionSummary &s, Function *function, Instruction *call, ArgRange r, bool write)
+{
+    VarState *vs = resolveCopies(getCallArgument(call, r.arg));
+    int arg = getArgumentIndex(vs);
+
+    if (arg >= 0) {
+        r.arg = arg;
+        addRange(write ? s.argWrites : s.argReads, r);
+    }
+    //accesses to the caller's own frame are private to the caller
+    else if (pointsToStack(function, vs)) return;
+    else if (write) s.writesUnknown = true;
+    else s.readsUnknown = true;
+}
+
+static void
+mergeCallee(FunctionSummary &s, FunctionSummary &callee, Function *function, Instruction *call)
+{
+    s.unknown |= callee.unknown;
+    s.mayExit |= callee.mayExit;
+    s.readsUnknown |= callee.readsUnknown;
+    s.writesUnknown |= callee.writesUnknown;
+
+    for (auto &g: callee.globalReads)
+        addGlobal(s.globalReads, g.first, g.second);
+    for (auto &g: callee.globalWrites)
+        addGlobal(s.globalWrites, g.first, g.second);
+
+    for (auto r: callee.argReads)
+        mapArgRange(s, function, call, r, false);
+    for (auto r: callee.argWrites)
+        mapArgRange(s, function, call, r, true);
+}
+
+/* The function called or tail called at the end of the block, NULL if unknown */
+static Function *
+getBlockCallee(Function *function, BasicBlock &bb, bool &isCall)
+{
+    Instruction *last = bb.lastInstr();
+    isCall = false;
+    if (!last) return NULL;
+
+    if (last->opcode == Instruction::Call) {
+        isCall = true;
+        auto query = function->calls.find(last->id);
+        if (query == function->calls.end()) return NULL;
+        return query->second;
+    }
+
+    //branches out of the function are tail calls
+    if (function->unRecognised.find(bb.bid) != function->unRecognised.end()) {
+        isCall = true;
+        PCAddress target = last->minstr->getTargetAddress();
+        if (!target) return NULL;
+        auto &functionMap = function->context->functionMap;
+        auto query = functionMap.find(target);
+        if (query == functionMap.end()) return NULL;
+        return query->second;
+    }
+    return NULL;
+}
+
+static FunctionSummary *
+summarise(Function *function, set<FuncID> &visiting)
+{
+    if (function->summary) return function->summary;
+
+    FunctionSummary &s = summaries[function->fid];
+
+    if (function->isExternal) {
+        summariseExternal(function, s);
+        function->summary = &s;
+        return &s;
+    }
+
+    //cold functions are not lifted in hot analysis mode
+    if (!function->isExecutable || !function->hot ||
+        !function->entry || function->blocks.empty()) {
+        s.unknown = true;
+        function->summary = &s;
+        return &s;
+    }
+
+    function->translate();
+    if (!function->available) {
+        s.unknown = true;
+        function->summary = &s;
+        return &s;
+    }
+
+    visiting.insert(function->fid);
+
+    /* Step 1: memory accessed by the function itself */
+    for (auto &bb: function->blocks) {
+        for (auto &mi: bb.minstrs)
+            addMemoryAccess(s, function, mi);
+    }
+
+    /* Step 2: merge the summaries of the callees (bottom-up) */
+    for (auto &bb: function->blocks) {
+        bool isCall;
+        Function *callee = getBlockCallee(function, bb, isCall);
+        if (!isCall) continue;
+        //indirect calls and recursion are not summarised
+        if (!callee || visiting.find(callee->fid) != visiting.end()) {
+            s.unknown = true;
+            continue;
+        }
+        mergeCallee(s, *summarise(callee, visiting), function, bb.lastInstr());
+    }
+
+    visiting.erase(function->fid);
+    function->summary = &s;
+    return &s;
+}
+
+FunctionSummary *
+getFunctionSummary(Function *function)
+{
+    set<FuncID> visiting;
+    return summarise(function, visiting);
+}
+
+bool
+FunctionSummary::readOnly()
+{
+    return !unknown && !writesUnknown && argWrites.empty() && globalWrites.empty();
+}
+
+bool
+FunctionSummary::pure()
+{
+    return readOnly() && !readsUnknown && argReads.empty() && globalReads.empty();
+}
+
+/* ---------------------------------------------------------------------
+ * Loop checks
+ * ------------------------------------------------------------------- */
+static bool
+overlaps(map<PCAddress, uint32_t> &a, map<PCAddress, uint32_t> &b)
+{
+    for (auto &r1: a) {
+        for (auto &r2: b) {
+            if (r1.first < r2.first + r2.second &&
+                r2.first < r1.first + r1.second)
+                return true;
+        }
+    }
+    return false;
+}
+
+void
+callSideEffectAnalysis(Loop *loop)
+{
+    Function *parent = loop->parent;
+    BasicBlock *entry = parent->entry;
+
+    /* Step 1: collect the memory written by the loop body itself */
+    bool writesMemory = false;
+    set<VarState *> writeBases;
+    map<PCAddress, uint32_t> globalWrites;
+
+    for (auto bid: loop->body) {
+        for (auto &mi: entry[bid].minstrs) {
+            if (mi.type == MemoryInstruction::Read ||
+                mi.type == MemoryInstruction::ReadAndRead || !mi.mem) continue;
+            VarState *mem = mi.mem;
+            if (mem->type == JVAR_ABSOLUTE) {
+                addGlobal(globalWrites, mem->value, mem->size);
+                writesMemory = true;
+            } else if (mem->type == JVAR_MEMORY && !isStackRegister(parent, mem->base)) {
+                writesMemory = true;
+                VarState *base = resolveCopies(getBaseState(mem));
+                if (base) writeBases.insert(base);
+            }
+        }
+    }
+
+    /* Step 2: check each call against the loop */
+    for (auto bid: loop->body) {
+        bool isCall;
+        Function *callee = getBlockCallee(parent, entry[bid], isCall);
+        if (!isCall) continue;
+
+        if (!callee) {
+            LOOPLOG("\tUnresolved call in block "<<dec<<bid<<endl);
+            loop->unsafeCalls.insert(bid);
+            continue;
+        }
+
+        FunctionSummary *s = getFunctionSummary(callee);
+        Instruction *call = entry[bid].lastInstr();
+        LOOPLOG("\tCall to "<<callee->name<<": "<<*s<<endl);
+
+        const char *reason = NULL;
+        if (s->unknown)
+            reason = "unknown side effects";
+        else if (s->mayExit)
+            reason = "may exit the program";
+        else if (s->writesUnknown || s->argWrites.size())
+            reason = "writes memory through pointers";
+        else if (s->globalWrites.size())
+            reason = "writes global memory";
+        else if (overlaps(s->globalReads, globalWrites))
+            reason = "reads global memory written by the loop";
+        else if (writesMemory) {
+            /* Same as the loop's own accesses, pointers with different
+             * bases are assumed not to overlap */
+            if (s->readsUnknown)
+                reason = "reads memory the loop may write";
+            for (auto &r: s->argReads) {
+                VarState *ptr = resolveCopies(getCallArgument(call, r.arg));
+                if (!ptr || !loop->isConstant(ptr) ||
+                    writeBases.find(ptr) != writeBases.end())
+                    reason = "reads memory the loop may write";
+            }
+        }
+
+        if (reason) {
+            LOOPLOG("\t\tCall is unsafe: "<<reason<<endl);
+            loop->unsafeCalls.insert(bid);
+        }
+    }
+}
+
+ostream&
+janus::operator<<(ostream& out, const FunctionSummary& s)
+{
+    if (s.unknown) {
+        out<<"unknown";
+        return out;
+    }
+    if (s.mayExit) out<<"may-exit ";
+    if (s.readsUnknown) out<<"reads-unknown ";
+    if (s.writesUnknown) out<<"writes-unknown ";
+    for (auto &r: s.argReads) {
+        out<<"reads-arg"<<r.arg;
+        if (r.bounded) out<<"["<<dec<<r.lo<<","<<r.hi<<")";
+        out<<" ";
+    }
+    for (auto &r: s.argWrites) {
+        out<<"writes-arg"<<r.arg;
+        if (r.bounded) out<<"["<<dec<<r.lo<<","<<r.hi<<")";
+        out<<" ";
+    }
+    if (s.globalReads.size()) out<<"reads "<<dec<<s.globalReads.size()<<" globals ";
+    if (s.globalWrites.size()) out<<"writes "<<dec<<s.globalWrites.size()<<" globals ";
+    if (!s.mayExit && !s.readsUnknown && !s.writesUnknown && s.argReads.empty() &&
+        s.argWrites.empty() && s.globalReads.empty() && s.globalWrites.empty())
+        out<<"pure";
+    return out;
+}
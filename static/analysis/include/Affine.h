@@ -1,8 +1,8 @@
 /*! \file Affine.h
  *  \brief Affine analysis for loops
  *
- * Affine analysis is used for detecting a specific type of loops that have constant loop bounds
- * and regular memory accesses
+ * Affine analysis is used for detecting a specific type of loops that have loop invariant bounds
+ * and memory addresses that are linear functions of the iterators of the loop nest
  */
 #ifndef _JANUS_AFFINE_ANALYSIS_
 #define _JANUS_AFFINE_ANALYSIS_
@@ -11,7 +11,8 @@
 
 /** \brief Affine analysis for a given loop
  *
- * Note that this analysis must be called after loop iterator analysis
+ * Sets the trip count span of the loop and the address type of its memory locations.
+ * Note that this analysis must be called after the memory locations of the loop are built
  */
 void affineAnalysis(janus::Loop *loop);
 #endif
\ No newline at end of file
@@ -111,6 +111,38 @@ public:
     Instruction             *getUpdateInstr();
 };
 
+/** \brief A reduction is a scalar accumulated in a SIMD register across iterations
+ *
+ *  The accumulator is only read by its update instruction and the result is only used
+ *  by the next iteration, so each vector lane can accumulate separately and the lanes
+ *  are combined after the loop */
+class Reduction
+{
+public:
+    enum ReductionOp
+    {
+        REDUCTION_NONE,
+        REDUCTION_ADD,
+        REDUCTION_MUL,
+        REDUCTION_MIN,
+        REDUCTION_MAX,
+        REDUCTION_AND,
+        REDUCTION_OR,
+        REDUCTION_XOR
+    };
+    /** \brief Phi state of the accumulator at the loop start */
+    VarState                *vs;
+    /** \brief The instruction accumulating into the register */
+    Instruction             *update;
+    ReductionOp             op;
+    /** \brief The result doesn't depend on the order of accumulation (bitwise operations) */
+    bool                    exact;
+
+    Reduction():vs(NULL),update(NULL),op(REDUCTION_NONE),exact(false){};
+    Reduction(VarState *vs, Instruction *update, ReductionOp op, bool exact)
+    :vs(vs),update(update),op(op),exact(exact){};
+};
+
 bool operator<(const Iterator& iter1, const Iterator& iter2);
 std::ostream& operator<<(std::ostream& out, const Iterator& iter);
 
@@ -0,0 +1,59 @@
+/*! \file PhaseStats.h
+ *  \brief Time and memory accounting for each stage of the static analyser
+ *
+ *  Enabled with the -stats switch. Each stage is wrapped in a PhaseTimer, the
+ *  time spent in a stage excludes the time of the stages nested in it, so the
+ *  stages add up to the total run time of the analyser.
+ */
+
+#ifndef _Janus_PHASE_STATS_
+#define _Janus_PHASE_STATS_
+
+#include "janus.h"
+#include <iostream>
+
+class JanusContext;
+
+namespace janus {
+    class Function;
+}
+
+///Set by the -stats switch, all timers are no-ops otherwise
+extern bool phaseStatsOn;
+
+/** \brief Times one stage of the analysis for the duration of its scope
+ *
+ * The cost is attributed to the stage and, if given, to the function. */
+class PhaseTimer {
+public:
+    PhaseTimer(const char *phase, janus::Function *func = NULL);
+    ~PhaseTimer();
+    ///Number of objects (blocks, instructions, loops, rules...) produced by the stage
+    void                addObjects(uint64_t n) { objects += n; }
+
+    const char          *phase;
+    janus::Function     *func;
+    PhaseTimer          *outer;
+    bool                active;
+    uint64_t            objects;
+    double              startWall;
+    double              startCPU;
+    ///Time spent in nested stages
+    double              innerWall;
+    double              innerCPU;
+    long                startRSS;
+};
+
+/** \brief Start the accounting of the whole run */
+void
+PhaseStats_Init();
+
+/** \brief Print the per stage and per function cost as a table */
+void
+PhaseStats_Report(JanusContext *gc, std::ostream &os);
+
+/** \brief Write the per stage and per function cost in JSON */
+void
+PhaseStats_ReportJSON(JanusContext *gc, std::ostream &os);
+
+#endif
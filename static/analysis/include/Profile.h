@@ -21,7 +21,18 @@ loadLoopCoverageProfiles(JanusContext *gc);
 void
 filterParallelisableLoop(JanusContext *gc);
 
+/** \brief Select the functions that need the full analysis in hot analysis mode (-hot)
+ *
+ * Functions with hot loops in the loop coverage profile (.lcov), hot functions with
+ * loops in the function coverage profile (.fcov), functions of manually selected
+ * loops and all their transitive callees are selected.
+ * Returns false if no profile is found */
+bool
+selectHotFunctions(JanusContext *gc);
+
 #define JANUS_LOOP_COVERAGE_THRESHOLD 1.0
 #define JANUS_LOOP_MIN_ITER_COUNT 15
+///The function coverage profile is a fraction of the total time
+#define JANUS_FUNC_COVERAGE_THRESHOLD 0.01
 
 #endif
\ No newline at end of file
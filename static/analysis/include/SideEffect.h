@@ -0,0 +1,73 @@
+/*! \file SideEffect.h
+ *  \brief Interprocedural side effect summaries
+ *
+ * Each function is summarised bottom-up on the call graph: the memory it reads
+ * and writes outside of its own stack frame, expressed relative to its pointer
+ * arguments or as global addresses, and whether it may leave the program.
+ * Shared library functions are summarised from a table of common libc/libm
+ * functions. The summaries decide whether a loop containing calls is still
+ * safe to parallelise.
+ */
+#ifndef _JANUS_SIDE_EFFECT_
+#define _JANUS_SIDE_EFFECT_
+
+#include "janus.h"
+#include "Function.h"
+#include "Loop.h"
+
+#include <vector>
+#include <map>
+
+namespace janus {
+
+/** \brief Memory range accessed through a pointer argument */
+struct ArgRange {
+    ///Index of the argument in the calling convention (integer arguments only)
+    int                 arg;
+    ///Accessed bytes [lo, hi) relative to the argument, only valid if bounded
+    int64_t             lo;
+    int64_t             hi;
+    ///False if the offset depends on another variable (e.g. indexed by a loop)
+    bool                bounded;
+};
+
+/** \brief Side effects of a function, including all its callees */
+struct FunctionSummary {
+    ///Indirect calls, unknown externals or code that can't be analysed
+    bool                unknown;
+    ///May terminate the program, throw or long jump
+    bool                mayExit;
+    ///Reads or writes memory through pointers not derived from the arguments
+    bool                readsUnknown;
+    bool                writesUnknown;
+    std::vector<ArgRange> argReads;
+    std::vector<ArgRange> argWrites;
+    ///Global memory accessed: start address -> size
+    std::map<PCAddress, uint32_t> globalReads;
+    std::map<PCAddress, uint32_t> globalWrites;
+
+    FunctionSummary():unknown(false),mayExit(false),readsUnknown(false),writesUnknown(false){}
+
+    ///No memory writes outside its own stack frame
+    bool                readOnly();
+    ///No memory accesses outside its own stack frame
+    bool                pure();
+};
+
+std::ostream& operator<<(std::ostream& out, const FunctionSummary& summary);
+
+} /* END Janus namespace */
+
+/** \brief Return the side effect summary of the function, computed on first use
+ *
+ * The function and its callees are translated if they haven't been */
+janus::FunctionSummary *
+getFunctionSummary(janus::Function *function);
+
+/** \brief Check the calls in the loop body against the loop's own memory accesses
+ *
+ * Calls that prevent the loop from being parallelised are added to loop->unsafeCalls */
+void
+callSideEffectAnalysis(janus::Loop *loop);
+
+#endif
@@ -6,6 +6,7 @@
 #include "ControlFlow.h"
 #include "SSA.h"
 #include "AST.h"
+#include "PhaseStats.h"
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -35,6 +36,8 @@ Function::Function(JanusContext *gc,FuncID fid, const Symbol &symbol, uint32_t s
     domTree = NULL;
     entry = NULL;
     translated = false;
+    hot = true;
+    summary = NULL;
     hasIndirectStackAccesses = false;
     available = true;
     isExternal = false;
@@ -74,29 +77,46 @@ Function::translate()
 
     /* Scan the code to retrieve stack information
      * this has to be done at first */
-    analyseStack(this);
+    {
+        PhaseTimer timer("stack analysis", this);
+        analyseStack(this);
+    }
 
     /* Scan for memory accesses */
-    scanMemoryAccess(this);
+    {
+        PhaseTimer timer("memory accesses", this);
+        scanMemoryAccess(this);
+    }
 
     /* For other mode, memory accesses are enough,
      * Only paralleliser and analysis mode needs to go further */
-    if (context->mode != JPARALLEL &&
-        context->mode != JPROF &&
-        context->mode != JANALYSIS &&
-        context->mode != JVECTOR &&
-        context->mode != JOPT &&
-	    context->mode != JSECURE &&
-        context->mode != JFETCH)
+    if (!context->hasMode(JPARALLEL) &&
+        !context->hasMode(JPROF) &&
+        !context->hasMode(JANALYSIS) &&
+        !context->hasMode(JVECTOR) &&
+        !context->hasMode(JOPT) &&
+        !context->hasMode(JSECURE) &&
+        !context->hasMode(JFETCH) &&
+        !context->hasMode(JPARAFETCH) &&
+        !context->hasMode(JPARAVECT))
         return;
 
     /* Construct the abstract syntax tree of the function */
-    buildASTGraph(this);
+    {
+        PhaseTimer timer("AST", this);
+        buildASTGraph(this);
+        timer.addObjects(exprs.size());
+    }
 
     /* Perform variable analaysis */
-    variableAnalysis(this);
+    {
+        PhaseTimer timer("variable analysis", this);
+        variableAnalysis(this);
+        timer.addObjects(allVars.size());
+    }
 
     /* Peform liveness analysis */
+    PhaseTimer timer("liveness", this);
     livenessAnalysis(this);
 }
 
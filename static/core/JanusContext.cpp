@@ -4,25 +4,74 @@
 #include "Loop.h"
 #include "Profile.h"
 #include "SSA.h"
+#include "PhaseStats.h"
 
 #include <map>
 #include <string>
+#include <algorithm>
 
 using namespace std;
 using namespace janus;
 
 JanusContext::JanusContext(const char* name, JMode mode)
-:mode(mode), name(string(name))
+:JanusContext(name, vector<JMode>(1, mode))
+{
+}
+
+JanusContext::JanusContext(const char* name, vector<JMode> modes)
+:mode(modes[0]), modes(modes), name(string(name))
 {
     passedLoop = 0;
     useProfiles = false;
     manualLoopSelection = false;
     sharedOn = true;
+    hotOnly = false;
+    prefetchLatency = 0;
+    reassociateFP = false;
+    loopsRecognised = false;
     //open the executable and parse according to the header
-    program.open(this, name);
+    {
+        PhaseTimer timer("loading");
+        program.open(this, name);
+    }
 
     //lift the binary to disassembly
+    PhaseTimer timer("disassembly");
     program.disassemble(this);
+    for (auto &func: functions)
+        timer.addObjects(func.minstrs.size());
+}
+
+bool JanusContext::hasMode(JMode m)
+{
+    for (auto md: modes)
+        if (md == m) return true;
+    return false;
+}
+
+bool JanusContext::usesLoopSelection(JMode m)
+{
+    return m == JPARALLEL || m == JPARAFETCH || m == JPARAVECT || m == JANALYSIS;
+}
+
+/* Depth of loop analysis required by each mode */
+enum AnalysisDepth {
+    ANALYSIS_NONE = 0,
+    ANALYSIS_LOOP_ONLY,
+    ANALYSIS_FULL
+};
+
+static AnalysisDepth
+requiredAnalysisDepth(JMode mode)
+{
+    switch (mode) {
+    /* Function timer doesn't need to recognise loop */
+    case JFCOV: return ANALYSIS_NONE;
+    /* for loop coverage profiling, loop recognition is enough */
+    case JLCOV:
+    case JGRAPH: return ANALYSIS_LOOP_ONLY;
+    default: return ANALYSIS_FULL;
+    }
 }
 
 void JanusContext::buildProgramDependenceGraph()
@@ -38,12 +87,31 @@ void JanusContext::buildProgramDependenceGraph()
     }
     GSTEPCONT(numBlocks<<" blocks"<<endl);
 
+    /* In hot analysis mode, loops are recognised from the CFG first,
+     * so that the coverage profiles can tell which functions are worth
+     * lifting. Cold functions keep only the disassembly and the CFG. */
+    if (hotOnly) {
+        recogniseLoops();
+        GSTEP("Selecting hot functions: ");
+        if (selectHotFunctions(this)) {
+            uint32_t numHot = 0;
+            for (auto &func: functions)
+                if (func.isExecutable && func.hot) numHot++;
+            GSTEPCONT(numHot<<" functions selected for analysis"<<endl);
+        } else {
+            GSTEPCONT("no coverage profile found, all functions are analysed"<<endl);
+        }
+    }
+
     /* Step 2: lift the disassembly to IR (the CFG must be ready) */
     GSTEP("Lifting disassembly to IR: ");
     uint32_t numInstrs = 0;
     for (auto &func: functions) {
-        if (func.isExecutable && func.blocks.size()) {
-            numInstrs += liftInstructions(&func);
+        if (func.isExecutable && func.hot && func.blocks.size()) {
+            PhaseTimer timer("lifting", &func);
+            uint32_t lifted = liftInstructions(&func);
+            timer.addObjects(lifted);
+            numInstrs += lifted;
         }
     }
     GSTEPCONT(numInstrs<<" instructions lifted"<<endl);
@@ -51,56 +119,89 @@ void JanusContext::buildProgramDependenceGraph()
     /* Step 3: construct SSA graph */
     GSTEP("Building SSA graphs"<<endl);
     for (auto &func: functions) {
-        if (func.isExecutable && func.blocks.size()) {
+        if (func.isExecutable && func.hot && func.blocks.size()) {
+            PhaseTimer timer("SSA", &func);
             buildSSAGraph(func);
+            timer.addObjects(func.allStates.size());
         }
     }
 
     /* Step 4: construct Control Dependence Graph */
     GSTEP("Building control dependence graphs"<<endl);
     for (auto &func: functions) {
-        if (func.isExecutable && func.blocks.size()) {
+        if (func.isExecutable && func.hot && func.blocks.size()) {
+            PhaseTimer timer("CDG", &func);
             buildCDG(func);
         }
     }
 }
 
-void JanusContext::analyseLoop()
+void JanusContext::recogniseLoops()
 {
-    /* Function timer doesn't need to recognise loop */
-    if (mode == JFCOV) return;
+    if (loopsRecognised) return;
+    loopsRecognised = true;
 
     GSTEP("Recognising loops: ");
 
-    /* Step 1: identify loops from the control flow graph */
     for (auto &func: functions) {
+        PhaseTimer timer("loop recognition", &func);
+        uint32_t numLoops = loops.size();
         searchLoop(this, &func);
+        timer.addObjects(loops.size() - numLoops);
     }
 
     GSTEPCONT(loops.size()<<" loops recognised"<<endl);
+}
+
+void JanusContext::analyseLoop()
+{
+    /* The analysis is shared by all modes, so go as deep as the most
+     * demanding mode requires */
+    AnalysisDepth depth = ANALYSIS_NONE;
+    for (auto md: modes)
+        depth = max(depth, requiredAnalysisDepth(md));
+
+    if (depth == ANALYSIS_NONE) return;
+
+    /* Step 1: identify loops from the control flow graph */
+    recogniseLoops();
 
     //for loop coverage profiling, this analysis is enough
-    if (mode == JLCOV || mode == JGRAPH) return;
+    if (depth == ANALYSIS_LOOP_ONLY) return;
 
     GSTEP("Analysing loop relations"<<endl);
 
     /* Step 2: analyse loop relations within one procedure */
     for (auto &func : functions) {
+        PhaseTimer timer("loop relations", &func);
         func.analyseLoopRelations();
     }
 
     /* Step 3: analyse loop relations across procedures */
-    analyseLoopAndFunctionRelations();
+    {
+        PhaseTimer timer("loop nests");
+        analyseLoopAndFunctionRelations();
+        timer.addObjects(loopNests.size());
+    }
 
     /* Step 4: load profiling information */
-    if (mode == JPROF) {
-        /* For automatic profiler mode, load loop coverage before analysis */
-        loadLoopCoverageProfiles(this);
-    }
+    {
+        PhaseTimer timer("profiles");
+        if (hasMode(JPROF)) {
+            /* For automatic profiler mode, load loop coverage before analysis */
+            loadLoopCoverageProfiles(this);
+        }
 
-    if (mode == JPARALLEL || mode == JANALYSIS) {
-        //load loop selection from previous run
-        loadLoopSelection(this);
+        /* The selection limits the loops being analysed, so it is only loaded here
+         * if all modes read it. Otherwise it is loaded before the rules of each of
+         * these modes are generated */
+        bool allSelect = true;
+        for (auto md: modes)
+            if (md != JGRAPH && !usesLoopSelection(md)) allSelect = false;
+        if (allSelect) {
+            //load loop selection from previous run
+            loadLoopSelection(this);
+        }
     }
 
     /* Step 5: analyse each loop more in depth (Pass 1) */
@@ -11,6 +11,8 @@
 #include "Dependence.h"
 #include "Alias.h"
 #include "Affine.h"
+#include "SideEffect.h"
+#include "PhaseStats.h"
 
 #include <stack>
 #include <set>
@@ -99,6 +101,7 @@ Loop::Loop(BasicBlock *start, Function *parent)
     mainIterator = NULL;
     affine = false;
     vectorWordSize = 0;
+    dependenceDistance = 0;
 
     /* Record this id in parent function */
     parent->loops.insert(id);
@@ -221,6 +224,9 @@ Loop::analyse(JanusContext *gc)
     }
 
     proceed:
+    /* Loops in cold functions are not lifted in hot analysis mode */
+    if (!parent->hot) return;
+
     analysed = true;
     BasicBlock *entry = parent->entry;
 
@@ -232,7 +238,9 @@ Loop::analyse(JanusContext *gc)
     for (auto *l : subLoops)
         l->analyse(gc);
 
-    if (gc->mode == JPROF && removed) {
+    /* The analysis is shared by all modes, removed loops are only skipped
+     * by the loop planner when generating its rules */
+    if (removed) {
         LOOPLOG("-----------------------------------------------------------------"<<endl);
         if (invocation_count)
             LOOPLOG("Loop "<<dec<<id<<" is removed due to low profiled coverage: "<<coverage<<" or low iteration: "<<(total_iteration_count/invocation_count)<<endl);
@@ -240,7 +248,6 @@ Loop::analyse(JanusContext *gc)
             LOOPLOG("Loop "<<dec<<id<<" is removed due to low profiled coverage: "<<coverage<<endl);
         //we still analyse removed loops since it might contribute to alias analysis of parent/children loops
         //TODO: reduce the number of loops with the help of alias analysis
-        return;
     }
 
     LOOPLOG("========================================================="<<endl);
@@ -276,13 +283,21 @@ Loop::analyse(JanusContext *gc)
     }
 
     /* Step 3: variable analysis (find constant variables) */
-    variableAnalysis(this);
+    {
+        PhaseTimer timer("loop variables", parent);
+        variableAnalysis(this);
+    }
 
     /* Step 4: dependence analysis for variables (only) */
-    dependenceAnalysis(this);
+    {
+        PhaseTimer timer("loop dependences", parent);
+        dependenceAnalysis(this);
+    }
 
     /* Step 5: iterator variable analysis */
+    PhaseTimer timer("loop iterators", parent);
     iteratorAnalysis(this);
+    timer.addObjects(iterators.size());
 
     LOOPLOG("========================================================="<<endl<<endl);
 }
@@ -290,13 +305,14 @@ Loop::analyse(JanusContext *gc)
 void
 Loop::analyse2(JanusContext *gc)
 {
-    if (unsafe) return;
+    if (unsafe || !parent->hot) return;
     if (gc->manualLoopSelection && !pass) return;
 
     LOOPLOG("========================================================="<<endl);
     LOOPLOG("Analysing Loop "<<dec<<id<<" Second Pass"<<endl);
 
     /* Step 6: iterator analysis again */
+    PhaseTimer timer("loop post iterators", parent);
     if (!postIteratorAnalysis(this)) {
         LOOPLOG("\tPost iterator analysis failed"<<endl);
     }
@@ -307,19 +323,32 @@ Loop::analyse2(JanusContext *gc)
 void
 Loop::analyse3(JanusContext *gc)
 {
-    if (unsafe) return;
+    if (unsafe || !parent->hot) return;
     if (gc->manualLoopSelection && !pass) return;
 
     LOOPLOG("========================================================="<<endl);
     LOOPLOG("Analysing Loop "<<dec<<id<<" Third Pass"<<endl);
 
     /* Step 7: alias analysis */
-    aliasAnalysis(this);
+    {
+        PhaseTimer timer("alias analysis", parent);
+        aliasAnalysis(this);
+    }
+
+    /* Step 8: check the side effects of calls in the loop */
+    {
+        PhaseTimer timer("call side effects", parent);
+        callSideEffectAnalysis(this);
+    }
 
-    /* Step 8: scratch register analysis */
-    scratchAnalysis(this);
+    /* Step 9: scratch register analysis */
+    {
+        PhaseTimer timer("scratch registers", parent);
+        scratchAnalysis(this);
+    }
 
-    /* Step 9: encode loop iterators */
+    /* Step 10: encode loop iterators */
+    PhaseTimer timer("iterator encoding", parent);
     encodeIterators(this);
     LOOPLOG("========================================================="<<endl<<endl);
 }
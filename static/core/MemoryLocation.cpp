@@ -71,8 +71,8 @@ MemoryLocation::MemoryLocation(MemoryInstruction *mi, Loop *loop)
         hasLoopIterator = true;
 
     for (auto subLoop: loop->descendants) {
-        expr.hasIterator(subLoop);
-        hasSubLoopIterator = true;
+        if (expr.hasIterator(subLoop))
+            hasSubLoopIterator = true;
     }
 
     if (hasLoopIterator && !hasSubLoopIterator) type = Affine1D;
@@ -21,6 +21,8 @@
 class JanusContext;
 
 namespace janus {
+    struct FunctionSummary;
+
     class Function
     {
     public:
@@ -39,6 +41,10 @@ namespace janus {
         JanusContext                           *context;
         ///If set, then it is safe to query the basic information of basic block/instructions/sub calls
         bool                                   translated;
+        ///If set, the function is lifted and analysed beyond its CFG (only cold functions are unset with -hot)
+        bool                                   hot;
+        ///Side effects of the function and its callees, see getFunctionSummary()
+        FunctionSummary                        *summary;
         /* --------------------------------------------------------------
          *                       information storage
          * ------------------------------------------------------------- */
@@ -15,8 +15,10 @@
 
 class JanusContext {
 public:
-    ///Analysis mode
+    ///Analysis mode (the mode whose rules are currently generated)
     JMode                                       mode;
+    ///All modes requested in this run, they share one analysis
+    std::vector<JMode>                          modes;
     ///The name of the executable
     std::string                                 name;
     ///the raw data parsed from the executable
@@ -38,16 +40,32 @@ public:
 
     ///Shared library profiling, enabled by default. Disable with -noshared switch
     bool					sharedOn;
+    ///Only analyse functions with hot loops in depth, enabled with -hot switch
+    bool                                        hotOnly;
+    ///Memory latency (cycles) hidden by the prefetcher, set with -pflatency=<cycles>. 0 means the default
+    uint32_t                                    prefetchLatency;
+    ///Let the vectoriser reorder floating point reductions and fuse multiply-adds, enabled with -vreassoc switch
+    bool                                        reassociateFP;
     
     int                                         passedLoop;
+    ///Set once the loops are recognised from the CFG
+    bool                                        loopsRecognised;
     //flag to turn on profiling information
     bool                                        useProfiles;
     bool                                        manualLoopSelection;
 
     JanusContext(const char* name, JMode mode);
+    JanusContext(const char* name, std::vector<JMode> modes);
+
+    ///Check whether the given mode is requested in this run
+    bool                            hasMode(JMode m);
+    ///Check whether the given mode selects loops from <exe>.loop.select
+    static bool                     usesLoopSelection(JMode m);
 
     ///Construct the CFG and SSA graph for the executable
     void                            buildProgramDependenceGraph();
+    ///Recognise loops from the control flow graph, only performed once
+    void                            recogniseLoops();
     ///Recognise and analyse loops from the program dependence graph
     void                            analyseLoop();
     ///Recognise loop nests for loops and functions
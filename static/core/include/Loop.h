@@ -9,6 +9,7 @@
 
 #include <set>
 #include <map>
+#include <vector>
 #include <string>
 
 class JanusContext;
@@ -40,6 +41,28 @@ enum LoopType {
     LOOP_DEPEND_MEM
 };
 
+/** \brief Possible directions of a dependence at one loop level,
+ *  comparing the iteration of the source with the iteration of the sink */
+enum DependenceDirection {
+    DEP_DIR_LT = 1,
+    DEP_DIR_EQ = 2,
+    DEP_DIR_GT = 4,
+    DEP_DIR_ANY = 7
+};
+
+class Loop;
+
+/** \brief Direction and distance of a memory dependence between two locations */
+struct DependenceVector {
+    MemoryLocation                  *src;
+    MemoryLocation                  *dst;
+    /** \brief Directions (DependenceDirection mask) for the analysed loop first, then its inner loops */
+    std::vector<std::pair<Loop *, uint32_t>> directions;
+    /** \brief Iteration distance in the analysed loop, dst iteration - src iteration */
+    int64_t                         distance;
+    bool                            distanceKnown;
+};
+
 enum LoopExitType {
     CONDITIONAL_EXIT,
     BREAK_EXIT,
@@ -101,6 +124,8 @@ class Loop
     std::set<Loop*>                 descendants;
     std::set<FuncID>                subCalls;
     std::map<BlockID, FuncID>       calls;
+    /** \brief Blocks ending with calls whose side effects prevent parallelisation */
+    std::set<BlockID>               unsafeCalls;
     /* --------------------------------------------------------------
      *                    Loop Variables
      * ------------------------------------------------------------- */
@@ -123,12 +148,19 @@ class Loop
     std::set<Variable*>             constPhiVars;
     /** \brief All iterators of the loop */
     std::map<VarState*, Iterator>   iterators;
+    /** \brief Reductions in SIMD registers, only handled by the vectoriser */
+    std::map<VarState*, Reduction>  reductions;
     /** \brief The main iterator that is associated with a loop bound  */
     Iterator                        *mainIterator;
     /** \brief Set of registers that represent the loop iterators  */
     RegSet                          iteratorRegs;
     /** \brief Iteration count from static analysis, if zero, it means the iteration count can't be determined */
     uint64_t                        staticIterCount;
+    /** \brief Final minus initial value of the main iterator, the iteration count is span / stride + 1
+     *
+     * An integer if the count is static, a loop invariant expression if it is only known at loop entry,
+     * Expr::NONE if the bound varies in the loop */
+    Expr                            tripCountSpan;
     /** \brief Vector word size in this loop */
     int                             vectorWordSize;
     /** \brief Peeling distance of multiple 16 bytes, -1 means incompatitable */
@@ -144,6 +176,10 @@ class Loop
     std::set<MemoryLocation *>      undecidedMemAccesses;
     /** \brief memory locations that can be decided statically */
     std::map<MemoryLocation*, std::set<MemoryLocation*>>  memoryDependences;
+    /** \brief direction and distance vectors of the memory dependences found by the dependence tests */
+    std::vector<DependenceVector>   dependenceVectors;
+    /** \brief Minimum distance of the loop-carried dependences for DOACROSS, 0 if the loop is DOALL */
+    int64_t                         dependenceDistance;
     /** \brief a set of recognised memory locations in the loop, indexed by array bases (common base) 
      *
      * Each array base is subject to runtime checks.
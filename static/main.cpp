@@ -1,12 +1,14 @@
 #include "JanusContext.h"
 #include "SchedGen.h"
+#include "PhaseStats.h"
 #include <string.h>
+#include <algorithm>
 
 using namespace std;
 
 static void usage()
 {
-    cout<<"Usage: analyze + <option> + <executable> + [profile_info]"<<endl;
+    cout<<"Usage: analyze + <option> [<option> ...] + <executable> + [profile_info]"<<endl;
     cout<<"Option:"<<endl;
     cout<<"  -a: static analysis without generating rules"<<endl;
     cout<<"  -c: generate custom analysis and rules from Cinnamon DSL"<<endl;
@@ -14,13 +16,72 @@ static void usage()
     cout<<"  -s: generate rules for secure execution"<<endl;
     cout<<"  -p: generate rules for automatic parallelisation"<<endl;
     cout<<"  -f: generate rules for automatic prefetch"<<endl;
+    cout<<"  -pf: generate rules for automatic parallelisation with prefetch"<<endl;
+    cout<<"  -pflatency=<cycles>: memory latency the prefetch distance is computed for (-f and -pf)"<<endl;
     cout<<"  -lc: generate rules for loop coverage profiling"<<endl;
     cout<<"  -fc: generate rules for function coverage profiling"<<endl;
     cout<<"  -pr: generate rules for automatic loop profiling"<<endl;
     cout<<"  -pr -noshared: generate rules for automatic loop profiling & disable shared library profiling"<<endl;
+    cout<<"  -hot: only analyse functions with hot loops from <executable>.lcov/.fcov in depth"<<endl;
+    cout<<"  -stats: print the time and memory spent in each analysis stage"<<endl;
+    cout<<"  -stats=json: write the analysis stage costs to <executable>.stats.json"<<endl;
     cout<<"  -o: generate rules for single thread optimisation"<<endl;
     cout<<"  -v: generate rules for automatic vectorisation"<<endl;
+    cout<<"  -vreassoc: allow -v to reorder floating point sums, products, min and max and to fuse multiply-adds (not bit-exact)"<<endl;
     cout<<"  -d: generate rules for testing dll instrumentation"<<endl;
+    cout<<"Multiple rule options (e.g. -p -f -lc) share one analysis run,"<<endl;
+    cout<<"each option then produces its own <executable>.<option>.jrs"<<endl;
+}
+
+/* Translate one command line option to its analysis mode
+ * Returns JNONE if the option is not recognised */
+static JMode parseMode(const char *option)
+{
+    if (option[0] != '-') return JNONE;
+
+    switch(option[1]) {
+        case 'a': IF_VERBOSE(cout<<"Static analysis mode enabled"<<endl); return JANALYSIS;
+        case 'c':
+            if (option[2] == 'f' && option[3] == 'g') {
+                IF_VERBOSE(cout<<"Control flow graph mode enabled"<<endl);
+                return JGRAPH;
+            }
+            IF_VERBOSE(cout<<"Custom Cinnamon DSL mode enabled"<<endl);
+            return JCUSTOM;
+        case 'p':
+            if (option[2] == 'r') {
+                IF_VERBOSE(cout<<"Automatic profiling mode enabled"<<endl);
+                return JPROF;
+            }
+            if (option[2] == 'f') {
+                IF_VERBOSE(cout<<"Parallelisation with prefetch mode enabled"<<endl);
+                return JPARAFETCH;
+            }
+            if (option[2] == 'v') {
+                IF_VERBOSE(cout<<"Parallelisation with vectorisation mode enabled"<<endl);
+                return JPARAVECT;
+            }
+            IF_VERBOSE(cout<<"Parallelisation mode enabled"<<endl);
+            return JPARALLEL;
+        case 'l':
+            if (option[2] == 'c') {
+                IF_VERBOSE(cout<<"Loop coverage profiling mode enabled"<<endl);
+                return JLCOV;
+            }
+            return JNONE;
+        case 'f':
+            if (option[2] == 'c') {
+                IF_VERBOSE(cout<<"Function coverage profiling mode enabled"<<endl);
+                return JFCOV;
+            }
+            IF_VERBOSE(cout<<"Software prefetch mode enabled"<<endl);
+            return JFETCH;
+        case 'v': IF_VERBOSE(cout<<"Loop vectorisation enabled"<<endl); return JVECTOR;
+        case 's': IF_VERBOSE(cout<<"Secure execution enabled"<<endl); return JSECURE;
+        case 'o': IF_VERBOSE(cout<<"Binary optimiser mode enabled"<<endl); return JOPT;
+        case 'd': IF_VERBOSE(cout<<"Testing for dll instrumentation enabled"<<endl); return JDLL;
+        default: return JNONE;
+    }
 }
 
 int main(int argc, char **argv) {
@@ -29,105 +90,101 @@ int main(int argc, char **argv) {
     IF_VERBOSE(cout<<"\t\tJanus Static Binary Analyser"<<endl);
     IF_VERBOSE(cout<<"---------------------------------------------------------------"<<endl<<endl);
 
-    if(argc != 3 && argc != 4) {
+    if(argc < 3) {
         usage();
         return 1;
     }
 
-    JMode mode = JNONE;
-
-    if(argv[1][0]=='-')
-    {
-        char option = argv[1][1];
-        switch(option) {
-            case 'a': mode = JANALYSIS; IF_VERBOSE(cout<<"Static analysis mode enabled"<<endl); break;
-            case 'c':
-                if (argv[1][2] == 'f' && argv[1][3] == 'g') {
-                    mode = JGRAPH;
-                    IF_VERBOSE(cout<<"Control flow graph mode enabled"<<endl);
-                } else {
-                    mode = JCUSTOM;
-                    IF_VERBOSE(cout<<"Custom Cinnamon DSL mode enabled"<<endl);
-                }
-                break;
-            case 'p':
-                if (argv[1][2] == 'r') {
-                    mode = JPROF;
-                    IF_VERBOSE(cout<<"Automatic profiling mode enabled"<<endl);
-                } else {
-                    mode = JPARALLEL;
-                    IF_VERBOSE(cout<<"Parallelisation mode enabled"<<endl);
-                }
-                break;
-            case 'l': 
-                if (argv[1][2] == 'c') {
-                    mode = JLCOV;
-                    IF_VERBOSE(cout<<"Loop coverage profiling mode enabled"<<endl); break;
-                }
-                else {
-                    usage();
-                    return 1;
-                }
-                break;
-            case 'f': 
-                if (argv[1][2] == 'c') {
-                    mode = JFCOV;
-                    IF_VERBOSE(cout<<"Function coverage profiling mode enabled"<<endl);
-                }
-                else {
-                    mode = JFETCH;
-                    IF_VERBOSE(cout<<"Software prefetch mode enabled"<<endl);
-                }
-                break;
-            case 'v': mode = JVECTOR; IF_VERBOSE(cout<<"Loop vectorisation enabled"<<endl); break;
-            case 's': mode = JSECURE; IF_VERBOSE(cout<<"Secure execution enabled"<<endl); break;
-            case 'o': mode = JOPT; IF_VERBOSE(cout<<"Binary optimiser mode enabled"<<endl); break;
-            case 'd': mode = JDLL; IF_VERBOSE(cout<<"Testing for dll instrumentation enabled"<<endl); break;
-            default: {
-                usage();
-                return 1;
-            }
+    vector<JMode> modes;
+    bool sharedOn= true;
+    bool hotOnly = false;
+    bool stats = false;
+    bool statsJSON = false;
+    uint32_t prefetchLatency = 0;
+    bool reassociateFP = false;
+    int argNo = 1;
+
+    /* Collect all the mode options before the executable */
+    for (; argNo < argc && argv[argNo][0] == '-'; argNo++) {
+        if (strcmp(argv[argNo], "-noshared") == 0) {
+            sharedOn = false;
+            continue;
+        }
+        if (strcmp(argv[argNo], "-hot") == 0) {
+            hotOnly = true;
+            continue;
+        }
+        if (strcmp(argv[argNo], "-stats") == 0) {
+            stats = true;
+            continue;
         }
+        if (strcmp(argv[argNo], "-stats=json") == 0) {
+            stats = statsJSON = true;
+            continue;
+        }
+        if (strncmp(argv[argNo], "-pflatency=", 11) == 0) {
+            prefetchLatency = atoi(argv[argNo] + 11);
+            continue;
+        }
+        if (strcmp(argv[argNo], "-vreassoc") == 0) {
+            reassociateFP = true;
+            continue;
+        }
+        JMode mode = parseMode(argv[argNo]);
+        if (mode == JNONE) {
+            usage();
+            return 1;
+        }
+        if (find(modes.begin(), modes.end(), mode) == modes.end())
+            modes.push_back(mode);
     }
-    else {
+
+    /* Exactly one executable must follow the options */
+    if (modes.empty() || argNo != argc - 1) {
         usage();
         return 1;
     }
-    int argNo=2;
-    bool sharedOn= true;
-    if(argc ==4){
-	if(strcmp(argv[2], "-noshared")==0 && mode == JPROF){
-	    sharedOn = false;
-	    argNo =3;
-	}
-	else{
-	    usage();
-	    return 1;
-	}
+
+    if (!sharedOn && find(modes.begin(), modes.end(), JPROF) == modes.end()) {
+        usage();
+        return 1;
     }
-   
-    GIO_Init(argv[argNo], mode);
-   
-   //Load executables
-    JanusContext *jc = new JanusContext(argv[argNo], mode);
+
+    GIO_Init(argv[argNo], modes[0]);
+
+    if (stats) PhaseStats_Init();
+
+    //Load executables
+    JanusContext *jc = new JanusContext(argv[argNo], modes);
     //
     jc->sharedOn= sharedOn;
-    
+    jc->hotOnly = hotOnly;
+    jc->prefetchLatency = prefetchLatency;
+    jc->reassociateFP = reassociateFP;
+
     //build CFG
     jc->buildProgramDependenceGraph();
 
     //analyse
     jc->analyseLoop();
 
-    if(mode == JANALYSIS || mode == JGRAPH) {
+    if(jc->hasMode(JANALYSIS) || jc->hasMode(JGRAPH)) {
         dumpCFG(jc);
         dumpSSA(jc);
         dumpLoopCFG(jc);
         dumpLoopSSA(jc);
         generateExeReport(jc);
         generateExeReport(jc, &cout);
-    } else {
-        generateRules(jc);
+    }
+
+    generateRules(jc);
+
+    if (statsJSON) {
+        ofstream statsFile(jc->name + ".stats.json", ios::out);
+        PhaseStats_ReportJSON(jc, statsFile);
+        IF_VERBOSE(cout<<"Analysis stage costs written to "<<jc->name<<".stats.json"<<endl);
+    } else if (stats) {
+        PhaseStats_Report(jc, cout);
     }
 
     delete jc;
@@ -1,12 +1,14 @@
 #include "JanusContext.h"
 #include "BasicBlock.h"
 #include "IO.h"
+#include "PhaseStats.h"
 #include "SchedGenInt.h"
 //#include "OptRule.h"
 #include "ParaRule.h"
 #include "dllRule.h"
 #include "CoverageRule.h"
 #include "DSLGen.h"
+#include "Profile.h"
 
 #ifdef JANUS_X86
 #include "VectRule.h"
@@ -30,12 +32,42 @@ compileRewriteRulesToFile(JanusContext *gc);
 static uint32_t
 compileRewriteRuleDataToFile(JanusContext *gc);
 
-void
-generateRules(JanusContext *gc)
+/* Short tag of each mode, used to name the rule file when
+ * several modes are generated from one analysis */
+static const char *
+getModeTag(JMode mode)
 {
-    uint32_t size;
-    if (!gc) return;
+    switch(mode) {
+    case JOPT: return "o";
+    case JPARALLEL: return "p";
+    case JVECTOR: return "v";
+    case JLCOV: return "lc";
+    case JFCOV: return "fc";
+    case JPROF: return "pr";
+    case JSECURE: return "s";
+    case JFETCH: return "f";
+    case JPARAFETCH: return "pf";
+    case JPARAVECT: return "pv";
+    case JCUSTOM: return "c";
+    case JDLL: return "d";
+    default: return "jrs";
+    }
+}
 
+string
+getRuleFileName(JanusContext *gc)
+{
+    /* Single mode keeps the original name so existing scripts still work */
+    if (gc->modes.size() <= 1)
+        return gc->name + ".jrs";
+    return gc->name + "." + getModeTag(gc->mode) + ".jrs";
+}
+
+/* Generate and write the rewrite schedule for the current mode gc->mode */
+static void
+generateRulesForMode(JanusContext *gc)
+{
+    uint32_t size;
     uint32_t numLoops = gc->loops.size();
 
     if (gc->mode != JFCOV && !numLoops) {
@@ -43,6 +75,10 @@ generateRules(JanusContext *gc)
         return;
     }
 
+    /* Rules from the previous mode must not leak into this schedule */
+    rewriteRules.clear();
+    reshapeBlock = NULL;
+
     /* Allocate a rule cluster for each loop */
     for(int i=0; i<=numLoops; i++) {
         rewriteRules.emplace_back(i);
@@ -50,51 +86,145 @@ generateRules(JanusContext *gc)
 
     GSTEP("Generating rewrite schedules: "<<endl);
 
-    switch(gc->mode) {
-    case JOPT:
-        //generateOptRules(gc);
-        break;
-    case JPARALLEL:
-        generateParallelRules(gc);
-        break;
-    case JVECTOR:
+    string generation = string("rule generation -") + getModeTag(gc->mode);
+    string emission = string("rule emission -") + getModeTag(gc->mode);
+    {
+        PhaseTimer timer(generation.c_str());
+
+        switch(gc->mode) {
+        case JOPT:
+            //generateOptRules(gc);
+            break;
+        case JPARALLEL:
+            generateParallelRules(gc);
+            break;
+        case JVECTOR:
+#ifdef JANUS_X86
+            generateVectorRules(gc);
+#endif
+            break;
+        case JLCOV:
+            generateLoopCoverageProfilingRules(gc);
+            break;
+        case JFCOV:
+            generateFunctionCoverageProfilingRules(gc);
+            break;
+        case JPROF:
+            generateLoopPlannerRules(gc);
+            break;
+        //case JSECURE:
+            //generateSecurityRule(gc);
+            //break;
+        case JFETCH:
+            generatePrefetchRules(gc);
+            break;
+        case JPARAFETCH:
+#ifdef JANUS_X86
+            generateParallelPrefetchRules(gc);
+#endif
+            break;
+        case JPARAVECT:
 #ifdef JANUS_X86
-        generateVectorRules(gc);
+            generateParallelVectorRules(gc);
 #endif
-        break;
-    case JLCOV:
-        generateLoopCoverageProfilingRules(gc);
-        break;
-    case JFCOV:
-        generateFunctionCoverageProfilingRules(gc);
-        break;
-    case JPROF:
-        generateLoopPlannerRules(gc);
-        break;
-    //case JSECURE:
-        //generateSecurityRule(gc);
-        //break;
-    case JFETCH:
-        generatePrefetchRules(gc);
-        break;
-    case JCUSTOM:
-        generateCustomRules(gc);
-        break;
-    case JDLL:
-        generateDLLRules(gc);
-        break;
-    default:
-        break;
+            break;
+        case JCUSTOM:
+            generateCustomRules(gc);
+            break;
+        case JDLL:
+            generateDLLRules(gc);
+            break;
+        default:
+            break;
+        }
+
+        for (auto &cluster: rewriteRules)
+            for (auto &rules: cluster.ruleMap)
+                timer.addObjects(rules.second.size());
     }
 
     /* Now we generated all rules, compile the static rules
      * to a rule file */
     GSTEP("Writing rewrite schedules to file: "<<endl);
-    if (gc->mode == JPARALLEL)
-        size = compileParallelRulesToFile(gc);
-    else
-        size = compileRewriteRulesToFile(gc);
-    GSTEP("Rewrite schedule file: "<<gc->name<<".jrs generated, "<<size<<" bytes "<<endl);
+    {
+        PhaseTimer timer(emission.c_str());
+        if (gc->mode == JPARALLEL || gc->mode == JPARAFETCH || gc->mode == JPARAVECT)
+            size = compileParallelRulesToFile(gc);
+        else
+            size = compileRewriteRulesToFile(gc);
+        timer.addObjects(size);
+    }
+    GSTEP("Rewrite schedule file: "<<getRuleFileName(gc)<<" generated, "<<size<<" bytes "<<endl);
+}
+
+/* Loop fields the rule generators write their selection results into */
+struct LoopModeState {
+    bool                pass;
+    bool                unsafe;
+    bool                needRuntimeCheck;
+    LoopType            type;
+    int                 vectorWordSize;
+    int                 peelDistance;
+    int64_t             dependenceDistance;
+    RSLoopHeader        header;
+};
+
+static LoopModeState
+saveLoopModeState(Loop &loop)
+{
+    LoopModeState state;
+    state.pass = loop.pass;
+    state.unsafe = loop.unsafe;
+    state.needRuntimeCheck = loop.needRuntimeCheck;
+    state.type = loop.type;
+    state.vectorWordSize = loop.vectorWordSize;
+    state.peelDistance = loop.peelDistance;
+    state.dependenceDistance = loop.dependenceDistance;
+    state.header = loop.header;
+    return state;
+}
+
+static void
+restoreLoopModeState(Loop &loop, LoopModeState &state)
+{
+    loop.pass = state.pass;
+    loop.unsafe = state.unsafe;
+    loop.needRuntimeCheck = state.needRuntimeCheck;
+    loop.type = state.type;
+    loop.vectorWordSize = state.vectorWordSize;
+    loop.peelDistance = state.peelDistance;
+    loop.dependenceDistance = state.dependenceDistance;
+    loop.header = state.header;
+}
+
+void
+generateRules(JanusContext *gc)
+{
+    if (!gc) return;
+
+    /* All modes share the same analysis, only the rule generation
+     * is repeated for each requested mode. Each mode starts from the
+     * loop state left by the analysis, so that its schedule is the same
+     * as the one generated when the mode is requested alone */
+    vector<LoopModeState> states;
+    for (auto &loop: gc->loops)
+        states.push_back(saveLoopModeState(loop));
+    int passedLoop = gc->passedLoop;
+    bool manualLoopSelection = gc->manualLoopSelection;
+
+    for (auto mode: gc->modes) {
+        /* analysis only modes do not produce rewrite schedules */
+        if (mode == JANALYSIS || mode == JGRAPH) continue;
+        gc->mode = mode;
+        for (size_t i = 0; i < gc->loops.size(); i++)
+            restoreLoopModeState(gc->loops[i], states[i]);
+        gc->passedLoop = passedLoop;
+        gc->manualLoopSelection = manualLoopSelection;
+        //the analysis doesn't load the selection if other modes don't read it
+        if (JanusContext::usesLoopSelection(mode) && !manualLoopSelection)
+            loadLoopSelection(gc);
+        generateRulesForMode(gc);
+    }
 }
 
 /* We have *fake* basic blocks which
@@ -159,7 +289,7 @@ void removeRule(uint32_t channel, RewriteRule rule, BasicBlock *block)
 static uint32_t
 compileRewriteRulesToFile(JanusContext *gc)
 {
-    FILE *op = fopen(string((gc->name)+".jrs").c_str(),"w");
+    FILE *op = fopen(getRuleFileName(gc).c_str(),"w");
     fpos_t pos;
     RSchedHeader header;
     uint32_t numRules = 0;
@@ -181,6 +311,7 @@ compileRewriteRulesToFile(JanusContext *gc)
 
     header.numRules = numRules;
     header.ruleDataOffset = 0;
+    header.templateOffset = 0;
     /* Emit rule header */
     fwrite(&header,sizeof(RSchedHeader),1,op);
     offset += sizeof(RSchedHeader);
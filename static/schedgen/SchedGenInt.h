@@ -6,6 +6,7 @@
 #include <map>
 #include <set>
 #include <vector>
+#include <string>
 
 namespace janus {
 /* Data structures for storing rules */
@@ -36,4 +37,8 @@ operator==(const RewriteRule &lhs, const RewriteRule &rhs);
 /* Main buffer to store all static rules */
 extern std::vector<janus::RuleCluster> rewriteRules;
 extern janus::BasicBlock *reshapeBlock;
+
+/* Name of the rule file for the mode currently being generated */
+std::string
+getRuleFileName(JanusContext *gc);
 #endif
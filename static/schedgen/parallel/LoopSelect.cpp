@@ -14,25 +14,55 @@ rejectLoopFromRuntimeFeedback(JanusContext *jc, std::set<LoopID> &selected);
 static bool
 selectLoopFromRuntimeFeedback(JanusContext *jc, std::set<LoopID> &selected);
 
-//currently we only checks the name only
+//calls are checked against their side effect summaries, see callSideEffectAnalysis()
+//in a speculative loop, external calls run in the transaction of the chunk
 static bool
-checkSafeCall(Function &func)
+checkSafeSubCalls(Loop &loop, bool speculative)
 {
-    if (func.name.find("pow@plt") != std::string::npos) return true;
-    if (func.name.find("sqrt@plt") != std::string::npos) return true;
-    return false;
+    Function *function = loop.parent;
+    bool safe = true;
+    for (auto bid: loop.unsafeCalls) {
+        Function *func = function->entry[bid].lastInstr()->getTargetFunction();
+        if (speculative && func && func->isExternal) {
+            LOOPLOG("\tCall to "<<func->name<<" is covered by the transaction"<<endl);
+            continue;
+        }
+        if (func) LOOPLOG("\tFound unsafe call to "<<func->name<<endl);
+        else LOOPLOG("\tFound unsafe call in block "<<dec<<bid<<endl);
+        safe = false;
+    }
+    return safe;
 }
 
-static bool
-checkSafeSubCalls(Loop &loop)
+//the minimum distance of the loop-carried dependences, 0 if any of them has no known distance
+static int64_t
+getDOACROSSDistance(Loop &loop)
 {
-    JanusContext *context = loop.parent->context;
-    for (auto fid: loop.subCalls) {
-        Function &func = context->functions[fid];
-        if (!checkSafeCall(func)) return false;
-        IF_LOOPLOG(else loopLog<<"\tFunction call"<<func.name<<" indentified safe"<<endl);
+    int64_t minDistance = 0;
+
+    for (auto &dep: loop.memoryDependences) {
+        for (auto dst: dep.second) {
+            bool found = false;
+            for (auto &dv: loop.dependenceVectors) {
+                if (!((dv.src == dep.first && dv.dst == dst) ||
+                      (dv.src == dst && dv.dst == dep.first))) continue;
+                if (!dv.distanceKnown) return 0;
+                found = true;
+                //a dependence within the same iteration doesn't order the iterations
+                if (dv.distance == 0) continue;
+                int64_t distance = dv.distance < 0 ? -dv.distance : dv.distance;
+                if (!minDistance || distance < minDistance) minDistance = distance;
+            }
+            if (!found) return 0;
+        }
     }
-    return true;
+
+    //neighbouring iterations can't overlap
+    if (minDistance == 1) {
+        LOOPLOG("\tDependence distance "<<dec<<minDistance<<" is too short for DOACROSS"<<endl);
+        return 0;
+    }
+    return minDistance;
 }
 
 bool loopHasFPUInstructions(Loop &loop){
@@ -51,18 +81,14 @@ bool loopHasFPUInstructions(Loop &loop){
 }
 
 bool
-checkSafetyForParallelisation(Loop &loop)
+checkSafetyForParallelisation(Loop &loop, bool speculative)
 {
     Function *function = loop.parent;
     JanusContext *jc = function->context;
     PCAddress target = 0;
 
-#ifdef NEED_MORE_TEST
-    if (loop.calls.size()) {
-        if (!checkSafeSubCalls(loop))
-            return false;
-    }
-#endif
+    if (!checkSafeSubCalls(loop, speculative))
+        return false;
 
     //currently we don't support loops with multiple exit
     if (loop.exit.size() > 1) {
@@ -109,17 +135,19 @@ checkSafetyForParallelisation(Loop &loop)
  * 1. The Phi node of the loop's start block is either constant or induction variables
  * 2. All its memory accesses are either LOOP_MEM_CONSTANT or LOOP_MEM_INDEPENDENT_ARRAY with no memory alias.
  * 3. No undecided memory accesses (LOOP_MEM_UNDECIDED)
- * 4. No cross-iteration dependences (LOOP_MEM_MAY_ALIAS_ARRAY)
+ * 4. No cross-iteration dependences (LOOP_MEM_MAY_ALIAS_ARRAY), unless all of them have a known distance (DOACROSS)
  * 5. Safety checks, see checkSafetyForParallelisation()
  * 6. Remove redudant loops in the same loop nest (last step)
  */
 void
-selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected)
+selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected, std::set<LoopID> &candidates)
 {
     LOOPLOG("Performing automatic DOALL loop selection:"<<endl);
 
     for (auto &loop : jc->loops) {
         if (jc->manualLoopSelection && !loop.pass) continue;
+        //loops in cold functions are not lifted in hot analysis mode
+        if (!loop.parent->hot) continue;
         LOOPLOG("Loop "<<dec<<loop.id<<":");
         if (loop.unsafe) {
             LOOPLOG("is unsafe, therefore rejected"<<endl);
@@ -162,24 +190,20 @@ selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected)
             passed = false;
         }
 
-        //condition 3: no undecided memory accesses
-        if (!jc->manualLoopSelection) {
-            if (loop.undecidedMemAccesses.size()) {
-                LOOPLOG("\tFound undecided memory accesses"<<endl);
-                passed = false;
-            }
-
-        //condition 4: no memory dependencies
-        if (loop.memoryDependences.size()) {
-            LOOPLOG("\tFound depending memory accesses"<<endl);
+        //a static count must be large enough, otherwise the count must be known at loop entry
+        //where the runtime checks it
+        if (loop.staticIterCount && loop.staticIterCount < PARA_MIN_ITERATIONS) {
+            LOOPLOG("\tLoop has an iteration count of "<<dec<<loop.staticIterCount<<endl);
             passed = false;
         }
-
-        }
-
-        if (!checkSafetyForParallelisation(loop)) {
-            LOOPLOG("\tThis loop is not safe for DOALL parallelisation"<<endl);
-            passed = false;
+        else if (!loop.staticIterCount) {
+            if (loop.tripCountSpan.kind == Expr::EXPANDED) {
+                LOOPLOG("\tIteration count ("<<loop.tripCountSpan<<")/"<<dec<<loop.mainIterator->stride
+                        <<" + 1 is checked at loop entry"<<endl);
+            } else {
+                LOOPLOG("\tIteration count is not known at loop entry"<<endl);
+                passed = false;
+            }
         }
 
         //condition 6 removed in the future
@@ -192,7 +216,11 @@ selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected)
                 break;
             }
         }
-        
+        if (loop.reductions.size()) {
+            LOOPLOG("\tThis loop contains SIMD reductions which are only handled by the vectoriser"<<endl);
+            passed = false;
+        }
+
         //condition 7: no FPU instructions
         //We currently don't really analyze them, which causes issues
         if (loopHasFPUInstructions(loop)){
@@ -200,10 +228,46 @@ selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected)
             passed = false;
         }
 
+        //the conditions above also hold for speculation, see selectSpeculativeLoops()
+        bool speculable = passed;
+
+        //condition 3: no undecided memory accesses
+        if (!jc->manualLoopSelection) {
+            if (loop.undecidedMemAccesses.size()) {
+                LOOPLOG("\tFound undecided memory accesses"<<endl);
+                passed = false;
+            }
+
+        //condition 4: no memory dependencies, or only dependences of a known distance (DOACROSS)
+        if (loop.memoryDependences.size()) {
+            LOOPLOG("\tFound depending memory accesses"<<endl);
+            for (auto &dv: loop.dependenceVectors) {
+                if (dv.distanceKnown)
+                    LOOPLOG("\t\tdependence distance "<<dec<<dv.distance<<" at "<<*dv.src<<" -> "<<*dv.dst<<endl);
+                else
+                    LOOPLOG("\t\tdependence distance unknown at "<<*dv.src<<" -> "<<*dv.dst<<endl);
+            }
+            loop.dependenceDistance = getDOACROSSDistance(loop);
+            if (loop.dependenceDistance)
+                LOOPLOG("\tLoop selected for DOACROSS with dependence distance "<<dec<<loop.dependenceDistance<<endl);
+            else
+                passed = false;
+        }
+
+        }
+
+        if (!checkSafetyForParallelisation(loop)) {
+            LOOPLOG("\tThis loop is not safe for DOALL parallelisation"<<endl);
+            passed = false;
+        }
+
         if (passed) {
             LOOPLOG("\tDOALL Check Phase 1 Passed"<<endl);
             selected.insert(loop.id);
-        } else loop.unsafe = true;
+        } else {
+            loop.unsafe = true;
+            if (speculable) candidates.insert(loop.id);
+        }
         LOOPLOG(""<<endl);
     }
 
@@ -239,6 +303,63 @@ selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected)
     cout <<endl;
 }
 
+/* Conditions for speculative selection
+ * 1. The loop is only rejected for DOALL by its memory accesses or calls, see selectDOALLLoops()
+ * 2. No loop in the same loop nest is selected for DOALL
+ * 3. The iteration count is static, the chunks are computed from constant bounds
+ * 4. Safety checks, external calls are covered by the transaction of the chunk
+ */
+void
+selectSpeculativeLoops(JanusContext *jc, std::set<LoopID> &candidates,
+                       std::set<LoopID> &parallel, std::set<LoopID> &selected)
+{
+    LOOPLOG("Performing speculative loop selection:"<<endl);
+
+    for (auto id: candidates) {
+        Loop &loop = jc->loops[id-1];
+        bool passed = true;
+        LOOPLOG("Loop "<<dec<<loop.id<<":"<<endl);
+
+        set<Loop*> nest = loop.ancestors;
+        nest.insert(loop.descendants.begin(), loop.descendants.end());
+        for (auto other: nest) {
+            if (parallel.find(other->id) == parallel.end()) continue;
+            LOOPLOG("\tLoop "<<dec<<other->id<<" in the same nest is selected for DOALL"<<endl);
+            passed = false;
+        }
+
+        if (!loop.staticIterCount) {
+            LOOPLOG("\tIteration count is not static"<<endl);
+            passed = false;
+        }
+
+        if (!checkSafetyForParallelisation(loop, true)) {
+            LOOPLOG("\tThis loop is not safe for speculative parallelisation"<<endl);
+            passed = false;
+        }
+
+        if (passed) {
+            LOOPLOG("\tSpeculative Check Passed"<<endl);
+            selected.insert(loop.id);
+            loop.unsafe = false;
+        }
+    }
+
+    filterLoopNests(jc, selected);
+
+    LOOPLOG("-- Final selected speculative loops: "<<endl);
+    IF_LOOPLOG(
+    for (auto id: selected)
+        loopLog <<dec<<id<<" ";
+    loopLog <<endl<<endl
+    );
+
+    cout <<"\tFinal selected speculative loops: ";
+    for (auto id: selected)
+        cout <<dec<<id<<" ";
+    cout <<endl;
+}
+
 void
 filterLoopNests(JanusContext *jc, std::set<LoopID> &selected)
 {
@@ -10,15 +10,31 @@
 #include "janus.h"
 #include "Loop.h"
 
+/** \brief Loops with fewer iterations are not worth the thread start-up */
+#define PARA_MIN_ITERATIONS     16
+
 /** \brief Return the set of DOALL loop IDs from the loop pool
  *  \param jc The global context containing all the loop information
  *  \param[out] selected Recognised DOALL loops are returned here. 
+ *  \param[out] candidates Loops rejected only for their memory accesses or calls are returned here.
  *  
  *  A DOALL loop is selected based on two assumptions:
  *  *No cross-iteration dependences.
  *  *Clear induction variables */
 void
-selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected);
+selectDOALLLoops(JanusContext *jc, std::set<LoopID> &selected, std::set<LoopID> &candidates);
+
+/** \brief Return the set of loop IDs to run speculatively
+ *  \param jc The global context containing all the loop information
+ *  \param candidates Loops rejected by selectDOALLLoops() only for their memory accesses or calls
+ *  \param parallel The selected DOALL loops
+ *  \param[out] selected Loops run in chunks of transactions are returned here.
+ *
+ *  The chunks are committed in order, so may-dependences and external calls
+ *  that write memory are allowed */
+void
+selectSpeculativeLoops(JanusContext *jc, std::set<LoopID> &candidates,
+                       std::set<LoopID> &parallel, std::set<LoopID> &selected);
 
 /** \brief Filter out the loops that are in the same loop nests
  *  \param jc The global context containing all the loop information
@@ -45,7 +61,8 @@ checkRuntimeQuestion(JanusContext *jc, std::set<LoopID> &selected);
 
 /** \brief Return false if the loop is not safe to parallelise
  *  
- *  E.g. indirect calls, no induction variables, unsafe function calls */
+ *  E.g. indirect calls, no induction variables, unsafe function calls.
+ *  If speculative, unsafe calls to external functions are allowed */
 bool
-checkSafetyForParallelisation(janus::Loop &loop);
+checkSafetyForParallelisation(janus::Loop &loop, bool speculative = false);
 #endif
\ No newline at end of file
@@ -4,17 +4,12 @@
 #include "LoopSelect.h"
 #include "IO.h"
 #include <vector>
+#include <fstream>
 
 #ifdef JANUS_X86
 #include "janus_x86.h"
 #endif
 
-#ifdef JANUS_VECT_SUPPORT
-#include "VECT_rule_structs.h"
-#include "VectRule.h"
-#include "janus_arch.h"
-#endif
-
 using namespace std;
 using namespace janus;
 
@@ -28,15 +23,19 @@ static void
 generateSubFunctionRules(JanusContext *gc, Loop &loop, Function &func);
 static int
 getEncodedArrayIndex(Loop *loop, Expr var);
+static Loop *
+getBoundsCheckLoop(Loop *loop);
 
 void
 generateParallelRules(JanusContext *gc)
 {
 
     set<LoopID> selected_loop;
+    set<LoopID> speculative_candidates;
+    set<LoopID> speculative_loop;
 
     /* Step 1: select DOALL loops for parallelisation */
-    selectDOALLLoops(gc, selected_loop);
+    selectDOALLLoops(gc, selected_loop, speculative_candidates);
 
     gc->passedLoop = selected_loop.size();
 
@@ -57,6 +56,20 @@ generateParallelRules(JanusContext *gc)
     }
 
     /* Step 3: select and generate speculative loops */
+    selectSpeculativeLoops(gc, speculative_candidates, selected_loop, speculative_loop);
+
+    gc->passedLoop += speculative_loop.size();
+
+    for (auto loopID : speculative_loop) {
+        Loop &loop = gc->loops[loopID-1];
+        loop.pass = true;
+        prepareLoopHeader(gc, loop);
+        /* Each chunk of iterations runs as a transaction, committed in chunk order */
+        loop.header.schedule = PARA_SPEC_CYCLIC_CHUNK;
+        loop.header.speculative = 1;
+        loop.header.id = dynamic_id++;
+        generateDOALLRules(gc, loop);
+    }
 
     /* Step 4: generate thread create/exit rules on main function */
     GASSERT(gc->main, "main function not found in this program");
@@ -119,9 +132,22 @@ prepareLoopHeader(JanusContext *gc, Loop &loop)
     else
         header.isInnerLoop = 0;
 
-    //DOALL Block based parallelisation
+    //DOALL Block based parallelisation, DOACROSS if the loop carries dependences of a known distance
     //TODO: intelligent determine the policy
-    header.schedule = PARA_DOALL_BLOCK;
+    if (loop.dependenceDistance) {
+        header.schedule = PARA_DOACROSS;
+        header.dependenceDistance = loop.dependenceDistance;
+    } else {
+        header.schedule = PARA_DOALL_BLOCK;
+        header.dependenceDistance = 0;
+    }
+    //prefetch rules are only added by the combined prefetch schedule
+    header.prefetchDistance = 0;
+    //set when the combined vector schedule extends the loop body
+    header.vectorWordSize = 0;
+    //set for the loops selected by selectSpeculativeLoops()
+    header.speculative = 0;
+    header.minIterations = PARA_MIN_ITERATIONS;
 }
 
 static void
@@ -203,6 +229,20 @@ generateDOALLRules(JanusContext *gc, Loop &loop)
     rule.reg0 = loop.header.id;
     insertRule(id, rule, loop.start);
 
+    /* A speculative chunk starts its transaction at the first iteration it runs
+     * while not the oldest, it is committed at the loop exit */
+    if (loop.header.speculative) {
+        rule = RewriteRule(TX_START, loop.start, PRE_INSERT);
+        rule.reg0 = loop.header.id;
+        insertRule(id, rule, loop.start);
+
+        for (auto bid: loop.body) {
+            rule = RewriteRule(TX_REDIRECT, entry + bid, PRE_INSERT);
+            rule.reg0 = loop.header.id;
+            insertRule(id, rule, entry + bid);
+        }
+    }
+
     RegSet checkRegisters;            //We use these for MEM_RESTORE_CHECK_REG rule insertion
     std::set<Instruction*> cmpInstrs; //
 
@@ -363,21 +403,12 @@ generateDOALLRules(JanusContext *gc, Loop &loop)
             rule.reg0 = loop.header.id;
             insertRule(id, rule, bb);
 
-            /* Generate rewrite rules for this function */
+            /* Generate rewrite rules for this function.
+             * External code called by a speculative loop is redirected to the
+             * transaction of the chunk, see checkSafeSubCalls() */
             Function *func = bb->lastInstr()->getTargetFunction();
             if (func && !func->isExternal)
                 generateSubFunctionRules(gc, loop, *func);
-            else {
-                //external functions, generate TX_START and TX_END
-                rule = RewriteRule(TX_START, bb, POST_INSERT);
-                rule.reg0 = loop.header.id;
-                insertRule(id, rule, bb);
-                if(bb->succ1) {
-                    rule = RewriteRule(TX_FINISH, bb->succ1, PRE_INSERT);
-                    rule.reg0 = loop.header.id;
-                    insertRule(id, rule, bb->succ1);
-                }
-            }
 
             /* PARA_SUBCALL_FINISH is inserted at the block where the subcall is supposed to be returned */
             if(bb->succ1) {
@@ -399,8 +430,13 @@ generateDOALLRules(JanusContext *gc, Loop &loop)
     else loop.header.stackFrameSize = 0;
 
     /* MEM_RECORD_BOUNDS is inserted where the array base runtime is generated
-     * so that Janus can keep a record privately for its later runtime check */
-    for (auto checkBase: loop.arrayToCheck) {
+     * so that Janus can keep a record privately for its later runtime check.
+     * All arrays are recorded since reads are checked against the writes */
+    bool needCheck = loop.arrayToCheck.size() && loop.arrayAccesses.size() > 1;
+    for (auto &memBase: loop.arrayAccesses) {
+        if (!needCheck) break;
+        Expr checkBase = memBase.first;
+        if (getEncodedArrayIndex(&loop, checkBase) == -1) continue;
         if (checkBase.vs && checkBase.vs->lastModified) {
             Instruction *lastModified = checkBase.vs->lastModified;
             BasicBlock *bb = lastModified->block;
@@ -426,128 +462,94 @@ generateDOALLRules(JanusContext *gc, Loop &loop)
         }
     }
 
-    /* MEM_BOUND_CHECK is inserted before the loop after all the inputs been recorded */
-    for (auto checkBase: loop.arrayToCheck) {
-        for (auto memBase: loop.arrayAccesses) {
-            Expr checkBase2 = memBase.first;
-            if (!(checkBase == checkBase2)) {
-                for (auto bid: loop.init) {
-                    BasicBlock *bb = entry + bid;
-                    rule = RewriteRule(MEM_BOUNDS_CHECK, bb, PRE_INSERT);
-                    rule.ureg0.up = getEncodedArrayIndex(&loop, checkBase);
-                    rule.ureg0.down = getEncodedArrayIndex(&loop, checkBase2);
-                    rule.reg1 = loop.header.id;
-                    insertRule(id, rule, bb);
-                }
-            }
-        }
-    }
-#ifdef JANUS_VECT_SUPPORT
-    VECT_RULE *vrule;
-
-    //step 1: insert broadcast rules
-    set<uint32_t> copySet;
-    loop.registerToCopy.toSTLSet(copySet);
-    for (auto reg: copySet) {
-        if (jreg_is_simd(reg)) {
-            //get the definition
-            Variable v((uint32_t)reg);
-            VarState *vs = loop.start->alive(v);
-            if (vs != NULL && vs->lastModified) {
-                Instruction *instr = vs->lastModified;
-                VECT_RULE *rule = new VECT_RULE(instr->block, instr->pc, instr->id, VECT_BROADCAST);
-                insertRule(id, *rule->encode(), instr->block);
-            }
+    /* A single MEM_BOUNDS_CHECK tests all arrays of the loop for overlap.
+     * It is inserted before the loop after all the inputs been recorded,
+     * or before the outer loop if the array bases don't change in it */
+    if (needCheck) {
+        Loop *checkLoop = getBoundsCheckLoop(&loop);
+        for (auto bid: checkLoop->init) {
+            BasicBlock *bb = entry + bid;
+            rule = RewriteRule(MEM_BOUNDS_CHECK, bb, PRE_INSERT);
+            rule.reg0 = (checkLoop != &loop);
+            rule.reg1 = loop.header.id;
+            insertRule(id, rule, bb);
         }
     }
+}
 
-    //step 1: retrieve the alignment information
-    bool aligned = alignmentAnalysis(loop);
-    //insert VECT_LOOP_PEEL if not aligned
-    if (loop.peelDistance > 0) {
-        //insert loop peeling after the loop
-        for (auto init: loop.init) {
-            BasicBlock *bb = entry + init;
-            Instruction *instr = &(bb->instrs[bb->size-1]);
-            VECT_LOOP_PEEL_rule *rule = new VECT_LOOP_PEEL_rule(bb, instr->pc, instr->id, (uint32_t)(loop.start->instrs->pc-instr->pc),
-                (uint16_t)loop.scratchRegs.regs.reg0, (uint16_t)loop.scratchRegs.regs.reg1, (uint32_t)loop.staticIterCount);
-            rule->vectorWordSize = loop.vectorWordSize;
-            insertRule(id, *rule->encode(), bb);
-        }
-    }
+static void
+generateSubFunctionRules(JanusContext *gc, Loop &loop, Function &func)
+{
 
-    //step 2: examine each loop instructions
-    for (auto bid: loop.body) {
-        BasicBlock &bb = entry[bid];
-        for (int i=0; i<bb.size; i++) {
-            Instruction &instr = bb.instrs[i];
-            if (instr.isVectorInstruction()) {
-                //extend the existing vector instruction
-                bool postIteratorUpdate = checkPostIteratorUpdate(instr);
-                VECT_CONVERT_rule *rule = new VECT_CONVERT_rule(&bb, instr.pc, instr.id, 0, postIteratorUpdate, (uint16_t)loop.mainIterator->stride, 
-                0, ALIGNED, 0, loop.staticIterCount);
-                insertRule(id, *rule->encode(), &bb);
-            }
-        }
-    }
+}
 
-    //update all strides
-    for (auto iterEntry: loop.iterators) {
-        Iterator &iter = iterEntry.second;
+static bool
+readWholeFile(string name, vector<char> &buffer)
+{
+    ifstream file(name, ios::in|ios::ate|ios::binary);
+    if (!file.is_open()) return false;
 
-        if (iter.strideKind == Iterator::INTEGER) {
-            //insert rewrite rule on the update instruction
-            Instruction *instr = iter.getUpdateInstr();
-            if (!instr) {
-                cerr<<"Induction update instruction not found"<<endl;
-            }
-            rule = RewriteRule(VECT_INDUCTION_STRIDE_UPDATE, instr->block->instrs->pc, instr->pc, instr->id);
-            rule.reg0 = 0;
-            rule.reg1 = loop.vectorWordSize;
-            insertRule(id,rule,instr->block);
-        }
-        else if (iter.strideKind == Iterator::SINGLE_VAR) {
-            VarState *vs = iter.strideVar;
-            if (vs->type == JVAR_REGISTER) {
-                uint64_t reg = vs->value;
-                //unroll the loop stride before the loop
-                for (auto init: loop.init) {
-                    BasicBlock *bb = entry + init;
-                    rule = RewriteRule(VECT_INDUCTION_STRIDE_UPDATE, bb, POST_INSERT);
-                    rule.reg0 = reg;
-                    rule.reg1 = loop.vectorWordSize;
-                    insertRule(id, rule, bb);
-                }
-                // Revert required for VECT_INDUCTION_STRIDE_UPDATE's multiplication of the reg value.
-                for (auto bid: loop.exit) {
-                    rule = RewriteRule(VECT_INDUCTION_STRIDE_RECOVER, entry + bid, PRE_INSERT);
-                    rule.reg0 = reg;
-                    rule.reg1 = loop.vectorWordSize;
-                    insertRule(id, rule, entry + bid);
-                }
-            }
-        } else continue;
-    }
-#endif
+    buffer.resize(file.tellg());
+    file.seekg(0, ios::beg);
+    file.read(buffer.data(), buffer.size());
+    return file.good();
 }
 
-static void
-generateSubFunctionRules(JanusContext *gc, Loop &loop, Function &func)
+/* Load the loop code templates recorded by the parallel client in a previous run.
+ * The templates are only embedded if they were recorded for the same executable
+ * and the same loops, otherwise the client generates the loop code at runtime. */
+static bool
+loadLoopCodeTemplates(JanusContext *gc, vector<char> &section)
 {
+    vector<char> binary;
+
+    if (!readWholeFile(getRuleFileName(gc) + ".tpl", section)) return false;
+    if (section.size() < sizeof(RSTemplateHeader)) return false;
+
+    RSTemplateHeader *header = (RSTemplateHeader *)section.data();
+    if (header->magic != RS_TEMPLATE_MAGIC ||
+        header->version != RS_TEMPLATE_VERSION) return false;
+    if (sizeof(RSTemplateHeader) + header->numTemplates * sizeof(RSCodeTemplate) > section.size())
+        return false;
+
+    /* The templates embed decisions derived from the executable */
+    if (!readWholeFile(gc->name, binary)) return false;
+    if (header->binaryChecksum != rs_template_checksum(0, binary.data(), binary.size())) {
+        GSTEP("Recorded loop code templates are outdated, ignored"<<endl);
+        return false;
+    }
 
+    RSCodeTemplate *templates = (RSCodeTemplate *)(section.data() + sizeof(RSTemplateHeader));
+    for (int i=0; i<header->numTemplates; i++) {
+        RSCodeTemplate &code = templates[i];
+        bool found = false;
+        for (auto &loop : gc->loops) {
+            if (loop.pass && loop.header.id == code.loopID &&
+                loop.header.loopStartAddr == code.loopStartAddr) {
+                found = true;
+                break;
+            }
+        }
+        if (!found ||
+            code.codeOffset + code.codeSize > section.size() ||
+            code.relocOffset + code.numRelocs * sizeof(RSCodeReloc) > section.size())
+            return false;
+    }
+    return true;
 }
 
 /* Emit all relevant info in the rule file */
 uint32_t
 compileParallelRulesToFile(JanusContext *gc)
 {
-    FILE *op = fopen(string((gc->name)+".jrs").c_str(),"w");
+    FILE *op = fopen(getRuleFileName(gc).c_str(),"w");
     fpos_t pos;
     RSchedHeader header;
     uint32_t numRules = 0;
     int offset = 0;
     int fileSize;
     uint32_t numLoops = gc->loops.size();
+    vector<char> templates;
 
     int id = 0;
     for (auto &loop: gc->loops) {
@@ -596,6 +598,12 @@ compileParallelRulesToFile(JanusContext *gc)
             offset += (size * sizeof(JVarProfile));
         }
     }
+
+    /* Pre-assembled loop code is appended after the rule data */
+    if (loadLoopCodeTemplates(gc, templates)) {
+        header.templateOffset = offset;
+        offset += templates.size();
+    } else header.templateOffset = 0;
     fileSize = offset;
 
     /* Emit rule header */
@@ -631,6 +639,10 @@ compileParallelRulesToFile(JanusContext *gc)
             }
         }
     }
+
+    /* Emit loop code templates */
+    if (header.templateOffset)
+        fwrite(templates.data(),templates.size(),1,op);
     fclose(op);
 
     return fileSize;
@@ -653,3 +665,37 @@ getEncodedArrayIndex(Loop *loop, Expr var)
     }
     return -1;
 }
+
+/* Return the outermost loop in the nest whose array bases of the given loop are all
+ * defined before the loop is entered, the runtime check can be hoisted before it.
+ * Ranges counted at loop entry are only known before the loop itself */
+static Loop *
+getBoundsCheckLoop(Loop *loop)
+{
+    Loop *checkLoop = loop;
+
+    for (auto &profile: loop->encodedVariables) {
+        if (profile.type == ARRAY_PROFILE && profile.array.stride)
+            return loop;
+    }
+
+    while (checkLoop->parentLoop && checkLoop->parentLoop->init.size()) {
+        Loop *outer = checkLoop->parentLoop;
+        bool invariant = true;
+        for (auto &memBase: loop->arrayAccesses) {
+            VarState *vs = memBase.first.vs;
+            if (memBase.first.kind == Expr::EXPANDED || vs == NULL) {
+                invariant = false;
+                break;
+            }
+            BasicBlock *def = vs->lastModified ? vs->lastModified->block : vs->block;
+            if (def == NULL || outer->body.find(def->bid) != outer->body.end()) {
+                invariant = false;
+                break;
+            }
+        }
+        if (!invariant) break;
+        checkLoop = outer;
+    }
+    return checkLoop;
+}
@@ -1,38 +1,76 @@
 
 #include "JanusContext.h"
 #include "PrefetchRule.h"
+#include "ParaRule.h"
 #include "Slice.h"
 #include "Alias.h"
+#include "janus_arch.h"
+
+#include <queue>
 
 using namespace std;
 using namespace janus;
 
-static bool findPrefetch(Loop &loop, map<VarState*, Iterator *> &passed);
-static void generatePrefetchRulesForLoop(JanusContext *jc, Loop &loop, map<VarState*, Iterator *> &passed);
-static void generatePrefetchRulesForSlice(JanusContext *jc, Slice &slice, VarState *vs, Iterator *iter, Loop &loop);
-static Instruction *getPrefetchInsertLocation(Slice &slice);
-static bool checkAndFormatPrefetchSlice(Slice &slice, Loop &loop, Iterator *iter);
+/* A chain of indirect loads, such as a[b[c[i]]].
+ * levels[0] is addressed by the loop iterator, every following level is
+ * addressed by the value loaded in the previous level */
+struct PrefetchChain {
+    vector<VarState*>       levels;
+    Iterator                *iter;
+};
+
+static bool findPrefetch(Loop &loop, vector<PrefetchChain> &chains);
+static int generatePrefetchRulesForLoop(JanusContext *jc, Loop &loop, vector<PrefetchChain> &chains);
+static int getPrefetchDistance(JanusContext *jc, Loop &loop, vector<PrefetchChain> &chains);
+static uint64_t estimateIterationCycles(Loop &loop);
+static void generatePrefetchRulesForChain(JanusContext *jc, Slice &slice, PrefetchChain &chain, Loop &loop, int distance);
+static Instruction *getPrefetchInsertLocation(Slice &slice, PrefetchChain &chain);
+static bool checkAndFormatPrefetchSlice(Slice &slice, Loop &loop, PrefetchChain &chain);
 static void prepareLoopMemoryAccesses(Loop *loop);
 static void prepareLoopIterators(Loop *loop);
-static bool instrContainIterator(Instruction *instr, Loop *loop);
 static void emitInstrCloneRules(list<Instruction*> &instrs, Instruction *front, Loop &loop);
 
 void
 generatePrefetchRules(JanusContext *jc) {
-    map<VarState*, Iterator *> passed;
+    vector<PrefetchChain> chains;
+    for (auto &loop: jc->loops) {
+        if (findPrefetch(loop, chains)) {
+            generatePrefetchRulesForLoop(jc, loop, chains);
+            chains.clear();
+        }
+    }
+}
+
+void
+generateParallelPrefetchRules(JanusContext *jc) {
+    vector<PrefetchChain> chains;
+
+    /* Step 1: select and parallelise loops, this also prepares the loop headers */
+    generateParallelRules(jc);
+
+    /* Step 2: prefetch only in the parallelised loops.
+     * The prefetch rules share the loop channel with the parallel rules.
+     * The distance is recorded in the loop header so that the runtime
+     * can fit it into the block each thread executes */
     for (auto &loop: jc->loops) {
-        if (findPrefetch(loop, passed)) {
-            generatePrefetchRulesForLoop(jc, loop, passed);
-            passed.clear();
+        //the prefetch slices of a speculative loop would read around its transactions
+        if (!loop.pass || loop.header.speculative) continue;
+        if (findPrefetch(loop, chains)) {
+            loop.header.prefetchDistance = generatePrefetchRulesForLoop(jc, loop, chains);
+            chains.clear();
         }
     }
 }
 
-static bool findPrefetch(Loop &loop, map<VarState*, Iterator *> &passed) {
+static bool findPrefetch(Loop &loop, vector<PrefetchChain> &chains) {
     VarState *indLoad;
 
     map<VarState*, MemoryLocation*> &locationTable = loop.locationTable;
     map<VarState*, VarState*> indirectMemGraph;
+    set<VarState*> intermediate;
+
+    /* Loops in cold functions are not lifted in hot analysis mode */
+    if (!loop.parent->hot) return false;
 
     /* For unsafe loops, continue to create memory locations and iterators */
     if (loop.unsafe) {
@@ -53,209 +91,424 @@ static bool findPrefetch(Loop &loop, map<VarState*, Iterator *> &passed) {
         }
     }
 
-    /* Currently we only supports second order accesses
-     * TODO: make it nth order using topological sort */
+    /* Follow the indirections back until a load addressed by the iterator.
+     * The graph is walked from each load towards its source, so the levels
+     * of a chain come out in reverse topological order */
     for (auto ind: indirectMemGraph) {
-        MemoryLocation* check = locationTable[ind.second];
-        if (check && check->containIterator(&loop))
-            passed[ind.first] = check->expr.hasIterator(&loop);
+        PrefetchChain chain;
+        set<VarState*> visited;
+        VarState *level = ind.first;
+        chain.iter = NULL;
+
+        while (level && visited.insert(level).second &&
+               chain.levels.size() <= PREFETCH_MAX_DEPTH) {
+            chain.levels.insert(chain.levels.begin(), level);
+            MemoryLocation *check = locationTable[level];
+            if (!check) break;
+            if (check->containIterator(&loop)) {
+                chain.iter = check->expr.hasIterator(&loop);
+                break;
+            }
+            auto next = indirectMemGraph.find(level);
+            level = (next == indirectMemGraph.end()) ? NULL : next->second;
+        }
+
+        if (!chain.iter || chain.levels.size() < 2) continue;
+        for (size_t i = 1; i + 1 < chain.levels.size(); i++)
+            intermediate.insert(chain.levels[i]);
+        chains.push_back(chain);
+    }
+
+    /* The chain of a[b[c[i]]] already prefetches b[c[i]] */
+    for (auto it = chains.begin(); it != chains.end();) {
+        if (intermediate.count(it->levels.back())) it = chains.erase(it);
+        else it++;
     }
 
     IF_LOOPLOG(
-        if (passed.size()) {
+        if (chains.size()) {
             loopLog<<"Loop "<<dec<<loop.id<<" found prefetch opportunities:"<<endl;
         }
-        for (auto vs: passed) {
-            loopLog<<"\t"<<vs.first<<" <- "<<*locationTable[vs.first]<<" <- "<<*vs.second<<endl;
+        for (auto &chain: chains) {
+            loopLog<<"\t";
+            for (auto it = chain.levels.rbegin(); it != chain.levels.rend(); it++)
+                loopLog<<*locationTable[*it]<<" <- ";
+            loopLog<<*chain.iter<<endl;
         }
     )
 
-    return (passed.size()>0);
+    return (chains.size()>0);
 }
 
-static void generatePrefetchRulesForLoop(JanusContext *jc, Loop &loop, map<VarState*, Iterator *> &passed)
+/* Returns the prefetch distance (in iterations) used for the loop */
+static int generatePrefetchRulesForLoop(JanusContext *jc, Loop &loop, vector<PrefetchChain> &chains)
 {
-    for (auto fetchItem: passed) {
-        Slice slice(fetchItem.first, Slice::CyclicScope, &loop);
-        Iterator *iter = fetchItem.second;
-        if (checkAndFormatPrefetchSlice(slice, loop, iter)) {
-            LOOPLOG("Slice for "<<fetchItem.first<<endl<<slice<<endl);
-            generatePrefetchRulesForSlice(jc, slice, fetchItem.first, iter, loop);
+    int distance = getPrefetchDistance(jc, loop, chains);
+
+    for (auto &chain: chains) {
+        Slice slice(chain.levels.back(), Slice::CyclicScope, &loop);
+        if (checkAndFormatPrefetchSlice(slice, loop, chain)) {
+            LOOPLOG("Slice for "<<chain.levels.back()<<endl<<slice<<endl);
+            generatePrefetchRulesForChain(jc, slice, chain, loop, distance);
         } else {
-            LOOPLOG("Slice for "<<fetchItem.first<<" rejected due to complex control flow in slices"<<endl<<endl);
+            LOOPLOG("Slice for "<<chain.levels.back()<<" rejected due to complex control flow in slices"<<endl<<endl);
         }
     }
+    return distance;
 }
 
-static bool checkAndFormatPrefetchSlice(Slice &slice, Loop &loop, Iterator *iter) {
-    if (!slice.instrs.size()) return false;
-    //currently we only allow slices within only one basic block
-    //inserting instructions at different basic block requires control dependent instruction to be added in slice
-    //currently we don't support control flow in slices
-    BasicBlock *block = slice.instrs.front()->block;
-    int count = 0;
-
-    Instruction *toRemove = NULL;
-    //check if all instructions belong to the same block
-    for (auto instr: slice.instrs) {
-        if (block != instr->block) {
-            count++;
-            toRemove = instr;
+/* Estimated cycles of one instruction, only the classes that dominate the iteration time */
+static uint64_t instructionCycles(Instruction &instr)
+{
+    switch (instr.opcode) {
+        case Instruction::Load: return 4;
+        case Instruction::Mul: return 3;
+        case Instruction::Div:
+        case Instruction::Rem: return 20;
+        case Instruction::Call: return 50;
+        case Instruction::Nop: return 0;
+        default: return 1;
+    }
+}
+
+/* Estimated cycles of one iteration of the loop, assuming loads hit in the cache.
+ * Blocks of inner loops are counted once per inner iteration */
+static uint64_t estimateIterationCycles(Loop &loop)
+{
+    BasicBlock *entry = loop.parent->entry;
+    uint64_t cycles = 0;
+
+    for (auto bid: loop.body) {
+        BasicBlock &bb = entry[bid];
+        uint64_t weight = 1;
+        for (auto sub: loop.descendants) {
+            if (sub->body.find(bid) == sub->body.end()) continue;
+            weight *= sub->staticIterCount ? sub->staticIterCount : PREFETCH_INNER_ITERATIONS;
+        }
+
+        uint64_t blockCycles = 0;
+        for (uint32_t i = 0; i < bb.size; i++)
+            blockCycles += instructionCycles(bb.instrs[i]);
+        cycles += blockCycles * weight;
+    }
+    return cycles ? cycles : 1;
+}
+
+/* The prefetch has to be issued enough iterations ahead to hide the memory latency,
+ * and at least one cache line ahead of the current access.
+ * Each level of a chain waits for the prefetch of the previous level, so deeper
+ * chains need a proportionally larger distance */
+static int getPrefetchDistance(JanusContext *jc, Loop &loop, vector<PrefetchChain> &chains)
+{
+    uint64_t latency = jc->prefetchLatency ? jc->prefetchLatency : PREFETCH_MEMORY_LATENCY;
+    uint64_t cycles = estimateIterationCycles(loop);
+    uint64_t distance = (latency + cycles - 1) / cycles;
+    uint64_t depth = 1;
+
+    for (auto &chain: chains) {
+        Iterator *iter = chain.iter;
+        if (chain.levels.size() - 1 > depth) depth = chain.levels.size() - 1;
+        if (!iter || iter->strideKind != Iterator::INTEGER || !iter->stride) continue;
+        uint64_t stride = iter->stride < 0 ? -iter->stride : iter->stride;
+        uint64_t lineDistance = (PREFETCH_CACHE_LINE + stride - 1) / stride;
+        if (lineDistance > distance) distance = lineDistance;
+    }
+    /* A single indirection gets half of the distance for each level */
+    distance = distance * (depth + 1) / 2;
+
+    if (distance < PREFETCH_MIN_DISTANCE) distance = PREFETCH_MIN_DISTANCE;
+    if (distance > PREFETCH_MAX_DISTANCE) distance = PREFETCH_MAX_DISTANCE;
+
+    LOOPLOG("Loop "<<dec<<loop.id<<" estimated "<<cycles<<" cycles per iteration, prefetch distance "
+            <<distance<<" iterations for latency "<<latency<<endl);
+    return (int)distance;
+}
+
+/* Slice instructions that define the inputs of instr, looking through memory operands */
+static set<Instruction*> getSliceDefinitions(Instruction *instr, set<Instruction*> &inSlice)
+{
+    set<Instruction*> defs;
+    queue<VarState*> q;
+    set<VarState*> visited;
+
+    for (auto vi: instr->inputs) q.push(vi);
+    while (!q.empty()) {
+        VarState *v = q.front();
+        q.pop();
+        if (!v || !visited.insert(v).second) continue;
+        if (v->lastModified) {
+            if (inSlice.count(v->lastModified) && v->lastModified != instr)
+                defs.insert(v->lastModified);
+        } else if (v->type == JVAR_MEMORY || v->type == JVAR_STACK) {
+            //the address registers of the memory operand
+            for (auto pred: v->pred) q.push(pred);
         }
     }
+    return defs;
+}
+
+/* The value must be computed from the iterator in the trigger, not from the
+ * current iteration or from a path through the loop control flow */
+static bool readsLoopPhi(Instruction *instr, Loop &loop)
+{
+    for (auto vi: instr->inputs) {
+        if (vi->isPHI && vi->block && loop.contains(vi->block->bid)) return true;
+        if (vi->type != JVAR_MEMORY && vi->type != JVAR_STACK) continue;
+        for (auto pred: vi->pred)
+            if (pred->isPHI && pred->block && loop.contains(pred->block->bid)) return true;
+    }
+    return false;
+}
+
+/* Only register computations and loads can be executed ahead for a future iteration */
+static bool canClone(Instruction *instr)
+{
+    if (instr->isControlFlow()) return false;
+    switch (instr->opcode) {
+        case Instruction::Call:
+        case Instruction::Return:
+        case Instruction::Interupt:
+        case Instruction::Store:
+        case Instruction::Fence:
+        case Instruction::Div:
+        case Instruction::Rem:
+            return false;
+        default: break;
+    }
+    for (auto vo: instr->outputs) {
+        if (vo->type != JVAR_REGISTER) return false;
+        if (vo->value == JREG_EFLAGS) continue;
+        if (vo->value < JREG_RAX || vo->value > JREG_R15 || vo->value == JREG_RSP) return false;
+    }
+    return true;
+}
+
+static bool checkAndFormatPrefetchSlice(Slice &slice, Loop &loop, PrefetchChain &chain) {
+    if (!slice.instrs.size()) return false;
+
+    //the instruction that loads the last level is not part of its address computation
+    for (auto it = slice.instrs.begin(); it != slice.instrs.end();) {
+        Instruction *instr = *it;
+        bool final = false;
+        for (auto vi: instr->inputs)
+            if (vi == chain.levels.back()) final = true;
+        if (final) it = slice.instrs.erase(it);
+        else it++;
+    }
+
+    Instruction *trigger = getPrefetchInsertLocation(slice, chain);
+    if (!trigger) return false;
 
-    if (count == 1) {
-        slice.instrs.remove(toRemove);
-    } else if (count > 1)
-        return false;
-    
-    /* sort the instruction list based on the instruction id */
-    map<InstID, Instruction *> temp;
+    set<Instruction*> inSlice(slice.instrs.begin(), slice.instrs.end());
+    map<Instruction*, set<Instruction*>> defs;
     for (auto instr: slice.instrs) {
-        temp[instr->id] = instr;
+        if (!canClone(instr)) return false;
+        if (instr != trigger && readsLoopPhi(instr, loop)) return false;
+        defs[instr] = getSliceDefinitions(instr, inSlice);
     }
-    //clear the previous slice
+    //the iterator load must be the root of the slice
+    if (defs[trigger].size()) return false;
+
+    /* The slice may span several blocks of the loop body, so the instruction ids
+     * are not necessarily in dependence order. Sort the instructions topologically,
+     * breaking ties with the instruction id to keep the program order within a block */
+    map<Instruction*, int> inDegree;
+    map<Instruction*, set<Instruction*>> users;
+    for (auto &d: defs) {
+        inDegree[d.first] = d.second.size();
+        for (auto def: d.second) users[def].insert(d.first);
+    }
+
+    auto later = [](Instruction *a, Instruction *b) { return a->id > b->id; };
+    priority_queue<Instruction*, vector<Instruction*>, decltype(later)> ready(later);
+    for (auto &d: inDegree)
+        if (d.second == 0) ready.push(d.first);
+
     slice.instrs.clear();
-    //add back to slice
-    for (auto instrP: temp) {
-        slice.instrs.push_back(instrP.second);
+    while (!ready.empty()) {
+        Instruction *instr = ready.top();
+        ready.pop();
+        slice.instrs.push_back(instr);
+        for (auto user: users[instr])
+            if (--inDegree[user] == 0) ready.push(user);
+    }
+    //a cycle in the slice means a recurrence through registers
+    return slice.instrs.size() == inSlice.size();
+}
+
+/* Registers written by the cloned instructions, they are saved around the clones.
+ * Only the general purpose registers and the flags can be saved, returns false if
+ * the clones write anything else */
+static bool getGuardMask(list<Instruction*> &instrs, uint64_t &mask)
+{
+    mask = 0;
+    for (auto instr: instrs) {
+        for (auto vo: instr->outputs) {
+            if (vo->type != JVAR_REGISTER) return false;
+            if (vo->value == JREG_EFLAGS) mask |= PREFETCH_GUARD_FLAGS;
+            else if (vo->value >= JREG_RAX && vo->value <= JREG_R15) mask |= 1ULL << (vo->value - JREG_RAX);
+            else return false;
+        }
+        switch (instr->opcode) {
+            case Instruction::Add: case Instruction::Sub: case Instruction::Mul:
+            case Instruction::Shl: case Instruction::LShr: case Instruction::AShr:
+            case Instruction::And: case Instruction::Or: case Instruction::Xor:
+            case Instruction::Neg: case Instruction::Compare:
+                mask |= PREFETCH_GUARD_FLAGS;
+                break;
+            default: break;
+        }
     }
     return true;
 }
 
-static void generatePrefetchRulesForSlice(JanusContext *jc,
+/* Slice instructions needed to compute the address of the given level, in slice order */
+static list<Instruction*> getLevelInstructions(Slice &slice, VarState *level, Instruction *trigger)
+{
+    set<Instruction*> inSlice(slice.instrs.begin(), slice.instrs.end());
+    set<Instruction*> needed;
+    queue<Instruction*> q;
+    list<Instruction*> result;
+
+    for (auto pred: level->pred) {
+        if (pred->lastModified && inSlice.count(pred->lastModified))
+            q.push(pred->lastModified);
+    }
+    while (!q.empty()) {
+        Instruction *instr = q.front();
+        q.pop();
+        if (instr == trigger || !needed.insert(instr).second) continue;
+        for (auto def: getSliceDefinitions(instr, inSlice))
+            q.push(def);
+    }
+
+    for (auto instr: slice.instrs)
+        if (needed.count(instr)) result.push_back(instr);
+    return result;
+}
+
+/* Prefetches for a chain of n levels are staggered:
+ * level 0 is prefetched at the full distance d, and level k is prefetched at
+ * d*(n+1-k)/(n+1) by loading the previous levels of that iteration, which were
+ * prefetched earlier. The loads are cloned between a save and a restore of the
+ * registers they write, and faults in the clones skip the rest of the slice */
+static void generatePrefetchRulesForChain(JanusContext *jc,
                                           Slice &slice,
-                                          VarState *vs,
-                                          Iterator *iter,
-                                          Loop &loop)
+                                          PrefetchChain &chain,
+                                          Loop &loop,
+                                          int distance)
 {
     RewriteRule rule;
+    Iterator *iter = chain.iter;
     //work out the insertion point
-    Instruction *trigger = getPrefetchInsertLocation(slice);
-
-    Instruction *front = slice.instrs.front();
+    Instruction *trigger = getPrefetchInsertLocation(slice, chain);
+    int depth = chain.levels.size() - 1;
+    JVar toFetch;
 
     if (!trigger) {
         LOOPLOG("\tError: could not find a prefetch insertion point!"<<endl);
+        return;
     }
+    //for constant stride, we can simply modify the memory operands
+    //without inserting new instructions or use additional registers
+    if (iter->strideKind != Iterator::INTEGER) return;
+
+    //level 0: prefetch the iterator access at the full distance
+    rule = RewriteRule(MEM_PREFETCH, trigger->block->instrs->pc, trigger->pc, trigger->id);
+    toFetch = *(JVar *)chain.levels.front();
+    toFetch.value += iter->stride * distance;
+    encodeJVar(toFetch, rule);
+    insertRule(loop.id, rule, trigger->block);
 
-    if (front && !instrContainIterator(front, &loop)) {
-        list<Instruction*> preCopy;
-        preCopy.push_back(front);
-        slice.instrs.pop_front();
-        //copy the instruction list for slices that doesn't start with iterator references
-        while (!slice.instrs.empty()) {
-            Instruction *instr = slice.instrs.front();
-            if (instr && instrContainIterator(instr, &loop)) {
-                //update front instruction
-                front = instr;
-                break;
-            }
-            else {
-                preCopy.push_back(instr);
-                slice.instrs.pop_front();
-            }
+    for (int level = 1; level <= depth; level++) {
+        int levelDistance = distance * (depth + 1 - level) / (depth + 1);
+        if (levelDistance < 1) levelDistance = 1;
+
+        list<Instruction*> clones = getLevelInstructions(slice, chain.levels[level], trigger);
+        list<Instruction*> written = clones;
+        written.push_back(trigger);
+        uint64_t mask;
+        if (!getGuardMask(written, mask)) {
+            LOOPLOG("\tPrefetch level "<<level<<" writes registers that can't be saved"<<endl);
+            return;
         }
 
-        //insert INSTR_CLONE rule
-        emitInstrCloneRules(preCopy, trigger, loop);
-    }
+        rule = RewriteRule(PREFETCH_GUARD_START, trigger->block->instrs->pc, trigger->pc, trigger->id);
+        rule.reg0 = mask;
+        insertRule(loop.id, rule, trigger->block);
 
-    if (iter->strideKind == Iterator::INTEGER) {
-        bool foundStart = false;
-        //for constant stride, we can simply modify the memory operands
-        //without inserting new instructions or use additional registers
-        
-        for (auto vi: front->inputs) {
-            if (vi->type == JVAR_MEMORY) {
-                MemoryLocation *ml = loop.locationTable[vi];
-                if (ml && ml->containIterator(&loop)) {
-                    rule = RewriteRule(MEM_PREFETCH, trigger->block->instrs->pc, trigger->pc, trigger->id);
-                    //update the memory operand to be prefetched
-                    JVar toFetch = *(JVar *)vi;
-                    //add prefetch distance
-                    toFetch.value += iter->stride * PREFETCH_CONSTANT;
-                    //encode jvar in rewrite rule
-                    encodeJVar(toFetch, rule);
-                    insertRule(loop.id, rule, trigger->block);
-
-                    //clone and update the front instruction to be copied with PREFETCH_CONSTANT/2
-                    rule = RewriteRule(INSTR_UPDATE, trigger->block->instrs->pc, trigger->pc, trigger->id);
-                    rule.ureg0.up = 1; //relative mode
-                    //prefetch distance
-                    rule.reg1 = iter->stride * (PREFETCH_CONSTANT/2);
-                    insertRule(loop.id, rule, trigger->block);
-                    foundStart = true;
-
-                    slice.instrs.pop_front();
-                }
-            }
-        }
+        //clone and update the iterator access to load the index of a future iteration
+        rule = RewriteRule(INSTR_UPDATE, trigger->block->instrs->pc, trigger->pc, trigger->id);
+        rule.ureg0.up = 1; //relative mode
+        //prefetch distance in iterations, for runtime tuning
+        rule.ureg0.down = distance;
+        //prefetch offset
+        rule.reg1 = iter->stride * levelDistance;
+        insertRule(loop.id, rule, trigger->block);
 
-        if (!foundStart) return;
-        if (slice.instrs.size() > 1) {
-            emitInstrCloneRules(slice.instrs, trigger, loop);
-        }
+        if (clones.size())
+            emitInstrCloneRules(clones, trigger, loop);
 
-        //at last, generate the final prefetch rewrite rule
         rule = RewriteRule(MEM_PREFETCH, trigger->block->instrs->pc, trigger->pc, trigger->id);
-        JVar toFetch2 = *(JVar *)vs;
-        encodeJVar(toFetch2, rule);
+        toFetch = *(JVar *)chain.levels[level];
+        encodeJVar(toFetch, rule);
+        insertRule(loop.id, rule, trigger->block);
+
+        rule = RewriteRule(PREFETCH_GUARD_END, trigger->block->instrs->pc, trigger->pc, trigger->id);
+        rule.reg0 = mask;
         insertRule(loop.id, rule, trigger->block);
     }
 }
 
-static Instruction *getPrefetchInsertLocation(Slice &slice)
+/* The insertion point is the load addressed by the iterator */
+static Instruction *getPrefetchInsertLocation(Slice &slice, PrefetchChain &chain)
 {
-    return slice.instrs.front();
+    for (auto instr: slice.instrs) {
+        for (auto vi: instr->inputs)
+            if (vi == chain.levels.front()) return instr;
+    }
+    return NULL;
 }
 
-static bool instrContainIterator(Instruction *instr, Loop *loop)
+static void emitCloneRule(Instruction *start, int length, Instruction *trigger, Loop &loop)
 {
-    if (!instr) return false;
-    for (auto vi: instr->inputs) {
-        if (vi->type == JVAR_MEMORY) {
-            MemoryLocation *ml = loop->locationTable[vi];
-            if (ml && ml->containIterator(loop)) return true;
-        }
+    RewriteRule rule(INSTR_CLONE, trigger->block->instrs->pc, trigger->pc, trigger->id);
+
+    if (start->block == trigger->block && start->id > trigger->id) {
+        //instruction relatively to trigger instruction
+        rule.ureg0.up = 1; //relative mode
+        rule.ureg0.down = start->id - trigger->id;
+        rule.ureg1.down = length;
+    } else {
+        //instruction in another block or before the trigger, cloned from its address
+        rule.ureg0.up = 2; //absolute mode
+        rule.ureg0.down = length;
+        rule.reg1 = start->pc;
     }
-    return false;
+    insertRule(loop.id, rule, trigger->block);
 }
 
 static void emitInstrCloneRules(list<Instruction*> &instrs, Instruction *trigger, Loop &loop)
 {
-    RewriteRule rule;
     Instruction *startInstr = instrs.front();
-    InstID prev = startInstr->id-1;
-    int step = 0;
+    Instruction *prev = startInstr;
+    int length = 1;
 
-    for (auto it = instrs.begin(); it != instrs.end(); it++) {
+    for (auto it = next(instrs.begin()); it != instrs.end(); it++) {
         //scan continuous code for instruction duplicate
         Instruction *instr = *it;
-        //found a non-continuous instruction, emit a instruction duplicate rewrite rule
-        if (instr->id != prev+1) {
-            //terminate prev
-            rule = RewriteRule(INSTR_CLONE, trigger->block->instrs->pc, trigger->pc, trigger->id);
-            //instruction relatively to trigger instruction
-            rule.ureg0.up = 1; //relative mode
-            rule.ureg0.down = startInstr->id - trigger->id;
-            rule.ureg1.down = step;
-            //update start and step
-            startInstr = instr;
-            step = 0;
-            prev = instr->id;
-            insertRule(loop.id, rule, trigger->block);
+        if (instr->id == prev->id+1 && instr->block == prev->block) {
+            length++;
         } else {
-            step++;
-            prev++;
+            //found a non-continuous instruction, emit a instruction duplicate rewrite rule
+            emitCloneRule(startInstr, length, trigger, loop);
+            startInstr = instr;
+            length = 1;
         }
+        prev = instr;
     }
     //finish the closure
-    rule = RewriteRule(INSTR_CLONE, trigger->block->instrs->pc, trigger->pc, trigger->id);
-    rule.ureg0.up = 1; //relative mode
-    rule.ureg0.down = startInstr->id - trigger->id;
-    rule.ureg1.down = step+1;
-    insertRule(loop.id, rule, trigger->block);
+    emitCloneRule(startInstr, length, trigger, loop);
 }
 
 static void prepareLoopMemoryAccesses(Loop *loop)
@@ -3,12 +3,26 @@
 
 #include "SchedGenInt.h"
 
-//"Architecture-dependent" constant -- we want to prefetch variables this many load instructions
-//    before they are actually needed
-#define PREFETCH_CONSTANT 64
+//"Architecture-dependent" constants for the prefetch distance
+//Default memory latency (cycles) the prefetch has to hide, change it with -pflatency=<cycles>
+#define PREFETCH_MEMORY_LATENCY 300
+#define PREFETCH_CACHE_LINE 64
+//Bounds of the prefetch distance in loop iterations
+#define PREFETCH_MIN_DISTANCE 2
+#define PREFETCH_MAX_DISTANCE 512
+//Assumed iteration count of inner loops whose iteration count is unknown
+#define PREFETCH_INNER_ITERATIONS 16
+//Longest chain of indirect loads, a[b[c[i]]] has depth 2
+#define PREFETCH_MAX_DEPTH 4
+//PREFETCH_GUARD_START mask: bit i saves general register i (rax is 0), this bit saves the flags
+#define PREFETCH_GUARD_FLAGS (1ULL << 16)
 
 /** \brief Generate prefetching rewrite rules */
 void
 generatePrefetchRules(JanusContext *jc);
 
+/** \brief Generate parallelisation rules and add prefetching rules to the parallelised loops */
+void
+generateParallelPrefetchRules(JanusContext *jc);
+
 #endif
@@ -1,59 +1,129 @@
 #include "FindReduction.h"
-#include "capstone/capstone.h"
+#include "SchedGenInt.h"
+#include "Iterator.h"
+#include "VECT_rule_structs.h"
+#include "janus_arch.h"
+#include <vector>
 
-static void
-insertInitRules(Loop *loop, bool isMultiply, VariableState *phiNode, RegSet &freeRegs, RegSet &freeVectRegs,
-        set<VECT_RULE *> &rules) {
-    for (auto initBid: loop->init) {
-        BasicBlock *bb = &(loop->parent->entry[initBid]);
-        MachineInstruction *instr = &(bb->instrs[bb->size-1]);
-        rules.insert(new VECT_REDUCE_INIT_rule(bb, instr->pc, instr->id, phiNode->getVar().getRegister(),
-            isMultiply ? 1 : 0, freeRegs.getNextLowest(JREG_RAX), freeVectRegs.getNextLowest(JREG_XMM0)));
+/* Accumulators per reduction, hides the latency of the floating point update */
+#define MAX_REDUCTION_ACCUMULATORS  4
+/* The lowest free SIMD registers are the temporaries of the other vector rules */
+#define RESERVED_SIMD_REGS          3
+
+bool
+checkLoopReductions(JanusContext *gc, Loop &loop)
+{
+    if (!loop.reductions.size()) return true;
+
+    for (auto &red: loop.reductions) {
+        if (!red.second.exact && !gc->reassociateFP) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" floating point reduction "<<red.first<<" not reassociated without -vreassoc.");
+            return false;
+        }
+    }
+    //the identity and the lane shuffles depend on the word size
+    if (loop.vectorWordSize != 4 && loop.vectorWordSize != 8) {
+        LOOPLOGLINE("loop "<<dec<<loop.id<<" reduction word size unknown.");
+        return false;
+    }
+    //one temporary is needed to build the identity
+    if (!loop.freeSIMDRegs.size()) {
+        LOOPLOGLINE("loop "<<dec<<loop.id<<" has no free SIMD register for the reduction.");
+        return false;
     }
+    return true;
 }
 
-static void
-insertReduceRules(Loop *loop, bool isMultiply, VariableState *phiNode, RegSet &freeVectRegs, 
-        set<VECT_RULE *> &rules) {
-    for (auto bid: loop->exit) {
-        BasicBlock *bb = &(loop->parent->entry[bid]);
-        rules.insert(new VECT_REDUCE_AFTER_rule(bb, bb->instrs[0].pc, bb->instrs[0].id, 
-            phiNode->getVar().getRegister(), freeVectRegs.getNextLowest(JREG_XMM0), isMultiply));
+bool
+isReductionRegister(Loop &loop, uint32_t reg)
+{
+    for (auto &red: loop.reductions) {
+        if (red.first->type == JVAR_REGISTER && red.first->value == reg) return true;
     }
+    return false;
 }
 
+static ReduceOp
+getReduceOp(Reduction::ReductionOp op)
+{
+    switch (op) {
+        case Reduction::REDUCTION_MUL: return REDUCE_MUL;
+        case Reduction::REDUCTION_MIN: return REDUCE_MIN;
+        case Reduction::REDUCTION_MAX: return REDUCE_MAX;
+        case Reduction::REDUCTION_AND: return REDUCE_AND;
+        case Reduction::REDUCTION_OR: return REDUCE_OR;
+        case Reduction::REDUCTION_XOR: return REDUCE_XOR;
+        default: return REDUCE_ADD;
+    }
+}
+
+/* Free SIMD registers not live across the loop, highest first */
 static void
-foundReductionVar(Loop *loop, VariableState *phiNode, set<uint32_t> &reductRegs,
-        RegSet &freeRegs, RegSet &freeVectRegs, set<VECT_RULE *> &rules) {
-    bool isMultiply = false;
-    for (auto instr: phiNode->dependants) {
-        //Assume one dependant.
-        if (instr->opcode == X86_INS_MULSS || instr->opcode == X86_INS_MULSD
-            || instr->opcode == X86_INS_DIVSS || instr->opcode == X86_INS_DIVSD) {
-            isMultiply = 1;
-        }
+getSpareSIMDRegs(Loop *loop, vector<uint32_t> &spare)
+{
+    set<uint32_t> freeRegs;
+    RegSet free = loop->freeSIMDRegs;
+    free.toSTLSet(freeRegs);
+
+    RegSet liveIn;
+    if (loop->parent->liveRegIn)
+        liveIn = loop->parent->liveRegIn[loop->start->instrs->id];
+
+    int skipped = 0;
+    for (auto reg: freeRegs) {
+        if (skipped++ < RESERVED_SIMD_REGS) continue;
+        if (liveIn.contains(reg)) continue;
+        spare.insert(spare.begin(), reg);
     }
-    insertInitRules(loop, isMultiply, phiNode, freeRegs, freeVectRegs, rules);
-    insertReduceRules(loop, isMultiply, phiNode, freeVectRegs, rules);
-    reductRegs.insert(phiNode->getVar().getRegister());
 }
 
-bool
-findReduction(Loop *loop, map<uint32_t, inductRegInfo *> &inductRegs, set<uint32_t> &reductRegs,
-        RegSet &freeRegs, RegSet &freeVectRegs, set<VECT_RULE *> &rules) {
-    for (auto phiNode: loop->start->phiNodes) {
-        // Is it a dependency?
-        if (!phiNode->notUsed && phiNode->type() == VARSTATE_PHI) {
-            // Is it a new reduction variable?
-            if (inductRegs.find(phiNode->getVar().getRegister()) == inductRegs.end()
-                && reductRegs.find(phiNode->getVar().getRegister()) == reductRegs.end()) {
-                 if (freeRegs.size() == 0) {
-                    LOOPLOGLINE("loop "<<dec<<currentLoopId<<" has no free registers.");
-                    return false;
-                }
-                foundReductionVar(loop, phiNode, reductRegs, freeRegs, freeVectRegs, rules);
-            }
+void
+generateReductionRules(Loop *loop)
+{
+    BasicBlock *entry = loop->parent->entry;
+    BasicBlock *body = entry + *(loop->body.begin());
+    Instruction *branch = body->lastInstr();
+    uint16_t freeVectReg = (uint16_t)loop->freeSIMDRegs.getNextLowest(JREG_XMM0);
+    int id = loop->id;
+
+    vector<uint32_t> spare;
+    getSpareSIMDRegs(loop, spare);
+
+    for (auto &red: loop->reductions) {
+        Reduction &reduction = red.second;
+        uint16_t reg = (uint16_t)reduction.vs->value;
+        ReduceOp op = getReduceOp(reduction.op);
+
+        //bitwise updates are too short to be worth more accumulators
+        uint16_t accMask = 0;
+        for (int i = 1; i < MAX_REDUCTION_ACCUMULATORS && !reduction.exact && spare.size(); i++) {
+            accMask |= 1 << (spare.back() - JREG_XMM0);
+            spare.pop_back();
+        }
+        LOOPLOGLINE("loop "<<dec<<id<<" reduction "<<reduction.vs<<" accumulators 0x"<<hex<<accMask<<dec);
+
+        for (auto bid: loop->init) {
+            BasicBlock *bb = entry + bid;
+            Instruction *instr = &(bb->instrs[bb->size-1]);
+            VECT_REDUCE_rule *rule = new VECT_REDUCE_rule(bb, instr->pc, instr->id, VECT_REDUCE_INIT,
+                reg, op, accMask, freeVectReg);
+            rule->updateVectorWordSize(loop->vectorWordSize);
+            insertRule(id, *rule->encode(), bb);
+        }
+
+        if (accMask) {
+            VECT_REDUCE_rule *rule = new VECT_REDUCE_rule(body, branch->pc, branch->id, VECT_REDUCE_ROTATE,
+                reg, op, accMask, freeVectReg);
+            rule->updateVectorWordSize(loop->vectorWordSize);
+            insertRule(id, *rule->encode(), body);
+        }
+
+        for (auto bid: loop->exit) {
+            BasicBlock *bb = entry + bid;
+            VECT_REDUCE_rule *rule = new VECT_REDUCE_rule(bb, bb->instrs[0].pc, bb->instrs[0].id, VECT_REDUCE_AFTER,
+                reg, op, accMask, freeVectReg);
+            rule->updateVectorWordSize(loop->vectorWordSize);
+            insertRule(id, *rule->encode(), bb);
         }
     }
-    return true;
-}
\ No newline at end of file
+}
@@ -1,12 +1,20 @@
 #include "JanusContext.h"
-#include "VectUtils.h"
-#include "VECT_rule_structs.h"
 #include <set>
-#include <map>
 
 using namespace std;
 using namespace janus;
 
+/** \brief Check whether the SIMD register reductions of the loop can be vectorised
+ *
+ * Floating point reductions are reordered across lanes, so they are only accepted
+ * when the user allows reassociation with -vreassoc */
 bool
-findReduction(Loop *loop, map<uint32_t, inductRegInfo *> &inductRegs, set<uint32_t> &reductRegs,
-        RegSet &freeRegs, RegSet &freeVectRegs, set<VECT_RULE *> &rules);
\ No newline at end of file
+checkLoopReductions(JanusContext *gc, Loop &loop);
+
+/** \brief Whether the register is the accumulator of a reduction in the loop */
+bool
+isReductionRegister(Loop &loop, uint32_t reg);
+
+/** \brief Insert the rules to initialise, rotate and combine the accumulators of each reduction */
+void
+generateReductionRules(Loop *loop);
@@ -0,0 +1,203 @@
+#include "LoopPeel.h"
+#include "SchedGenInt.h"
+#include "Iterator.h"
+#include "VectRule.h"
+#include "VectLoopSelect.h"
+#include "janus_arch.h"
+
+/* Widest vector register used by the runtime, in bytes */
+#define MAX_VECTOR_WIDTH    32
+
+/* The compare at the end of the loop body tests an iterator with an immediate stride
+ * against a value that doesn't change in the loop */
+static bool
+findBoundCompare(Loop &loop, BasicBlock *body, RegSet &bodyWrites, AlignmentPeel &peel)
+{
+#ifdef JANUS_X86
+    if (body->size < 3) return false;
+    Instruction *branch = body->lastInstr();
+    Instruction *compare = branch - 1;
+    if (!branch->isConditionalJump()) return false;
+    if (compare->minstr->opcode != X86_INS_CMP || compare->isMemoryAccess()) return false;
+
+    peel.iter = NULL;
+    for (auto &iterEntry: loop.iterators) {
+        Iterator &iter = iterEntry.second;
+        //the scalar iterations keep the other iterators in step
+        if (iter.strideKind != Iterator::INTEGER) return false;
+        if (iter.vs && iter.vs->type == JVAR_REGISTER && compare->regReads.contains(iter.vs->value))
+            peel.iter = &iter;
+    }
+    if (!peel.iter || peel.iter->kind != Iterator::INDUCTION_IMM) return false;
+    //the stride is encoded in a byte
+    if (peel.iter->stride <= 0 || peel.iter->stride > 127) return false;
+
+    RegSet bound = compare->regReads;
+    bound.remove(peel.iter->vs->value);
+    if ((bound & bodyWrites).bits) return false;
+    peel.compare = compare;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* The first contiguous store of the loop, its address must be the one of the current iteration
+ * at loop entry */
+static bool
+findStoreStream(Loop &loop, BasicBlock *body, AlignmentPeel &peel)
+{
+    for (uint32_t i = 0; i < body->size; i++) {
+        Instruction &instr = body->instrs[i];
+        if (!instr.isVectorInstruction()) continue;
+        bool write = false;
+        int64_t stride = 0;
+        MemoryLocation *location = getAccessLocation(loop, instr, write);
+        if (!location || !write || !location->escev) continue;
+        if (!getAccessStride(loop, location, stride) || stride != loop.vectorWordSize) continue;
+        if (checkPostIteratorUpdate(instr)) continue;
+        peel.store = &instr;
+        peel.location = location;
+        return true;
+    }
+    return false;
+}
+
+/* Two general purpose registers neither used in the loop nor live across it */
+static bool
+findFreeRegs(Loop &loop, RegSet &bodyRegs, AlignmentPeel &peel)
+{
+#ifdef JANUS_X86
+    RegSet liveIn = loop.parent->liveRegIn[loop.start->instrs->id];
+    peel.boundReg = 0;
+    peel.countReg = 0;
+    for (uint32_t reg = JREG_RAX; reg <= JREG_R15; reg++) {
+        if (reg == JREG_RSP || reg == JREG_RBP) continue;
+        if (bodyRegs.contains(reg) || liveIn.contains(reg)) continue;
+        if (!peel.boundReg) peel.boundReg = reg;
+        else if (!peel.countReg) peel.countReg = reg;
+    }
+    return peel.countReg != 0;
+#else
+    return false;
+#endif
+}
+
+bool
+findAlignmentPeel(Loop &loop, AlignmentPeel &peel)
+{
+#ifdef JANUS_X86
+    BasicBlock *entry = loop.parent->entry;
+    if (loop.body.size() != 1 || loop.reductions.size() || !loop.parent->liveRegIn) return false;
+    if (loop.vectorWordSize != 4 && loop.vectorWordSize != 8) return false;
+    //at least one vector iteration is left after the scalar iterations on both sides
+    if (loop.staticIterCount < (uint64_t)(3 * MAX_VECTOR_WIDTH / loop.vectorWordSize)) return false;
+
+    BasicBlock *body = entry + *(loop.body.begin());
+    RegSet bodyRegs, bodyWrites;
+    for (uint32_t i = 0; i < body->size; i++) {
+        bodyRegs.merge(body->instrs[i].regReads);
+        bodyWrites.merge(body->instrs[i].regWrites);
+    }
+    bodyRegs.merge(bodyWrites);
+
+    if (!findBoundCompare(loop, body, bodyWrites, peel)) {
+        LOOPLOGLINE("loop "<<dec<<loop.id<<" peel: loop bound not recognised.");
+        return false;
+    }
+    if (!findStoreStream(loop, body, peel)) {
+        LOOPLOGLINE("loop "<<dec<<loop.id<<" peel: no contiguous store.");
+        return false;
+    }
+    if (!findFreeRegs(loop, bodyRegs, peel)) {
+        LOOPLOGLINE("loop "<<dec<<loop.id<<" peel: no free registers.");
+        return false;
+    }
+    //the peel is placed at the end of the init blocks, which fall through or jump to the loop
+    for (auto bid: loop.init) {
+        Instruction *last = entry[bid].lastInstr();
+        if (last->isConditionalJump()) return false;
+        if (last->isControlFlow() && last->minstr->opcode != X86_INS_JMP) return false;
+    }
+    //the left over iterations are placed at the start of the exit blocks
+    for (auto bid: loop.exit) {
+        for (auto pred: entry[bid].pred) {
+            if (!loop.body.count(pred->bid)) return false;
+        }
+    }
+    LOOPLOGLINE("loop "<<dec<<loop.id<<" peel: aligning store at "<<hex<<peel.store->pc<<dec);
+    return true;
+#else
+    return false;
+#endif
+}
+
+Aligned
+getAccessAlignment(Loop &loop, AlignmentPeel *peel, Instruction &instr)
+{
+#ifdef JANUS_X86
+    //the VEX forms of the arithmetic don't require their memory operand to be aligned
+    switch (instr.minstr->opcode) {
+        case X86_INS_MOVSS: case X86_INS_VMOVSS: case X86_INS_MOVSD: case X86_INS_VMOVSD:
+        case X86_INS_MOVAPS: case X86_INS_MOVAPD:
+            break;
+        default:
+            return ALIGNED;
+    }
+#endif
+    if (!instr.isMemoryAccess()) return ALIGNED;
+    //the peel is skipped at runtime if the store is not aligned to its element,
+    //and it shifts the other streams, so a peeled loop keeps the unaligned forms
+    if (peel) return UNALIGNED;
+    bool write = false;
+    MemoryLocation *location = getAccessLocation(loop, instr, write);
+    if (!location || !location->escev) return UNALIGNED;
+    Expr start = location->escev->start;
+
+    if (start.kind != Expr::INTEGER || start.i % MAX_VECTOR_WIDTH != 0) return UNALIGNED;
+    //the other loops of the nest keep the vector aligned
+    for (auto strideP: location->escev->strides) {
+        if (strideP.first->loop->id == loop.id) continue;
+        Expr stride = strideP.second;
+        if (stride.kind != Expr::INTEGER || stride.i % MAX_VECTOR_WIDTH != 0) return UNALIGNED;
+    }
+    return ALIGNED;
+}
+
+void
+generateAlignmentPeelRules(Loop *loop, AlignmentPeel &peel)
+{
+    BasicBlock *entry = loop->parent->entry;
+    BasicBlock *body = peel.compare->block;
+    PCAddress startPC = loop->start->instrs->pc;
+    uint16_t compareOffset = (uint16_t)(peel.compare->pc - startPC);
+    uint16_t storeOffset = (uint16_t)(peel.store->pc - startPC);
+    uint16_t iterReg = (uint16_t)peel.iter->vs->value;
+    int8_t stride = (int8_t)peel.iter->stride;
+    int id = loop->id;
+
+    for (auto bid: loop->init) {
+        BasicBlock *bb = entry + bid;
+        Instruction *instr = bb->lastInstr();
+        VECT_LOOP_ALIGN_rule *rule = new VECT_LOOP_ALIGN_rule(bb, instr->pc, instr->id, VECT_ALIGN_PEEL,
+            (int32_t)(startPC - instr->pc), compareOffset, storeOffset, iterReg, (uint16_t)peel.boundReg,
+            (uint16_t)peel.countReg, stride, (uint32_t)loop->staticIterCount);
+        rule->updateVectorWordSize(loop->vectorWordSize);
+        insertRule(id, *rule->encode(), bb);
+    }
+
+    VECT_LOOP_ALIGN_rule *rule = new VECT_LOOP_ALIGN_rule(body, peel.compare->pc, peel.compare->id, VECT_ALIGN_BOUND,
+        0, compareOffset, storeOffset, iterReg, (uint16_t)peel.boundReg, (uint16_t)peel.countReg, stride,
+        (uint32_t)loop->staticIterCount);
+    rule->updateVectorWordSize(loop->vectorWordSize);
+    insertRule(id, *rule->encode(), body);
+
+    for (auto bid: loop->exit) {
+        BasicBlock *bb = entry + bid;
+        rule = new VECT_LOOP_ALIGN_rule(bb, bb->instrs[0].pc, bb->instrs[0].id, VECT_ALIGN_TAIL,
+            (int32_t)(startPC - bb->instrs[0].pc), compareOffset, storeOffset, iterReg, (uint16_t)peel.boundReg,
+            (uint16_t)peel.countReg, stride, (uint32_t)loop->staticIterCount);
+        rule->updateVectorWordSize(loop->vectorWordSize);
+        insertRule(id, *rule->encode(), bb);
+    }
+}
@@ -0,0 +1,40 @@
+#include "JanusContext.h"
+#include "VECT_rule_structs.h"
+#include <set>
+
+using namespace std;
+using namespace janus;
+
+/** \brief The store stream aligned by the runtime peel and the registers used around the loop */
+struct AlignmentPeel {
+    ///The contiguous store whose address is aligned before the vector loop
+    Instruction             *store;
+    ///The memory location written by the store
+    MemoryLocation          *location;
+    ///The compare of the loop branch
+    Instruction             *compare;
+    ///The iterator tested by the compare
+    Iterator                *iter;
+    ///Free register holding the bound of the vector loop
+    uint32_t                boundReg;
+    ///Free register holding the number of scalar iterations after the loop
+    uint32_t                countReg;
+};
+
+/** \brief Check whether the loop can be aligned at runtime
+ *
+ * The misalignment of the store stream is only known from the base pointer at loop entry,
+ * so scalar iterations are run before the loop until it is aligned and the left over
+ * iterations after it. Returns false if the loop doesn't have the shape these need */
+bool
+findAlignmentPeel(Loop &loop, AlignmentPeel &peel);
+
+/** \brief Whether the memory access of the instruction can use the aligned SIMD form
+ *
+ * The moves of a peeled loop are unaligned, pass NULL if the loop is not peeled */
+Aligned
+getAccessAlignment(Loop &loop, AlignmentPeel *peel, Instruction &instr);
+
+/** \brief Insert the rules to peel, bound and finish the loop */
+void
+generateAlignmentPeelRules(Loop *loop, AlignmentPeel &peel);
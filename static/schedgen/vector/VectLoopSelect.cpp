@@ -1,13 +1,18 @@
 #include "VectLoopSelect.h"
+#include "FindReduction.h"
+#include "LoopPeel.h"
 #include "capstone/capstone.h"
 #include <set>
 
 using namespace janus;
 
 static bool checkLoopDependencies(Loop &loop);
-static bool checkContinuousMemoryAccess(Loop &loop);
+static bool checkStridedMemoryAccess(Loop &loop);
 static bool checkStrideAlignment(Loop &loop);
 static bool checkCompatibleImplementation(Loop &loop);
+static bool checkOuterLoopBody(Loop &outer, Loop &inner);
+static bool checkOuterLoopAccesses(Loop &outer);
+
 void
 setSupportedVectorOpcodes(set<InstOp> &supported_opcodes, set<InstOp> &singles, set<InstOp> &doubles)
 {
@@ -29,6 +34,12 @@ setSupportedVectorOpcodes(set<InstOp> &supported_opcodes, set<InstOp> &singles,
     singles.insert(X86_INS_MOVSS);
     singles.insert(X86_INS_MULSS);
     singles.insert(X86_INS_DIVSS);
+    singles.insert(X86_INS_MINSS);
+    singles.insert(X86_INS_MAXSS);
+    singles.insert(X86_INS_SQRTSS);
+    singles.insert(X86_INS_VMINSS);
+    singles.insert(X86_INS_VMAXSS);
+    singles.insert(X86_INS_VSQRTSS);
 
     //Double precision
     doubles.insert(X86_INS_MOVAPD);
@@ -47,14 +58,44 @@ setSupportedVectorOpcodes(set<InstOp> &supported_opcodes, set<InstOp> &singles,
     doubles.insert(X86_INS_MOVSD);
     doubles.insert(X86_INS_MULSD);
     doubles.insert(X86_INS_DIVSD);
+    doubles.insert(X86_INS_MINSD);
+    doubles.insert(X86_INS_MAXSD);
+    doubles.insert(X86_INS_SQRTSD);
+    doubles.insert(X86_INS_VMINSD);
+    doubles.insert(X86_INS_VMAXSD);
+    doubles.insert(X86_INS_VSQRTSD);
     doubles.insert(X86_INS_CVTSI2SD);
     doubles.insert(X86_INS_VCVTSI2SD);
 
     supported_opcodes.insert(singles.begin(), singles.end());
     supported_opcodes.insert(doubles.begin(), doubles.end());
 
-    supported_opcodes.insert(X86_INS_PXOR);
-    supported_opcodes.insert(X86_INS_VPXOR);
+    //Packed operations on whole registers, they don't define the word size
+    InstOp packed[] = {
+        //Logic
+        X86_INS_ANDPS, X86_INS_ANDNPS, X86_INS_ORPS, X86_INS_XORPS,
+        X86_INS_ANDPD, X86_INS_ANDNPD, X86_INS_ORPD, X86_INS_XORPD,
+        X86_INS_VANDPS, X86_INS_VANDNPS, X86_INS_VORPS, X86_INS_VXORPS,
+        X86_INS_VANDPD, X86_INS_VANDNPD, X86_INS_VORPD, X86_INS_VXORPD,
+        X86_INS_PAND, X86_INS_PANDN, X86_INS_POR, X86_INS_PXOR,
+        X86_INS_VPAND, X86_INS_VPANDN, X86_INS_VPOR, X86_INS_VPXOR,
+        //Integer arithmetic
+        X86_INS_PADDB, X86_INS_PADDW, X86_INS_PADDD, X86_INS_PADDQ,
+        X86_INS_PSUBB, X86_INS_PSUBW, X86_INS_PSUBD, X86_INS_PSUBQ,
+        X86_INS_VPADDB, X86_INS_VPADDW, X86_INS_VPADDD, X86_INS_VPADDQ,
+        X86_INS_VPSUBB, X86_INS_VPSUBW, X86_INS_VPSUBD, X86_INS_VPSUBQ,
+        X86_INS_PMULLW, X86_INS_PMULLD, X86_INS_VPMULLW, X86_INS_VPMULLD,
+        //Integer min/max and compare
+        X86_INS_PMINSB, X86_INS_PMINSW, X86_INS_PMINSD, X86_INS_PMINUB, X86_INS_PMINUW, X86_INS_PMINUD,
+        X86_INS_PMAXSB, X86_INS_PMAXSW, X86_INS_PMAXSD, X86_INS_PMAXUB, X86_INS_PMAXUW, X86_INS_PMAXUD,
+        X86_INS_VPMINSB, X86_INS_VPMINSW, X86_INS_VPMINSD, X86_INS_VPMINUB, X86_INS_VPMINUW, X86_INS_VPMINUD,
+        X86_INS_VPMAXSB, X86_INS_VPMAXSW, X86_INS_VPMAXSD, X86_INS_VPMAXUB, X86_INS_VPMAXUW, X86_INS_VPMAXUD,
+        X86_INS_PCMPEQB, X86_INS_PCMPEQW, X86_INS_PCMPEQD, X86_INS_PCMPEQQ,
+        X86_INS_PCMPGTB, X86_INS_PCMPGTW, X86_INS_PCMPGTD, X86_INS_PCMPGTQ,
+        X86_INS_VPCMPEQB, X86_INS_VPCMPEQW, X86_INS_VPCMPEQD, X86_INS_VPCMPEQQ,
+        X86_INS_VPCMPGTB, X86_INS_VPCMPGTW, X86_INS_VPCMPGTD, X86_INS_VPCMPGTQ
+    };
+    supported_opcodes.insert(packed, packed + sizeof(packed) / sizeof(InstOp));
 #endif
 }
 
@@ -97,6 +138,11 @@ isVectorRuntimeCompatible(Loop &loop, set<InstOp> &supported_opcode, set<InstOp>
                         return false;
                     }
                 }
+                //the memory operand of a packed operation can't be widened
+                else if (instr.isMemoryAccess()) {
+                    LOOPLOGLINE("loop "<<dec<<loop.id<<" packed operation with memory operand: "<<bb.instrs[i]);
+                    return false;
+                }
 
                 //check reduction read
             }
@@ -121,8 +167,12 @@ isVectorRuntimeCompatible(Loop &loop, set<InstOp> &supported_opcode, set<InstOp>
 }
 
 static bool
-checkLoopIterator(Iterator &iter)
+checkLoopIterator(Loop &loop, Iterator &iter)
 {
+    //reductions in SIMD registers are accumulated lane by lane
+    if (iter.kind == Iterator::REDUCTION_PLUS)
+        return loop.reductions.find(iter.vs) != loop.reductions.end();
+
     //currently we are only processing on add iterator
     //if (!(iter.vs && iter.vs->lastModified && iter.vs->lastModified->opcode == Instruction::Add))
     //    return false;
@@ -132,8 +182,6 @@ checkLoopIterator(Iterator &iter)
     if (iter.kind != Iterator::INDUCTION_IMM && iter.kind != Iterator::INDUCTION_VAR)
         return false;
 
-    if (iter.kind == Iterator::REDUCTION_PLUS) return false;
-
     //the update instruction can be retrieved
     if (!iter.getUpdateInstr()) return false;
     return true;
@@ -143,7 +191,7 @@ static bool
 checkLoopIterators(Loop &loop)
 {
     for (auto &iter: loop.iterators) {
-        if (!checkLoopIterator(iter.second)) return false;
+        if (!checkLoopIterator(loop, iter.second)) return false;
     }
     return true;
 }
@@ -152,6 +200,8 @@ void
 selectVectorisableLoop(JanusContext *gc, set<Loop *> &selected_loops, set<InstOp> &supported_opcode, set<InstOp> &singles, set<InstOp> &doubles)
 {
     for (auto &loop : gc->loops) {
+        //loops in cold functions are not lifted in hot analysis mode
+        if (!loop.parent->hot) continue;
         //Condition 1: we only look at innermost loops
         if (loop.descendants.size()) {
             LOOPLOGLINE("loop "<<dec<<loop.id<<" not innermost.");
@@ -203,15 +253,19 @@ selectVectorisableLoop(JanusContext *gc, set<Loop *> &selected_loops, set<InstOp
             LOOPLOGLINE("loop "<<dec<<loop.id<<" induction variable support not yet implemented.");
             continue;
         }
-        //filter out loops with non-continuous memory writes
-        //release this filter if the masked write is implemented
-        if (!checkContinuousMemoryAccess(loop)) {
-            LOOPLOGLINE("loop "<<dec<<loop.id<<" memory writes not continuous, transformation not yet implemented.");
+        //reductions are reordered across the lanes
+        if (!checkLoopReductions(gc, loop)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" reduction not supported.");
+            continue;
+        }
+        //non-continuous accesses are gathered and scattered lane by lane
+        if (!checkStridedMemoryAccess(loop)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" memory stride not supported, transformation not yet implemented.");
             continue;
         }
         //check stride alignment
         if (!checkStrideAlignment(loop)) {
-            LOOPLOGLINE("loop "<<dec<<loop.id<<" memory stride not uniform, transformation not yet implemented.");
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" memory accesses not aligned, transformation not yet implemented.");
             continue;
         }
         //check the limit of the current implementation
@@ -223,6 +277,56 @@ selectVectorisableLoop(JanusContext *gc, set<Loop *> &selected_loops, set<InstOp
     }
 }
 
+void
+selectOuterVectorisableLoop(JanusContext *gc, set<Loop *> &outer_loops, set<Loop *> &selected_loops, set<InstOp> &supported_opcode, set<InstOp> &singles, set<InstOp> &doubles)
+{
+    for (auto &loop : gc->loops) {
+        //Condition 1: perfect nest of two loops, the inner one is not vectorised itself
+        if (loop.subLoops.size() != 1 || loop.descendants.size() != 1) continue;
+        Loop *inner = *(loop.subLoops.begin());
+        if (selected_loops.count(inner)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" inner loop already vectorised.");
+            continue;
+        }
+        //Condition 2: same requirements on the outer iterations as an innermost loop
+        if (!loop.mainIterator || loop.subCalls.size() || loop.undecidedMemAccesses.size() || loop.unsafe) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" outer loop not analysable.");
+            continue;
+        }
+        //Condition 3: lanes must not depend on each other
+        if (loop.memoryDependences.size() || loop.reductions.size() || loop.undecidedPhiVariables.size()) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" outer loop has cross iteration dependencies.");
+            continue;
+        }
+        if (!isVectorRuntimeCompatible(loop, supported_opcode, singles, doubles)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" not currently handled in Janus runtime.");
+            continue;
+        }
+        //Condition 4: no outer iterations are left over by the vector loop
+        if (loop.vectorWordSize != 4 && loop.vectorWordSize != 8) continue;
+        uint64_t lanes = 32 / loop.vectorWordSize;
+        if (loop.staticIterCount < lanes || loop.staticIterCount % lanes) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" outer static iter count:"<<loop.staticIterCount);
+            continue;
+        }
+        if (!checkLoopIterators(loop)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" induction variable support not yet implemented.");
+            continue;
+        }
+        //Condition 5: all the lanes take the same path through the nest
+        if (!checkOuterLoopBody(loop, *inner)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" outer loop control flow not supported.");
+            continue;
+        }
+        //Condition 6: each lane accesses the memory of its own outer iteration
+        if (!checkOuterLoopAccesses(loop)) {
+            LOOPLOGLINE("loop "<<dec<<loop.id<<" outer loop memory stride not supported.");
+            continue;
+        }
+        outer_loops.insert(&loop);
+    }
+}
+
 void
 printVectorisableLoops(set<Loop *> &selected_loops) {
     cout << "Vectorisable loops: " << endl;
@@ -242,21 +346,83 @@ static bool checkLoopDependencies(Loop &loop) {
     return false;
 }
 
-static bool checkContinuousMemoryAccess(Loop &loop) {
+bool getAccessStride(Loop &loop, MemoryLocation *location, int64_t &stride) {
+    stride = 0;
+    if (!location->escev) return false;
+    for (auto strideP: location->escev->strides) {
+        if (strideP.first->loop->id != loop.id) continue;
+        if (strideP.second.kind != Expr::INTEGER) return false;
+        stride += strideP.second.i;
+    }
+    return true;
+}
+
+MemoryLocation *getAccessLocation(Loop &loop, Instruction &instr, bool &write) {
     for (auto memWrite: loop.memoryWrites) {
-        Iterator *iter = memWrite->expr.hasIterator(&loop);
-        if (iter && iter->strideKind == Iterator::INTEGER) {
-            if ((int)iter->stride != (int)memWrite->vs->size)
+        if (memWrite->writeFrom.find(&instr) != memWrite->writeFrom.end()) {
+            write = true;
+            return memWrite;
+        }
+    }
+    for (auto memRead: loop.memoryReads) {
+        if (memRead->readBy.find(&instr) != memRead->readBy.end()) {
+            write = false;
+            return memRead;
+        }
+    }
+    return NULL;
+}
+
+static bool isStridedAccessSupported(Loop &loop, MemoryLocation *location) {
+    set<Instruction *> instrs(location->readBy);
+    instrs.insert(location->writeFrom.begin(), location->writeFrom.end());
+    //each lane is a single scalar element
+    if (location->vs->size != loop.vectorWordSize) return false;
+    for (auto instr: instrs) {
+        switch (instr->minstr->opcode) {
+#ifdef JANUS_X86
+            case X86_INS_MOVSS: case X86_INS_VMOVSS:
+            case X86_INS_MOVSD: case X86_INS_VMOVSD:
+            case X86_INS_ADDSS: case X86_INS_VADDSS: case X86_INS_ADDSD: case X86_INS_VADDSD:
+            case X86_INS_SUBSS: case X86_INS_VSUBSS: case X86_INS_SUBSD: case X86_INS_VSUBSD:
+            case X86_INS_MULSS: case X86_INS_VMULSS: case X86_INS_MULSD: case X86_INS_VMULSD:
+            case X86_INS_DIVSS: case X86_INS_VDIVSS: case X86_INS_DIVSD: case X86_INS_VDIVSD:
+            case X86_INS_MINSS: case X86_INS_VMINSS: case X86_INS_MINSD: case X86_INS_VMINSD:
+            case X86_INS_MAXSS: case X86_INS_VMAXSS: case X86_INS_MAXSD: case X86_INS_VMAXSD:
+                if (instr->minstr->isXMMInstruction()) break;
+#endif
+            default:
                 return false;
         }
     }
     return true;
 }
 
+static bool checkStridedMemoryAccess(Loop &loop) {
+    int strided = 0;
+    int64_t stride;
+
+    for (auto memWrite: loop.memoryWrites) {
+        //every iteration must write to a different element
+        if (!getAccessStride(loop, memWrite, stride) || stride == 0) return false;
+        if (stride == loop.vectorWordSize) continue;
+        if (!isStridedAccessSupported(loop, memWrite)) return false;
+        strided++;
+    }
+    for (auto memRead: loop.memoryReads) {
+        if (!getAccessStride(loop, memRead, stride)) return false;
+        if (stride == 0 || stride == loop.vectorWordSize) continue;
+        if (!isStridedAccessSupported(loop, memRead)) return false;
+        strided++;
+    }
+    //the lanes are gathered with three free SIMD registers
+    if (strided && loop.freeSIMDRegs.size() < 3) return false;
+    return true;
+}
+
 static bool checkStrideAlignment(Loop &loop) {
 
     bool aligned = true;
-    int64_t strideImm = 0;
 
     for (auto s: loop.arrayAccesses) {
         auto set = s. second;
@@ -278,19 +444,13 @@ static bool checkStrideAlignment(Loop &loop) {
                     }
                 }
             }
-            //analyse the strides
-            for (auto strideP: m->escev->strides) {
-                Iterator *iter = strideP.first;
-                if (iter->loop->id != loop.id) continue;
-                Expr stride = strideP.second;
-                if (stride.kind == Expr::INTEGER) {
-                    if (strideImm == 0) strideImm = stride.i;
-                    else if (strideImm != stride.i) return false;
-                }
-            }
         }
     }
-    if (loop.peelDistance) return false;
+    //misaligned streams are aligned at runtime by peeling scalar iterations
+    if (loop.peelDistance) {
+        AlignmentPeel peel;
+        return findAlignmentPeel(loop, peel);
+    }
     return true;
 }
 
@@ -303,4 +463,74 @@ static bool checkCompatibleImplementation(Loop &loop)
         if (write->type == MemoryLocation::AffinemD) return false;
     }
     return true;
-}
\ No newline at end of file
+}
+/* The inner loop runs the same number of iterations for every lane and the latch of the
+ * outer loop is its only other branch. The iterators are updated in the latch block, so the
+ * nest sees the values of the current iteration */
+static bool checkOuterLoopBody(Loop &outer, Loop &inner)
+{
+    BasicBlock *entry = outer.parent->entry;
+    if (inner.body.size() != 1 || !inner.staticIterCount) return false;
+
+    BasicBlock *latch = NULL;
+    for (auto bid: outer.body) {
+        BasicBlock &bb = entry[bid];
+        for (int i = 0; i < bb.size; i++) {
+            Instruction &instr = bb.instrs[i];
+            if (!instr.isVectorInstruction()) continue;
+#ifdef JANUS_X86
+            //the converted integer would be the one of the first lane only
+            InstOp opcode = instr.minstr->opcode;
+            if (opcode == X86_INS_CVTSI2SD || opcode == X86_INS_VCVTSI2SD) return false;
+#endif
+            //the spilled lanes are not kept
+            for (auto vi: instr.inputs)
+                if (vi->type == JVAR_STACK || vi->type == JVAR_STACKFRAME) return false;
+            for (auto vo: instr.outputs)
+                if (vo->type == JVAR_STACK || vo->type == JVAR_STACKFRAME) return false;
+        }
+        if (inner.body.count(bid) || !bb.lastInstr()->isConditionalJump()) continue;
+        if (latch) return false;
+        for (auto pred: outer.start->pred)
+            if (pred->bid == bid) latch = &bb;
+        if (!latch) return false;
+    }
+    if (!latch) return false;
+
+    for (auto &iterEntry: outer.iterators) {
+        Instruction *update = iterEntry.second.getUpdateInstr();
+        if (!update || update->block != latch) return false;
+    }
+    return true;
+}
+
+/* Stores and vector loads are contiguous or gathered across the outer iterations, a load that
+ * doesn't move with the outer loop is broadcast. Other instructions only read memory invariant
+ * in the outer loop, their value is the same in all lanes */
+static bool checkOuterLoopAccesses(Loop &outer) {
+    int strided = 0;
+    int64_t stride;
+
+    for (auto memWrite: outer.memoryWrites) {
+        if (!getAccessStride(outer, memWrite, stride) || stride == 0) return false;
+        for (auto instr: memWrite->writeFrom)
+            if (!instr->isVectorInstruction()) return false;
+        if (stride == outer.vectorWordSize) continue;
+        if (!isStridedAccessSupported(outer, memWrite)) return false;
+        strided++;
+    }
+    for (auto memRead: outer.memoryReads) {
+        if (!getAccessStride(outer, memRead, stride)) return false;
+        bool vector = false;
+        for (auto instr: memRead->readBy) {
+            if (instr->isVectorInstruction()) vector = true;
+            else if (stride) return false;
+        }
+        if (!vector || stride == outer.vectorWordSize) continue;
+        if (!isStridedAccessSupported(outer, memRead)) return false;
+        strided++;
+    }
+    //the lanes are gathered with three free SIMD registers
+    if (strided && outer.freeSIMDRegs.size() < 3) return false;
+    return true;
+}
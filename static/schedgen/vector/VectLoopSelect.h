@@ -13,5 +13,21 @@ isVectorRuntimeCompatible(Loop &loop, set<InstOp> &supported_opcode, set<InstOp>
 void
 selectVectorisableLoop(JanusContext *gc, set<Loop *> &selected_loops, set<InstOp> &supported_opcode, set<InstOp> &singles, set<InstOp> &doubles);
 
+/** \brief Select the outer loops of two-level nests whose lanes run consecutive outer iterations
+ *
+ * The inner loop runs in lock-step for all the lanes, so its trip count must be a constant */
 void
-printVectorisableLoops(set<Loop *> &selected_loops);
\ No newline at end of file
+selectOuterVectorisableLoop(JanusContext *gc, set<Loop *> &outer_loops, set<Loop *> &selected_loops, set<InstOp> &supported_opcode, set<InstOp> &singles, set<InstOp> &doubles);
+
+void
+printVectorisableLoops(set<Loop *> &selected_loops);
+
+/** \brief Get the distance in bytes between the accesses of two consecutive iterations
+ *
+ * Returns false if the distance is not a constant */
+bool
+getAccessStride(Loop &loop, MemoryLocation *location, int64_t &stride);
+
+/** \brief Return the memory location accessed by the instruction in the loop, NULL if none */
+MemoryLocation *
+getAccessLocation(Loop &loop, Instruction &instr, bool &write);
\ No newline at end of file
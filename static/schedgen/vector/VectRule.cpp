@@ -4,10 +4,15 @@
 //#include "janus_x86.h"
 #include "capstone/capstone.h"
 #include "VectLoopSelect.h"
+#include "FindReduction.h"
+#include "LoopPeel.h"
+#include "ParaRule.h"
 #include "VECT_rule_structs.h"
 #include "janus_arch.h"
+#include <map>
 
 static bool needBroadcast(Loop &loop, Instruction &instr);
+static Instruction *getFusedMultiply(Loop &loop, Instruction &add);
 
 static void
 prepareLoopHeader(JanusContext *gc, Loop &loop)
@@ -30,24 +35,14 @@ prepareLoopHeader(JanusContext *gc, Loop &loop)
 
 }
 
-void
-generateVectorRulesForLoop(JanusContext *gc, Loop *loop)
+/* Debug rules at the start and finish of the loop and of its outermost loop */
+static void
+generateLoopDebugRules(Loop *loop)
 {
     BasicBlock *entry = loop->parent->entry;
-    /* Get the array of instructions */
-    Instruction *instrs = loop->parent->instrs.data();
-
     RewriteRule rule;
-    VECT_RULE *vrule;
-
     int id = loop->id;
 
-    //step 1: retrieve the alignment information
-    bool aligned = alignmentAnalysis(*loop);
-
-    if (loop->peelDistance) return;
-
-    /* Add debug rules at the start end finish of the loop */
     if (loop->ancestors.size() == 0) {
         /* Loop start and finish */
         for (auto bid: loop->init) {
@@ -80,13 +75,23 @@ generateVectorRulesForLoop(JanusContext *gc, Loop *loop)
             }
         }
     }
+}
 
 #ifdef JANUS_X86
-    //step 1: insert broadcast rules
+/* Copy the loop invariant SIMD registers into all the lanes. In a parallelised loop the
+ * arguments are broadcast at the start of the init block, before the threads copy them */
+static void
+generateBroadcastRules(Loop *loop, bool threaded)
+{
+    BasicBlock *entry = loop->parent->entry;
+    RewriteRule rule;
+    int id = loop->id;
+
     set<uint32_t> copySet;
     loop->registerToCopy.toSTLSet(copySet);
     for (auto reg: copySet) {
-        if (jreg_is_simd(reg)) {
+        //the accumulator lanes are initialised by the reduction rules
+        if (jreg_is_simd(reg) && !isReductionRegister(*loop, reg)) {
             //get the definition
             Variable v((uint32_t)reg);
             VarState *vs = loop->start->alive(v);
@@ -100,7 +105,7 @@ generateVectorRulesForLoop(JanusContext *gc, Loop *loop)
                 //if variable state not found, it means it is from function argument
                 //then add to the init block of the loop
                 for (auto bid: loop->init) {
-                    rule = RewriteRule(VECT_BROADCAST, entry + bid, POST_INSERT);
+                    rule = RewriteRule(VECT_BROADCAST, entry + bid, threaded ? PRE_INSERT : POST_INSERT);
                     rule.ureg0.up = 1;
                     rule.ureg0.down = v.size;
                     rule.reg1 = reg;
@@ -109,38 +114,19 @@ generateVectorRulesForLoop(JanusContext *gc, Loop *loop)
             }
         }
     }
+}
 
-    //insert VECT_LOOP_PEEL if not aligned
-    if (loop->peelDistance > 0) {
-        //insert loop peeling after the loop
-        for (auto init: loop->init) {
-            BasicBlock *bb = entry + init;
-            Instruction *instr = &(bb->instrs[bb->size-1]);
-            VECT_LOOP_PEEL_rule *rule = new VECT_LOOP_PEEL_rule(bb, instr->pc, instr->id, (uint32_t)(loop->start->instrs->pc-instr->pc),
-                (uint16_t)loop->scratchRegs.regs.reg0, (uint16_t)loop->scratchRegs.regs.reg1, (uint32_t)loop->staticIterCount);
-            rule->vectorWordSize = loop->vectorWordSize;
-            insertRule(id, *rule->encode(), bb);
-        }
-    }
-
-    //step 2: examine each loop instructions
-    for (auto bid: loop->body) {
-        BasicBlock &bb = entry[bid];
-        for (int i=0; i<bb.size; i++) {
-            Instruction &instr = bb.instrs[i];
-            if (instr.isVectorInstruction()) {
-                //extend the existing vector instruction
-                bool postIteratorUpdate = checkPostIteratorUpdate(instr);
-                VECT_CONVERT_rule *rule = new VECT_CONVERT_rule(&bb, instr.pc, instr.id, 0, postIteratorUpdate, (uint16_t)loop->mainIterator->stride, 
-                (uint16_t)loop->freeSIMDRegs.getNextLowest(JREG_XMM0), ALIGNED, 0, loop->staticIterCount);
-                insertRule(id, *rule->encode(), &bb);
-            }
-        }
-    }
+/* Step the iterators over all the lanes */
+static void
+generateStrideUpdateRules(Loop *loop)
+{
+    BasicBlock *entry = loop->parent->entry;
+    RewriteRule rule;
+    int id = loop->id;
 
-    //update all strides
     for (auto iterEntry: loop->iterators) {
         Iterator &iter = iterEntry.second;
+        if (iter.kind == Iterator::REDUCTION_PLUS) continue;
 
         if (iter.strideKind == Iterator::INTEGER) {
             //insert rewrite rule on the update instruction
@@ -175,6 +161,190 @@ generateVectorRulesForLoop(JanusContext *gc, Loop *loop)
             }
         } else continue;
     }
+}
+
+/* A block falling through into the next one shares its fragment, which is split so that the
+ * rules of the next block are found at the start of a fragment */
+static void
+generateBlockSplitRules(Loop *loop)
+{
+    Function *parent = loop->parent;
+    BasicBlock *entry = parent->entry;
+    RewriteRule rule;
+    int id = loop->id;
+
+    set<BlockID> blocks(loop->init);
+    blocks.insert(loop->body.begin(), loop->body.end());
+    for (auto bid: blocks) {
+        BasicBlock *bb = entry + bid;
+        Instruction *last = bb->lastInstr();
+        if (last->isControlFlow() || last->id + 1 >= parent->instrs.size()) continue;
+        Instruction *next = parent->instrs.data() + last->id + 1;
+        rule = RewriteRule(APP_SPLIT_BLOCK, bb->instrs->pc, next->pc, next->id);
+        insertRule(id, rule, bb);
+    }
+}
+
+/* The iterators of the outer loop are updated in its latch block, only the instructions after
+ * the update there see the value of the last lane */
+static bool
+checkOuterPostIteratorUpdate(Loop &loop, Instruction &instr)
+{
+    for (auto &iterEntry: loop.iterators) {
+        Instruction *update = iterEntry.second.getUpdateInstr();
+        if (update && update->block == instr.block && update->id < instr.id)
+            return checkPostIteratorUpdate(instr);
+    }
+    return false;
+}
+#endif
+
+/* A threaded loop is run by the block schedule of the parallel runtime, which creates the
+ * threads at the loop init and rounds their blocks to whole vectors */
+void
+generateVectorRulesForLoop(JanusContext *gc, Loop *loop, bool threaded)
+{
+    BasicBlock *entry = loop->parent->entry;
+    /* Get the array of instructions */
+    Instruction *instrs = loop->parent->instrs.data();
+
+    RewriteRule rule;
+    VECT_RULE *vrule;
+
+    int id = loop->id;
+
+    //step 1: retrieve the alignment information
+    bool aligned = alignmentAnalysis(*loop);
+
+    //the store stream is aligned at runtime if the loop allows it
+    AlignmentPeel alignmentPeel;
+    bool peeled = !threaded && findAlignmentPeel(*loop, alignmentPeel);
+    if (loop->peelDistance && !peeled) return;
+
+    /* Add debug rules at the start end finish of the loop */
+    if (!threaded) generateLoopDebugRules(loop);
+
+#ifdef JANUS_X86
+    //step 1: insert broadcast rules
+    generateBroadcastRules(loop, threaded);
+
+    //peel scalar iterations until the store stream is aligned
+    if (peeled) generateAlignmentPeelRules(loop, alignmentPeel);
+
+    //multiplications fused into the addition using them, the single rounding is not bit-exact
+    map<Instruction *, Instruction *> fusedPairs;
+    set<Instruction *> fusedMuls;
+    if (gc->reassociateFP) {
+        for (auto bid: loop->body) {
+            BasicBlock &bb = entry[bid];
+            for (int i=0; i<bb.size; i++) {
+                Instruction *mul = getFusedMultiply(*loop, bb.instrs[i]);
+                if (mul && !fusedMuls.count(mul)) {
+                    fusedPairs[bb.instrs + i] = mul;
+                    fusedMuls.insert(mul);
+                }
+            }
+        }
+    }
+
+    //step 2: examine each loop instructions
+    for (auto bid: loop->body) {
+        BasicBlock &bb = entry[bid];
+        for (int i=0; i<bb.size; i++) {
+            Instruction &instr = bb.instrs[i];
+            if (instr.isVectorInstruction()) {
+                bool postIteratorUpdate = checkPostIteratorUpdate(instr);
+                bool write = false;
+                int64_t stride = 0;
+                MemoryLocation *location = getAccessLocation(*loop, instr, write);
+                if (location) getAccessStride(*loop, location, stride);
+
+                //the multiplication is rewritten together with the addition
+                if (fusedMuls.count(&instr)) continue;
+                if (fusedPairs.count(&instr)) {
+                    Instruction *mul = fusedPairs[&instr];
+                    VECT_FMA_rule *rule = new VECT_FMA_rule(&bb, instr.pc, instr.id, (uint16_t)(instr.pc - mul->pc),
+                        (uint16_t)loop->vectorWordSize, checkPostIteratorUpdate(*mul), postIteratorUpdate,
+                        (uint16_t)loop->freeSIMDRegs.getNextLowest(JREG_XMM0), loop->staticIterCount);
+                    insertRule(id, *rule->encode(), &bb);
+                    continue;
+                }
+
+                if (stride && stride != loop->vectorWordSize) {
+                    //non-continuous access, load or store the lanes separately
+                    RegSet freeRegs = loop->freeSIMDRegs;
+                    uint16_t freeVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                    uint16_t indexVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                    uint16_t maskVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                    VECT_STRIDED_rule *rule = new VECT_STRIDED_rule(&bb, instr.pc, instr.id, write ? VECT_SCATTER : VECT_GATHER,
+                        (int32_t)stride, postIteratorUpdate, freeVectReg, indexVectReg, maskVectReg);
+                    rule->updateVectorWordSize(loop->vectorWordSize);
+                    insertRule(id, *rule->encode(), &bb);
+                    continue;
+                }
+                //extend the existing vector instruction
+                VECT_CONVERT_rule *rule = new VECT_CONVERT_rule(&bb, instr.pc, instr.id, 0, postIteratorUpdate, (uint16_t)loop->vectorWordSize, 
+                (uint16_t)loop->freeSIMDRegs.getNextLowest(JREG_XMM0),
+                getAccessAlignment(*loop, peeled ? &alignmentPeel : NULL, instr), 0, loop->staticIterCount);
+                insertRule(id, *rule->encode(), &bb);
+            }
+        }
+    }
+
+    //initialise, rotate and combine the reduction accumulators
+    generateReductionRules(loop);
+
+    //update all strides
+    generateStrideUpdateRules(loop);
+#endif
+}
+
+void
+generateOuterVectorRulesForLoop(JanusContext *gc, Loop *loop)
+{
+    BasicBlock *entry = loop->parent->entry;
+    int id = loop->id;
+
+    /* Add debug rules at the start end finish of the loop */
+    generateLoopDebugRules(loop);
+
+#ifdef JANUS_X86
+    generateBroadcastRules(loop, false);
+    generateBlockSplitRules(loop);
+
+    //the inner loop is part of the body, its instructions are extended with the outer strides
+    for (auto bid: loop->body) {
+        BasicBlock &bb = entry[bid];
+        for (int i=0; i<bb.size; i++) {
+            Instruction &instr = bb.instrs[i];
+            if (!instr.isVectorInstruction()) continue;
+            bool postIteratorUpdate = checkOuterPostIteratorUpdate(*loop, instr);
+            bool write = false;
+            int64_t stride = 0;
+            MemoryLocation *location = getAccessLocation(*loop, instr, write);
+            if (location) getAccessStride(*loop, location, stride);
+
+            if (location && stride != loop->vectorWordSize) {
+                //the lanes are in different rows, or all read the same element
+                RegSet freeRegs = loop->freeSIMDRegs;
+                uint16_t freeVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                uint16_t indexVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                uint16_t maskVectReg = freeRegs.popNextLowest(JREG_XMM0);
+                VECT_STRIDED_rule *rule = new VECT_STRIDED_rule(&bb, instr.pc, instr.id, write ? VECT_SCATTER : VECT_GATHER,
+                    (int32_t)stride, postIteratorUpdate, freeVectReg, indexVectReg, maskVectReg);
+                rule->updateVectorWordSize(loop->vectorWordSize);
+                insertRule(id, *rule->encode(), &bb);
+                continue;
+            }
+            VECT_CONVERT_rule *rule = new VECT_CONVERT_rule(&bb, instr.pc, instr.id, 0, postIteratorUpdate, (uint16_t)loop->vectorWordSize,
+                (uint16_t)loop->freeSIMDRegs.getNextLowest(JREG_XMM0),
+                getAccessAlignment(*loop, NULL, instr), 0, loop->staticIterCount);
+            insertRule(id, *rule->encode(), &bb);
+        }
+    }
+
+    //only the outer iterators step over the lanes, the inner loop runs as before
+    generateStrideUpdateRules(loop);
 #endif
 }
 
@@ -195,7 +365,58 @@ generateVectorRules(JanusContext *gc)
     /* Step 2: generate rules for each loop */
     for (auto l: selected_loops) {
         cout <<l->id<<" ";
-        generateVectorRulesForLoop(gc, l);
+        generateVectorRulesForLoop(gc, l, false);
+    }
+
+    /* Step 3: vectorise the outer loop of the nests whose inner loop is not vectorised */
+    set<Loop*> outer_loops;
+    selectOuterVectorisableLoop(gc, outer_loops, selected_loops, supported_opcodes, singles, doubles);
+    for (auto l: outer_loops) {
+        cout <<l->id<<" ";
+        generateOuterVectorRulesForLoop(gc, l);
+    }
+    cout<<endl;
+}
+
+/* Only the DOALL loops scheduled by blocks are vectorised. The runtime can't combine the
+ * lanes of the threads, nor align the start of each block */
+static bool
+checkParallelVectorLoop(Loop &loop)
+{
+    if (!loop.pass || loop.header.schedule != PARA_DOALL_BLOCK) return false;
+    alignmentAnalysis(loop);
+    if (loop.reductions.size() || loop.peelDistance) return false;
+    if (loop.vectorWordSize != 4 && loop.vectorWordSize != 8) return false;
+    //every thread runs whole vectors except the last one
+    if (!loop.staticIterCount || loop.staticIterCount % (32 / loop.vectorWordSize)) return false;
+    //the threads start from the iterator values of the original stride
+    for (auto &iterEntry: loop.iterators) {
+        if (iterEntry.second.strideKind != Iterator::INTEGER) return false;
+    }
+    return true;
+}
+
+void
+generateParallelVectorRules(JanusContext *gc)
+{
+    set<InstOp> supported_opcodes;
+    set<InstOp> singles;
+    set<InstOp> doubles;
+    set<Loop*> selected_loops;
+
+    /* Step 1: select and parallelise loops, this also prepares the loop headers */
+    generateParallelRules(gc);
+
+    /* Step 2: vectorise the parallelised loops that pass the vector selection.
+     * The vector rules share the loop channel with the parallel rules and the
+     * word size in the loop header tells the runtime to round the thread blocks */
+    setSupportedVectorOpcodes(supported_opcodes, singles, doubles);
+    selectVectorisableLoop(gc, selected_loops, supported_opcodes, singles, doubles);
+    for (auto l: selected_loops) {
+        if (!checkParallelVectorLoop(*l)) continue;
+        cout <<l->id<<" ";
+        l->header.vectorWordSize = l->vectorWordSize;
+        generateVectorRulesForLoop(gc, l, true);
     }
     cout<<endl;
 }
@@ -244,7 +465,8 @@ bool alignmentAnalysis(Loop &loop)
         }
     }
 
-    if (aligned && strideImm) loop.vectorWordSize = strideImm;
+    //the word size comes from the opcodes if the accesses are strided
+    if (aligned && strideImm && !loop.vectorWordSize) loop.vectorWordSize = strideImm;
     LOOPLOGLINE("\tfixed stride "<<strideImm<<" peel distance "<<loop.peelDistance);
 }
 
@@ -253,6 +475,73 @@ static bool needBroadcast(Loop &loop, Instruction &instr)
     return false;
 }
 
+static bool isFusedAddOpcode(InstOp opcode, bool &single)
+{
+#ifdef JANUS_X86
+    single = opcode == X86_INS_ADDSS || opcode == X86_INS_VADDSS;
+    return single || opcode == X86_INS_ADDSD || opcode == X86_INS_VADDSD;
+#else
+    return false;
+#endif
+}
+
+static bool isFusedMulOpcode(InstOp opcode, bool single)
+{
+#ifdef JANUS_X86
+    if (single) return opcode == X86_INS_MULSS || opcode == X86_INS_VMULSS;
+    return opcode == X86_INS_MULSD || opcode == X86_INS_VMULSD;
+#else
+    return false;
+#endif
+}
+
+/* Find the multiplication that can be fused with the addition.
+ * The product must only be used by the addition, so that it doesn't have to be kept, and
+ * the inputs of the multiplication must not change before the addition, where the fused
+ * instruction is placed. Returns NULL if there is no such multiplication */
+static Instruction *getFusedMultiply(Loop &loop, Instruction &add)
+{
+    bool single;
+    if (!add.minstr->isXMMInstruction() || !isFusedAddOpcode(add.minstr->opcode, single))
+        return NULL;
+
+    for (auto vi: add.inputs) {
+        if (vi->type != JVAR_REGISTER || !jreg_is_simd(vi->value)) continue;
+        Instruction *mul = vi->lastModified;
+        if (!mul || mul->block != add.block || mul->id >= add.id) continue;
+        if (!isFusedMulOpcode(mul->minstr->opcode, single)) continue;
+
+        //the product is not used anywhere else, including the next iteration
+        if (vi->dependants.size() != 1) continue;
+        bool usedByPhi = false;
+        for (auto succ: vi->succ)
+            if (succ->isPHI) usedByPhi = true;
+        if (usedByPhi) continue;
+
+        //a fused multiply-add has a single memory operand, which must be contiguous
+        if (mul->isMemoryAccess() && add.isMemoryAccess()) continue;
+        Instruction *memInstr = mul->isMemoryAccess() ? mul : &add;
+        bool write = false;
+        int64_t stride = 0;
+        MemoryLocation *location = getAccessLocation(loop, *memInstr, write);
+        if (location) getAccessStride(loop, location, stride);
+        if (stride && stride != loop.vectorWordSize) continue;
+
+        //the instructions in between don't modify the inputs of the multiplication
+        bool modified = false;
+        for (Instruction *between = mul + 1; between < &add; between++) {
+            if ((between->regWrites & mul->regReads).bits) modified = true;
+            if (mul->isMemoryAccess()) {
+                for (auto vo: between->outputs)
+                    if (vo->type == JVAR_MEMORY || vo->type == JVAR_STACK) modified = true;
+            }
+        }
+        if (modified) continue;
+        return mul;
+    }
+    return NULL;
+}
+
 bool checkPostIteratorUpdate(Instruction &instr)
 {
     for (auto vi: instr.inputs) {
@@ -12,6 +12,9 @@
 /** \brief Generate VECTOR related rules */
 void
 generateVectorRules(JanusContext *gc);
+/** \brief Generate rules for the parallelised loops with a vectorised body */
+void
+generateParallelVectorRules(JanusContext *gc);
 /** \brief Check if all loops memory accesses are aligned */
 bool alignmentAnalysis(janus::Loop &loop);
 /** \brief Whether this instruction is after the induction variable update */
@@ -20,6 +20,7 @@ static void usage()
     cout<<"Usage: schedump {file}.jrs             : dump all rules"<<endl;
     cout<<"       schedump -h {file}.jrs          : dump rule header only"<<endl;
     cout<<"       schedump -c channel {file}.jrs  : dump rules at specified channel"<<endl;
+    cout<<"       schedump -t {file}.jrs          : dump loop code templates"<<endl;
 }
 
 static bool checkFileFormat(char *name)
@@ -49,6 +50,45 @@ static void loadRewriteRule(char *name)
     ruleFile.close();
 }
 
+static const char *templateKindName[TEMPLATE_KIND_COUNT] = {
+    "loop init", "loop finish", "thread loop init", "thread loop finish"
+};
+
+static const char *relocSymbolName[] = {
+    "shared", "loop", "thread", "thread pool", "reenter thread pool", "redirect native"
+};
+
+static void dumpTemplates(RSchedHeader *header)
+{
+    if (!header->multiMode || !header->templateOffset ||
+        header->templateOffset + sizeof(RSTemplateHeader) > (size_t)fileSize) {
+        cout <<"No loop code templates"<<endl;
+        return;
+    }
+
+    char *section = buffer + header->templateOffset;
+    RSTemplateHeader *theader = (RSTemplateHeader *)section;
+    if (theader->magic != RS_TEMPLATE_MAGIC) {
+        cout <<"Template section corrupted"<<endl;
+        return;
+    }
+    cout <<"Templates recorded for "<<theader->numberOfThreads<<" threads, version "<<theader->version<<endl;
+
+    RSCodeTemplate *templates = (RSCodeTemplate *)(section + sizeof(RSTemplateHeader));
+    for (uint32_t i=0; i<theader->numTemplates; i++) {
+        RSCodeTemplate &code = templates[i];
+        cout <<"Loop "<<code.loopID<<" "<<templateKindName[code.kind]<<": "<<code.codeSize<<" bytes, "
+             <<code.numRelocs<<" relocations"<<endl;
+        RSCodeReloc *relocs = (RSCodeReloc *)(section + code.relocOffset);
+        for (uint32_t j=0; j<code.numRelocs; j++) {
+            cout <<"\t+"<<hex<<relocs[j].offset<<dec<<" "<<relocSymbolName[relocs[j].symbol];
+            if (relocs[j].symbol == RELOC_LOOP || relocs[j].symbol == RELOC_THREAD)
+                cout <<"["<<relocs[j].index<<"]";
+            cout <<" + "<<relocs[j].addend<<endl;
+        }
+    }
+}
+
 static void
 usageAndExit()
 {
@@ -70,15 +110,15 @@ int main(int argc, char **argv) {
         }
     } else if (argc == 3) {
         /* Dump header mode */
-        //check -h
+        //check -h or -t
         if (argv[1][0] != '-') usageAndExit();
-        if (argv[1][1] != 'h') usageAndExit();
+        if (argv[1][1] != 'h' && argv[1][1] != 't') usageAndExit();
         if (!checkFileFormat(argv[2])) {
             cerr << "Please supply a rewrite schedule file ending with *.jrs"<<endl;
             return 0;
         } else {
             loadRewriteRule(argv[2]);
-            mode = 2;
+            mode = (argv[1][1] == 'h') ? 2 : 4;
         }
     } else if (argc == 4) {
         /* Dump channel mode */
@@ -113,10 +153,17 @@ int main(int argc, char **argv) {
     if (header->multiMode) cout <<"Multiple loop mode"<<endl;
     if (header->ruleDataOffset)
         cout <<"Data section offset: "<<header->ruleDataOffset<<endl;
+    if (header->multiMode && header->templateOffset)
+        cout <<"Template section offset: "<<header->templateOffset<<endl;
 
     /* For mode 2 it is enough */
     if (mode == 2) return 1;
 
+    if (mode == 4) {
+        dumpTemplates(header);
+        return 1;
+    }
+
     if (header->multiMode) {
         /* Parse loop headers */
         RSLoopHeader *loops = (RSLoopHeader *)(buffer + sizeof(RSchedHeader));
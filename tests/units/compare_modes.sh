@@ -0,0 +1,29 @@
+#!/bin/bash
+# Check that the rewrite schedules generated by one analysis run with several
+# modes are byte-identical to the schedules of separate runs of each mode
+# Usage: compare_modes.sh <executable> <option> [<option> ...]
+
+my_dir="$(cd "$(dirname "$0")" && pwd)"
+source $my_dir/../../janus/janus_header
+
+binfile=$1
+shift
+name=$(basename $binfile)
+workdir=$(mktemp -d)
+trap "rm -rf $workdir" EXIT
+
+#the loop selection is read from next to the executable
+cp $binfile* $workdir/
+cd $workdir
+
+$JANUSBIN/analyze "$@" $name > /dev/null || exit 1
+
+for option in "$@"; do
+    $JANUSBIN/analyze $option $name > /dev/null || exit 1
+    if ! cmp $name.jrs $name.${option#-}.jrs; then
+        echo "Schedule of $option differs when generated with $*"
+        exit 1
+    fi
+done
+
+echo "Schedules of $* match the separate runs"
@@ -27,3 +27,18 @@ $CC doall_const_bound.c -o $OUT/doall_stack_bound
 echo "test 4: static"
 echo "$CC -O2 static.c -o $OUT/static"
 $CC -O2 static.c -o $OUT/static
+
+#test 5
+echo "test 5: overlapping arrays"
+echo "$CC -O2 doall_alias_arrays.c -o $OUT/doall_alias_arrays"
+$CC -O2 doall_alias_arrays.c -o $OUT/doall_alias_arrays
+
+#test 6
+echo "test 6: speculative indirect updates"
+echo "$CC -O2 spec_indirect.c -o $OUT/spec_indirect"
+$CC -O2 spec_indirect.c -o $OUT/spec_indirect
+
+#test 7
+echo "test 7: per-thread ranges of a runtime bound"
+echo "$CC -O2 doall_n_ranges.c -o $OUT/doall_n_ranges"
+$CC -O2 doall_n_ranges.c -o $OUT/doall_n_ranges
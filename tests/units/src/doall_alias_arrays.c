@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 0x800000
+
+/* The arrays only overlap for some calls, and the loop bound is
+ * only known when the loop is entered */
+static void __attribute__ ((noinline))
+shift(long *dst, long *src, long n)
+{
+    long i;
+
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = src[i] + 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long i;
+    long n = N + argc - 1;
+    long *a, *b;
+
+    a = (long *)malloc(sizeof(long)*(n+1));
+    b = (long *)malloc(sizeof(long)*(n+1));
+
+    for(i = 0; i <= n; i++)
+    {
+        a[i] = 0;
+    }
+
+    /* disjoint arrays, the runtime check passes */
+    shift(b, a, n);
+
+    /* a[i+1] depends on a[i], the runtime check fails */
+    shift(a + 1, a, n);
+
+    for(i = 0; i <= n; i++)
+    {
+        if (a[i] != i || (i < n && b[i] != 1)) {
+            printf("Wrong result at %ld\n", i);
+            return 1;
+        }
+    }
+
+    printf("Total %ld\n", a[n]);
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 0x100000
+#define GUARD 64
+
+int *a;
+
+/* The bound is a register, the iteration count is only known at loop entry */
+__attribute__((noinline)) void increment(int *v, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++)
+    {
+        v[i] += 1;
+    }
+}
+
+int main(void)
+{
+    /* No iteration, fewer iterations than the runtime splits (16),
+     * and counts that are not a multiple of the number of threads */
+    int counts[] = {0, 1, 15, 17, 1001, N - 3, N};
+    int c, i;
+
+    a = (int *)malloc(sizeof(int)*(N + GUARD));
+
+    for(c = 0; c < (int)(sizeof(counts)/sizeof(counts[0])); c++)
+    {
+        int n = counts[c];
+
+        memset(a, 0, sizeof(int)*(N + GUARD));
+        increment(a, n);
+
+        /* Each element of the range is written exactly once, nothing after it */
+        for(i = 0; i < N + GUARD; i++)
+        {
+            if (a[i] != (i < n)) {
+                printf("Wrong result at %d for n = %d\n", i, n);
+                return 1;
+            }
+        }
+    }
+
+    printf("Ranges correct\n");
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 0x100000
+#define DUP 0x400
+
+/* Two consecutive iterations out of every DUP update a[0]. Any split of the
+ * iterations at a multiple of 64 separates them, so concurrent transactions
+ * conflict on a[0] and are executed again */
+#define CONFLICT(i) ((i) % DUP == 63 || (i) % DUP == 64)
+
+int a[N];
+int idx[N];
+
+int main(void)
+{
+    int i;
+    int dup = 0;
+
+    /* A permutation, except for the conflicting iterations */
+    for(i = 0; i < N; i++)
+    {
+        idx[i] = CONFLICT(i) ? 0 : (int)((i * 7919L) % N);
+    }
+
+    /* The indirect updates may depend on each other, so the loop is speculative.
+     * Neighbouring elements share a word, so transactions write disjoint bytes
+     * of the same words */
+    for(i = 0; i < N; i++)
+    {
+        a[idx[i]] += i;
+    }
+
+    for(i = 0; i < N; i++)
+    {
+        if (CONFLICT(i)) dup += i;
+    }
+
+    for(i = 1; i < N; i++)
+    {
+        if (!CONFLICT(i) && a[idx[i]] != i) {
+            printf("Wrong result at %d\n", idx[i]);
+            return 1;
+        }
+    }
+    if (a[0] != dup) {
+        printf("Wrong result at 0\n");
+        return 1;
+    }
+
+    printf("Total %d\n", a[0]);
+
+    return 0;
+}